@@ -1,8 +1,10 @@
-project "legba"
-    kind "ConsoleApp"
+-- Everything but the console app, for hosts embedding scripts, see src/Embed/Script.h
+project "liblegba"
+    kind "StaticLib"
     language "C++"
     cppdialect "C++20"
     staticruntime "off"
+    targetname "legba"
 
     targetdir ("%{wks.location}/bin/"..outputdir.."/%{prj.name}")
     objdir ("%{wks.location}/bin-int/"..outputdir.."/%{prj.name}")
@@ -12,10 +14,42 @@ project "legba"
         "src/**.cpp"
     }
 
+    removefiles {
+        "src/main.cpp"
+    }
+
+    includedirs {
+        "src"
+    }
+
+    filter "configurations:Debug"
+        symbols "On"
+
+    filter "configurations:Release"
+        symbols "Off"
+        optimize "Full"
+
+project "legba"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++20"
+    staticruntime "off"
+
+    targetdir ("%{wks.location}/bin/"..outputdir.."/%{prj.name}")
+    objdir ("%{wks.location}/bin-int/"..outputdir.."/%{prj.name}")
+
+    files {
+        "src/main.cpp"
+    }
+
     includedirs {
         "src"
     }
 
+    links {
+        "liblegba"
+    }
+
     postbuildcommands {
         "{COPYDIR} %[rsc] %[%{cfg.targetdir}/rsc]"
     }
@@ -30,3 +64,6 @@ project "legba"
     filter "configurations:Release"
         symbols "Off"
         optimize "Full"
+
+    filter "system:linux"
+        links { "pthread" }
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Compares scripts translated to C with 'legba --emit-c' against the interpreter.
+# Usage: aot.sh path/to/legba [script.leg ...]  (defaults to every script in this directory)
+# Scripts the C translation doesn't support, like those spawning tasks or running
+# coroutines, are skipped with the reason.
+set -e
+
+LEGBA=${1:?usage: aot.sh path/to/legba [script.leg ...]}
+shift
+CC=${CC:-cc}
+DIR=$(dirname "$0")
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+[ $# -gt 0 ] || set -- "$DIR"/*.leg
+
+now() { date +%s%N; }
+
+for script in "$@"; do
+    name=$(basename "$script" .leg)
+    if ! "$LEGBA" --emit-c "$OUT/$name.c" "$script" > "$OUT/$name.log"; then
+        reason=$(sed -n 's/^-- Compile error: \(.*\) \.\.\. Exiting$/\1/p' "$OUT/$name.log")
+        echo "-- $name: skipped, ${reason:-the translation failed}"
+        continue
+    fi
+    "$CC" -std=c99 -O2 -o "$OUT/$name" "$OUT/$name.c" -lm
+
+    start=$(now)
+    # what the script printed and its result, without the interpreter's reports
+    interpreted=$("$LEGBA" "$script" | awk '/^-- Running script/ { run = 1; next } run && (!/^-- / || /^-- (Script returned|Runtime error)/)' || true)
+    middle=$(now)
+    compiled=$("$OUT/$name" || true)
+    end=$(now)
+
+    if [ "$interpreted" != "$compiled" ]; then
+        echo "-- $name: results differ, interpreter '$interpreted', C '$compiled'"
+        continue
+    fi
+    awk -v name="$name" -v vm=$((middle - start)) -v aot=$((end - middle)) 'BEGIN {
+        printf "-- %-10s interpreter %8.1fms  C %8.1fms  speedup %.2fx\n", name, vm / 1e6, aot / 1e6, vm / aot
+    }'
+done
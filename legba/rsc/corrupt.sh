@@ -0,0 +1,177 @@
+#!/bin/sh
+# Loads corrupted .legc files, each has to be rejected with an error instead of
+# crashing the loader or the VM. Starts with crafted ones, then flips a random
+# byte per file and runs the files the check lets through.
+# Usage: corrupt.sh path/to/legba [rounds]  (200 random files by default)
+set -e
+
+LEGBA=${1:?usage: corrupt.sh path/to/legba [rounds]}
+ROUNDS=${2:-200}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+cat > "$OUT/script.leg" <<'EOF'
+class Box {
+    public var v;
+
+    fn Box(v) {
+        this.v = v;
+    }
+
+    fn scaled(a, b) {
+        return this.v * a + b;
+    }
+
+    fn twice() {
+        return this.scaled(2, 0);
+    }
+}
+
+fn add(a, b) {
+    return a + b;
+}
+var s = "a string";
+var box = Box(3);
+return add(1.5, len(s)) + box.twice();
+EOF
+# calls stay calls, so there are CALL and INVOKEVT instructions to damage
+"$LEGBA" --compile --no-inline "$OUT/script.leg" -o "$OUT/good.legc" > /dev/null
+"$LEGBA" --check "$OUT/good.legc" > /dev/null
+
+failed=0
+
+u32() { od -An -tu4 -j "$2" -N4 "$1" | tr -d ' '; }
+u8() { od -An -tu1 -j "$2" -N1 "$1" | tr -d ' '; }
+# writes the bytes given as octal escapes at an offset
+poke() { printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null; }
+octal() { for byte in "$@"; do printf '\\%o' "$byte"; done; }
+
+# Runs legba on the file with the options, which has to fail with status 1 and the
+# message. Without a message it may run, fail or time out, but not crash.
+run() {
+    name=$1
+    message=$2
+    shift 2
+    set +e
+    output=$(timeout 10 "$LEGBA" "$@" "$OUT/$name.legc" 2>&1)
+    status=$?
+    set -e
+    if [ -z "$message" ]; then
+        [ $status -le 1 ] || [ $status -eq 124 ]
+        return
+    fi
+    if [ $status -ne 1 ] || ! printf '%s' "$output" | grep -q "$message"; then
+        echo "-- $name: expected '$message', got status $status"
+        printf '%s\n' "$output" | grep "rror" || true
+        failed=1
+    else
+        echo "-- $name: rejected"
+    fi
+}
+expect() { run "$1" "$2" --check; }
+
+variant() { cp "$OUT/good.legc" "$OUT/$1.legc"; }
+
+# Header: magic, version, opcodes, byte order, size, main at 16, globals at 20, then
+# the function, class and string tables as offset and count at 24, 32 and 40.
+# Function entries take 56 bytes: name, params, flags, frame, then code, constants
+# and relocations as offset and count.
+functions=$(u32 "$OUT/good.legc" 24)
+count=$(u32 "$OUT/good.legc" 28)
+strings=$(u32 "$OUT/good.legc" 44)
+entry() { echo $((functions + 56 * $1)); }
+main=$(entry "$(u32 "$OUT/good.legc" 16)")
+# index of the first function with that many parameters and flags, 1 for methods
+find() {
+    for index in $(seq 0 $((count - 1))); do
+        at=$(entry "$index")
+        if [ "$(u32 "$OUT/good.legc" $((at + 4)))" = "$1" ] && [ "$(u32 "$OUT/good.legc" $((at + 8)))" = "$2" ]; then
+            echo "$index"
+            return
+        fi
+    done
+}
+add=$(find 2 0)
+scaled=$(find 2 1)
+twice=$(find 0 1)
+
+# opcodes, see VM/Instruction.h
+MOVE=4
+CALL=23
+EXTRA=44
+
+variant globals
+poke "$OUT/globals.legc" 20 '\377\377\377\177'
+expect globals "Global count out of range"
+
+# the string constant of the top level
+variant relocation
+relocations=$(u32 "$OUT/good.legc" $((main + 32)))
+poke "$OUT/relocation.legc" $((relocations + 4)) "$(octal $((strings & 255)) $((strings >> 8 & 255)))"
+expect relocation "String index out of range"
+
+# a constant of the top level turned into a pointer
+variant constant
+constants=$(u32 "$OUT/good.legc" $((main + 24)))
+poke "$OUT/constant.legc" $((constants + 6)) '\375\377'
+expect constant "Invalid constant"
+
+# the ADD of add reading register 255
+variant register
+code=$(u32 "$OUT/good.legc" $(($(entry "$add") + 16)))
+poke "$OUT/register.legc" $((code + 2)) '\377'
+expect register "register out of frame"
+
+# the call of add calling the method scaled instead, without an instance
+variant method
+code=$(u32 "$OUT/good.legc" $((main + 16)))
+length=$(u32 "$OUT/good.legc" $((main + 20)))
+for word in $(seq 1 $((length - 1))); do
+    if [ "$(u8 "$OUT/good.legc" $((code + 4 * word - 4)))" = $CALL ] && [ "$(u32 "$OUT/good.legc" $((code + 4 * word)))" = $((EXTRA | add << 8)) ]; then
+        poke "$OUT/method.legc" $((code + 4 * word + 1)) "$(octal $((scaled & 255)) $((scaled >> 8 & 255)))"
+    fi
+done
+expect method "function out of range"
+
+# twice calling scaled on a register holding nil instead of this
+variant receiver
+code=$(u32 "$OUT/good.legc" $(($(entry "$twice") + 16)))
+if [ "$(u8 "$OUT/good.legc" "$code")" = $MOVE ]; then
+    poke "$OUT/receiver.legc" $((code + 2)) "$(octal $(($(u8 "$OUT/good.legc" $((code + 1))) + 1)))"
+fi
+run receiver "Invalid receiver" --no-jit
+
+variant truncated
+dd if="$OUT/good.legc" of="$OUT/truncated.legc" bs=1 count=40 2> /dev/null
+expect truncated "Not a Legba bytecode file\|truncated"
+
+size=$(wc -c < "$OUT/good.legc")
+crashes=0
+ran=0
+for round in $(seq "$ROUNDS"); do
+    variant random
+    # a single byte, more of them and next to nothing gets past the check
+    at=$(od -An -tu4 -N4 /dev/urandom | tr -d ' ')
+    byte=$(od -An -tu1 -N1 /dev/urandom | tr -d ' ')
+    poke "$OUT/random.legc" $((at % size)) "$(octal "$byte")"
+    set +e
+    "$LEGBA" --check "$OUT/random.legc" > /dev/null 2>&1
+    status=$?
+    set -e
+    if [ $status -eq 1 ]; then
+        continue
+    fi
+    if [ $status -eq 0 ]; then
+        ran=$((ran + 1))
+        if run random "" --no-jit && run random ""; then
+            continue
+        fi
+        status="$status when run"
+    fi
+    cp "$OUT/random.legc" "crash-$round.legc"
+    echo "-- random: status $status, kept as crash-$round.legc"
+    crashes=$((crashes + 1))
+    failed=1
+done
+echo "-- random: $ROUNDS files, $ran passed the check and ran, $crashes crashes"
+exit $failed
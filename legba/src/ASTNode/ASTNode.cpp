@@ -2,6 +2,7 @@
 
 #include <sstream>
 #include "Error.h"
+#include "ASTNode/Arena.h"
 
 SymbolFlag tokenToSymbolFlag(TokenType token) {
     switch (token) {
@@ -100,6 +101,30 @@ std::string BoolNode::toString() {
     return os.str();
 }
 
+std::string ArrayNode::toString() {
+	std::stringstream os;
+    os << "ArrayNode(";
+    if (getElementType() != ValueTypeEnum::VT_NONE) {
+        os << valueTypeEnumToString(getElementType()) << ' ';
+    }
+    os << "{ ";
+    for (auto element : getElements()) {
+        os << element << ' ';
+    }
+    os << "})";
+    return os.str();
+}
+
+std::string MapNode::toString() {
+	std::stringstream os;
+    os << "MapNode({ ";
+    for (size_t i = 0; i + 1 < getEntries().size(); i += 2) {
+        os << getEntries()[i] << ": " << getEntries()[i + 1] << ' ';
+    }
+    os << "})";
+    return os.str();
+}
+
 std::string VariableNode::toString() {
 	std::stringstream os;
     os << "VariableNode(" << getVar() << ')';
@@ -138,13 +163,39 @@ std::string BinaryNode::toString() {
     return os.str();
 }
 
-void CallNode::setFunction(FunctionNode* func) {
+template<typename T>
+void CallNode<T>::setFunction(T* func) {
     this->func = func;
 }
 
-std::string CallNode::toString() {
+template<typename T>
+void CallNode<T>::setArgs(std::vector<Node*> args) {
+    this->args = std::move(args);
+}
+
+template<typename T>
+void CallNode<T>::setReceiver(Node* receiver) {
+    this->receiver = receiver;
+}
+
+template<typename T>
+void CallNode<T>::setInstantiatedClass(ClassNode* klass) {
+    this->instantiatedClass = klass;
+}
+
+template<typename T>
+void CallNode<T>::setBuiltin(Builtin const* builtin) {
+    this->builtin = builtin;
+}
+
+template<typename T>
+std::string CallNode<T>::toString() {
 	std::stringstream os;
-    os << "CallNode('" << getCallee() << "' { ";
+    os << "CallNode(";
+    if (getReceiver() != nullptr) {
+        os << getReceiver() << '.';
+    }
+    os << '\'' << getCallee() << "' { ";
     for (auto const& arg : getArgs()) {
         os << arg << ' ';
     }
@@ -152,6 +203,13 @@ std::string CallNode::toString() {
     return os.str();
 }
 
+template class CallNode<FunctionNode>;
+template class CallNode<MethodNode>;
+
+std::string SpawnNode::toString() {
+    return std::string(coroutine ? "AsyncNode(" : "SpawnNode(") + getCall()->toString() + ')';
+}
+
 std::string FunctionNode::toString() {
 	std::stringstream os;
     os << "FunctionNode(" << getName() << ' ';
@@ -230,6 +288,7 @@ void ClassNode::addAttribute(std::string name, VariableDeclarationNode* attribut
     } else if (attributes.contains(name)) {
         throw ParserError("There already exists a attribute named '" + name + "' in this class.");
     }
+    attribute->setSlot(attribute->isStatic() ? staticCount++ : fieldCount++, false);
     attributes.emplace(name, attribute);
 }
 
@@ -251,8 +310,16 @@ VariableDeclarationNode* ClassNode::getAttribute(const std::string& name) {
     return nullptr;
 }
 
-MethodNode* ClassNode::getMethod(CallNode* callee) {
-    auto it = methods.find(callee->getCallee());
+void ClassNode::removeMethod(const std::string& name) {
+    methods.erase(name);
+}
+
+MethodNode* ClassNode::getMethod(MethodCallNode* callee) {
+    return getMethod(callee->getCallee());
+}
+
+MethodNode* ClassNode::getMethod(const std::string& name) {
+    auto it = methods.find(name);
     if (it != methods.end()) {
         return it->second;
     }
@@ -260,15 +327,25 @@ MethodNode* ClassNode::getMethod(CallNode* callee) {
     return nullptr;
 }
 
+MethodNode* ClassNode::getConstructor() {
+    return getMethod(name);
+}
+
 void ScopeNode::addStatement(Node* node) {
     statements.emplace_back(node);
 }
 
+void ScopeNode::setStatements(std::vector<Node*> statements) {
+    this->statements = std::move(statements);
+}
+
 void ScopeNode::addVariable(std::string name, VariableDeclarationNode* var) {
     if (functions.contains(name)) {
         throw ParserError("There already exists a function named '" + name + "' in this scope.");
     }
-    variables.emplace(name, var); // allows shadowing; varibales must be resolved instantly!
+    // a redeclaration shadows the earlier one from here on, uses before it were
+    // resolved already
+    variables.insert_or_assign(std::move(name), var);
 }
 
 void ScopeNode::addFunction(std::string name, FunctionNode* func) {
@@ -280,6 +357,30 @@ void ScopeNode::addFunction(std::string name, FunctionNode* func) {
     functions.emplace(name, func);
 }
 
+void ScopeNode::removeFunction(const std::string& name) {
+    functions.erase(name);
+}
+
+void ScopeNode::addClass(std::string name, ClassNode* klass) {
+    if (classes.contains(name)) {
+        throw ParserError("There already exists a class named '" + name + "' in this scope.");
+    }
+    classes.emplace(name, klass);
+}
+
+ClassNode* ScopeNode::getClass(const std::string& name) {
+    auto it = classes.find(name);
+    if (it != classes.end()) {
+        return it->second;
+    }
+
+    if (enclosing == nullptr) {
+        return nullptr;
+    }
+
+    return enclosing->getClass(name);
+}
+
 VariableDeclarationNode* ScopeNode::getVariable(const std::string& name) {
     auto it = variables.find(name);
     if (it != variables.end()) {
@@ -293,8 +394,8 @@ VariableDeclarationNode* ScopeNode::getVariable(const std::string& name) {
     return enclosing->getVariable(name);
 }
 
-FunctionNode* ScopeNode::getFunction(CallNode* callee) { // functions should be accessible even if declared after the call -> cache unresolved calls
-    auto it = functions.find(callee->getCallee()->);
+FunctionNode* ScopeNode::getFunction(FunctionCallNode* callee) { // functions should be accessible even if declared after the call -> cache unresolved calls
+    auto it = functions.find(callee->getCallee());
     if (it != functions.end()) {
         return it->second;
     }
@@ -306,10 +407,121 @@ FunctionNode* ScopeNode::getFunction(CallNode* callee) { // functions should be
     return enclosing->getFunction(callee);
 }
 
+void FunctionNode::setBody(Node* body) {
+    this->body = body;
+}
+
+void MethodNode::setBody(Node* body) {
+    this->body = body;
+}
+
+void FunctionNode::setFrameSize(int frameSize) {
+    this->frameSize = frameSize;
+}
+
+void MethodNode::setFrameSize(int frameSize) {
+    this->frameSize = frameSize;
+}
+
+void VariableDeclarationNode::setSlot(int slot, bool global) {
+    this->slot = slot;
+    this->global = global;
+}
+
+void UnaryNode::setNode(Node* node) {
+    this->node = node;
+}
+
+void BinaryNode::setLeft(Node* left) {
+    this->left = left;
+}
+
+void BinaryNode::setRight(Node* right) {
+    this->right = right;
+}
+
+void ArrayNode::setElements(std::vector<Node*> elements) {
+    this->elements = std::move(elements);
+}
+
+void ArrayNode::setElementType(ValueTypeEnum elementType) {
+    this->elementType = elementType;
+}
+
+void MapNode::setEntries(std::vector<Node*> entries) {
+    this->entries = std::move(entries);
+}
+
+void StringNode::setConstant(Value constant) {
+    this->constant = constant;
+}
+
+void SpawnNode::setCall(FunctionCallNode* call) {
+    this->call = call;
+}
+
+void VariableDeclarationNode::setInitializer(Node* initializer) {
+    this->initializer = initializer;
+}
+
+void IfNode::setCondition(Node* condition) {
+    this->condition = condition;
+}
+
+void IfNode::setThenBranch(Node* thenBranch) {
+    this->thenBranch = thenBranch;
+}
+
+void IfNode::setElseBranch(Node* elseBranch) {
+    this->elseBranch = elseBranch;
+}
+
+void WhileNode::setCondition(Node* condition) {
+    this->condition = condition;
+}
+
+void WhileNode::setBody(Node* body) {
+    this->body = body;
+}
+
+void ForNode::setInitializer(Node* initializer) {
+    this->initializer = initializer;
+}
+
+void ForNode::setCondition(Node* condition) {
+    this->condition = condition;
+}
+
+void ForNode::setIncrement(Node* increment) {
+    this->increment = increment;
+}
+
+void ForNode::setBody(Node* body) {
+    this->body = body;
+}
+
 void Node::setResultType(ValueType resultType) {
     this->resultType = resultType;
 }
 
+void Node::setLine(int line) {
+    this->line = line;
+}
+
+void* Node::operator new(size_t size) {
+    if (auto arena = Arena::current(); arena != nullptr) {
+        return arena->allocate(size);
+    }
+    return ::operator new(size);
+}
+
+void Node::operator delete(void* pointer) {
+    if (auto arena = Arena::current(); arena != nullptr && arena->release(pointer)) {
+        return;
+    }
+    ::operator delete(pointer);
+}
+
 std::ostream& operator <<(std::ostream& os, Node* const& node) {
     os << node->toString() << " -> " << node->getResultType().toString();
     return os;
@@ -0,0 +1,11 @@
+#ifndef LEGBA_ASTNODE_H
+#define LEGBA_ASTNODE_H
+
+#include "ASTNode/Node.h"
+#include "ASTNode/Literal.h"
+#include "ASTNode/Expression.h"
+#include "ASTNode/Symbol.h"
+#include "ASTNode/Control.h"
+#include "ASTNode/Class.h"
+
+#endif
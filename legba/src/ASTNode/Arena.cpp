@@ -0,0 +1,37 @@
+#include "ASTNode/Arena.h"
+
+#include <algorithm>
+
+#include "ASTNode/Node.h"
+
+Arena::~Arena() {
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+        // nodes only derive from Node, which starts every one of them
+        static_cast<Node*>(*it)->~Node();
+    }
+}
+
+void* Arena::allocate(size_t size) {
+    size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    if (static_cast<size_t>(end - top) < size) {
+        size_t blockSize = std::max(size, BLOCK_SIZE);
+        blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(blockSize));
+        top = blocks.back().get();
+        end = top + blockSize;
+    }
+    void* pointer = top;
+    top += size;
+    bytes += size;
+    nodes.push_back(pointer);
+    return pointer;
+}
+
+bool Arena::release(void* pointer) {
+    auto it = std::find(nodes.rbegin(), nodes.rend(), pointer);
+    if (it == nodes.rend()) {
+        return false;
+    }
+    // the memory stays used until the arena goes
+    nodes.erase(std::next(it).base());
+    return true;
+}
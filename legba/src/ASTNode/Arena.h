@@ -0,0 +1,57 @@
+#ifndef LEGBA_ASTNODE_ARENA_H
+#define LEGBA_ASTNODE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for the nodes of one script. While a Scope of an arena is active
+// on a thread, every node created there is allocated from it, see Node::operator
+// new; without one nodes come from the global heap as always. Destroying the arena
+// runs the destructors of its nodes and frees them all at once, so the tree and
+// everything pointing into it, like the classes of a program compiled from it, must
+// be gone by then.
+class Arena {
+public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    Arena() = default;
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+    ~Arena();
+
+    // Makes an arena the one of the calling thread while it lives.
+    class Scope {
+    public:
+        explicit Scope(Arena& arena) : previous(active) { active = &arena; }
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+        ~Scope() { active = previous; }
+
+    private:
+        Arena* previous;
+    };
+
+    // the arena of the calling thread, nullptr if none is active
+    static Arena* current() { return active; }
+
+    // Memory for a node, whose destructor runs with the arena's.
+    void* allocate(size_t size);
+    // Takes back memory of a node whose constructor threw, false if it isn't the
+    // arena's.
+    bool release(void* pointer);
+
+    size_t getBytes() const { return bytes; }
+    size_t getNodeCount() const { return nodes.size(); }
+
+private:
+    static inline thread_local Arena* active = nullptr;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte* top = nullptr;
+    std::byte* end = nullptr;
+    std::vector<void*> nodes;   // in the order they were created
+    size_t bytes = 0;
+};
+
+#endif
@@ -19,8 +19,12 @@ public:
     uint16_t getFlags() const { return flags; }
     std::vector<std::string> getParams() const { return params; }
     Node* getBody() const { return body; }
+    void setBody(Node* body);
     ClassNode* getClass() const { return klass; }
 
+    int getFrameSize() const { return frameSize; }
+    void setFrameSize(int frameSize);
+
     virtual std::string toString() override;
 
 private:
@@ -29,6 +33,7 @@ private:
     std::vector<std::string> params;
     Node* body;
     ClassNode* klass;
+    int frameSize = 0;
 };
 
 using MethodCallNode = CallNode<MethodNode>;
@@ -43,18 +48,28 @@ public:
     std::unordered_map<std::string, MethodNode*> getMethods() const { return methods; }
     std::unordered_map<std::string, VariableDeclarationNode*> getAttributes() const { return attributes; }
 
+    // Layout: instance attributes get consecutive slots in declaration order, static
+    // ones consecutive slots in the per-class storage. The slot is the attribute's.
+    int getFieldCount() const { return fieldCount; }
+    int getStaticCount() const { return staticCount; }
+
     virtual std::string toString() override;
 
     void addAttribute(std::string name, VariableDeclarationNode* attribute);
     void addMethod(std::string name, MethodNode* method);
+    void removeMethod(const std::string& name);
 
     VariableDeclarationNode* getAttribute(const std::string& name);
     MethodNode* getMethod(MethodCallNode* callee);
+    MethodNode* getMethod(const std::string& name);
+    MethodNode* getConstructor();
 
 private:
     std::string name;
     std::unordered_map<std::string, MethodNode*> methods;
     std::unordered_map<std::string, VariableDeclarationNode*> attributes;
+    int fieldCount = 0;
+    int staticCount = 0;
 };
 
 std::ostream& operator <<(std::ostream& os, Node* const& node);
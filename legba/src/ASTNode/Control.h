@@ -17,11 +17,15 @@ public:
     std::vector<Node*> getStatements() const { return statements; }
 
     void addStatement(Node* node);
+    void setStatements(std::vector<Node*> statements);
     void addVariable(std::string name, VariableDeclarationNode* var);
     void addFunction(std::string name, FunctionNode* func);
+    void removeFunction(const std::string& name);
+    void addClass(std::string name, ClassNode* klass);
 
     VariableDeclarationNode* getVariable(const std::string& name);
     FunctionNode* getFunction(FunctionCallNode* callee);
+    ClassNode* getClass(const std::string& name);
 
     virtual std::string toString() override;
 
@@ -30,6 +34,7 @@ private:
     std::vector<Node*> statements;
     std::unordered_map<std::string, VariableDeclarationNode*> variables;
     std::unordered_map<std::string, FunctionNode*> functions;
+    std::unordered_map<std::string, ClassNode*> classes;
 };
 
 class IfNode : public Node {
@@ -41,6 +46,9 @@ public:
     Node* getCondition() const { return condition; }
     Node* getThenBranch() const { return thenBranch; }
     Node* getElseBranch() const { return elseBranch; }
+    void setCondition(Node* condition);
+    void setThenBranch(Node* thenBranch);
+    void setElseBranch(Node* elseBranch);
 
     virtual std::string toString() override;
 
@@ -58,6 +66,8 @@ public:
 
     Node* getCondition() const { return condition; }
     Node* getBody() const { return body; }
+    void setCondition(Node* condition);
+    void setBody(Node* body);
 
     virtual std::string toString() override;
 
@@ -76,6 +86,10 @@ public:
     Node* getCondition() const { return condition; }
     Node* getIncrement() const { return increment; }
     Node* getBody() const { return body; }
+    void setInitializer(Node* initializer);
+    void setCondition(Node* condition);
+    void setIncrement(Node* increment);
+    void setBody(Node* body);
 
     virtual std::string toString() override;
 
@@ -26,6 +26,7 @@ public:
 
     OpNode* getOp() const { return op; }
     Node* getNode() const { return node; }
+    void setNode(Node* node);
 
     virtual std::string toString() override;
 
@@ -47,6 +48,8 @@ public:
     OpNode* getOp() const { return op; }
     Node* getLeft() const { return left; }
     Node* getRight() const { return right; }
+    void setLeft(Node* left);
+    void setRight(Node* right);
 
     virtual std::string toString() override;
 
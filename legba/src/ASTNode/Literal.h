@@ -2,7 +2,10 @@
 
 #include "ASTNode/Node.h"
 
+#include <vector>
+
 #include "Token.h"
+#include "Runtime/Value.h"
 
 class IntegerNode : public Node {
 public:
@@ -34,10 +37,15 @@ public:
 
     std::string getValue() const { return value; }
 
+    // the interned constant, created by the parser: threads may evaluate the node
+    Value getConstant() const { return constant; }
+    void setConstant(Value constant);
+
     virtual std::string toString() override;
 
 private:
     std::string value;
+    Value constant;
 };
 
 class CharNode : public Node {
@@ -62,4 +70,37 @@ public:
 
 private:
     bool value;
-};
\ No newline at end of file
+};
+
+// [a, b, c] with up to 255 elements. Unless a declaration gives its element type,
+// the array gets the narrowest one holding all the values.
+class ArrayNode : public Node {
+public:
+    ArrayNode(std::vector<Node*> elements) : Node(NodeType::ARRAY, ValueType(ValueTypeEnum::VT_ARRAY)), elements(std::move(elements)) {}
+
+    std::vector<Node*> const& getElements() const { return elements; }
+    void setElements(std::vector<Node*> elements);
+    // VT_NONE if not declared
+    ValueTypeEnum getElementType() const { return elementType; }
+    void setElementType(ValueTypeEnum elementType);
+
+    virtual std::string toString() override;
+
+private:
+    std::vector<Node*> elements;
+    ValueTypeEnum elementType = ValueTypeEnum::VT_NONE;
+};
+
+// {k: v, ...} with up to 127 entries, keys and values alternate in the list.
+class MapNode : public Node {
+public:
+    MapNode(std::vector<Node*> entries) : Node(NodeType::MAP, ValueType(ValueTypeEnum::VT_MAP)), entries(std::move(entries)) {}
+
+    std::vector<Node*> const& getEntries() const { return entries; }
+    void setEntries(std::vector<Node*> entries);
+
+    virtual std::string toString() override;
+
+private:
+    std::vector<Node*> entries;
+};
@@ -1,13 +1,15 @@
 #ifndef LEGBA_NODE_H
 #define LEGBA_NODE_H
+#include <cstddef>
+
 #include "ValueType.h"
 
 enum class NodeType {
-    INTEGER, DOUBLE, STRING, CHAR, BOOL,
+    INTEGER, DOUBLE, STRING, CHAR, BOOL, ARRAY, MAP,
     VARIABLE, VARIABLE_DECL, IDENTIFIER,
     OP, UNARY, BINARY,
     SCOPE, IF, WHILE, FOR,
-    CALL, FUNCTION, CLASS, METHOD
+    CALL, METHOD_CALL, SPAWN, FUNCTION, CLASS, METHOD
 };
 
 class Node {
@@ -15,15 +17,24 @@ public:
     Node(NodeType type, ValueType resultType = ValueType()) : type(type), resultType(resultType) {}
     virtual ~Node() = default;
 
+    // from the calling thread's arena while one is active, see Arena
+    static void* operator new(size_t size);
+    static void operator delete(void* pointer);
+
     NodeType getType() const { return type; };
     virtual std::string toString() = 0;
 
     void setResultType(ValueType resultType);
     ValueType getResultType() const { return resultType; }
 
+    // source line of statements and declarations, 0 for everything else
+    int getLine() const { return line; }
+    void setLine(int line);
+
 protected:
     ValueType resultType;
     NodeType type;
+    int line = 0;
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include "Token.h"
 #include "misc/Utils.h"
 
+#include <vector>
+
+class ClassNode;
+struct Builtin;
+
 enum SymbolFlag : uint16_t {
     SF_NONE = 0,
     SF_MUST_FN = BIT(0),
@@ -31,6 +36,12 @@ public:
     std::string getName() const { return name; }
     uint16_t getFlags() const { return flags; }
     Node* getInitializer() const { return initializer; }
+    void setInitializer(Node* initializer);
+    bool isStatic() const { return (flags & SF_STATIC) == SF_STATIC; }
+
+    int getSlot() const { return slot; }
+    bool isGlobal() const { return global; }
+    void setSlot(int slot, bool global);
 
     virtual std::string toString() override;
 
@@ -38,6 +49,8 @@ private:
     std::string name;
     uint16_t flags;
     Node* initializer;
+    int slot = -1;
+    bool global = false;
 };
 
 class VariableNode : public Node {
@@ -52,6 +65,18 @@ private:
     VariableDeclarationNode* var;
 };
 
+class IdentifierNode : public Node {
+public:
+    IdentifierNode(const std::string& name) : Node(NodeType::IDENTIFIER), name(name) {}
+
+    std::string getName() const { return name; }
+
+    virtual std::string toString() override;
+
+private:
+    std::string name;
+};
+
 class FunctionNode : public Node {
 public:
     FunctionNode(const std::string& name, uint16_t flags, std::vector<std::string> params, Node* body)
@@ -62,6 +87,10 @@ public:
     uint16_t getFlags() const { return flags; }
     std::vector<std::string> getParams() const { return params; }
     Node* getBody() const { return body; }
+    void setBody(Node* body);
+
+    int getFrameSize() const { return frameSize; }
+    void setFrameSize(int frameSize);
 
     virtual std::string toString() override;
 
@@ -70,27 +99,64 @@ private:
     uint16_t flags;
     std::vector<std::string> params;
     Node* body;
+    int frameSize = 0;
 };
 
 template<typename T>
 class CallNode : public Node {
 public:
-    CallNode(std::vector<Node*> args, T* func = nullptr)
-        : Node(NodeType::CALL), args(std::move(args)), func(func) {
+    CallNode(const std::string& callee, std::vector<Node*> args, Node* receiver = nullptr, T* func = nullptr)
+        : Node(receiver == nullptr ? NodeType::CALL : NodeType::METHOD_CALL), callee(callee), args(std::move(args)), receiver(receiver), func(func) {
     }
 
-    std::vector<Node*> getArgs() const { return args; }
+    std::string getCallee() const { return callee; }
+    std::vector<Node*> const& getArgs() const { return args; }
+    Node* getReceiver() const { return receiver; }
+    void setArgs(std::vector<Node*> args);
+    void setReceiver(Node* receiver);
 
     T* getFunction() const { return func; }
     void setFunction(T* func);
 
+    ClassNode* getInstantiatedClass() const { return instantiatedClass; }
+    void setInstantiatedClass(ClassNode* klass);
+
+    // native function called instead, see Builtins.h
+    Builtin const* getBuiltin() const { return builtin; }
+    void setBuiltin(Builtin const* builtin);
+
     virtual std::string toString() override;
 
 private:
+    std::string callee;
     std::vector<Node*> args;
+    Node* receiver;
     T* func;
+    ClassNode* instantiatedClass = nullptr;
+    Builtin const* builtin = nullptr;
 };
 
 using FunctionCallNode = CallNode<FunctionNode>;
 
+// spawn(f, args...): runs the call of f as a task, see Runtime/Scheduler.h. The call
+// is resolved like any other but must name a function. async(f, args...) is the same
+// but starts a coroutine on the spawning thread instead, see Runtime/Coroutines.h.
+class SpawnNode : public Node {
+public:
+    SpawnNode(FunctionCallNode* call, bool coroutine = false)
+        : Node(NodeType::SPAWN, ValueType(coroutine ? ValueTypeEnum::VT_COROUTINE : ValueTypeEnum::VT_TASK)), call(call), coroutine(coroutine) {}
+
+    FunctionCallNode* getCall() const { return call; }
+    void setCall(FunctionCallNode* call);
+    bool isCoroutine() const { return coroutine; }
+    // as called in the source
+    const char* keyword() const { return coroutine ? "async" : "spawn"; }
+
+    virtual std::string toString() override;
+
+private:
+    FunctionCallNode* call;
+    bool coroutine;
+};
+
 #endif
\ No newline at end of file
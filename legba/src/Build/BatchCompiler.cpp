@@ -0,0 +1,180 @@
+#include "Build/BatchCompiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "Error.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "ASTNode/Arena.h"
+#include "Build/ModuleBuilder.h"
+#include "Optimizer/DeadCodeEliminator.h"
+#include "Optimizer/Inliner.h"
+#include "Runtime/Heap.h"
+#include "VM/Bytecode.h"
+#include "VM/Compiler.h"
+#include "VM/Program.h"
+
+BatchCompiler::BatchCompiler(Mode mode, unsigned jobs) : mode(mode), jobs(jobs) {
+    if (this->jobs == 0) {
+        this->jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+}
+
+std::vector<std::string> BatchCompiler::collect(std::vector<std::string> const& paths) {
+    std::vector<std::string> scripts;
+    for (auto const& path : paths) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            scripts.push_back(path);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(path, error)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".leg") {
+                found.push_back(entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        scripts.insert(scripts.end(), found.begin(), found.end());
+    }
+    return scripts;
+}
+
+bool BatchCompiler::run(std::vector<std::string> const& paths) {
+    files.clear();
+    files.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        files[i].path = paths[i];
+    }
+
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            process(files[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < std::min<size_t>(jobs, files.size()); i++) {
+        threads.emplace_back(work);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return getFailed() == 0;
+}
+
+size_t BatchCompiler::getFailed() const {
+    return std::count_if(files.begin(), files.end(), [](File const& file) { return !file.ok; });
+}
+
+bool BatchCompiler::compile(std::string const& source, bool inlining, bool keepFunctions, std::ostream& diagnostics,
+                            std::ostream* bytecode) {
+    // the script's constant strings, dropped with it, nothing here ever collects
+    struct CurrentHeap {
+        CurrentHeap() { Heap::setCurrent(&heap); }
+        ~CurrentHeap() { Heap::setCurrent(nullptr); }
+        Heap heap;
+    } current;
+    // declared next, the parser, the tree and the program all go before it
+    Arena arena;
+    Arena::Scope scope(arena);
+
+    auto tokens = Lexer().lex(source);
+    Parser parser;
+    parser.setDiagnostics(diagnostics);
+    if (!parser.parse(tokens)) {
+        return false;
+    }
+
+    auto eliminator = DeadCodeEliminator(parser.getRootScope(), parser.getUnresolvedFunctionCalls());
+    eliminator.setKeepFunctions(keepFunctions);
+    eliminator.run();
+    if (inlining) {
+        Inliner(parser.getRootScope()).run();
+    }
+
+    Program program;
+    try {
+        Compiler().compile(parser.getRootScope(), parser.getGlobalCount(), program);
+        if (bytecode != nullptr) {
+            writeBytecode(program, *bytecode);
+        }
+    } catch (CompileError const& e) {
+        diagnostics << "Error: " << e.what() << std::endl;
+        return false;
+    } catch (BytecodeError const& e) {
+        diagnostics << "Error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BatchCompiler::process(File& file) const {
+    std::ostringstream diagnostics;
+    auto finish = [&](bool ok) {
+        file.ok = ok;
+        file.diagnostics = diagnostics.str();
+    };
+
+    if (isBytecodeFile(file.path)) {
+        if (mode == Mode::COMPILE) {
+            diagnostics << "Error: The script is compiled already." << std::endl;
+            finish(false);
+            return;
+        }
+        // loading allocates its strings in the heap of the thread
+        Heap heap;
+        Heap::setCurrent(&heap);
+        try {
+            Program program;
+            loadBytecode(file.path, program);
+            finish(true);
+        } catch (BytecodeError const& e) {
+            diagnostics << "Error: " << e.what() << std::endl;
+            finish(false);
+        }
+        Heap::setCurrent(nullptr);
+        return;
+    }
+
+    std::ifstream in(file.path, std::ios::in);
+    if (!in.is_open()) {
+        diagnostics << "Error: Failed to open the file." << std::endl;
+        finish(false);
+        return;
+    }
+    std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    file.lines = std::count(source.begin(), source.end(), '\n');
+
+    std::ostringstream bytecode;
+    bool ok;
+    if (ModuleBuilder::importsModules(source)) {
+        // the threads of the batch are busy already, the modules are built on this one
+        auto builder = ModuleBuilder(1);
+        builder.setInlining(inlining);
+        builder.setCacheDirectory(ModuleBuilder::defaultCacheDirectory(file.path));
+        builder.setDiagnostics(diagnostics);
+        ok = builder.compile(file.path, mode == Mode::COMPILE ? &bytecode : nullptr);
+    } else {
+        ok = compile(source, inlining, false, diagnostics, mode == Mode::COMPILE ? &bytecode : nullptr);
+    }
+    if (!ok || mode == Mode::CHECK) {
+        finish(ok);
+        return;
+    }
+    auto path = std::filesystem::path(file.path).replace_extension(BYTECODE_EXTENSION).string();
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        diagnostics << "Error: Failed to write '" << path << "'." << std::endl;
+        finish(false);
+        return;
+    }
+    out << bytecode.view();
+    finish(true);
+}
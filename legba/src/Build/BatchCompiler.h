@@ -0,0 +1,67 @@
+#ifndef LEGBA_BUILD_BATCHCOMPILER_H
+#define LEGBA_BUILD_BATCHCOMPILER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Checks or compiles many scripts in one process, see legba --check and legba
+// --compile with several scripts or directories. One pool of threads works through
+// all of them, each thread taking the next file as soon as it is done with one.
+//
+// A file is lexed, parsed, optimized and compiled like a single script, with its
+// nodes in an Arena and its constant strings in a Heap of its own, both dropped
+// once the file is done. Nothing else is shared between the threads but the
+// builtins and the constants of the main heap, which don't change meanwhile. What
+// the parser and compiler report is kept per file, in the order the files were
+// given. Scripts importing modules are built with a ModuleBuilder each, on the
+// thread that took them.
+class BatchCompiler {
+public:
+    enum class Mode {
+        CHECK,      // report errors only, .legc files are loaded to verify them
+        COMPILE,    // write a .legc file next to every script
+    };
+
+    struct File {
+        std::string path;
+        bool ok = false;
+        std::string diagnostics;    // one line per error
+        size_t lines = 0;
+    };
+
+    // jobs threads, 0 for one per hardware thread
+    BatchCompiler(Mode mode, unsigned jobs);
+
+    // same as --no-inline for a single script
+    void setInlining(bool enabled) { inlining = enabled; }
+
+    // The scripts among paths: files as they are and directories as the .leg files
+    // anywhere below them, sorted by path.
+    static std::vector<std::string> collect(std::vector<std::string> const& paths);
+
+    // Compiles one script like the batch does, in an arena and heap of its own, and
+    // writes its bytecode to bytecode unless that is nullptr. Unused functions are
+    // kept if keepFunctions, for hosts calling them. False with the errors in
+    // diagnostics if it failed.
+    static bool compile(std::string const& source, bool inlining, bool keepFunctions, std::ostream& diagnostics,
+                        std::ostream* bytecode);
+
+    // Works through the files, true if all of them were fine.
+    bool run(std::vector<std::string> const& paths);
+
+    std::vector<File> const& getFiles() const { return files; }
+    size_t getFailed() const;
+    unsigned getJobs() const { return jobs; }
+
+private:
+    void process(File& file) const;
+
+    Mode mode;
+    unsigned jobs;
+    bool inlining = true;
+    std::vector<File> files;
+};
+
+#endif
@@ -0,0 +1,454 @@
+#include "Build/CompileServer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Error.h"
+#include "Build/BatchCompiler.h"
+#include "Build/ModuleBuilder.h"
+
+#if defined(_WIN32)
+
+std::string CompileServer::defaultSocket() {
+    return "";
+}
+
+CompileServer::CompileServer(std::string socket, size_t capacity) : socket(std::move(socket)), capacity(capacity) {
+    throw RuntimeError("The compile server needs Unix domain sockets.");
+}
+
+CompileServer::~CompileServer() = default;
+
+void CompileServer::serve() {}
+
+std::string CompileClient::request(std::string const& line, std::string& output) {
+    throw RuntimeError("The compile server needs Unix domain sockets.");
+}
+
+#else
+
+static constexpr size_t MAX_REQUEST = 4096;
+
+static bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto count = ::write(fd, data.data(), data.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(count));
+    }
+    return true;
+}
+
+// up to the newline, which is dropped, false if the connection ended before
+static bool readLine(int fd, std::string& line, size_t limit) {
+    line.clear();
+    char c;
+    while (line.size() < limit) {
+        auto count = ::read(fd, &c, 1);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+static bool readExactly(int fd, std::string& data, size_t size) {
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        auto count = ::read(fd, data.data() + done, size - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+static sockaddr_un socketAddress(std::string const& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw RuntimeError("The socket path '" + path + "' is too long.");
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// the user of the process at the other end of a connection
+static bool peerUser(int fd, uid_t& user) {
+#if defined(SO_PEERCRED)
+    ucred credentials = {};
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+        return false;
+    }
+    user = credentials.uid;
+    return true;
+#else
+    gid_t group;
+    return ::getpeereid(fd, &user, &group) == 0;
+#endif
+}
+
+// where the socket goes without XDG_RUNTIME_DIR, only the user may enter it
+static std::string fallbackDirectory() {
+    return "/tmp/legba-" + std::to_string(getuid());
+}
+
+// Throws unless path is a directory of the calling user that nobody else can
+// access, creating it first if asked to.
+static void checkPrivateDirectory(std::string const& path, bool create) {
+    if (create && ::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw RuntimeError("Failed to create '" + path + "': " + std::strerror(errno) + '.');
+    }
+    struct stat info;
+    if (::lstat(path.c_str(), &info) != 0) {
+        throw RuntimeError("No directory '" + path + "' for the socket.");
+    }
+    if (!S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+        throw RuntimeError("'" + path + "' is not a directory only this user can access, refusing to use it.");
+    }
+}
+
+// Throws if something other than a socket of the calling user is at path. Nothing
+// being there is fine.
+static void checkSocketOwner(std::string const& path) {
+    struct stat info;
+    if (::lstat(path.c_str(), &info) != 0) {
+        return;
+    }
+    if (!S_ISSOCK(info.st_mode) || info.st_uid != getuid()) {
+        throw RuntimeError("'" + path + "' is not a socket of this user, refusing to use it.");
+    }
+}
+
+// a connection to the daemon at path, -1 if none listens there
+static int connectTo(std::string const& path) {
+    auto address = socketAddress(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::string CompileServer::defaultSocket() {
+    if (auto runtime = std::getenv("XDG_RUNTIME_DIR"); runtime != nullptr && *runtime != '\0') {
+        return std::string(runtime) + "/legba.sock";
+    }
+    return fallbackDirectory() + "/legba.sock";
+}
+
+CompileServer::CompileServer(std::string socket, size_t capacity)
+    : socket(std::move(socket)), capacity(capacity), started(std::chrono::steady_clock::now()) {
+    auto address = socketAddress(this->socket);
+    auto directory = std::filesystem::path(this->socket).parent_path().string();
+    if (directory == fallbackDirectory()) {
+        checkPrivateDirectory(directory, true);
+    }
+    checkSocketOwner(this->socket);
+    if (int other = connectTo(this->socket); other >= 0) {
+        ::close(other);
+        throw RuntimeError("A daemon listens on '" + this->socket + "' already.");
+    }
+    // left behind by a daemon that didn't stop
+    std::error_code error;
+    if (std::filesystem::is_socket(this->socket, error)) {
+        ::unlink(this->socket.c_str());
+    }
+
+    // only the user may connect, from the moment the socket exists
+    auto mask = ::umask(0177);
+    listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    bool bound = listener >= 0 && ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    auto reason = std::string(std::strerror(errno));
+    ::umask(mask);
+    if (bound && (::chmod(this->socket.c_str(), 0600) != 0 || ::listen(listener, 64) != 0)) {
+        reason = std::strerror(errno);
+        ::unlink(this->socket.c_str());
+        bound = false;
+    }
+    if (!bound) {
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        throw RuntimeError("Failed to listen on '" + this->socket + "': " + reason + '.');
+    }
+}
+
+CompileServer::~CompileServer() {
+    ::close(listener);
+    ::unlink(socket.c_str());
+}
+
+void CompileServer::serve() {
+    // clients that went away fail the write instead
+    std::signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        std::unique_lock lock(mutex);
+        if (stopping) {
+            ::close(connection);
+            break;
+        }
+        active++;
+        lock.unlock();
+
+        std::thread([this, connection] {
+            handle(connection);
+            ::close(connection);
+            std::lock_guard lock(mutex);
+            active--;
+            idle.notify_all();
+        }).detach();
+    }
+
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [&] { return active == 0; });
+}
+
+void CompileServer::handle(int connection) {
+    // other users get nothing compiled, nor can they stop the daemon
+    uid_t user;
+    if (!peerUser(connection, user) || user != getuid()) {
+        return;
+    }
+    std::string line;
+    if (!readLine(connection, line, MAX_REQUEST)) {
+        return;
+    }
+
+    std::string status = "ok";
+    std::string output;
+    if (line.size() > 9 && line.starts_with("build ") && line[8] == ' ') {
+        bool ok = false;
+        if (!build(line.substr(9), line[6] == '1', line[7] == '1', ok, output)) {
+            status = "error";
+        } else if (!ok) {
+            status = "failed";
+        }
+    } else if (line == "stats") {
+        output = stats();
+    } else if (line == "stop") {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        // wakes up the accept of serve
+        ::shutdown(listener, SHUT_RDWR);
+        output = "Stopping.\n";
+    } else {
+        status = "error";
+        output = "Unknown request '" + line + "'.";
+    }
+    writeAll(connection, status + ' ' + std::to_string(output.size()) + '\n');
+    writeAll(connection, output);
+}
+
+bool CompileServer::build(std::string const& path, bool inlining, bool keepFunctions, bool& ok, std::string& output) {
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(path, error);
+    auto size = error ? 0 : std::filesystem::file_size(path, error);
+    if (error) {
+        output = "Failed to open '" + path + "'.";
+        return false;
+    }
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+    auto key = std::string{inlining ? '1' : '0', keepFunctions ? '1' : '0'} + path;
+
+    // a hit, or a file that changed only in time, refreshed
+    auto lookup = [&](size_t const* hash) {
+        auto it = index.find(key);
+        if (it == index.end() || it->second->size != size) {
+            return false;
+        }
+        auto& entry = *it->second;
+        if (entry.modified != nanoseconds) {
+            if (hash == nullptr || entry.hash != *hash) {
+                return false;
+            }
+            entry.modified = nanoseconds;
+            counts.rehashed++;
+        }
+        counts.hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        ok = entry.ok;
+        output = entry.output;
+        return true;
+    };
+
+    {
+        std::lock_guard lock(mutex);
+        counts.requests++;
+        if (lookup(nullptr)) {
+            return true;
+        }
+    }
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        output = "Failed to open '" + path + "'.";
+        return false;
+    }
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    size = source.size();
+    size_t hash = std::hash<std::string_view>()(source);
+    {
+        std::lock_guard lock(mutex);
+        if (lookup(&hash)) {
+            return true;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::ostringstream diagnostics;
+    std::ostringstream bytecode;
+    bool modules = ModuleBuilder::importsModules(source);
+    if (modules) {
+        auto builder = ModuleBuilder(0);
+        builder.setInlining(inlining);
+        builder.setKeepFunctions(keepFunctions);
+        builder.setCacheDirectory(ModuleBuilder::defaultCacheDirectory(path));
+        builder.setDiagnostics(diagnostics);
+        ok = builder.compile(path, &bytecode);
+    } else {
+        ok = BatchCompiler::compile(source, inlining, keepFunctions, diagnostics, &bytecode);
+    }
+    output = ok ? bytecode.str() : diagnostics.str();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard lock(mutex);
+    counts.misses++;
+    counts.compileSeconds += seconds;
+    // the program depends on files other than the script, the modules' own cache
+    // tells what changed
+    if (!modules) {
+        insert(Entry{key, nanoseconds, size, hash, ok, output});
+    }
+    return true;
+}
+
+void CompileServer::insert(Entry entry) {
+    if (auto it = index.find(entry.key); it != index.end()) {
+        used -= bytes(*it->second);
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    if (bytes(entry) > capacity) {
+        return;
+    }
+    used += bytes(entry);
+    entries.push_front(std::move(entry));
+    index.emplace(entries.front().key, entries.begin());
+    while (used > capacity) {
+        used -= bytes(entries.back());
+        index.erase(entries.back().key);
+        entries.pop_back();
+        counts.evictions++;
+    }
+}
+
+std::string CompileServer::stats() {
+    std::lock_guard lock(mutex);
+    double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return std::format("Cached scripts: {}, {:.2f} of {:.2f} MB\n", entries.size(), used / 1048576.0, capacity / 1048576.0)
+         + std::format("Requests: {}, hits: {} ({} rehashed), misses: {}, evictions: {}\n",
+                       counts.requests, counts.hits, counts.rehashed, counts.misses, counts.evictions)
+         + std::format("Compiling took {:.3f}s, up for {:.0f}s\n", counts.compileSeconds, uptime);
+}
+
+std::string CompileClient::request(std::string const& line, std::string& output) {
+    // the bytecode gets run, so it has to come from a daemon of this user
+    auto directory = std::filesystem::path(socket).parent_path().string();
+    if (directory == fallbackDirectory()) {
+        std::error_code error;
+        if (std::filesystem::exists(directory, error)) {
+            checkPrivateDirectory(directory, false);
+        }
+    }
+    checkSocketOwner(socket);
+    int fd = connectTo(socket);
+    if (fd < 0) {
+        throw RuntimeError("No daemon listens on '" + socket + "', start one with legba --serve.");
+    }
+    uid_t user;
+    if (!peerUser(fd, user) || user != getuid()) {
+        ::close(fd);
+        throw RuntimeError("The daemon on '" + socket + "' runs as another user, refusing to use it.");
+    }
+    std::string header;
+    bool ok = writeAll(fd, line + '\n') && readLine(fd, header, MAX_REQUEST);
+    auto space = header.find(' ');
+    ok = ok && space != std::string::npos;
+    if (ok) {
+        size_t size = std::strtoull(header.c_str() + space + 1, nullptr, 10);
+        ok = readExactly(fd, output, size);
+    }
+    ::close(fd);
+    if (!ok) {
+        throw RuntimeError("The connection to the daemon broke.");
+    }
+    auto status = header.substr(0, space);
+    if (status == "error") {
+        throw RuntimeError(output);
+    }
+    return status;
+}
+
+#endif
+
+bool CompileClient::build(std::string const& path, bool inlining, bool keepFunctions, std::string& output) {
+    return request(std::string("build ") + (inlining ? '1' : '0') + (keepFunctions ? '1' : '0') + ' ' + path, output) == "ok";
+}
+
+std::string CompileClient::stats() {
+    std::string output;
+    request("stats", output);
+    return output;
+}
+
+void CompileClient::stop() {
+    std::string output;
+    request("stop", output);
+}
@@ -0,0 +1,116 @@
+#ifndef LEGBA_BUILD_COMPILESERVER_H
+#define LEGBA_BUILD_COMPILESERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Daemon keeping compiled scripts in memory, see legba --serve. It listens on a Unix
+// domain socket and answers one request per connection, a line naming the command,
+// with a line "ok <length>", "failed <length>" or "error <length>" and that many
+// bytes:
+//
+//     build <i><k> <absolute path>  bytecode of the script, or the errors of compiling
+//                                   it if failed. i and k are 0 or 1: with inlining,
+//                                   keeping unused functions
+//     stats                         what the cache holds and how often it helped
+//     stop                          shuts the daemon down
+//
+// Scripts are cached as the bytecode of a .legc file, all a client needs to run one
+// without lexing, parsing or compiling it, by path and those two settings. An entry
+// is fresh as long as the file has the same size and modification time; if only the
+// time changed and the contents hash the same, it is kept too. Once the entries take
+// more bytes than the capacity the least recently used ones are dropped. Scripts
+// importing modules are built every time instead, reusing the compiled modules cached
+// next to them, see ModuleBuilder. Each connection is handled on a thread of its own,
+// compiling outside of the cache's lock.
+//
+// Clients run the bytecode they get, so both sides only talk to processes of the same
+// user: the socket is only accessible to its owner, the server drops connections of
+// other users and the client refuses sockets and daemons of other users.
+class CompileServer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 << 20;
+
+    // the socket of the calling user's daemon, in $XDG_RUNTIME_DIR or a directory
+    // only the user can access in /tmp
+    static std::string defaultSocket();
+
+    // Binds the socket with access for the user only, replacing one no daemon listens
+    // on anymore. Throws RuntimeError if another daemon does, another user owns the
+    // socket or it can't be bound.
+    CompileServer(std::string socket, size_t capacity);
+    CompileServer(CompileServer const&) = delete;
+    CompileServer& operator=(CompileServer const&) = delete;
+    // removes the socket
+    ~CompileServer();
+
+    // Answers requests until one says stop.
+    void serve();
+
+private:
+    struct Entry {
+        std::string key;            // settings and path
+        int64_t modified = 0;       // nanoseconds since the epoch
+        uint64_t size = 0;
+        size_t hash = 0;            // of the source
+        bool ok = false;
+        std::string output;         // bytecode, or the errors if not ok
+    };
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        uint64_t rehashed = 0;      // hits whose file was touched but didn't change
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        double compileSeconds = 0;
+    };
+
+    void handle(int connection);
+    // false if the file can't be read, with the reason in output
+    bool build(std::string const& path, bool inlining, bool keepFunctions, bool& ok, std::string& output);
+    std::string stats();
+    void insert(Entry entry);
+    size_t bytes(Entry const& entry) const { return entry.key.size() + entry.output.size() + sizeof(Entry); }
+
+    std::string socket;
+    int listener = -1;
+    size_t capacity;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex mutex;
+    std::list<Entry> entries;       // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t used = 0;
+    Stats counts;
+    int active = 0;                 // connections being handled
+    std::condition_variable idle;
+    bool stopping = false;
+};
+
+// Sends requests to a CompileServer. Throws RuntimeError if no daemon listens on the
+// socket or the connection breaks.
+class CompileClient {
+public:
+    explicit CompileClient(std::string socket) : socket(std::move(socket)) {}
+
+    // The bytecode of the script at path into output, or false with its errors.
+    bool build(std::string const& path, bool inlining, bool keepFunctions, std::string& output);
+    std::string stats();
+    void stop();
+
+private:
+    // the status of the reply and its payload in output
+    std::string request(std::string const& line, std::string& output);
+
+    std::string socket;
+};
+
+#endif
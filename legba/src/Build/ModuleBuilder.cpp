@@ -0,0 +1,767 @@
+#include "Build/ModuleBuilder.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+
+#include "Error.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "ASTNode/Arena.h"
+#include "Optimizer/DeadCodeEliminator.h"
+#include "Optimizer/Inliner.h"
+#include "Runtime/Heap.h"
+#include "VM/Bytecode.h"
+#include "VM/Compiler.h"
+
+namespace {
+
+constexpr const char* CACHE_MAGIC = "legba-module";
+constexpr const char* CACHE_EXTENSION = ".legm";
+
+// FNV-1a, the same across runs and builds unlike std::hash
+uint64_t hashBytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string hex(uint64_t value) {
+    return std::format("{:016x}", value);
+}
+
+// Tasks for a pool of threads, tasks may push more while they run. run returns once
+// all of them are done.
+class WorkQueue {
+public:
+    void push(std::function<void()> task) {
+        std::lock_guard lock(mutex);
+        tasks.push_back(std::move(task));
+        changed.notify_one();
+    }
+
+    void run(unsigned jobs) {
+        auto work = [this] {
+            std::unique_lock lock(mutex);
+            while (true) {
+                changed.wait(lock, [this] { return !tasks.empty() || running == 0; });
+                if (tasks.empty()) {
+                    return;
+                }
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                running++;
+                lock.unlock();
+                task();
+                lock.lock();
+                running--;
+                changed.notify_all();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < jobs; i++) {
+            threads.emplace_back(work);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::function<void()>> tasks;
+    int running = 0;
+};
+
+// Rewrites the indices in the code of a module's proto to those of the linked program.
+void relocate(FunctionProto& proto, std::vector<int> const& functions, std::vector<int> const& classes, int globals) {
+    for (size_t at = 0; at < proto.code.size(); at++) {
+        Instruction i = proto.code[at];
+        switch (getOp(i)) {
+            case OpCode::GETGLOBAL:
+            case OpCode::SETGLOBAL: {
+                int slot = getBx(i) + globals;
+                if (slot > UINT16_MAX) {
+                    throw CompileError("The modules declare more than " + std::to_string(UINT16_MAX + 1) + " globals.");
+                }
+                proto.code[at] = encodeABx(getOp(i), getA(i), static_cast<uint16_t>(slot));
+                break;
+            }
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+            case OpCode::SPAWN:
+            case OpCode::ASYNC:
+            case OpCode::INVOKEDIRECT:
+                at++;
+                proto.code[at] = encodeExtra(functions[getExtra(proto.code[at])]);
+                break;
+            case OpCode::NEW:
+            case OpCode::GETSTATIC:
+            case OpCode::SETSTATIC:
+                at++;
+                proto.code[at] = encodeExtra(classes[getExtra(proto.code[at])]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+}
+
+struct ModuleBuilder::Module {
+    std::string path;               // canonical, identifies the module
+    std::string name;               // in errors, relative to the main module
+    bool main = false;
+    std::string source;
+    uint64_t sourceHash = 0;
+    uint64_t buildHash = 0;
+
+    std::vector<std::string> importPaths;   // canonical, in the order of the imports
+    std::vector<Module*> imports;
+    std::vector<Module*> importers;
+
+    // the cache entry, if it was compiled from the same source
+    bool cached = false;
+    uint64_t cachedBuild = 0;
+
+    bool dirty = false;             // compiled again
+    bool needed = false;            // parsed and resolved, for itself or its importers
+    size_t pending = 0;             // imports that compile first
+
+    // the module's code, with stubs for what it imports
+    std::string bytecode;
+    std::vector<Program::Import> importedFunctions;
+    std::vector<Program::Import> importedClasses;
+
+    // what parsing made, kept until the build is done as other modules point into it
+    std::unique_ptr<Heap> heap;
+    std::unique_ptr<Arena> arena;
+    std::unique_ptr<Parser> parser;
+
+    std::ostringstream errors;
+    bool failed = false;
+};
+
+namespace {
+
+// Makes a module's heap and arena those of the calling thread while it lives.
+struct Working {
+    explicit Working(Heap* heap, Arena& arena) : scope(arena) { Heap::setCurrent(heap); }
+    ~Working() { Heap::setCurrent(nullptr); }
+
+    Arena::Scope scope;
+};
+
+}
+
+ModuleBuilder::ModuleBuilder(unsigned jobs) : jobs(jobs) {
+    if (this->jobs == 0) {
+        this->jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+}
+
+ModuleBuilder::~ModuleBuilder() = default;
+
+std::string ModuleBuilder::defaultCacheDirectory(std::string const& path) {
+    return (std::filesystem::absolute(path).parent_path() / ".legba-cache").string();
+}
+
+bool ModuleBuilder::importsModules(std::vector<Token> const& tokens) {
+    return std::any_of(tokens.begin(), tokens.end(), [](Token const& token) { return token.type == TokenType::IMPORT; });
+}
+
+bool ModuleBuilder::importsModules(std::string const& source) {
+    // most scripts are told apart without lexing them
+    return source.find("import") != std::string::npos && importsModules(Lexer().lex(source));
+}
+
+bool ModuleBuilder::build(std::string const& path, Program& program) {
+    modules.clear();
+    byPath.clear();
+    sorted.clear();
+    owners.clear();
+    parsed = 0;
+    compiled = 0;
+    reused = 0;
+
+    bool ok = discover(path) && order() && analyze() && compileModules();
+    if (ok) {
+        try {
+            link(program);
+        } catch (CompileError const& e) {
+            *diagnostics << "Error: " << e.what() << std::endl;
+            ok = false;
+        } catch (BytecodeError const& e) {
+            *diagnostics << "Error: " << e.what() << std::endl;
+            ok = false;
+        }
+    }
+
+    // the trees point into each other, they all go at once
+    owners.clear();
+    for (auto& module : modules) {
+        module->parser.reset();
+    }
+    for (auto& module : modules) {
+        module->arena.reset();
+        module->heap.reset();
+        module->source.clear();
+        module->bytecode.clear();
+    }
+    return ok;
+}
+
+bool ModuleBuilder::compile(std::string const& path, std::ostream* bytecode) {
+    // the linked program's constant strings, dropped with it
+    struct CurrentHeap {
+        CurrentHeap() { Heap::setCurrent(&heap); }
+        ~CurrentHeap() { Heap::setCurrent(nullptr); }
+        Heap heap;
+    } current;
+
+    Program program;
+    if (!build(path, program)) {
+        return false;
+    }
+    if (bytecode != nullptr) {
+        try {
+            writeBytecode(program, *bytecode);
+        } catch (BytecodeError const& e) {
+            *diagnostics << "Error: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Phases
+
+bool ModuleBuilder::discover(std::string const& path) {
+    std::error_code error;
+    auto canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(path), error).string();
+    auto directory = std::filesystem::path(canonical).parent_path();
+
+    WorkQueue queue;
+    std::mutex mutex;
+    std::function<void(Module*)> visit;
+    // a module not seen yet gets loaded by one of the threads
+    auto add = [&](std::string const& modulePath) {
+        auto [it, added] = byPath.emplace(modulePath, nullptr);
+        if (!added) {
+            return;
+        }
+        auto module = std::make_unique<Module>();
+        module->path = modulePath;
+        module->name = std::filesystem::path(modulePath).lexically_relative(directory).string();
+        if (module->name.empty()) {
+            module->name = modulePath;
+        }
+        module->main = modules.empty();
+        it->second = module.get();
+        queue.push([&visit, m = module.get()] { visit(m); });
+        modules.push_back(std::move(module));
+    };
+    visit = [&](Module* module) {
+        load(*module);
+        std::lock_guard lock(mutex);
+        for (auto const& import : module->importPaths) {
+            add(import);
+        }
+    };
+
+    {
+        std::lock_guard lock(mutex);
+        add(canonical);
+    }
+    queue.run(jobs);
+
+    for (auto& module : modules) {
+        for (auto const& import : module->importPaths) {
+            auto imported = byPath.at(import);
+            module->imports.push_back(imported);
+            imported->importers.push_back(module.get());
+        }
+    }
+    return report();
+}
+
+bool ModuleBuilder::order() {
+    enum class State { NEW, ACTIVE, DONE };
+    std::unordered_map<Module*, State> states;
+    std::vector<Module*> path;
+
+    std::function<bool(Module*)> visit = [&](Module* module) {
+        states[module] = State::ACTIVE;
+        path.push_back(module);
+        for (auto import : module->imports) {
+            if (states[import] == State::ACTIVE) {
+                std::string cycle;
+                for (auto it = std::find(path.begin(), path.end(), import); it != path.end(); ++it) {
+                    cycle += (*it)->name + " -> ";
+                }
+                module->errors << "Error: Modules import each other: " << cycle << import->name << '.' << std::endl;
+                module->failed = true;
+                return false;
+            }
+            if (states[import] == State::NEW && !visit(import)) {
+                return false;
+            }
+        }
+        path.pop_back();
+        states[module] = State::DONE;
+        sorted.push_back(module);
+        return true;
+    };
+    if (!visit(modules.front().get())) {
+        return report();
+    }
+
+    // a module is compiled again if it or anything it imports changed, or the settings
+    for (auto module : sorted) {
+        auto settings = std::format("{} {} {} {} {}", CACHE_MAGIC, BYTECODE_VERSION, inlining, module->main, module->main && keepFunctions);
+        uint64_t hash = hashBytes(hex(module->sourceHash), hashBytes(settings));
+        for (auto import : module->imports) {
+            hash = hashBytes(import->path + '\n' + hex(import->buildHash), hash);
+        }
+        module->buildHash = hash;
+        module->dirty = !module->cached || module->cachedBuild != hash;
+        if (!module->dirty) {
+            reused++;
+        }
+    }
+    return true;
+}
+
+bool ModuleBuilder::analyze() {
+    // importers come before their imports backwards
+    std::vector<Module*> needed;
+    for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+        auto module = *it;
+        module->needed |= module->dirty;
+        if (module->needed) {
+            needed.push_back(module);
+            for (auto import : module->imports) {
+                import->needed = true;
+            }
+        }
+    }
+
+    auto forEach = [&](auto&& step) {
+        WorkQueue queue;
+        for (auto module : needed) {
+            queue.push([&step, module] { step(*module); });
+        }
+        queue.run(jobs);
+        return report();
+    };
+
+    bool ok = forEach([this](Module& module) {
+        if (module.parser == nullptr) {
+            parse(module);
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+
+    for (auto module : needed) {
+        for (auto stmt : module->parser->getRootScope()->getStatements()) {
+            if (stmt->getType() == NodeType::FUNCTION || stmt->getType() == NodeType::CLASS) {
+                owners.emplace(stmt, module);
+            }
+        }
+    }
+
+    // calls resolve into the root scopes of the imports, which nothing changes now
+    ok = forEach([](Module& module) {
+        std::vector<std::pair<std::string, ScopeNode*>> imported;
+        for (auto import : module.imports) {
+            imported.emplace_back(import->name, import->parser->getRootScope());
+        }
+        module.failed |= !module.parser->resolve(imported);
+    });
+    if (!ok) {
+        return false;
+    }
+
+    // the checks follow calls into other modules, all of them resolved by now
+    return forEach([](Module& module) {
+        if (module.dirty) {
+            module.failed |= !module.parser->checkParallelLoops();
+        }
+    });
+}
+
+bool ModuleBuilder::compileModules() {
+    if (!cacheDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+    }
+
+    WorkQueue queue;
+    std::mutex mutex;
+    std::function<void(Module*)> step = [&](Module* module) {
+        compileModule(*module);
+        std::lock_guard lock(mutex);
+        for (auto importer : module->importers) {
+            if (importer->dirty && --importer->pending == 0) {
+                queue.push([&step, importer] { step(importer); });
+            }
+        }
+    };
+    for (auto module : sorted) {
+        if (!module->dirty) {
+            continue;
+        }
+        module->pending = std::count_if(module->imports.begin(), module->imports.end(), [](Module* import) { return import->dirty; });
+        if (module->pending == 0) {
+            queue.push([&step, module] { step(module); });
+        }
+    }
+    queue.run(jobs);
+    return report();
+}
+
+void ModuleBuilder::link(Program& program) {
+    struct Linked {
+        std::unique_ptr<Program> code;
+        std::vector<int> functions;     // indices in program by those in code
+        std::vector<int> classes;
+        std::unordered_map<std::string, int> functionsByName;
+        std::unordered_map<std::string, int> classesByName;
+        int globals = 0;
+        int main = 0;
+    };
+    std::unordered_map<Module*, Linked> linked;
+
+    // the main module's functions first, hosts find them by name
+    auto placed = std::vector<Module*>{sorted.back()};
+    placed.insert(placed.end(), sorted.begin(), sorted.end() - 1);
+    for (auto module : placed) {
+        auto& entry = linked[module];
+        entry.code = std::make_unique<Program>();
+        auto& code = *entry.code;
+        loadBytecode(std::string_view(module->bytecode), code);
+
+        std::unordered_set<int> stubs;
+        for (auto const& import : module->importedFunctions) {
+            stubs.insert(import.index);
+        }
+        entry.functions.assign(code.functions.size(), -1);
+        for (size_t f = 0; f < code.functions.size(); f++) {
+            if (stubs.contains(static_cast<int>(f))) {
+                continue;
+            }
+            entry.functions[f] = static_cast<int>(program.functions.size());
+            if (static_cast<int>(f) == code.mainFunction) {
+                entry.main = entry.functions[f];
+                code.functions[f]->name = '<' + module->name + '>';
+            } else {
+                entry.functionsByName.emplace(code.functions[f]->name, entry.functions[f]);
+            }
+            program.functions.push_back(code.functions[f]);
+        }
+
+        stubs.clear();
+        for (auto const& import : module->importedClasses) {
+            stubs.insert(import.index);
+        }
+        entry.classes.assign(code.classes.size(), -1);
+        for (size_t c = 0; c < code.classes.size(); c++) {
+            if (stubs.contains(static_cast<int>(c))) {
+                continue;
+            }
+            entry.classes[c] = static_cast<int>(program.classes.size());
+            entry.classesByName.emplace(code.classes[c]->name, entry.classes[c]);
+            program.classes.push_back(code.classes[c]);
+        }
+
+        entry.globals = program.globalCount;
+        program.globalCount += code.globalCount;
+    }
+
+    // stubs stand for what the imported modules declare under that name
+    for (auto module : placed) {
+        auto& entry = linked.at(module);
+        auto resolve = [&](Program::Import const& import, bool isClass) {
+            auto& target = linked.at(byPath.at(import.module));
+            auto& names = isClass ? target.classesByName : target.functionsByName;
+            auto it = names.find(import.name);
+            if (it == names.end()) {
+                throw CompileError("'" + module->name + "' uses '" + import.name + "' of '" + byPath.at(import.module)->name
+                                   + "', which doesn't declare it.");
+            }
+            (isClass ? entry.classes : entry.functions)[import.index] = it->second;
+        };
+        for (auto const& import : module->importedFunctions) {
+            resolve(import, false);
+        }
+        for (auto const& import : module->importedClasses) {
+            resolve(import, true);
+        }
+    }
+
+    for (auto module : placed) {
+        auto& entry = linked.at(module);
+        auto& code = *entry.code;
+        for (size_t f = 0; f < code.functions.size(); f++) {
+            if (program.functions[entry.functions[f]] == code.functions[f]) {
+                relocate(*code.functions[f], entry.functions, entry.classes, entry.globals);
+            }
+        }
+
+        // the program owns what was moved, the module keeps its mapping
+        for (auto const& import : module->importedFunctions) {
+            delete code.functions[import.index];
+        }
+        for (auto const& import : module->importedClasses) {
+            delete code.classes[import.index];
+        }
+        code.functions.clear();
+        code.classes.clear();
+        program.modules.push_back(std::move(entry.code));
+    }
+
+    // runs the top level code of every module, imports first, and returns what the
+    // main module returns
+    auto main = new FunctionProto();
+    main->name = "<script>";
+    main->frameSize = 1;
+    for (auto module : sorted) {
+        main->codeStorage.push_back(encodeABC(OpCode::CALL, 0, 0, 0));
+        main->codeStorage.push_back(encodeExtra(linked.at(module).main));
+    }
+    main->codeStorage.push_back(encodeABC(OpCode::RETURN, 0, 0, 0));
+    main->viewStorage();
+    program.mainFunction = static_cast<int>(program.functions.size());
+    program.functions.push_back(main);
+}
+
+// Modules
+
+void ModuleBuilder::load(Module& module) {
+    std::ifstream in(module.path, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        module.errors << "Error: Failed to open the file." << std::endl;
+        module.failed = true;
+        return;
+    }
+    module.source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    in.close();
+    module.sourceHash = hashBytes(module.source);
+
+    if (readCache(module)) {
+        return;
+    }
+
+    parse(module);
+    auto directory = std::filesystem::path(module.path).parent_path();
+    for (auto const& import : module.parser->getImports()) {
+        std::error_code error;
+        auto path = std::filesystem::weakly_canonical(directory / import.path, error);
+        if (error || !std::filesystem::is_regular_file(path, error)) {
+            module.errors << "[" << import.line << "] Error: No module '" << import.path << "' to import." << std::endl;
+            module.failed = true;
+            continue;
+        }
+        if (std::find(module.importPaths.begin(), module.importPaths.end(), path.string()) == module.importPaths.end()) {
+            module.importPaths.push_back(path.string());
+        }
+    }
+}
+
+void ModuleBuilder::parse(Module& module) {
+    module.heap = std::make_unique<Heap>();
+    module.arena = std::make_unique<Arena>();
+    Working working(module.heap.get(), *module.arena);
+
+    auto tokens = Lexer().lex(module.source);
+    module.parser = std::make_unique<Parser>();
+    module.parser->setDiagnostics(module.errors);
+    module.failed |= !module.parser->parseModule(tokens);
+    parsed++;
+}
+
+void ModuleBuilder::compileModule(Module& module) {
+    Working working(module.heap.get(), *module.arena);
+    auto rootScope = module.parser->getRootScope();
+
+    // other modules call into everything but the main one
+    auto eliminator = DeadCodeEliminator(rootScope, module.parser->getUnresolvedFunctionCalls());
+    eliminator.setKeepFunctions(!module.main || keepFunctions);
+    eliminator.setKeepMethods(!module.main);
+    eliminator.run();
+    if (inlining) {
+        auto inliner = Inliner(rootScope);
+        inliner.setOpen(!module.main);
+        inliner.run();
+    }
+
+    Program program;
+    try {
+        Compiler compiler;
+        compiler.setImports([this](Node* declaration) {
+            if (declaration->getType() == NodeType::METHOD) {
+                declaration = static_cast<MethodNode*>(declaration)->getClass();
+            }
+            return owners.at(declaration)->path;
+        });
+        compiler.compile(rootScope, module.parser->getGlobalCount(), program);
+        std::ostringstream bytecode;
+        writeBytecode(program, bytecode);
+        module.bytecode = bytecode.str();
+    } catch (CompileError const& e) {
+        module.errors << "Error: " << e.what() << std::endl;
+        module.failed = true;
+        return;
+    } catch (BytecodeError const& e) {
+        module.errors << "Error: " << e.what() << std::endl;
+        module.failed = true;
+        return;
+    }
+    module.importedFunctions = program.importedFunctions;
+    module.importedClasses = program.importedClasses;
+    compiled++;
+    writeCache(module);
+}
+
+// Cache entries are a few lines of text naming what the bytecode after them was
+// compiled from and imports:
+//
+//     legba-module <bytecode version>
+//     source <hash>
+//     build <hash>
+//     import\t<path>                        one per imported module
+//     function\t<index>\t<name>\t<path>     one per stub, class lines alike
+//     bytecode <size>
+
+std::string ModuleBuilder::cachePath(Module const& module) const {
+    return (std::filesystem::path(cacheDirectory) / (hex(hashBytes(module.path)) + CACHE_EXTENSION)).string();
+}
+
+bool ModuleBuilder::readCache(Module& module) {
+    if (cacheDirectory.empty()) {
+        return false;
+    }
+    std::ifstream in(cachePath(module), std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    size_t position = 0;
+    auto next = [&](std::string_view& line) {
+        auto end = data.find('\n', position);
+        if (end == std::string::npos) {
+            return false;
+        }
+        line = std::string_view(data).substr(position, end - position);
+        position = end + 1;
+        return true;
+    };
+    auto split = [](std::string_view line) {
+        std::vector<std::string> fields;
+        for (size_t start = 0, end; start <= line.size(); start = end + 1) {
+            end = std::min(line.find('\t', start), line.size());
+            fields.emplace_back(line.substr(start, end - start));
+        }
+        return fields;
+    };
+
+    std::string_view line;
+    if (!next(line) || line != std::format("{} {}", CACHE_MAGIC, BYTECODE_VERSION)
+        || !next(line) || line != "source " + hex(module.sourceHash) || !next(line) || !line.starts_with("build ")) {
+        return false;
+    }
+    uint64_t build = std::strtoull(std::string(line.substr(6)).c_str(), nullptr, 16);
+
+    std::vector<std::string> imports;
+    std::vector<Program::Import> functions;
+    std::vector<Program::Import> classes;
+    while (next(line) && !line.starts_with("bytecode ")) {
+        auto fields = split(line);
+        if (fields[0] == "import" && fields.size() == 2) {
+            imports.push_back(fields[1]);
+        } else if ((fields[0] == "function" || fields[0] == "class") && fields.size() == 4) {
+            (fields[0] == "class" ? classes : functions).push_back({std::stoi(fields[1]), fields[3], fields[2]});
+        } else {
+            return false;
+        }
+    }
+    if (!line.starts_with("bytecode ") || std::strtoull(std::string(line.substr(9)).c_str(), nullptr, 10) != data.size() - position) {
+        return false;
+    }
+
+    module.cached = true;
+    module.cachedBuild = build;
+    module.importPaths = std::move(imports);
+    module.importedFunctions = std::move(functions);
+    module.importedClasses = std::move(classes);
+    module.bytecode = data.substr(position);
+    return true;
+}
+
+void ModuleBuilder::writeCache(Module const& module) {
+    if (cacheDirectory.empty()) {
+        return;
+    }
+    std::ostringstream entry;
+    entry << CACHE_MAGIC << ' ' << BYTECODE_VERSION << '\n'
+          << "source " << hex(module.sourceHash) << '\n'
+          << "build " << hex(module.buildHash) << '\n';
+    for (auto const& import : module.importPaths) {
+        entry << "import\t" << import << '\n';
+    }
+    for (auto const& import : module.importedFunctions) {
+        entry << "function\t" << import.index << '\t' << import.name << '\t' << import.module << '\n';
+    }
+    for (auto const& import : module.importedClasses) {
+        entry << "class\t" << import.index << '\t' << import.name << '\t' << import.module << '\n';
+    }
+    entry << "bytecode " << module.bytecode.size() << '\n' << module.bytecode;
+
+    // written aside and renamed, so builds running at the same time never read half
+    // an entry; a cache that can't be written only costs the next build time
+    auto path = cachePath(module);
+    auto temporary = path + '.' + hex(std::random_device()());
+    std::ofstream out(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return;
+    }
+    out << entry.view();
+    out.close();
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+bool ModuleBuilder::report() {
+    bool ok = true;
+    for (auto& module : modules) {
+        std::istringstream errors(module->errors.str());
+        for (std::string line; std::getline(errors, line);) {
+            *diagnostics << (module->main ? "" : module->name + ": ") << line << '\n';
+        }
+        module->errors.str("");
+        ok &= !module->failed;
+    }
+    diagnostics->flush();
+    return ok;
+}
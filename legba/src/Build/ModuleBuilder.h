@@ -0,0 +1,109 @@
+#ifndef LEGBA_BUILD_MODULEBUILDER_H
+#define LEGBA_BUILD_MODULEBUILDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Token.h"
+#include "ASTNode/Node.h"
+#include "VM/Program.h"
+
+// Builds a script that imports modules, `import "path.leg";` at its top level, into
+// one Program. Every module is a file with a root scope and globals of its own; the
+// functions and classes at its top level are what modules importing it can call,
+// resolved once parsing is done like calls of functions declared further down.
+//
+// The imports form a graph, built in phases on one pool of threads:
+//   1. discover: read and hash every module reachable from the main one, taking the
+//      imports of a module from the cache if its source didn't change, parsing it
+//      otherwise
+//   2. order: reject cycles and give every module a build hash of its source, the
+//      build hashes of its imports and the settings it is compiled with
+//   3. parse and resolve the modules without cached code of that build hash, and all
+//      they import, whose declarations they refer to
+//   4. compile those modules, each one once the modules it imports are done, so
+//      modules that don't depend on each other compile at the same time
+//   5. link the code of all modules into one program, whose top level code runs that
+//      of every module after that of the modules it imports
+//
+// Compiled modules are cached as bytecode with stubs for what they import, listed
+// next to it by module and name; linking replaces the stubs and moves the globals of
+// every module to a range of their own. Nothing of a module is inlined into another,
+// so a module's code only changes with its own source, and it is still compiled again
+// when an import changed as its calls may not resolve the same anymore.
+class ModuleBuilder {
+public:
+    // jobs threads, 0 for one per hardware thread
+    explicit ModuleBuilder(unsigned jobs);
+    ~ModuleBuilder();
+
+    // same as --no-inline for a single script
+    void setInlining(bool enabled) { inlining = enabled; }
+    // Unused functions of the main module are kept, for hosts calling them. Those of
+    // the other modules always are.
+    void setKeepFunctions(bool keep) { keepFunctions = keep; }
+    // where compiled modules are kept, nothing is cached if empty
+    void setCacheDirectory(std::string directory) { cacheDirectory = std::move(directory); }
+    // where errors are printed, those of imported modules prefixed by their path
+    void setDiagnostics(std::ostream& os) { diagnostics = &os; }
+
+    // .legba-cache next to the main module
+    static std::string defaultCacheDirectory(std::string const& path);
+    // whether a script imports modules, so it has to be built with this
+    static bool importsModules(std::vector<Token> const& tokens);
+    static bool importsModules(std::string const& source);
+
+    // Builds the module at path and everything it imports into program, with the
+    // strings of its constants in the heap of the calling thread. False with the
+    // errors in diagnostics if it failed.
+    bool build(std::string const& path, Program& program);
+    // Builds like build in a heap of its own and writes the bytecode of the program,
+    // unless bytecode is nullptr.
+    bool compile(std::string const& path, std::ostream* bytecode);
+
+    // of the last build
+    size_t getModules() const { return modules.size(); }
+    size_t getParsed() const { return parsed; }
+    size_t getCompiled() const { return compiled; }
+    // modules whose cached code was still good
+    size_t getReused() const { return reused; }
+
+private:
+    struct Module;
+
+    bool discover(std::string const& path);
+    bool order();
+    bool analyze();
+    bool compileModules();
+    void link(Program& program);
+
+    void load(Module& module);
+    void parse(Module& module);
+    bool readCache(Module& module);
+    void writeCache(Module const& module);
+    std::string cachePath(Module const& module) const;
+    void compileModule(Module& module);
+    bool report();
+
+    unsigned jobs;
+    bool inlining = true;
+    bool keepFunctions = false;
+    std::string cacheDirectory;
+    std::ostream* diagnostics = &std::cout;
+
+    std::vector<std::unique_ptr<Module>> modules;   // the main one first
+    std::unordered_map<std::string, Module*> byPath;
+    std::vector<Module*> sorted;                    // every module after its imports
+    std::unordered_map<Node*, Module*> owners;      // of the functions and classes parsed
+    std::atomic<size_t> parsed = 0;
+    std::atomic<size_t> compiled = 0;
+    size_t reused = 0;
+};
+
+#endif
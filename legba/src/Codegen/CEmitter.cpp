@@ -0,0 +1,989 @@
+#include "CEmitter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+
+#include "Error.h"
+#include "Codegen/CRuntime.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Operations.h"
+
+void CEmitter::emit(const std::string& sourceName, std::ostream& os) {
+    types.run();
+
+    // bodies come first, they decide which strings and dynamic dispatchers exist
+    std::ostringstream definitions;
+    for (auto func : types.getFunctions()) {
+        function(func, definitions);
+    }
+    for (auto klass : types.getClasses()) {
+        for (auto method : types.getMethods(klass)) {
+            function(method, definitions);
+        }
+        constructor(klass, definitions);
+    }
+    script(definitions);
+
+    std::ostringstream dispatchers;
+    for (auto const& [name, argc] : dynamicMethods) {
+        dynamicMethod(name, argc, dispatchers);
+    }
+    for (auto const& name : dynamicGetters) {
+        dynamicAttribute(name, false, dispatchers);
+    }
+    for (auto const& name : dynamicSetters) {
+        dynamicAttribute(name, true, dispatchers);
+    }
+
+    os << "/* Generated by legba --emit-c from '" << sourceName << "' */\n"
+       << "#include \"" << C_RUNTIME_HEADER_NAME << "\"\n\n";
+
+    for (auto klass : types.getClasses()) {
+        os << "typedef struct " << className(klass) << ' ' << className(klass) << ";\n";
+    }
+    for (auto klass : types.getClasses()) {
+        declareClass(klass, os);
+    }
+
+    for (size_t i = 0; i < strings.size(); i++) {
+        os << "static lg_value str_" << i << ";\n";
+    }
+    visitTree(rootScope, [&](Node* n) {
+        if (n->getType() == NodeType::VARIABLE_DECL && static_cast<VariableDeclarationNode*>(n)->isGlobal()) {
+            auto var = static_cast<VariableDeclarationNode*>(n);
+            auto type = types.variableType(var);
+            os << "static " << cType(type) << ' ' << variableName(var) << " = " << zero(type) << ";\n";
+        }
+    });
+    os << '\n';
+
+    for (auto func : types.getFunctions()) {
+        os << signature(func) << ";\n";
+    }
+    for (auto klass : types.getClasses()) {
+        for (auto method : types.getMethods(klass)) {
+            os << signature(method) << ";\n";
+        }
+    }
+    for (auto const& [name, argc] : dynamicMethods) {
+        os << "static lg_value dyn_m_" << name << '_' << argc << "(lg_value receiver";
+        for (size_t i = 0; i < argc; i++) {
+            os << ", lg_value a" << i;
+        }
+        os << ");\n";
+    }
+    for (auto const& name : dynamicGetters) {
+        os << "static lg_value dyn_get_" << name << "(lg_value object);\n";
+    }
+    for (auto const& name : dynamicSetters) {
+        os << "static lg_value dyn_set_" << name << "(lg_value object, lg_value value);\n";
+    }
+    os << '\n' << definitions.str() << dispatchers.str();
+
+    os << "lg_value legba_run(void) {\n";
+    for (size_t i = 0; i < strings.size(); i++) {
+        os << "    str_" << i << " = lg_new_string(\"" << cString(strings[i]) << "\", " << strings[i].size() << ");\n";
+    }
+    os << "    return lg_script();\n"
+       << "}\n\n"
+       << "#ifndef LEGBA_NO_MAIN\n"
+       << "int main(void) {\n"
+       << "    lg_value result = legba_run();\n"
+       << "    if (!lg_is_nil(result)) {\n"
+       << "        printf(\"-- Script returned %s\\n\", lg_to_string(result)->chars);\n"
+       << "    }\n"
+       << "    return 0;\n"
+       << "}\n"
+       << "#endif\n";
+}
+
+// Declarations
+
+void CEmitter::declareClass(ClassNode* klass, std::ostream& os) {
+    os << "\nstruct " << className(klass) << " {\n"
+       << "    lg_object header;\n";
+    for (auto const& name : types.getAttributeNames(klass)) {
+        os << "    " << cType(types.attributeType(klass, name)) << " a_" << name << ";\n";
+    }
+    os << "};\n";
+    for (auto const& name : types.getAttributeNames(klass, true)) {
+        auto type = types.attributeType(klass, name);
+        os << "static " << cType(type) << ' ' << staticName(klass, name) << " = " << zero(type) << ";\n";
+    }
+
+    auto const& classes = types.getClasses();
+    auto id = std::find(classes.begin(), classes.end(), klass) - classes.begin();
+    os << "static const lg_class " << classInfo(klass) << " = { \"" << klass->getName() << "\", " << id << " };\n";
+
+    auto constructor = klass->getConstructor();
+    os << "static LG_UNUSED " << className(klass) << "* new_" << klass->getName() << '(';
+    if (constructor == nullptr || constructor->getParams().empty()) {
+        os << "void";
+    } else {
+        auto params = TypeInference::getParams(constructor);
+        for (size_t i = 0; i < params.size(); i++) {
+            os << (i > 0 ? ", " : "") << cType(types.variableType(params[i])) << " a" << i;
+        }
+    }
+    os << ");\n";
+}
+
+std::string CEmitter::signature(Node* function) {
+    // methods and constructors may only be reachable through dispatch that never happens
+    std::string result = (function->getType() == NodeType::METHOD ? "static LG_UNUSED " : "static ") + cType(types.returnType(function)) + ' ' + functionName(function) + '(';
+
+    auto params = TypeInference::getParams(function);
+    if (function->getType() == NodeType::METHOD) {
+        params.insert(params.begin(), TypeInference::getThis(static_cast<MethodNode*>(function)));
+    }
+    if (params.empty()) {
+        return result + "void)";
+    }
+    for (size_t i = 0; i < params.size(); i++) {
+        result += (i > 0 ? ", " : "") + cType(types.variableType(params[i])) + ' ' + variableName(params[i]);
+    }
+    return result + ')';
+}
+
+void CEmitter::function(Node* function, std::ostream& os) {
+    currentFunction = function;
+    os << signature(function) << " {\n";
+
+    Node* node = function->getType() == NodeType::FUNCTION
+        ? static_cast<FunctionNode*>(function)->getBody()
+        : static_cast<MethodNode*>(function)->getBody();
+    visitTree(node, [&](Node* n) {
+        if (n->getType() == NodeType::VARIABLE_DECL) {
+            auto var = static_cast<VariableDeclarationNode*>(n);
+            auto type = types.variableType(var);
+            os << "    " << cType(type) << ' ' << variableName(var) << " = " << zero(type) << ";\n";
+        }
+    });
+    body(node, os);
+
+    if (TypeInference::canComplete(node)) {
+        os << "    return LG_NIL;\n";
+    }
+    os << "}\n\n";
+    currentFunction = nullptr;
+}
+
+void CEmitter::constructor(ClassNode* klass, std::ostream& os) {
+    auto self = StaticType::instance(klass);
+    auto constructor = klass->getConstructor();
+
+    os << "static LG_UNUSED " << className(klass) << "* new_" << klass->getName() << '(';
+    std::vector<VariableDeclarationNode*> params;
+    if (constructor != nullptr) {
+        params = TypeInference::getParams(constructor);
+    }
+    if (params.empty()) {
+        os << "void";
+    }
+    for (size_t i = 0; i < params.size(); i++) {
+        os << (i > 0 ? ", " : "") << cType(types.variableType(params[i])) << " a" << i;
+    }
+    os << ") {\n"
+       << "    " << className(klass) << "* self = (" << className(klass) << "*)lg_new_instance(sizeof("
+       << className(klass) << "), &" << classInfo(klass) << ");\n";
+
+    // calloc leaves typed attributes zeroed, which is not nil for boxed ones
+    for (auto const& name : types.getAttributeNames(klass)) {
+        if (types.attributeType(klass, name).isBoxed()) {
+            os << "    self->a_" << name << " = LG_NIL;\n";
+        }
+    }
+
+    if (constructor != nullptr) {
+        os << "    " << functionName(constructor) << '('
+           << convert("self", self, types.variableType(TypeInference::getThis(constructor)));
+        for (size_t i = 0; i < params.size(); i++) {
+            os << ", a" << i;
+        }
+        os << ");\n";
+    }
+    os << "    return self;\n"
+       << "}\n\n";
+}
+
+void CEmitter::script(std::ostream& os) {
+    currentFunction = nullptr;
+    os << "static lg_value lg_script(void) {\n";
+    body(rootScope, os);
+    if (TypeInference::canComplete(rootScope)) {
+        os << "    return LG_NIL;\n";
+    }
+    os << "}\n\n";
+}
+
+void CEmitter::body(Node* body, std::ostream& os) {
+    temporaries.clear();
+    depth = 1;
+
+    std::ostringstream statements;
+    for (auto stmt : static_cast<ScopeNode*>(body)->getStatements()) {
+        statement(stmt, statements);
+    }
+
+    for (auto const& temporary : temporaries) {
+        os << "    " << temporary << ";\n";
+    }
+    os << statements.str();
+}
+
+void CEmitter::dynamicMethod(const std::string& name, size_t argc, std::ostream& os) {
+    os << "static lg_value dyn_m_" << name << '_' << argc << "(lg_value receiver";
+    for (size_t i = 0; i < argc; i++) {
+        os << ", lg_value a" << i;
+    }
+    os << ") {\n"
+       << "    const lg_class* klass = lg_class_of(receiver, \"methods\");\n"
+       << "    switch (klass->id) {\n";
+
+    auto const& classes = types.getClasses();
+    auto dynamic = StaticType::of(TypeKind::DYNAMIC);
+    for (size_t id = 0; id < classes.size(); id++) {
+        auto method = classes[id]->getMethod(name);
+        if (method == nullptr) {
+            continue;
+        }
+
+        os << "        case " << id << ":\n";
+        auto params = TypeInference::getParams(method);
+        if (params.size() != argc) {
+            os << "            lg_error(\"'" << classes[id]->getName() << '.' << name << "' expects " << params.size()
+               << " arguments but got " << argc << ".\");\n";
+            continue;
+        }
+
+        auto self = types.variableType(TypeInference::getThis(method));
+        std::string call = functionName(method) + '(' + (self.is(TypeKind::INSTANCE)
+            ? "(" + className(classes[id]) + "*)lg_as_object(receiver)"
+            : convert("receiver", dynamic, self));
+        for (size_t i = 0; i < argc; i++) {
+            call += ", " + convert("a" + std::to_string(i), dynamic, types.variableType(params[i]));
+        }
+        os << "            return " << box(call + ')', types.returnType(method)) << ";\n";
+    }
+
+    os << "    }\n"
+       << "    lg_error(\"Class '%s' has no method '" << name << "'.\", klass->name);\n"
+       << "}\n\n";
+}
+
+void CEmitter::dynamicAttribute(const std::string& name, bool set, std::ostream& os) {
+    if (set) {
+        os << "static lg_value dyn_set_" << name << "(lg_value object, lg_value value) {\n";
+    } else {
+        os << "static lg_value dyn_get_" << name << "(lg_value object) {\n";
+    }
+    os << "    const lg_class* klass = lg_class_of(object, \"attributes\");\n"
+       << "    switch (klass->id) {\n";
+
+    auto const& classes = types.getClasses();
+    for (size_t id = 0; id < classes.size(); id++) {
+        if (classes[id]->getAttribute(name) == nullptr) {
+            continue;
+        }
+
+        auto type = types.attributeType(classes[id], name);
+        std::string field = attributeSlot(classes[id], name, "((" + className(classes[id]) + "*)lg_as_object(object))", true);
+        os << "        case " << id << ":\n";
+        if (set) {
+            os << "            " << field << " = " << convert("value", StaticType::of(TypeKind::DYNAMIC), type) << ";\n"
+               << "            return value;\n";
+        } else {
+            os << "            return " << box(field, type) << ";\n";
+        }
+    }
+
+    os << "    }\n"
+       << "    lg_error(\"Class '%s' has no attribute '" << name << "'.\", klass->name);\n"
+       << "}\n\n";
+}
+
+// Statements
+
+void CEmitter::line(std::ostream& os, const std::string& code) const {
+    os << std::string(depth * 4, ' ') << code << '\n';
+}
+
+void CEmitter::statement(Node* node, std::ostream& os) {
+    switch (node->getType()) {
+        case NodeType::SCOPE:
+            line(os, "{");
+            depth++;
+            for (auto stmt : static_cast<ScopeNode*>(node)->getStatements()) {
+                statement(stmt, os);
+            }
+            depth--;
+            line(os, "}");
+            break;
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            auto condition = ifNode->getCondition();
+            line(os, "if (" + truthy(expression(condition), types.typeOf(condition)) + ")");
+            block(ifNode->getThenBranch(), os);
+            if (ifNode->getElseBranch() != nullptr) {
+                line(os, "else");
+                block(ifNode->getElseBranch(), os);
+            }
+            break;
+        }
+        case NodeType::WHILE: {
+            auto whileNode = static_cast<WhileNode*>(node);
+            auto condition = whileNode->getCondition();
+            line(os, "while (" + truthy(expression(condition), types.typeOf(condition)) + ")");
+            block(whileNode->getBody(), os);
+            break;
+        }
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            line(os, "{");
+            depth++;
+            if (forNode->getInitializer() != nullptr) {
+                statement(forNode->getInitializer(), os);
+            }
+            std::string condition;
+            if (forNode->getCondition() != nullptr) {
+                condition = truthy(expression(forNode->getCondition()), types.typeOf(forNode->getCondition()));
+            }
+            std::string increment;
+            if (forNode->getIncrement() != nullptr) {
+                increment = "(void)" + expression(forNode->getIncrement());
+            }
+            line(os, "for (; " + condition + "; " + increment + ")");
+            block(forNode->getBody(), os);
+            depth--;
+            line(os, "}");
+            break;
+        }
+        case NodeType::VARIABLE_DECL: {
+            auto var = static_cast<VariableDeclarationNode*>(node);
+            auto type = types.variableType(var);
+            std::string value = convert("LG_NIL", StaticType::of(TypeKind::NIL), type);
+            if (var->getInitializer() != nullptr) {
+                value = convert(expression(var->getInitializer()), types.typeOf(var->getInitializer()), type);
+            }
+            line(os, variableName(var) + " = " + value + ';');
+            break;
+        }
+        case NodeType::FUNCTION:
+        case NodeType::CLASS:
+            break; // emitted separately
+        case NodeType::UNARY:
+            if (static_cast<UnaryNode*>(node)->getOp()->getOp() == TokenType::RETURN) {
+                returnStatement(static_cast<UnaryNode*>(node), os);
+                break;
+            }
+            line(os, "(void)" + expression(node) + ';');
+            break;
+        case NodeType::BINARY:
+            if (static_cast<BinaryNode*>(node)->getOp()->getOp() == TokenType::EQUAL) {
+                line(os, assignment(static_cast<BinaryNode*>(node), true) + ';');
+                break;
+            }
+            line(os, "(void)" + expression(node) + ';');
+            break;
+        case NodeType::CALL:
+        case NodeType::METHOD_CALL:
+            line(os, expression(node) + ';');
+            break;
+        default:
+            line(os, "(void)" + expression(node) + ';');
+            break;
+    }
+}
+
+void CEmitter::block(Node* node, std::ostream& os) {
+    if (node->getType() == NodeType::SCOPE) {
+        statement(node, os);
+        return;
+    }
+
+    line(os, "{");
+    depth++;
+    statement(node, os);
+    depth--;
+    line(os, "}");
+}
+
+void CEmitter::returnStatement(UnaryNode* node, std::ostream& os) {
+    // the script itself hands back a boxed value
+    auto target = currentFunction != nullptr ? types.returnType(currentFunction) : StaticType::of(TypeKind::DYNAMIC);
+    if (node->getNode() == nullptr) {
+        line(os, "return " + convert("LG_NIL", StaticType::of(TypeKind::NIL), target) + ';');
+        return;
+    }
+
+    line(os, "return " + convert(expression(node->getNode()), types.typeOf(node->getNode()), target) + ';');
+}
+
+// Expressions
+
+std::string CEmitter::expression(Node* node) {
+    switch (node->getType()) {
+        case NodeType::INTEGER:
+        case NodeType::DOUBLE:
+        case NodeType::BOOL:
+        case NodeType::CHAR:
+        case NodeType::STRING:
+            return literal(node);
+        case NodeType::VARIABLE:
+            return variableName(static_cast<VariableNode*>(node)->getVar());
+        case NodeType::IDENTIFIER:
+            throw CompileError("Undefined variable '" + static_cast<IdentifierNode*>(node)->getName() + "'.");
+        case NodeType::UNARY: return unary(static_cast<UnaryNode*>(node));
+        case NodeType::BINARY: return binary(static_cast<BinaryNode*>(node));
+        case NodeType::CALL: return call(static_cast<FunctionCallNode*>(node));
+        case NodeType::METHOD_CALL: return methodCall(static_cast<MethodCallNode*>(node));
+        case NodeType::ARRAY: return array(static_cast<ArrayNode*>(node));
+        case NodeType::MAP: return map(static_cast<MapNode*>(node));
+        case NodeType::SPAWN:
+            if (static_cast<SpawnNode*>(node)->isCoroutine()) {
+                throw CompileError("The C translation has no coroutines, 'async' only runs in the VM.");
+            }
+            throw CompileError("The C translation has no tasks, 'spawn' and parallel loops only run in the interpreter and the VM.");
+        default:
+            throw CompileError("Cannot compile " + node->toString() + " as an expression.");
+    }
+}
+
+std::string CEmitter::literal(Node* node) {
+    switch (node->getType()) {
+        case NodeType::INTEGER: return std::to_string(static_cast<IntegerNode*>(node)->getValue());
+        case NodeType::DOUBLE: {
+            std::ostringstream os;
+            os << std::setprecision(17) << static_cast<DoubleNode*>(node)->getValue();
+            auto text = os.str();
+            if (text == "inf") {
+                return "HUGE_VAL";
+            }
+            if (text.find_first_of(".e") == std::string::npos) {
+                text += ".0";
+            }
+            return text;
+        }
+        case NodeType::BOOL: return static_cast<BoolNode*>(node)->getValue() ? "true" : "false";
+        case NodeType::CHAR: return "lg_char(" + std::to_string(static_cast<int>(static_cast<CharNode*>(node)->getValue())) + ')';
+        default: return stringConstant(static_cast<StringNode*>(node)->getValue());
+    }
+}
+
+std::string CEmitter::unary(UnaryNode* node) {
+    auto operand = node->getNode();
+    switch (node->getOp()->getOp()) {
+        case TokenType::BANG:
+            return "(!" + truthy(expression(operand), types.typeOf(operand)) + ')';
+        case TokenType::MINUS: {
+            auto type = types.typeOf(operand);
+            auto code = expression(operand);
+            if (type.is(TypeKind::INT)) return "lg_neg_i(" + code + ')';
+            if (type.is(TypeKind::DOUBLE)) return "(-" + code + ')';
+            return "lg_negate(" + box(code, type) + ')';
+        }
+        default:
+            throw CompileError("A return is only allowed as a statement.");
+    }
+}
+
+std::string CEmitter::binary(BinaryNode* node) {
+    switch (node->getOp()->getOp()) {
+        case TokenType::EQUAL: return assignment(node, false);
+        case TokenType::AND:
+        case TokenType::OR: return logical(node);
+        case TokenType::DOT: return attribute(node);
+        case TokenType::LEFT_BRACKET: {
+            std::string prefix;
+            auto codes = operands({ node->getLeft(), node->getRight() }, prefix);
+            auto code = "lg_index_get(" + box(codes[0], types.typeOf(node->getLeft())) + ", " + box(codes[1], types.typeOf(node->getRight())) + ')';
+            return prefix.empty() ? code : '(' + prefix + code + ')';
+        }
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::MODULO: return arithmetic(node);
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL: return comparison(node);
+        default:
+            throw CompileError("Unsupported binary operator " + tokenTypeToString(node->getOp()->getOp()) + '.');
+    }
+}
+
+std::string CEmitter::arithmetic(BinaryNode* node) {
+    std::string prefix;
+    auto codes = operands({ node->getLeft(), node->getRight() }, prefix);
+    auto left = types.typeOf(node->getLeft());
+    auto right = types.typeOf(node->getRight());
+    auto result = types.typeOf(node);
+    auto op = node->getOp()->getOp();
+
+    std::string code;
+    if (result.is(TypeKind::INT)) {
+        // ints wrap around and divide like in the interpreter
+        switch (op) {
+            case TokenType::PLUS: code = "lg_add_ii"; break;
+            case TokenType::MINUS: code = "lg_sub_ii"; break;
+            case TokenType::STAR: code = "lg_mul_ii"; break;
+            case TokenType::SLASH: code = "lg_div_ii"; break;
+            default: code = "lg_mod_ii"; break;
+        }
+        code += '(' + codes[0] + ", " + codes[1] + ')';
+    } else if (result.is(TypeKind::DOUBLE)) {
+        auto x = left.is(TypeKind::INT) ? "(double)" + codes[0] : codes[0];
+        auto y = right.is(TypeKind::INT) ? "(double)" + codes[1] : codes[1];
+        switch (op) {
+            case TokenType::PLUS: code = '(' + x + " + " + y + ')'; break;
+            case TokenType::MINUS: code = '(' + x + " - " + y + ')'; break;
+            case TokenType::STAR: code = '(' + x + " * " + y + ')'; break;
+            case TokenType::SLASH: code = '(' + x + " / " + y + ')'; break;
+            default: code = "fmod(" + x + ", " + y + ')'; break;
+        }
+    } else {
+        std::string name;
+        switch (op) {
+            case TokenType::PLUS: name = "LG_ADD"; break;
+            case TokenType::MINUS: name = "LG_SUB"; break;
+            case TokenType::STAR: name = "LG_MUL"; break;
+            case TokenType::SLASH: name = "LG_DIV"; break;
+            default: name = "LG_MOD"; break;
+        }
+        code = "lg_arith(" + name + ", " + box(codes[0], left) + ", " + box(codes[1], right) + ')';
+    }
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+std::string CEmitter::comparison(BinaryNode* node) {
+    std::string prefix;
+    auto codes = operands({ node->getLeft(), node->getRight() }, prefix);
+    auto left = types.typeOf(node->getLeft());
+    auto right = types.typeOf(node->getRight());
+    auto op = node->getOp()->getOp();
+
+    std::string symbol;
+    std::string name;
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: symbol = "=="; break;
+        case TokenType::BANG_EQUAL: symbol = "!="; break;
+        case TokenType::LESS: symbol = "<"; name = "LG_LT"; break;
+        case TokenType::LESS_EQUAL: symbol = "<="; name = "LG_LE"; break;
+        case TokenType::GREATER: symbol = ">"; name = "LG_GT"; break;
+        default: symbol = ">="; name = "LG_GE"; break;
+    }
+
+    bool equality = name.empty();
+    std::string code;
+    if (left.isNumber() && right.isNumber()) {
+        bool mixed = left != right;
+        auto x = mixed && left.is(TypeKind::INT) ? "(double)" + codes[0] : codes[0];
+        auto y = mixed && right.is(TypeKind::INT) ? "(double)" + codes[1] : codes[1];
+        code = '(' + x + ' ' + symbol + ' ' + y + ')';
+    } else if (equality && left == right && (left.is(TypeKind::BOOL) || left.is(TypeKind::INSTANCE))) {
+        code = '(' + codes[0] + ' ' + symbol + ' ' + codes[1] + ')';
+    } else if (equality) {
+        code = "lg_equal(" + box(codes[0], left) + ", " + box(codes[1], right) + ')';
+        if (op == TokenType::BANG_EQUAL) {
+            code = '!' + code;
+        }
+    } else {
+        code = "lg_compare(" + name + ", " + box(codes[0], left) + ", " + box(codes[1], right) + ')';
+    }
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+std::string CEmitter::logical(BinaryNode* node) {
+    // the left operand is the result unless it decides nothing, like the interpreter
+    auto left = types.typeOf(node->getLeft());
+    auto right = types.typeOf(node->getRight());
+    auto result = types.typeOf(node);
+
+    auto value = temporary(left);
+    auto first = convert(value, left, result);
+    auto second = convert(expression(node->getRight()), right, result);
+    auto code = '(' + value + " = " + expression(node->getLeft()) + ", " + truthy(value, left) + " ? ";
+    if (node->getOp()->getOp() == TokenType::AND) {
+        return code + second + " : " + first + ')';
+    }
+    return code + first + " : " + second + ')';
+}
+
+std::string CEmitter::attribute(BinaryNode* node) {
+    auto name = static_cast<IdentifierNode*>(node->getRight())->getName();
+    auto receiver = types.typeOf(node->getLeft());
+    auto object = expression(node->getLeft());
+
+    if (!receiver.is(TypeKind::INSTANCE)) {
+        dynamicGetters.insert(name);
+        return "dyn_get_" + name + '(' + box(object, receiver) + ')';
+    }
+    if (receiver.klass->getAttribute(name) == nullptr) {
+        return "((void)" + object + ", lg_fail(\"Class '" + receiver.klass->getName() + "' has no attribute '" + name + "'.\"))";
+    }
+    return attributeSlot(receiver.klass, name, object, node->getLeft()->getType() == NodeType::VARIABLE);
+}
+
+std::string CEmitter::assignment(BinaryNode* node, bool statement) {
+    auto target = node->getLeft();
+    auto value = types.typeOf(node->getRight());
+
+    if (target->getType() == NodeType::VARIABLE) {
+        auto var = static_cast<VariableNode*>(target)->getVar();
+        auto code = variableName(var) + " = " + convert(expression(node->getRight()), value, types.variableType(var));
+        return statement ? code : '(' + code + ')';
+    }
+
+    auto attribute = static_cast<BinaryNode*>(target);
+    if (attribute->getOp()->getOp() == TokenType::LEFT_BRACKET) {
+        std::string prefix;
+        auto codes = operands({ attribute->getLeft(), attribute->getRight(), node->getRight() }, prefix);
+        auto code = "lg_index_set(" + box(codes[0], types.typeOf(attribute->getLeft())) + ", " + box(codes[1], types.typeOf(attribute->getRight()))
+            + ", " + box(codes[2], value) + ')';
+        return prefix.empty() ? code : '(' + prefix + code + ')';
+    }
+    auto name = static_cast<IdentifierNode*>(attribute->getRight())->getName();
+    auto receiver = types.typeOf(attribute->getLeft());
+    if (receiver.is(TypeKind::INSTANCE) && attribute->getLeft()->getType() == NodeType::VARIABLE
+        && receiver.klass->getAttribute(name) != nullptr && receiver.klass->getAttribute(name)->isStatic()) {
+        auto code = staticName(receiver.klass, name) + " = " + convert(expression(node->getRight()), value, types.attributeType(receiver.klass, name));
+        return statement ? code : '(' + code + ')';
+    }
+
+    std::string prefix;
+    auto codes = operands({ attribute->getLeft(), node->getRight() }, prefix);
+
+    std::string code;
+    if (!receiver.is(TypeKind::INSTANCE)) {
+        dynamicSetters.insert(name);
+        code = "dyn_set_" + name + '(' + box(codes[0], receiver) + ", " + box(codes[1], value) + ')';
+    } else if (receiver.klass->getAttribute(name) == nullptr) {
+        return failure(codes, prefix, "Class '" + receiver.klass->getName() + "' has no attribute '" + name + "'.");
+    } else {
+        code = attributeSlot(receiver.klass, name, codes[0], false) + " = " + convert(codes[1], value, types.attributeType(receiver.klass, name));
+    }
+
+    if (prefix.empty()) {
+        return statement ? code : '(' + code + ')';
+    }
+    return '(' + prefix + code + ')';
+}
+
+// Boxed elements, the runtime picks the element type unless one was declared.
+std::string CEmitter::array(ArrayNode* node) {
+    auto elements = node->getElements();
+    std::string prefix;
+    auto codes = operands(elements, prefix);
+    auto declared = declaredElementType(node->getElementType());
+    auto code = "lg_array_literal(" + std::to_string(declared ? static_cast<int>(*declared) : -1) + ", " + std::to_string(elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+        code += ", " + box(codes[i], types.typeOf(elements[i]));
+    }
+    code += ')';
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+// Boxed keys and values alternating, like the VM's NEWMAP.
+std::string CEmitter::map(MapNode* node) {
+    auto entries = node->getEntries();
+    std::string prefix;
+    auto codes = operands(entries, prefix);
+    auto code = "lg_map_literal(" + std::to_string(entries.size() / 2);
+    for (size_t i = 0; i < entries.size(); i++) {
+        code += ", " + box(codes[i], types.typeOf(entries[i]));
+    }
+    code += ')';
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+std::string CEmitter::call(FunctionCallNode* node) {
+    auto args = node->getArgs();
+    auto func = node->getFunction();
+    auto klass = node->getInstantiatedClass();
+    auto builtin = node->getBuiltin();
+    if (func == nullptr && klass == nullptr && builtin == nullptr) {
+        throw CompileError("Undefined function '" + node->getCallee() + "'.");
+    }
+
+    std::string prefix;
+    auto codes = operands(args, prefix);
+    auto argc = std::to_string(args.size());
+
+    // the runtime's builtins take and return boxed values, typed results get unboxed
+    if (builtin != nullptr) {
+        if (builtin->params[0] == ValueTypeEnum::VT_TASK) {
+            throw CompileError("The C translation has no tasks, '" + std::string(builtin->name) + "' only runs in the interpreter and the VM.");
+        }
+        if (builtin->params[0] == ValueTypeEnum::VT_COROUTINE) {
+            throw CompileError("The C translation has no coroutines, '" + std::string(builtin->name) + "' only runs in the VM.");
+        }
+        std::string code = std::string("lg_builtin_") + builtin->name + '(';
+        for (size_t i = 0; i < args.size(); i++) {
+            code += (i > 0 ? ", " : "") + box(codes[i], types.typeOf(args[i]));
+        }
+        code += ')';
+        switch (types.typeOf(node).kind) {
+            case TypeKind::INT: code = "lg_as_int(" + code + ')'; break;
+            case TypeKind::DOUBLE: code = "lg_as_double(" + code + ')'; break;
+            case TypeKind::BOOL: code = "lg_as_bool(" + code + ')'; break;
+            default: break;
+        }
+        return prefix.empty() ? code : '(' + prefix + code + ')';
+    }
+
+    if (func != nullptr) {
+        if (!TypeInference::arityMatches(node)) {
+            return failure(codes, prefix, "'" + func->getName() + "' expects " + std::to_string(func->getParams().size())
+                + " arguments but got " + argc + '.');
+        }
+        auto code = functionName(func) + '(' + arguments(codes, args, func, 0) + ')';
+        return prefix.empty() ? code : '(' + prefix + code + ')';
+    }
+
+    auto constructor = klass->getConstructor();
+    if (!TypeInference::arityMatches(node)) {
+        if (constructor == nullptr) {
+            return failure(codes, prefix, "Class '" + klass->getName() + "' has no constructor taking arguments.");
+        }
+        return failure(codes, prefix, "'" + klass->getName() + '.' + klass->getName() + "' expects "
+            + std::to_string(constructor->getParams().size()) + " arguments but got " + argc + '.');
+    }
+    std::string code = "new_" + klass->getName() + '(' + (constructor != nullptr ? arguments(codes, args, constructor, 0) : "") + ')';
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+std::string CEmitter::methodCall(MethodCallNode* node) {
+    auto args = node->getArgs();
+    auto nodes = args;
+    nodes.insert(nodes.begin(), node->getReceiver());
+
+    std::string prefix;
+    auto codes = operands(nodes, prefix);
+    auto receiver = types.typeOf(node->getReceiver());
+    auto name = node->getCallee();
+
+    std::string code;
+    if (auto target = types.staticTarget(node)) {
+        code = functionName(target) + '(' + convert(codes[0], receiver, types.variableType(TypeInference::getThis(target)));
+        if (!args.empty()) {
+            code += ", " + arguments(codes, nodes, target, 1);
+        }
+        code += ')';
+    } else if (receiver.is(TypeKind::INSTANCE)) {
+        auto method = receiver.klass->getMethod(name);
+        if (method == nullptr) {
+            return failure(codes, prefix, "Class '" + receiver.klass->getName() + "' has no method '" + name + "'.");
+        }
+        return failure(codes, prefix, "'" + receiver.klass->getName() + '.' + name + "' expects "
+            + std::to_string(method->getParams().size()) + " arguments but got " + std::to_string(args.size()) + '.');
+    } else {
+        dynamicMethods.emplace(name, args.size());
+        code = "dyn_m_" + name + '_' + std::to_string(args.size()) + '(' + box(codes[0], receiver);
+        for (size_t i = 1; i < nodes.size(); i++) {
+            code += ", " + box(codes[i], types.typeOf(nodes[i]));
+        }
+        code += ')';
+    }
+    return prefix.empty() ? code : '(' + prefix + code + ')';
+}
+
+std::vector<std::string> CEmitter::operands(std::vector<Node*> const& nodes, std::string& prefix) {
+    // C leaves the evaluation order of operands open, the interpreter goes left to
+    // right. An operand that may be affected by a later one runs first into a temporary.
+    auto runsCode = [&](Node* n) {
+        switch (n->getType()) {
+            case NodeType::INTEGER:
+            case NodeType::DOUBLE:
+            case NodeType::BOOL:
+            case NodeType::CHAR:
+            case NodeType::STRING:
+            case NodeType::VARIABLE:
+                return false;
+            case NodeType::BINARY: {
+                // reading a known attribute of a variable can't fail or change anything
+                auto binary = static_cast<BinaryNode*>(n);
+                if (binary->getOp()->getOp() != TokenType::DOT || binary->getLeft()->getType() != NodeType::VARIABLE) {
+                    return true;
+                }
+                auto receiver = types.typeOf(binary->getLeft());
+                auto name = static_cast<IdentifierNode*>(binary->getRight())->getName();
+                return !receiver.is(TypeKind::INSTANCE) || receiver.klass->getAttribute(name) == nullptr;
+            }
+            default:
+                return true;
+        }
+    };
+    auto assigns = [](Node* n) {
+        bool found = false;
+        visitTree(n, [&](Node* m) {
+            found |= m->getType() == NodeType::BINARY && static_cast<BinaryNode*>(m)->getOp()->getOp() == TokenType::EQUAL;
+        });
+        return found;
+    };
+
+    auto codes = std::vector<std::string>();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        auto code = expression(nodes[i]);
+
+        bool laterCode = false;
+        bool laterAssignment = false;
+        for (size_t j = i + 1; j < nodes.size(); j++) {
+            laterCode |= runsCode(nodes[j]);
+            laterAssignment |= assigns(nodes[j]);
+        }
+
+        bool stable = nodes[i]->getType() != NodeType::VARIABLE && nodes[i]->getType() != NodeType::BINARY && !runsCode(nodes[i]);
+        if (nodes[i]->getType() == NodeType::VARIABLE) {
+            stable = !static_cast<VariableNode*>(nodes[i])->getVar()->isGlobal() && !laterAssignment;
+        }
+        if (laterCode && !stable) {
+            auto value = temporary(types.typeOf(nodes[i]));
+            prefix += value + " = " + code + ", ";
+            code = value;
+        }
+        codes.push_back(code);
+    }
+    return codes;
+}
+
+std::string CEmitter::arguments(std::vector<std::string> const& codes, std::vector<Node*> const& nodes, Node* function, size_t first) {
+    auto params = TypeInference::getParams(function);
+    std::string result;
+    for (size_t i = 0; i < params.size(); i++) {
+        result += (i > 0 ? ", " : "") + convert(codes[first + i], types.typeOf(nodes[first + i]), types.variableType(params[i]));
+    }
+    return result;
+}
+
+std::string CEmitter::failure(std::vector<std::string> const& codes, const std::string& prefix, const std::string& message) {
+    // operands still run before the error, like in the interpreter
+    std::string code = '(' + prefix;
+    for (auto const& operand : codes) {
+        code += "(void)" + operand + ", ";
+    }
+    return code + "lg_fail(\"" + cString(message) + "\"))";
+}
+
+// Types
+
+std::string CEmitter::convert(const std::string& code, StaticType from, StaticType to) {
+    if (from == to || (from.isBoxed() && to.isBoxed())) {
+        return code;
+    }
+    if (to.isBoxed()) {
+        return box(code, from);
+    }
+
+    auto boxed = box(code, from);
+    switch (to.kind) {
+        case TypeKind::INT: return "lg_expect_int(" + boxed + ')';
+        case TypeKind::DOUBLE: return "lg_expect_double(" + boxed + ')';
+        case TypeKind::BOOL: return "lg_expect_bool(" + boxed + ')';
+        default:
+            return "((" + className(to.klass) + "*)lg_expect_instance(" + boxed + ", &" + classInfo(to.klass) + "))";
+    }
+}
+
+std::string CEmitter::box(const std::string& code, StaticType type) {
+    switch (type.kind) {
+        case TypeKind::INT: return "lg_int(" + code + ')';
+        case TypeKind::DOUBLE: return "lg_double(" + code + ')';
+        case TypeKind::BOOL: return "lg_bool(" + code + ')';
+        case TypeKind::INSTANCE: return "lg_object_value(" + code + ')';
+        default: return code;
+    }
+}
+
+std::string CEmitter::truthy(const std::string& code, StaticType type) {
+    switch (type.kind) {
+        case TypeKind::BOOL: return code;
+        case TypeKind::INT: return '(' + code + " != 0)";
+        case TypeKind::DOUBLE: return '(' + code + " != 0.0)";
+        case TypeKind::INSTANCE: return "((void)" + code + ", true)";
+        case TypeKind::NIL: return "((void)" + code + ", false)";
+        default: return "lg_truthy(" + code + ')';
+    }
+}
+
+std::string CEmitter::temporary(StaticType type) {
+    auto name = "t" + std::to_string(temporaries.size());
+    temporaries.push_back(cType(type) + ' ' + name);
+    return name;
+}
+
+std::string CEmitter::stringConstant(const std::string& value) {
+    auto it = stringIndices.find(value);
+    if (it != stringIndices.end()) {
+        return "str_" + std::to_string(it->second);
+    }
+
+    stringIndices.emplace(value, strings.size());
+    strings.push_back(value);
+    return "str_" + std::to_string(strings.size() - 1);
+}
+
+std::string CEmitter::cType(StaticType type) {
+    switch (type.kind) {
+        case TypeKind::INT: return "int32_t";
+        case TypeKind::DOUBLE: return "double";
+        case TypeKind::BOOL: return "bool";
+        case TypeKind::INSTANCE: return className(type.klass) + '*';
+        default: return "lg_value";
+    }
+}
+
+std::string CEmitter::zero(StaticType type) {
+    switch (type.kind) {
+        case TypeKind::INT: return "0";
+        case TypeKind::DOUBLE: return "0.0";
+        case TypeKind::BOOL: return "false";
+        case TypeKind::INSTANCE: return "NULL";
+        default: return "LG_NIL";
+    }
+}
+
+// Names
+
+std::string CEmitter::variableName(VariableDeclarationNode* var) {
+    // slots are unique per frame, names alone may be shadowed
+    return (var->isGlobal() ? "g" : "l") + std::to_string(var->getSlot()) + '_' + var->getName();
+}
+
+std::string CEmitter::functionName(Node* function) {
+    if (function->getType() == NodeType::FUNCTION) {
+        return "f_" + static_cast<FunctionNode*>(function)->getName();
+    }
+    auto method = static_cast<MethodNode*>(function);
+    return "m_" + method->getClass()->getName() + "__" + method->getName();
+}
+
+// Lvalue of the attribute of object: a struct member, or the class' global for a
+// static attribute, after evaluating object unless that has no effect.
+std::string CEmitter::attributeSlot(ClassNode* klass, const std::string& name, const std::string& object, bool pure) {
+    if (!klass->getAttribute(name)->isStatic()) {
+        return object + "->a_" + name;
+    }
+    if (pure) {
+        return staticName(klass, name);
+    }
+    return "(*((void)" + object + ", &" + staticName(klass, name) + "))";
+}
+
+std::string CEmitter::cString(const std::string& value) {
+    std::string result;
+    for (char c : value) {
+        if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?') {
+            result += c;
+        } else {
+            // always three digits, so a following digit can't extend the escape
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", static_cast<unsigned char>(c));
+            result += escape;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+#ifndef LEGBA_CODEGEN_CEMITTER_H
+#define LEGBA_CODEGEN_CEMITTER_H
+
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ASTNode/ASTNode.h"
+#include "Codegen/TypeInference.h"
+
+// Translates the parsed AST into a C99 translation unit that includes the runtime
+// header from CRuntime.h. Slots with a static type become plain C variables and
+// their arithmetic plain C arithmetic, classes become structs with one member per
+// attribute. Everything else stays NaN-boxed and goes through the runtime, with
+// the same semantics and error messages as the interpreter.
+class CEmitter {
+public:
+    explicit CEmitter(ScopeNode* rootScope) : rootScope(rootScope), types(rootScope) {}
+
+    void emit(const std::string& sourceName, std::ostream& os);
+
+private:
+    // Declarations
+    void declareClass(ClassNode* klass, std::ostream& os);
+    void function(Node* function, std::ostream& os);
+    void constructor(ClassNode* klass, std::ostream& os);
+    void script(std::ostream& os);
+    void body(Node* body, std::ostream& os);
+    std::string signature(Node* function);
+    void dynamicMethod(const std::string& name, size_t argc, std::ostream& os);
+    void dynamicAttribute(const std::string& name, bool set, std::ostream& os);
+
+    // Statements
+    void statement(Node* node, std::ostream& os);
+    void block(Node* node, std::ostream& os);
+    void returnStatement(UnaryNode* node, std::ostream& os);
+    void line(std::ostream& os, const std::string& code) const;
+
+    // Expressions, each is generated in the C type of its inferred static type
+    std::string expression(Node* node);
+    std::string literal(Node* node);
+    std::string unary(UnaryNode* node);
+    std::string binary(BinaryNode* node);
+    std::string arithmetic(BinaryNode* node);
+    std::string comparison(BinaryNode* node);
+    std::string logical(BinaryNode* node);
+    std::string attribute(BinaryNode* node);
+    std::string assignment(BinaryNode* node, bool statement);
+    std::string array(ArrayNode* node);
+    std::string map(MapNode* node);
+    std::string call(FunctionCallNode* node);
+    std::string methodCall(MethodCallNode* node);
+    std::vector<std::string> operands(std::vector<Node*> const& nodes, std::string& prefix);
+    std::string arguments(std::vector<std::string> const& codes, std::vector<Node*> const& nodes, Node* function, size_t first);
+    std::string failure(std::vector<std::string> const& codes, const std::string& prefix, const std::string& message);
+
+    // Types
+    std::string convert(const std::string& code, StaticType from, StaticType to);
+    std::string box(const std::string& code, StaticType type);
+    std::string truthy(const std::string& code, StaticType type);
+    std::string temporary(StaticType type);
+    std::string stringConstant(const std::string& value);
+    static std::string cType(StaticType type);
+    static std::string zero(StaticType type);
+
+    // Names
+    static std::string variableName(VariableDeclarationNode* var);
+    static std::string functionName(Node* function);
+    static std::string className(ClassNode* klass) { return "C_" + klass->getName(); }
+    static std::string classInfo(ClassNode* klass) { return "class_" + klass->getName(); }
+    static std::string staticName(ClassNode* klass, const std::string& name) { return "s_" + klass->getName() + '_' + name; }
+    static std::string attributeSlot(ClassNode* klass, const std::string& name, const std::string& object, bool pure);
+    static std::string cString(const std::string& value);
+
+private:
+    ScopeNode* rootScope;
+    TypeInference types;
+
+    int depth = 0;
+    Node* currentFunction = nullptr;
+    std::vector<std::string> temporaries;
+
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, size_t> stringIndices;
+    std::set<std::pair<std::string, size_t>> dynamicMethods;
+    std::set<std::string> dynamicGetters;
+    std::set<std::string> dynamicSetters;
+};
+
+#endif
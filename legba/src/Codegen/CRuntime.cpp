@@ -0,0 +1,1318 @@
+#include "CRuntime.h"
+
+const char* const C_RUNTIME_HEADER_NAME = "legba_runtime.h";
+
+// Kept in several literals, some compilers limit the length of a single one.
+static const char* const RUNTIME_VALUES = R"RUNTIME(/* Runtime support for C generated by legba --emit-c. */
+#ifndef LEGBA_RUNTIME_H
+#define LEGBA_RUNTIME_H
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LG_NORETURN __attribute__((noreturn))
+#define LG_UNUSED __attribute__((unused))
+#else
+#define LG_NORETURN
+#define LG_UNUSED
+#endif
+
+#define LG_API static inline LG_UNUSED
+
+/* Values are NaN-boxed exactly like in the interpreter: doubles as they are, other
+   types in the payload of a negative quiet NaN with the tag in the upper 16 bits. */
+typedef uint64_t lg_value;
+
+#define LG_TAG_SHIFT 48
+#define LG_PAYLOAD_MASK ((UINT64_C(1) << LG_TAG_SHIFT) - 1)
+#define LG_TAG_INT UINT64_C(0xFFF9)
+#define LG_TAG_BOOL UINT64_C(0xFFFA)
+#define LG_TAG_CHAR UINT64_C(0xFFFB)
+#define LG_TAG_NIL UINT64_C(0xFFFC)
+#define LG_TAG_OBJECT UINT64_C(0xFFFD)
+#define LG_CANONICAL_NAN UINT64_C(0x7FF8000000000000)
+#define LG_NIL (LG_TAG_NIL << LG_TAG_SHIFT)
+
+typedef struct lg_class {
+    const char* name;
+    int id;
+} lg_class;
+
+typedef enum lg_object_type {
+    LG_STRING, LG_INSTANCE, LG_ARRAY, LG_MAP
+} lg_object_type;
+
+typedef struct lg_object {
+    lg_object_type type;
+    const lg_class* klass;
+} lg_object;
+
+/* Long concatenations are ropes of their two parts until lg_flat copies them
+   together, chars is NULL until then. */
+typedef struct lg_string {
+    lg_object header;
+    size_t length;
+    char* chars;
+    struct lg_string* left;
+    struct lg_string* right;
+    uint32_t hash;      /* 0 until lg_string_hash computed it */
+} lg_string;
+
+#define LG_ROPE_MIN_LENGTH 64
+
+/* Arrays keep their elements after the struct like ArrayObject: int32_t, double or
+   boxed values by element type. */
+typedef enum lg_element_type {
+    LG_INTS, LG_DOUBLES, LG_VALUES
+} lg_element_type;
+
+typedef struct lg_array {
+    lg_object header;
+    lg_element_type element_type;
+    uint32_t length;
+} lg_array;
+
+#define LG_MAX_ARRAY_LENGTH ((UINT32_MAX - 16) / 8) /* the interpreter's limit */
+
+/* Swiss table like MapObject: a control byte per slot, then the key and value of
+   every slot. capacity is 0 until the first entry. */
+typedef struct lg_map {
+    lg_object header;
+    uint32_t count;
+    uint32_t tombstones;
+    uint32_t capacity;
+    uint8_t* controls;
+    lg_value* entries;
+} lg_map;
+
+#define LG_EMPTY 0x80
+#define LG_DELETED 0xFE
+#define LG_GROUP 16
+#define LG_MAX_MAP_CAPACITY (UINT32_C(1) << 27)
+#define LG_MAX_MAP_COUNT (LG_MAX_MAP_CAPACITY / 8 * 7)
+
+enum lg_op {
+    LG_ADD, LG_SUB, LG_MUL, LG_DIV, LG_MOD, LG_LT, LG_LE, LG_GT, LG_GE
+};
+
+static const char* const lg_op_names[] = {
+    "PLUS", "MINUS", "STAR", "SLASH", "MODULO", "LESS", "LESS_EQUAL", "GREATER", "GREATER_EQUAL"
+};
+
+LG_API LG_NORETURN void lg_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputs("-- Runtime error: ", stdout);
+    vprintf(format, args);
+    fputc('\n', stdout);
+    va_end(args);
+    exit(1);
+}
+
+/* lg_error usable in expressions of any boxed type */
+#define lg_fail(...) (lg_error(__VA_ARGS__), LG_NIL)
+
+LG_API uint64_t lg_tag(lg_value v) { return v >> LG_TAG_SHIFT; }
+LG_API bool lg_is_double(lg_value v) { return lg_tag(v) < LG_TAG_INT; }
+LG_API bool lg_is_int(lg_value v) { return lg_tag(v) == LG_TAG_INT; }
+LG_API bool lg_is_bool(lg_value v) { return lg_tag(v) == LG_TAG_BOOL; }
+LG_API bool lg_is_char(lg_value v) { return lg_tag(v) == LG_TAG_CHAR; }
+LG_API bool lg_is_nil(lg_value v) { return lg_tag(v) == LG_TAG_NIL; }
+LG_API bool lg_is_object(lg_value v) { return lg_tag(v) == LG_TAG_OBJECT; }
+
+LG_API lg_value lg_int(int32_t i) { return (LG_TAG_INT << LG_TAG_SHIFT) | (uint32_t)i; }
+LG_API lg_value lg_bool(bool b) { return (LG_TAG_BOOL << LG_TAG_SHIFT) | (b ? 1u : 0u); }
+LG_API lg_value lg_char(char c) { return (LG_TAG_CHAR << LG_TAG_SHIFT) | (uint8_t)c; }
+LG_API lg_value lg_object_value(void* object) { return (LG_TAG_OBJECT << LG_TAG_SHIFT) | (uint64_t)(uintptr_t)object; }
+LG_API lg_value lg_double(double d) {
+    lg_value v;
+    if (d != d) {
+        return LG_CANONICAL_NAN;
+    }
+    memcpy(&v, &d, sizeof(double));
+    return v;
+}
+
+LG_API int32_t lg_as_int(lg_value v) { return (int32_t)(uint32_t)v; }
+LG_API bool lg_as_bool(lg_value v) { return (v & 1) != 0; }
+LG_API char lg_as_char(lg_value v) { return (char)(v & 0xFF); }
+LG_API lg_object* lg_as_object(lg_value v) { return (lg_object*)(uintptr_t)(v & LG_PAYLOAD_MASK); }
+LG_API double lg_as_double(lg_value v) {
+    double d;
+    memcpy(&d, &v, sizeof(double));
+    return d;
+}
+
+LG_API bool lg_is_string(lg_value v) { return lg_is_object(v) && lg_as_object(v)->type == LG_STRING; }
+LG_API bool lg_is_instance(lg_value v) { return lg_is_object(v) && lg_as_object(v)->type == LG_INSTANCE; }
+LG_API bool lg_is_array(lg_value v) { return lg_is_object(v) && lg_as_object(v)->type == LG_ARRAY; }
+LG_API bool lg_is_map(lg_value v) { return lg_is_object(v) && lg_as_object(v)->type == LG_MAP; }
+LG_API bool lg_is_integral(lg_value v) { return lg_is_int(v) || lg_is_char(v); }
+LG_API int32_t lg_to_int(lg_value v) { return lg_is_int(v) ? lg_as_int(v) : (int32_t)lg_as_char(v); }
+LG_API double lg_to_number(lg_value v) {
+    return lg_is_int(v) ? (double)lg_as_int(v) : lg_is_char(v) ? (double)lg_as_char(v) : lg_as_double(v);
+}
+
+LG_API const char* lg_type_name(lg_value v) {
+    switch (lg_tag(v)) {
+        case LG_TAG_INT: return "int";
+        case LG_TAG_BOOL: return "bool";
+        case LG_TAG_CHAR: return "char";
+        case LG_TAG_NIL: return "void";
+        case LG_TAG_OBJECT:
+            switch (lg_as_object(v)->type) {
+                case LG_STRING: return "string";
+                case LG_ARRAY: {
+                    lg_element_type type = ((lg_array*)lg_as_object(v))->element_type;
+                    return type == LG_INTS ? "int[]" : type == LG_DOUBLES ? "double[]" : "array";
+                }
+                case LG_MAP: return "map";
+                default: return lg_as_object(v)->klass->name;
+            }
+        default: return "double";
+    }
+}
+
+LG_API lg_array* lg_as_array(lg_value v) { return (lg_array*)lg_as_object(v); }
+LG_API lg_map* lg_as_map(lg_value v) { return (lg_map*)lg_as_object(v); }
+LG_API int32_t* lg_ints(lg_array* array) { return (int32_t*)(array + 1); }
+LG_API double* lg_doubles(lg_array* array) { return (double*)(array + 1); }
+LG_API lg_value* lg_values(lg_array* array) { return (lg_value*)(array + 1); }
+
+LG_API lg_value lg_array_element(lg_array* array, uint32_t index) {
+    switch (array->element_type) {
+        case LG_INTS: return lg_int(lg_ints(array)[index]);
+        case LG_DOUBLES: return lg_double(lg_doubles(array)[index]);
+        default: return lg_values(array)[index];
+    }
+}
+)RUNTIME";
+
+static const char* const RUNTIME_OPERATIONS = R"RUNTIME(
+/* Strings */
+
+LG_API lg_string* lg_alloc_string(size_t length) {
+    lg_string* string = (lg_string*)malloc(sizeof(lg_string) + length + 1);
+    if (string == NULL) {
+        lg_error("Out of memory.");
+    }
+    string->header.type = LG_STRING;
+    string->header.klass = NULL;
+    string->length = length;
+    string->chars = (char*)(string + 1);
+    string->chars[length] = '\0';
+    string->left = string->right = NULL;
+    string->hash = 0;
+    return string;
+}
+
+LG_API lg_value lg_new_string(const char* chars, size_t length) {
+    lg_string* string = lg_alloc_string(length);
+    memcpy(string->chars, chars, length);
+    return lg_object_value(string);
+}
+
+LG_API lg_string* lg_as_string(lg_value v) { return (lg_string*)lg_as_object(v); }
+
+/* Fills the characters of a rope from the back, appending builds ropes leaning left
+   which keeps the pending parts few. */
+LG_API lg_string* lg_flat(lg_string* string) {
+    if (string->chars != NULL) {
+        return string;
+    }
+    char* chars = (char*)malloc(string->length + 1);
+    size_t capacity = 16, count = 0;
+    lg_string** pending = (lg_string**)malloc(capacity * sizeof(lg_string*));
+    if (chars == NULL || pending == NULL) {
+        lg_error("Out of memory.");
+    }
+    char* out = chars + string->length;
+    *out = '\0';
+    pending[count++] = string;
+    while (count > 0) {
+        lg_string* part = pending[--count];
+        if (part->chars == NULL) {
+            if (count + 2 > capacity) {
+                capacity *= 2;
+                pending = (lg_string**)realloc(pending, capacity * sizeof(lg_string*));
+                if (pending == NULL) {
+                    lg_error("Out of memory.");
+                }
+            }
+            pending[count++] = part->left;
+            pending[count++] = part->right;
+            continue;
+        }
+        out -= part->length;
+        memcpy(out, part->chars, part->length);
+    }
+    free(pending);
+    string->chars = chars;
+    string->left = string->right = NULL;
+    return string;
+}
+
+typedef struct lg_buffer {
+    char* chars;
+    size_t length;
+    size_t capacity;
+} lg_buffer;
+
+LG_API void lg_append(lg_buffer* buffer, const char* chars, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = (buffer->length + length) * 2;
+        buffer->chars = (char*)realloc(buffer->chars, buffer->capacity);
+        if (buffer->chars == NULL) {
+            lg_error("Out of memory.");
+        }
+    }
+    memcpy(buffer->chars + buffer->length, chars, length);
+    buffer->length += length;
+}
+
+LG_API lg_string* lg_to_string(lg_value v);
+
+/* Arrays of values and maps may contain themselves, nesting is cut off. */
+LG_API void lg_append_value(lg_buffer* out, lg_value v, int depth) {
+    if (lg_is_array(v)) {
+        lg_array* array = lg_as_array(v);
+        if (depth == 8) {
+            lg_append(out, "[...]", 5);
+            return;
+        }
+        lg_append(out, "[", 1);
+        for (uint32_t i = 0; i < array->length; i++) {
+            if (i > 0) {
+                lg_append(out, ", ", 2);
+            }
+            lg_append_value(out, lg_array_element(array, i), depth + 1);
+        }
+        lg_append(out, "]", 1);
+    } else if (lg_is_map(v)) {
+        lg_map* map = lg_as_map(v);
+        bool first = true;
+        if (depth == 8) {
+            lg_append(out, "{...}", 5);
+            return;
+        }
+        lg_append(out, "{", 1);
+        for (uint32_t slot = 0; slot < map->capacity; slot++) {
+            if (map->controls[slot] < LG_EMPTY) {
+                if (!first) {
+                    lg_append(out, ", ", 2);
+                }
+                first = false;
+                lg_append_value(out, map->entries[2 * slot], depth + 1);
+                lg_append(out, ": ", 2);
+                lg_append_value(out, map->entries[2 * slot + 1], depth + 1);
+            }
+        }
+        lg_append(out, "}", 1);
+    } else {
+        lg_string* string = lg_to_string(v);
+        lg_append(out, string->chars, string->length);
+    }
+}
+
+/* Same formatting as Value::toString of the interpreter */
+LG_API lg_string* lg_to_string(lg_value v) {
+    char buffer[64];
+    int length;
+    switch (lg_tag(v)) {
+        case LG_TAG_INT: length = snprintf(buffer, sizeof(buffer), "%d", lg_as_int(v)); break;
+        case LG_TAG_BOOL: length = snprintf(buffer, sizeof(buffer), "%s", lg_as_bool(v) ? "true" : "false"); break;
+        case LG_TAG_CHAR: length = snprintf(buffer, sizeof(buffer), "%c", lg_as_char(v)); break;
+        case LG_TAG_NIL: length = snprintf(buffer, sizeof(buffer), "nil"); break;
+        case LG_TAG_OBJECT:
+            if (lg_as_object(v)->type == LG_STRING) {
+                return lg_flat(lg_as_string(v));
+            }
+            if (lg_as_object(v)->type == LG_ARRAY || lg_as_object(v)->type == LG_MAP) {
+                lg_buffer out = { NULL, 0, 0 };
+                lg_append_value(&out, v, 0);
+                lg_string* string = lg_as_string(lg_new_string(out.chars, out.length));
+                free(out.chars);
+                return string;
+            }
+            length = snprintf(buffer, sizeof(buffer), "<%.48s instance>", lg_as_object(v)->klass->name);
+            break;
+        default: length = snprintf(buffer, sizeof(buffer), "%g", lg_as_double(v)); break;
+    }
+    return lg_as_string(lg_new_string(buffer, (size_t)length));
+}
+
+LG_API lg_value lg_concat(lg_value a, lg_value b) {
+    lg_string* x = lg_is_string(a) ? lg_as_string(a) : lg_to_string(a);
+    lg_string* y = lg_is_string(b) ? lg_as_string(b) : lg_to_string(b);
+    if (x->length + y->length >= LG_ROPE_MIN_LENGTH) {
+        lg_string* rope = (lg_string*)malloc(sizeof(lg_string));
+        if (rope == NULL) {
+            lg_error("Out of memory.");
+        }
+        rope->header.type = LG_STRING;
+        rope->header.klass = NULL;
+        rope->length = x->length + y->length;
+        rope->chars = NULL;
+        rope->left = x;
+        rope->right = y;
+        rope->hash = 0;
+        return lg_object_value(rope);
+    }
+    lg_string* result = lg_alloc_string(x->length + y->length);
+    memcpy(result->chars, lg_flat(x)->chars, x->length);
+    memcpy(result->chars + x->length, lg_flat(y)->chars, y->length);
+    return lg_object_value(result);
+}
+
+/* Operators, statically typed ints wrap around like in the interpreter */
+
+LG_API int32_t lg_add_ii(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+LG_API int32_t lg_sub_ii(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+LG_API int32_t lg_mul_ii(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+LG_API int32_t lg_neg_i(int32_t a) { return (int32_t)(0u - (uint32_t)a); }
+LG_API int32_t lg_div_ii(int32_t a, int32_t b) {
+    if (b == 0) lg_error("Division by zero.");
+    if (b == -1) return lg_neg_i(a);
+    return a / b;
+}
+LG_API int32_t lg_mod_ii(int32_t a, int32_t b) {
+    if (b == 0) lg_error("Division by zero.");
+    if (b == -1) return 0;
+    return a % b;
+}
+
+LG_API bool lg_truthy(lg_value v) {
+    switch (lg_tag(v)) {
+        case LG_TAG_BOOL: return lg_as_bool(v);
+        case LG_TAG_NIL: return false;
+        case LG_TAG_INT: return lg_as_int(v) != 0;
+        case LG_TAG_CHAR: return lg_as_char(v) != '\0';
+        case LG_TAG_OBJECT: return true;
+        default: return lg_as_double(v) != 0.0;
+    }
+}
+
+LG_API bool lg_equal(lg_value a, lg_value b) {
+    bool numbers = (lg_is_int(a) || lg_is_double(a)) && (lg_is_int(b) || lg_is_double(b));
+    if (numbers) {
+        if (lg_is_int(a) && lg_is_int(b)) {
+            return lg_as_int(a) == lg_as_int(b);
+        }
+        return lg_to_number(a) == lg_to_number(b);
+    }
+    if (lg_is_string(a) && lg_is_string(b)) {
+        lg_string* x = lg_as_string(a);
+        lg_string* y = lg_as_string(b);
+        return x == y || (x->length == y->length && memcmp(lg_flat(x)->chars, lg_flat(y)->chars, x->length) == 0);
+    }
+    return a == b;
+}
+
+LG_API LG_NORETURN void lg_operand_error(int op, lg_value a, lg_value b) {
+    lg_error("Unsupported operand types for %s: %s and %s.", lg_op_names[op], lg_type_name(a), lg_type_name(b));
+}
+
+LG_API lg_value lg_arith(int op, lg_value a, lg_value b) {
+    if (op == LG_ADD && (lg_is_string(a) || lg_is_string(b))) {
+        return lg_concat(a, b);
+    }
+    if (lg_is_integral(a) && lg_is_integral(b)) {
+        int32_t x = lg_to_int(a), y = lg_to_int(b);
+        switch (op) {
+            case LG_ADD: return lg_int(lg_add_ii(x, y));
+            case LG_SUB: return lg_int(lg_sub_ii(x, y));
+            case LG_MUL: return lg_int(lg_mul_ii(x, y));
+            case LG_DIV: return lg_int(lg_div_ii(x, y));
+            case LG_MOD: return lg_int(lg_mod_ii(x, y));
+        }
+    }
+    bool numbers = (lg_is_int(a) || lg_is_double(a) || lg_is_char(a)) && (lg_is_int(b) || lg_is_double(b) || lg_is_char(b));
+    if (numbers) {
+        double x = lg_to_number(a), y = lg_to_number(b);
+        switch (op) {
+            case LG_ADD: return lg_double(x + y);
+            case LG_SUB: return lg_double(x - y);
+            case LG_MUL: return lg_double(x * y);
+            case LG_DIV: return lg_double(x / y);
+            case LG_MOD: return lg_double(fmod(x, y));
+        }
+    }
+    lg_operand_error(op, a, b);
+}
+
+LG_API bool lg_compare(int op, lg_value a, lg_value b) {
+    double x, y;
+    if (lg_is_integral(a) && lg_is_integral(b)) {
+        x = lg_to_int(a);
+        y = lg_to_int(b);
+    } else if ((lg_is_int(a) || lg_is_double(a)) && (lg_is_int(b) || lg_is_double(b))) {
+        x = lg_to_number(a);
+        y = lg_to_number(b);
+    } else if (lg_is_string(a) && lg_is_string(b)) {
+        lg_string* s = lg_flat(lg_as_string(a));
+        lg_string* t = lg_flat(lg_as_string(b));
+        size_t length = s->length < t->length ? s->length : t->length;
+        int c = memcmp(s->chars, t->chars, length);
+        x = c != 0 ? c : (s->length > t->length) - (s->length < t->length);
+        y = 0;
+    } else {
+        lg_operand_error(op, a, b);
+    }
+    switch (op) {
+        case LG_LT: return x < y;
+        case LG_LE: return x <= y;
+        case LG_GT: return x > y;
+        default: return x >= y;
+    }
+}
+
+LG_API lg_value lg_negate(lg_value v) {
+    if (lg_is_int(v)) return lg_int(lg_neg_i(lg_as_int(v)));
+    if (lg_is_double(v)) return lg_double(-lg_as_double(v));
+    lg_error("Unsupported operand type for MINUS: %s.", lg_type_name(v));
+}
+)RUNTIME";
+
+static const char* const RUNTIME_OBJECTS = R"RUNTIME(
+/* Conversions of dynamic values into statically typed slots */
+
+LG_API int32_t lg_expect_int(lg_value v) {
+    if (!lg_is_int(v)) lg_error("Expected a value of type int, got %s.", lg_type_name(v));
+    return lg_as_int(v);
+}
+
+LG_API double lg_expect_double(lg_value v) {
+    if (!lg_is_double(v)) lg_error("Expected a value of type double, got %s.", lg_type_name(v));
+    return lg_as_double(v);
+}
+
+LG_API bool lg_expect_bool(lg_value v) {
+    if (!lg_is_bool(v)) lg_error("Expected a value of type bool, got %s.", lg_type_name(v));
+    return lg_as_bool(v);
+}
+
+LG_API void* lg_expect_instance(lg_value v, const lg_class* klass) {
+    if (!lg_is_instance(v) || lg_as_object(v)->klass != klass) {
+        lg_error("Expected a value of type %s, got %s.", klass->name, lg_type_name(v));
+    }
+    return lg_as_object(v);
+}
+
+/* Instances */
+
+LG_API void* lg_new_instance(size_t size, const lg_class* klass) {
+    lg_object* object = (lg_object*)calloc(1, size);
+    if (object == NULL) {
+        lg_error("Out of memory.");
+    }
+    object->type = LG_INSTANCE;
+    object->klass = klass;
+    return object;
+}
+
+/* class of a receiver whose type is only known at runtime, what names the access */
+LG_API const lg_class* lg_class_of(lg_value v, const char* what) {
+    if (!lg_is_instance(v)) {
+        lg_error("Only instances have %s, got %s.", what, lg_type_name(v));
+    }
+    return lg_as_object(v)->klass;
+}
+)RUNTIME";
+
+static const char* const RUNTIME_MAPS = R"RUNTIME(
+/* Maps, the Swiss tables of Map.cpp with a portable group match. Hashes, probe
+   sequences and growth are the same, every key lands in the same slot and maps
+   iterate in the interpreter's order. Strings are not interned here, keys are
+   compared by their contents. */
+
+LG_API uint32_t lg_string_hash(lg_string* string) {
+    if (string->hash == 0) {
+        uint32_t h = 2166136261u;
+        const char* chars = lg_flat(string)->chars;
+        for (size_t i = 0; i < string->length; i++) {
+            h = (h ^ (uint8_t)chars[i]) * 16777619u;
+        }
+        string->hash = h != 0 ? h : 1;
+    }
+    return string->hash;
+}
+
+/* integral doubles become ints, 1 and 1.0 are one key */
+LG_API lg_value lg_map_key(lg_value key) {
+    if (lg_is_double(key)) {
+        double d = lg_as_double(key);
+        if (d >= INT32_MIN && d <= INT32_MAX && trunc(d) == d) {
+            return lg_int((int32_t)d);
+        }
+        return key;
+    }
+    if (!lg_is_int(key) && !lg_is_char(key) && !lg_is_bool(key) && !lg_is_string(key)) {
+        lg_error("Map keys must be numbers, strings, chars or bools, got %s.", lg_type_name(key));
+    }
+    return key;
+}
+
+LG_API uint64_t lg_map_hash(lg_value key) {
+    uint64_t h = lg_is_string(key) ? lg_string_hash(lg_as_string(key)) : key;
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    h ^= h >> 33;
+    return h;
+}
+
+LG_API bool lg_map_key_equal(lg_value stored, lg_value key) {
+    if (stored == key) {
+        return true;
+    }
+    if (!lg_is_string(stored) || !lg_is_string(key)) {
+        return false;
+    }
+    lg_string* x = lg_as_string(stored);
+    lg_string* y = lg_as_string(key);
+    return lg_string_hash(x) == lg_string_hash(y) && x->length == y->length
+        && memcmp(lg_flat(x)->chars, lg_flat(y)->chars, x->length) == 0;
+}
+
+/* bit i set if slot i of the group has control byte c */
+LG_API uint32_t lg_match(const uint8_t* group, uint8_t c) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < LG_GROUP; i++) {
+        bits |= (uint32_t)(group[i] == c) << i;
+    }
+    return bits;
+}
+
+LG_API uint32_t lg_match_free(const uint8_t* group) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < LG_GROUP; i++) {
+        bits |= (uint32_t)(group[i] >> 7) << i;
+    }
+    return bits;
+}
+
+LG_API uint32_t lg_lowest_bit(uint32_t bits) {
+    uint32_t i = 0;
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/* slot of the key, -1 if absent */
+LG_API int64_t lg_map_find_slot(lg_map* map, lg_value key, uint64_t h) {
+    uint32_t mask = map->capacity / LG_GROUP - 1;
+    uint32_t group = (uint32_t)(h >> 7) & mask;
+    for (uint32_t step = 1; ; step++) {
+        const uint8_t* controls = map->controls + group * LG_GROUP;
+        for (uint32_t bits = lg_match(controls, (uint8_t)(h & 0x7F)); bits != 0; bits &= bits - 1) {
+            uint32_t slot = group * LG_GROUP + lg_lowest_bit(bits);
+            if (lg_map_key_equal(map->entries[2 * slot], key)) {
+                return slot;
+            }
+        }
+        if (lg_match(controls, LG_EMPTY) != 0) {
+            return -1;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+LG_API uint32_t lg_map_free_slot(uint8_t* controls, uint32_t capacity, uint64_t h) {
+    uint32_t mask = capacity / LG_GROUP - 1;
+    uint32_t group = (uint32_t)(h >> 7) & mask;
+    for (uint32_t step = 1; ; step++) {
+        uint32_t bits = lg_match_free(controls + group * LG_GROUP);
+        if (bits != 0) {
+            return group * LG_GROUP + lg_lowest_bit(bits);
+        }
+        group = (group + step) & mask;
+    }
+}
+
+/* moves the entries into a new table with room for count of them */
+LG_API void lg_map_rehash(lg_map* map, size_t count) {
+    uint32_t capacity = LG_GROUP;
+    while (count > capacity / 8 * 7) {
+        if (capacity == LG_MAX_MAP_CAPACITY) {
+            lg_error("Maps hold at most %u entries.", (unsigned)LG_MAX_MAP_COUNT);
+        }
+        capacity *= 2;
+    }
+    uint8_t* controls = (uint8_t*)malloc(capacity + (size_t)capacity * 2 * sizeof(lg_value));
+    if (controls == NULL) {
+        lg_error("Out of memory.");
+    }
+    lg_value* entries = (lg_value*)(controls + capacity);
+    memset(controls, LG_EMPTY, capacity);
+    for (uint32_t slot = 0; slot < map->capacity; slot++) {
+        if (map->controls[slot] < LG_EMPTY) {
+            uint64_t h = lg_map_hash(map->entries[2 * slot]);
+            uint32_t to = lg_map_free_slot(controls, capacity, h);
+            controls[to] = (uint8_t)(h & 0x7F);
+            entries[2 * to] = map->entries[2 * slot];
+            entries[2 * to + 1] = map->entries[2 * slot + 1];
+        }
+    }
+    free(map->controls);
+    map->controls = controls;
+    map->entries = entries;
+    map->capacity = capacity;
+    map->tombstones = 0;
+}
+
+LG_API lg_value lg_new_map(size_t expected) {
+    lg_map* map = (lg_map*)malloc(sizeof(lg_map));
+    if (map == NULL) {
+        lg_error("Out of memory.");
+    }
+    map->header.type = LG_MAP;
+    map->header.klass = NULL;
+    map->count = map->tombstones = map->capacity = 0;
+    map->controls = NULL;
+    map->entries = NULL;
+    if (expected > 0) {
+        lg_map_rehash(map, expected);
+    }
+    return lg_object_value(map);
+}
+
+/* the value stored for key, NULL if there is none */
+LG_API lg_value* lg_map_find(lg_map* map, lg_value key) {
+    key = lg_map_key(key);
+    if (map->count == 0) {
+        return NULL;
+    }
+    int64_t slot = lg_map_find_slot(map, key, lg_map_hash(key));
+    return slot >= 0 ? &map->entries[2 * slot + 1] : NULL;
+}
+
+LG_API lg_value lg_map_get(lg_map* map, lg_value key) {
+    lg_value* value = lg_map_find(map, key);
+    return value != NULL ? *value : LG_NIL;
+}
+
+LG_API void lg_map_set(lg_map* map, lg_value key, lg_value value) {
+    key = lg_map_key(key);
+    lg_value* stored = lg_map_find(map, key);
+    if (stored != NULL) {
+        *stored = value;
+        return;
+    }
+    if (map->capacity == 0 || map->count + map->tombstones + 1 > map->capacity / 8 * 7) {
+        lg_map_rehash(map, (size_t)map->count + 1);
+    }
+    uint64_t h = lg_map_hash(key);
+    uint32_t slot = lg_map_free_slot(map->controls, map->capacity, h);
+    if (map->controls[slot] == LG_DELETED) {
+        map->tombstones--;
+    }
+    map->controls[slot] = (uint8_t)(h & 0x7F);
+    map->entries[2 * slot] = key;
+    map->entries[2 * slot + 1] = value;
+    map->count++;
+}
+
+/* a group with an empty slot was never full, removing from it leaves no tombstone */
+LG_API bool lg_map_remove(lg_map* map, lg_value key) {
+    key = lg_map_key(key);
+    if (map->count == 0) {
+        return false;
+    }
+    int64_t slot = lg_map_find_slot(map, key, lg_map_hash(key));
+    if (slot < 0) {
+        return false;
+    }
+    if (lg_match(map->controls + slot / LG_GROUP * LG_GROUP, LG_EMPTY) != 0) {
+        map->controls[slot] = LG_EMPTY;
+    } else {
+        map->controls[slot] = LG_DELETED;
+        map->tombstones++;
+    }
+    map->entries[2 * slot] = map->entries[2 * slot + 1] = LG_NIL;
+    map->count--;
+    return true;
+}
+
+/* count keys and values alternating, later keys replace earlier ones */
+LG_API lg_value lg_map_literal(int count, ...) {
+    lg_value map = lg_new_map((size_t)count);
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        lg_value key = va_arg(args, lg_value);
+        lg_value value = va_arg(args, lg_value);
+        lg_map_set(lg_as_map(map), key, value);
+    }
+    va_end(args);
+    return map;
+}
+)RUNTIME";
+
+static const char* const RUNTIME_ARRAYS = R"RUNTIME(
+/* Arrays, same element types, conversions and errors as Operations.cpp */
+
+LG_API lg_value lg_new_array(lg_element_type type, int64_t length) {
+    if (length < 0 || (uint64_t)length > LG_MAX_ARRAY_LENGTH) {
+        lg_error("Array length out of range: %lld.", (long long)length);
+    }
+    size_t size = type == LG_INTS ? sizeof(int32_t) : sizeof(lg_value);
+    lg_array* array = (lg_array*)malloc(sizeof(lg_array) + (size_t)length * size);
+    if (array == NULL) {
+        lg_error("Out of memory.");
+    }
+    array->header.type = LG_ARRAY;
+    array->header.klass = NULL;
+    array->element_type = type;
+    array->length = (uint32_t)length;
+    if (type == LG_VALUES) {
+        for (uint32_t i = 0; i < array->length; i++) {
+            lg_values(array)[i] = LG_NIL;
+        }
+    } else {
+        memset(array + 1, 0, (size_t)length * size);
+    }
+    return lg_object_value(array);
+}
+
+LG_API void lg_set_element(lg_array* array, uint32_t index, lg_value value) {
+    switch (array->element_type) {
+        case LG_INTS:
+            if (!lg_is_int(value)) lg_error("Can't store a %s in an int[].", lg_type_name(value));
+            lg_ints(array)[index] = lg_as_int(value);
+            break;
+        case LG_DOUBLES:
+            if (!lg_is_int(value) && !lg_is_double(value)) lg_error("Can't store a %s in a double[].", lg_type_name(value));
+            lg_doubles(array)[index] = lg_to_number(value);
+            break;
+        default:
+            lg_values(array)[index] = value;
+            break;
+    }
+}
+
+/* count boxed values, declared is an element type or -1 for the narrowest one that
+   holds them all */
+LG_API lg_value lg_array_literal(int declared, int count, ...) {
+    lg_value values[255];
+    bool ints = count > 0, numbers = count > 0;
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        values[i] = va_arg(args, lg_value);
+        ints = ints && lg_is_int(values[i]);
+        numbers = numbers && (lg_is_int(values[i]) || lg_is_double(values[i]));
+    }
+    va_end(args);
+
+    lg_element_type type = declared >= 0 ? (lg_element_type)declared : ints ? LG_INTS : numbers ? LG_DOUBLES : LG_VALUES;
+    lg_value result = lg_new_array(type, count);
+    for (int i = 0; i < count; i++) {
+        lg_set_element(lg_as_array(result), (uint32_t)i, values[i]);
+    }
+    return result;
+}
+
+LG_API uint32_t lg_checked_index(lg_value array, lg_value index) {
+    if (!lg_is_array(array)) lg_error("Only arrays and maps can be indexed, got %s.", lg_type_name(array));
+    if (!lg_is_int(index)) lg_error("Array index must be an int, got %s.", lg_type_name(index));
+    uint32_t length = lg_as_array(array)->length;
+    if (lg_as_int(index) < 0 || (uint32_t)lg_as_int(index) >= length) {
+        lg_error("Array index %d out of range for length %u.", lg_as_int(index), length);
+    }
+    return (uint32_t)lg_as_int(index);
+}
+
+LG_API lg_value lg_index_get(lg_value array, lg_value index) {
+    if (lg_is_map(array)) {
+        return lg_map_get(lg_as_map(array), index);
+    }
+    uint32_t i = lg_checked_index(array, index);
+    return lg_array_element(lg_as_array(array), i);
+}
+
+LG_API lg_value lg_index_set(lg_value array, lg_value index, lg_value value) {
+    if (lg_is_map(array)) {
+        lg_map_set(lg_as_map(array), index, value);
+        return value;
+    }
+    uint32_t i = lg_checked_index(array, index);
+    lg_set_element(lg_as_array(array), i, value);
+    return value;
+}
+
+/* Double sums add up eight interleaved lanes combined in a fixed order, the same
+   order as the kernels of the interpreter, so both print the same digits. */
+LG_API double lg_combine_lanes(const double* lanes) {
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+LG_API double lg_sum_doubles(const double* a, size_t n) {
+    double lanes[8] = { 0 };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (size_t l = 0; l < 8; l++) {
+            lanes[l] += a[i + l];
+        }
+    }
+    double sum = lg_combine_lanes(lanes);
+    for (; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+LG_API double lg_dot_doubles(const double* a, const double* b, size_t n) {
+    double lanes[8] = { 0 };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (size_t l = 0; l < 8; l++) {
+            lanes[l] += a[i + l] * b[i + l];
+        }
+    }
+    double sum = lg_combine_lanes(lanes);
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+/* the elements of an int[] or double[] as doubles, ints are converted into a new
+   buffer the caller frees */
+LG_API const double* lg_as_doubles(lg_array* array) {
+    if (array->element_type == LG_DOUBLES) {
+        return lg_doubles(array);
+    }
+    double* doubles = (double*)malloc((array->length + 1) * sizeof(double));
+    if (doubles == NULL) {
+        lg_error("Out of memory.");
+    }
+    for (uint32_t i = 0; i < array->length; i++) {
+        doubles[i] = lg_ints(array)[i];
+    }
+    return doubles;
+}
+)RUNTIME";
+
+static const char* const RUNTIME_BUILTINS = R"RUNTIME(
+/* Builtins, same signatures, checks and results as in Builtins.cpp */
+
+LG_API void lg_check_number(const char* name, int index, lg_value v) {
+    if (!lg_is_double(v) && !lg_is_int(v)) lg_error("'%s' expects a number as argument %d, got %s.", name, index, lg_type_name(v));
+}
+
+LG_API void lg_check_int(const char* name, int index, lg_value v) {
+    if (!lg_is_int(v)) lg_error("'%s' expects an int as argument %d, got %s.", name, index, lg_type_name(v));
+}
+
+LG_API void lg_check_string(const char* name, int index, lg_value v) {
+    if (!lg_is_string(v)) lg_error("'%s' expects a string as argument %d, got %s.", name, index, lg_type_name(v));
+}
+
+LG_API void lg_check_array(const char* name, int index, lg_value v) {
+    if (!lg_is_array(v)) lg_error("'%s' expects an array as argument %d, got %s.", name, index, lg_type_name(v));
+}
+
+LG_API lg_value lg_builtin_print(lg_value v) {
+    lg_string* string = lg_to_string(v);
+    fwrite(string->chars, 1, string->length, stdout);
+    fputc('\n', stdout);
+    return LG_NIL;
+}
+
+LG_API lg_value lg_builtin_str(lg_value v) {
+    return lg_is_string(v) ? v : lg_object_value(lg_to_string(v));
+}
+
+LG_API lg_value lg_builtin_fixed(lg_value v, lg_value digits) {
+    lg_check_number("fixed", 1, v);
+    lg_check_int("fixed", 2, digits);
+    if (lg_as_int(digits) < 0 || lg_as_int(digits) > 20) {
+        lg_error("'fixed' takes 0 to 20 digits, got %d.", lg_as_int(digits));
+    }
+    int length = snprintf(NULL, 0, "%.*f", (int)lg_as_int(digits), lg_to_number(v));
+    lg_string* string = lg_alloc_string((size_t)length);
+    snprintf(string->chars, (size_t)length + 1, "%.*f", (int)lg_as_int(digits), lg_to_number(v));
+    return lg_object_value(string);
+}
+
+/* whole string only: no blanks, no '+' and no hex */
+LG_API lg_value lg_builtin_number(lg_value v) {
+    lg_check_string("number", 1, v);
+    lg_string* string = lg_flat(lg_as_string(v));
+    const char* chars = string->chars;
+    size_t length = string->length;
+    if (length == 0 || chars[0] == '+' || isspace((unsigned char)chars[0]) || memchr(chars, 'x', length) || memchr(chars, 'X', length)) {
+        return LG_NIL;
+    }
+
+    size_t i = chars[0] == '-' ? 1 : 0;
+    int64_t integer = 0;
+    bool integral = i < length;
+    for (; i < length && integral; i++) {
+        integral = chars[i] >= '0' && chars[i] <= '9' && integer <= INT32_MAX;
+        integer = integer * 10 + (chars[i] - '0');
+    }
+    if (integral) {
+        integer = chars[0] == '-' ? -integer : integer;
+        if (integer >= INT32_MIN && integer <= INT32_MAX) {
+            return lg_int((int32_t)integer);
+        }
+    }
+
+    char* end;
+    errno = 0;
+    double d = strtod(chars, &end);
+    if (end != chars + length || errno == ERANGE) {
+        return LG_NIL;
+    }
+    return lg_double(d);
+}
+
+LG_API lg_value lg_builtin_len(lg_value v) {
+    if (lg_is_array(v)) {
+        return lg_int((int32_t)lg_as_array(v)->length);
+    }
+    if (lg_is_map(v)) {
+        return lg_int((int32_t)lg_as_map(v)->count);
+    }
+    if (!lg_is_string(v)) lg_error("'len' expects a string, an array or a map as argument 1, got %s.", lg_type_name(v));
+    return lg_int((int32_t)lg_as_string(v)->length);
+}
+
+LG_API lg_value lg_builtin_int(lg_value v) {
+    lg_check_number("int", 1, v);
+    if (lg_is_int(v)) {
+        return v;
+    }
+    double d = trunc(lg_as_double(v));
+    if (d != d) {
+        return lg_int(0);
+    }
+    return lg_int(d < INT32_MIN ? INT32_MIN : d > INT32_MAX ? INT32_MAX : (int32_t)d);
+}
+
+LG_API lg_value lg_builtin_sqrt(lg_value v) { lg_check_number("sqrt", 1, v); return lg_double(sqrt(lg_to_number(v))); }
+LG_API lg_value lg_builtin_floor(lg_value v) { lg_check_number("floor", 1, v); return lg_double(floor(lg_to_number(v))); }
+LG_API lg_value lg_builtin_ceil(lg_value v) { lg_check_number("ceil", 1, v); return lg_double(ceil(lg_to_number(v))); }
+LG_API lg_value lg_builtin_sin(lg_value v) { lg_check_number("sin", 1, v); return lg_double(sin(lg_to_number(v))); }
+LG_API lg_value lg_builtin_cos(lg_value v) { lg_check_number("cos", 1, v); return lg_double(cos(lg_to_number(v))); }
+
+LG_API lg_value lg_builtin_pow(lg_value a, lg_value b) {
+    lg_check_number("pow", 1, a);
+    lg_check_number("pow", 2, b);
+    return lg_double(pow(lg_to_number(a), lg_to_number(b)));
+}
+
+LG_API lg_value lg_builtin_abs(lg_value v) {
+    lg_check_number("abs", 1, v);
+    if (lg_is_int(v)) {
+        return lg_as_int(v) < 0 ? lg_int(lg_neg_i(lg_as_int(v))) : v;
+    }
+    return lg_double(fabs(lg_as_double(v)));
+}
+
+LG_API lg_value lg_builtin_min(lg_value a, lg_value b) {
+    lg_check_number("min", 1, a);
+    lg_check_number("min", 2, b);
+    if (lg_is_int(a) && lg_is_int(b)) {
+        return lg_as_int(a) < lg_as_int(b) ? a : b;
+    }
+    return lg_double(fmin(lg_to_number(a), lg_to_number(b)));
+}
+
+LG_API lg_value lg_builtin_max(lg_value a, lg_value b) {
+    lg_check_number("max", 1, a);
+    lg_check_number("max", 2, b);
+    if (lg_is_int(a) && lg_is_int(b)) {
+        return lg_as_int(a) > lg_as_int(b) ? a : b;
+    }
+    return lg_double(fmax(lg_to_number(a), lg_to_number(b)));
+}
+
+LG_API lg_value lg_builtin_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return lg_double((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+/* the translation runs on one thread */
+LG_API lg_value lg_builtin_threads(void) { return lg_int(1); }
+
+LG_API lg_value lg_builtin_ints(lg_value n) { lg_check_int("ints", 1, n); return lg_new_array(LG_INTS, lg_as_int(n)); }
+LG_API lg_value lg_builtin_doubles(lg_value n) { lg_check_int("doubles", 1, n); return lg_new_array(LG_DOUBLES, lg_as_int(n)); }
+LG_API lg_value lg_builtin_array(lg_value n) { lg_check_int("array", 1, n); return lg_new_array(LG_VALUES, lg_as_int(n)); }
+
+LG_API lg_array* lg_typed_array(const char* name, int index, lg_value v) {
+    lg_check_array(name, index, v);
+    if (lg_as_array(v)->element_type == LG_VALUES) {
+        lg_error("'%s' expects an int[] or double[] as argument %d, got array.", name, index);
+    }
+    return lg_as_array(v);
+}
+
+LG_API void lg_check_lengths(const char* name, lg_array* a, lg_array* b) {
+    if (a->length != b->length) lg_error("'%s' expects arrays of the same length, got %u and %u.", name, a->length, b->length);
+}
+
+LG_API lg_value lg_builtin_sum(lg_value v) {
+    lg_array* a = lg_typed_array("sum", 1, v);
+    if (a->element_type == LG_DOUBLES) {
+        return lg_double(lg_sum_doubles(lg_doubles(a), a->length));
+    }
+    int32_t sum = 0;
+    for (uint32_t i = 0; i < a->length; i++) {
+        sum = lg_add_ii(sum, lg_ints(a)[i]);
+    }
+    return lg_int(sum);
+}
+
+LG_API lg_value lg_builtin_dot(lg_value x, lg_value y) {
+    lg_array* a = lg_typed_array("dot", 1, x);
+    lg_array* b = lg_typed_array("dot", 2, y);
+    lg_check_lengths("dot", a, b);
+    if (a->element_type == LG_INTS && b->element_type == LG_INTS) {
+        int32_t sum = 0;
+        for (uint32_t i = 0; i < a->length; i++) {
+            sum = lg_add_ii(sum, lg_mul_ii(lg_ints(a)[i], lg_ints(b)[i]));
+        }
+        return lg_int(sum);
+    }
+    const double* p = lg_as_doubles(a);
+    const double* q = lg_as_doubles(b);
+    double sum = lg_dot_doubles(p, q, a->length);
+    if (p != lg_doubles(a)) free((void*)p);
+    if (q != lg_doubles(b)) free((void*)q);
+    return lg_double(sum);
+}
+
+LG_API lg_value lg_builtin_fill(lg_value v, lg_value value) {
+    lg_check_array("fill", 1, v);
+    lg_array* array = lg_as_array(v);
+    for (uint32_t i = 0; i < array->length; i++) {
+        lg_set_element(array, i, value);
+    }
+    return LG_NIL;
+}
+
+LG_API lg_value lg_builtin_copy(lg_value x, lg_value y) {
+    lg_check_array("copy", 1, x);
+    lg_check_array("copy", 2, y);
+    lg_array* dst = lg_as_array(x);
+    lg_array* src = lg_as_array(y);
+    if (src->length > dst->length) {
+        lg_error("'copy' can't copy %u elements into an array of length %u.", src->length, dst->length);
+    }
+    if (dst->element_type == src->element_type) {
+        memmove(dst + 1, src + 1, src->length * (src->element_type == LG_INTS ? sizeof(int32_t) : sizeof(lg_value)));
+        return LG_NIL;
+    }
+    for (uint32_t i = 0; i < src->length; i++) {
+        lg_set_element(dst, i, lg_array_element(src, i));
+    }
+    return LG_NIL;
+}
+
+LG_API lg_value lg_builtin_equal(lg_value x, lg_value y) {
+    lg_check_array("equal", 1, x);
+    lg_check_array("equal", 2, y);
+    lg_array* a = lg_as_array(x);
+    lg_array* b = lg_as_array(y);
+    if (a->length != b->length) {
+        return lg_bool(false);
+    }
+    for (uint32_t i = 0; i < a->length; i++) {
+        if (!lg_equal(lg_array_element(a, i), lg_array_element(b, i))) {
+            return lg_bool(false);
+        }
+    }
+    return lg_bool(true);
+}
+
+/* a[i] op b[i], or a[i] op b for a number b, ints only if both operands hold ints */
+LG_API lg_value lg_elementwise(int op, const char* name, lg_value x, lg_value y) {
+    lg_array* a = lg_typed_array(name, 1, x);
+    bool scalar = !lg_is_array(y);
+    if (scalar && !lg_is_int(y) && !lg_is_double(y)) {
+        lg_error("'%s' expects an array or a number as argument 2, got %s.", name, lg_type_name(y));
+    }
+    lg_array* b = scalar ? NULL : lg_typed_array(name, 2, y);
+    if (!scalar) {
+        lg_check_lengths(name, a, b);
+    }
+    bool ints = a->element_type == LG_INTS && (scalar ? lg_is_int(y) : b->element_type == LG_INTS);
+
+    lg_array* out = lg_as_array(lg_new_array(ints ? LG_INTS : LG_DOUBLES, a->length));
+    for (uint32_t i = 0; i < a->length; i++) {
+        if (ints) {
+            int32_t p = lg_ints(a)[i], q = scalar ? lg_as_int(y) : lg_ints(b)[i];
+            lg_ints(out)[i] = op == LG_ADD ? lg_add_ii(p, q) : op == LG_SUB ? lg_sub_ii(p, q) : lg_mul_ii(p, q);
+        } else {
+            double p = a->element_type == LG_INTS ? lg_ints(a)[i] : lg_doubles(a)[i];
+            double q = scalar ? lg_to_number(y) : b->element_type == LG_INTS ? lg_ints(b)[i] : lg_doubles(b)[i];
+            lg_doubles(out)[i] = op == LG_ADD ? p + q : op == LG_SUB ? p - q : p * q;
+        }
+    }
+    return lg_object_value(out);
+}
+
+LG_API lg_value lg_builtin_add(lg_value a, lg_value b) { lg_check_array("add", 1, a); return lg_elementwise(LG_ADD, "add", a, b); }
+LG_API lg_value lg_builtin_sub(lg_value a, lg_value b) { lg_check_array("sub", 1, a); return lg_elementwise(LG_SUB, "sub", a, b); }
+LG_API lg_value lg_builtin_mul(lg_value a, lg_value b) { lg_check_array("mul", 1, a); return lg_elementwise(LG_MUL, "mul", a, b); }
+
+LG_API void lg_check_map(const char* name, int index, lg_value v) {
+    if (!lg_is_map(v)) lg_error("'%s' expects a map as argument %d, got %s.", name, index, lg_type_name(v));
+}
+
+LG_API lg_value lg_builtin_has(lg_value m, lg_value key) { lg_check_map("has", 1, m); return lg_bool(lg_map_find(lg_as_map(m), key) != NULL); }
+LG_API lg_value lg_builtin_remove(lg_value m, lg_value key) { lg_check_map("remove", 1, m); return lg_bool(lg_map_remove(lg_as_map(m), key)); }
+
+/* keys or values in slot order, typed like an array literal of them */
+LG_API lg_value lg_map_entries(lg_map* map, int which) {
+    bool ints = map->count > 0, numbers = map->count > 0;
+    for (uint32_t slot = 0; slot < map->capacity; slot++) {
+        if (map->controls[slot] < LG_EMPTY) {
+            lg_value v = map->entries[2 * slot + which];
+            ints = ints && lg_is_int(v);
+            numbers = numbers && (lg_is_int(v) || lg_is_double(v));
+        }
+    }
+    lg_value result = lg_new_array(ints ? LG_INTS : numbers ? LG_DOUBLES : LG_VALUES, map->count);
+    uint32_t i = 0;
+    for (uint32_t slot = 0; slot < map->capacity; slot++) {
+        if (map->controls[slot] < LG_EMPTY) {
+            lg_set_element(lg_as_array(result), i++, map->entries[2 * slot + which]);
+        }
+    }
+    return result;
+}
+
+LG_API lg_value lg_builtin_keys(lg_value m) { lg_check_map("keys", 1, m); return lg_map_entries(lg_as_map(m), 0); }
+LG_API lg_value lg_builtin_values(lg_value m) { lg_check_map("values", 1, m); return lg_map_entries(lg_as_map(m), 1); }
+)RUNTIME";
+
+static const char* const RUNTIME_IO = R"RUNTIME(
+/* no coroutines in the translation, sleeping and I/O block */
+LG_API lg_value lg_builtin_sleep(lg_value seconds) {
+    lg_check_number("sleep", 1, seconds);
+    double s = fmax(lg_to_number(seconds), 0.0);
+    struct timespec wait = { (time_t)s, (long)((s - floor(s)) * 1e9) };
+    while (nanosleep(&wait, &wait) != 0 && errno == EINTR) {}
+    return LG_NIL;
+}
+
+LG_API lg_value lg_builtin_yield(void) { return LG_NIL; }
+
+LG_API lg_value lg_builtin_open(lg_value path, lg_value mode) {
+    lg_check_string("open", 1, path);
+    lg_check_string("open", 2, mode);
+    const char* m = lg_flat(lg_as_string(mode))->chars;
+    int flags = strcmp(m, "r") == 0 ? O_RDONLY : strcmp(m, "w") == 0 ? O_WRONLY | O_CREAT | O_TRUNC
+        : strcmp(m, "a") == 0 ? O_WRONLY | O_CREAT | O_APPEND : -1;
+    if (flags < 0) lg_error("'open' expects the mode \"r\", \"w\" or \"a\", got \"%s\".", m);
+    const char* p = lg_flat(lg_as_string(path))->chars;
+    int fd = open(p, flags, 0644);
+    if (fd < 0) lg_error("Failed to open '%s'.", p);
+    return lg_int(fd);
+}
+
+/* what was read from a descriptor past the lines returned */
+typedef struct {
+    char* data;
+    size_t start, length, capacity;
+    bool eof;
+} lg_input;
+
+static lg_input* lg_inputs = NULL;
+static int lg_input_count = 0;
+
+LG_API lg_input* lg_input_of(int fd) {
+    if (fd < 0) lg_error("Bad file %d.", fd);
+    if (fd >= lg_input_count) {
+        int count = fd + 16;
+        lg_inputs = (lg_input*)realloc(lg_inputs, count * sizeof(lg_input));
+        if (lg_inputs == NULL) lg_error("Out of memory.");
+        memset(lg_inputs + lg_input_count, 0, (count - lg_input_count) * sizeof(lg_input));
+        lg_input_count = count;
+    }
+    return &lg_inputs[fd];
+}
+
+LG_API lg_value lg_builtin_close(lg_value file) {
+    lg_check_int("close", 1, file);
+    lg_input* input = lg_input_of(lg_as_int(file));
+    free(input->data);
+    memset(input, 0, sizeof(lg_input));
+    if (close(lg_as_int(file)) != 0) lg_error("Failed to close file %d.", lg_as_int(file));
+    return LG_NIL;
+}
+
+LG_API lg_value lg_builtin_readLine(lg_value file) {
+    lg_check_int("readLine", 1, file);
+    int fd = lg_as_int(file);
+    lg_input* input = lg_input_of(fd);
+    for (;;) {
+        char* newline = (char*)memchr(input->data + input->start, '\n', input->length - input->start);
+        if (newline != NULL) {
+            lg_value line = lg_new_string(input->data + input->start, (size_t)(newline - input->data) - input->start);
+            input->start = (size_t)(newline - input->data) + 1;
+            return line;
+        }
+        if (input->eof) {
+            if (input->start == input->length) return LG_NIL;
+            lg_value rest = lg_new_string(input->data + input->start, input->length - input->start);
+            input->start = input->length;
+            return rest;
+        }
+        memmove(input->data, input->data + input->start, input->length - input->start);
+        input->length -= input->start;
+        input->start = 0;
+        if (input->capacity - input->length < 4096) {
+            input->capacity = input->capacity * 2 + 65536;
+            input->data = (char*)realloc(input->data, input->capacity);
+            if (input->data == NULL) lg_error("Out of memory.");
+        }
+        ssize_t count = read(fd, input->data + input->length, input->capacity - input->length);
+        if (count < 0 && errno != EINTR) lg_error("Failed to read from file %d.", fd);
+        if (count == 0) input->eof = true;
+        if (count > 0) input->length += (size_t)count;
+    }
+}
+
+LG_API lg_value lg_builtin_write(lg_value file, lg_value v) {
+    lg_check_int("write", 1, file);
+    int fd = lg_as_int(file);
+    if (fd == 1) fflush(stdout);
+    lg_string* string = lg_to_string(v);
+    size_t written = 0;
+    while (written < string->length) {
+        ssize_t count = write(fd, string->chars + written, string->length - written);
+        if (count < 0 && errno != EINTR) lg_error("Failed to write to file %d.", fd);
+        if (count > 0) written += (size_t)count;
+    }
+    return LG_NIL;
+}
+
+#endif
+)RUNTIME";
+
+std::string cRuntimeHeader() {
+    return std::string(RUNTIME_VALUES) + RUNTIME_OPERATIONS + RUNTIME_OBJECTS + RUNTIME_MAPS + RUNTIME_ARRAYS + RUNTIME_BUILTINS + RUNTIME_IO;
+}
@@ -0,0 +1,10 @@
+#ifndef LEGBA_CODEGEN_CRUNTIME_H
+#define LEGBA_CODEGEN_CRUNTIME_H
+
+#include <string>
+
+// File name and contents of the runtime header that C emitted by CEmitter includes.
+extern const char* const C_RUNTIME_HEADER_NAME;
+std::string cRuntimeHeader();
+
+#endif
@@ -0,0 +1,642 @@
+#include "TypeInference.h"
+
+#include <algorithm>
+
+#include "Runtime/Builtins.h"
+
+StaticType joinTypes(StaticType a, StaticType b) {
+    if (a.is(TypeKind::UNKNOWN)) return b;
+    if (b.is(TypeKind::UNKNOWN)) return a;
+    if (a == b) return a;
+    return StaticType::of(TypeKind::DYNAMIC);
+}
+
+static bool isArithmetic(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::MODULO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Result type of a builtin's signature. Strings are dynamic like everywhere else.
+static StaticType builtinType(ValueTypeEnum result) {
+    switch (result) {
+        case ValueTypeEnum::VT_INTEGER: return StaticType::of(TypeKind::INT);
+        case ValueTypeEnum::VT_DOUBLE: return StaticType::of(TypeKind::DOUBLE);
+        case ValueTypeEnum::VT_BOOL: return StaticType::of(TypeKind::BOOL);
+        case ValueTypeEnum::VT_VOID: return StaticType::of(TypeKind::NIL);
+        default: return StaticType::of(TypeKind::DYNAMIC);
+    }
+}
+
+static bool containsCall(Node* node) {
+    bool found = false;
+    visitTree(node, [&](Node* n) {
+        found |= n->getType() == NodeType::CALL || n->getType() == NodeType::METHOD_CALL;
+    });
+    return found;
+}
+
+TypeInference::TypeInference(ScopeNode* rootScope) : rootScope(rootScope) {
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::FUNCTION) {
+            functions.push_back(static_cast<FunctionNode*>(stmt));
+            declared.insert(stmt);
+        } else if (stmt->getType() == NodeType::CLASS) {
+            classes.push_back(static_cast<ClassNode*>(stmt));
+            declared.insert(stmt);
+        }
+    }
+}
+
+void TypeInference::run() {
+    for (auto klass : classes) {
+        collectInitializedAttributes(klass);
+        for (auto method : getMethods(klass)) {
+            variables[getThis(method)] = StaticType::instance(klass);
+            collectGlobalReads(method->getBody());
+        }
+    }
+    for (auto func : functions) {
+        collectGlobalReads(func->getBody());
+    }
+    markUnsafeGlobals();
+
+    // what other modules pass in and store is never seen here
+    if (open) {
+        for (auto func : functions) {
+            for (auto param : getParams(func)) {
+                variables[param] = StaticType::of(TypeKind::DYNAMIC);
+            }
+        }
+        for (auto klass : classes) {
+            for (auto method : getMethods(klass)) {
+                for (auto param : getParams(method)) {
+                    variables[param] = StaticType::of(TypeKind::DYNAMIC);
+                }
+            }
+            for (auto const& [name, _] : klass->getAttributes()) {
+                attributes[klass][name] = StaticType::of(TypeKind::DYNAMIC);
+            }
+        }
+    }
+
+    // every slot only ever moves up the lattice, which bounds the number of passes
+    do {
+        changed = false;
+
+        currentFunction = nullptr;
+        visitStatement(rootScope);
+
+        for (auto func : functions) {
+            currentFunction = func;
+            visitStatement(func->getBody());
+            if (canComplete(func->getBody())) {
+                flowInto(returns[func], StaticType::of(TypeKind::NIL));
+            }
+        }
+        for (auto klass : classes) {
+            for (auto method : getMethods(klass)) {
+                currentFunction = method;
+                visitStatement(method->getBody());
+                if (canComplete(method->getBody())) {
+                    flowInto(returns[method], StaticType::of(TypeKind::NIL));
+                }
+            }
+        }
+    } while (changed);
+
+    currentFunction = nullptr;
+    finished = true;
+}
+
+// Queries
+
+StaticType TypeInference::settled(StaticType type) const {
+    // nothing flowed into the slot, whatever shows up at runtime stays boxed
+    if (finished && type.is(TypeKind::UNKNOWN)) {
+        return StaticType::of(TypeKind::DYNAMIC);
+    }
+    return type;
+}
+
+StaticType TypeInference::variableType(VariableDeclarationNode* var) {
+    auto it = variables.find(var);
+    return settled(it != variables.end() ? it->second : StaticType());
+}
+
+StaticType TypeInference::returnType(Node* function) {
+    auto it = returns.find(function);
+    return settled(it != returns.end() ? it->second : StaticType());
+}
+
+StaticType TypeInference::attributeType(ClassNode* klass, const std::string& name) {
+    return settled(attributes[klass][name]);
+}
+
+bool TypeInference::declares(Node* node) const {
+    if (node->getType() == NodeType::METHOD) {
+        node = static_cast<MethodNode*>(node)->getClass();
+    }
+    return declared.contains(node);
+}
+
+std::vector<MethodNode*> TypeInference::getMethods(ClassNode* klass) const {
+    auto methods = std::vector<MethodNode*>();
+    for (auto const& [_, method] : klass->getMethods()) {
+        methods.push_back(method);
+    }
+    std::sort(methods.begin(), methods.end(), [](MethodNode* a, MethodNode* b) { return a->getName() < b->getName(); });
+    return methods;
+}
+
+std::vector<std::string> TypeInference::getAttributeNames(ClassNode* klass, bool statics) const {
+    auto names = std::vector<std::string>();
+    for (auto const& [name, attribute] : klass->getAttributes()) {
+        if (attribute->isStatic() == statics) {
+            names.push_back(name);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::vector<VariableDeclarationNode*> TypeInference::getParams(Node* function) {
+    // parameters are declared in a scope of their own around the body
+    Node* body;
+    std::vector<std::string> names;
+    if (function->getType() == NodeType::FUNCTION) {
+        body = static_cast<FunctionNode*>(function)->getBody();
+        names = static_cast<FunctionNode*>(function)->getParams();
+    } else {
+        body = static_cast<MethodNode*>(function)->getBody();
+        names = static_cast<MethodNode*>(function)->getParams();
+    }
+
+    auto scope = static_cast<ScopeNode*>(body)->getEnclosing();
+    auto params = std::vector<VariableDeclarationNode*>();
+    for (auto const& name : names) {
+        params.push_back(scope->getVariable(name));
+    }
+    return params;
+}
+
+VariableDeclarationNode* TypeInference::getThis(MethodNode* method) {
+    return static_cast<ScopeNode*>(method->getBody())->getEnclosing()->getVariable("this");
+}
+
+MethodNode* TypeInference::staticTarget(MethodCallNode* call) {
+    auto receiver = typeOf(call->getReceiver());
+    if (!receiver.is(TypeKind::INSTANCE)) {
+        return nullptr;
+    }
+
+    auto method = receiver.klass->getMethod(call->getCallee());
+    if (method == nullptr || method->getParams().size() != call->getArgs().size()) {
+        return nullptr;
+    }
+    return method;
+}
+
+bool TypeInference::arityMatches(FunctionCallNode* call) {
+    size_t argc = call->getArgs().size();
+    if (call->getFunction() != nullptr) {
+        return call->getFunction()->getParams().size() == argc;
+    }
+    if (call->getInstantiatedClass() != nullptr) {
+        auto constructor = call->getInstantiatedClass()->getConstructor();
+        return constructor != nullptr ? constructor->getParams().size() == argc : argc == 0;
+    }
+    if (call->getBuiltin() != nullptr) {
+        return static_cast<size_t>(call->getBuiltin()->arity) == argc;
+    }
+    return false;
+}
+
+bool TypeInference::canComplete(Node* node) {
+    if (node == nullptr) {
+        return true;
+    }
+
+    switch (node->getType()) {
+        case NodeType::UNARY:
+            return static_cast<UnaryNode*>(node)->getOp()->getOp() != TokenType::RETURN;
+        case NodeType::SCOPE: {
+            auto statements = static_cast<ScopeNode*>(node)->getStatements();
+            return std::all_of(statements.begin(), statements.end(), canComplete);
+        }
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            return ifNode->getElseBranch() == nullptr || canComplete(ifNode->getThenBranch()) || canComplete(ifNode->getElseBranch());
+        }
+        case NodeType::WHILE: {
+            // there is no break, only a return leaves an endless loop
+            auto condition = static_cast<WhileNode*>(node)->getCondition();
+            return condition->getType() != NodeType::BOOL || !static_cast<BoolNode*>(condition)->getValue();
+        }
+        case NodeType::FOR:
+            return static_cast<ForNode*>(node)->getCondition() != nullptr;
+        default:
+            return true;
+    }
+}
+
+// Expression types
+
+StaticType TypeInference::typeOf(Node* node) {
+    switch (node->getType()) {
+        case NodeType::INTEGER: return StaticType::of(TypeKind::INT);
+        case NodeType::DOUBLE: return StaticType::of(TypeKind::DOUBLE);
+        case NodeType::BOOL: return StaticType::of(TypeKind::BOOL);
+        case NodeType::VARIABLE: return variableType(static_cast<VariableNode*>(node)->getVar());
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(node);
+            if (unary->getOp()->getOp() == TokenType::BANG) {
+                return StaticType::of(TypeKind::BOOL);
+            }
+            auto operand = typeOf(unary->getNode());
+            if (operand.is(TypeKind::UNKNOWN) || operand.isNumber()) {
+                return operand;
+            }
+            return StaticType::of(TypeKind::DYNAMIC);
+        }
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            auto op = binary->getOp()->getOp();
+            switch (op) {
+                case TokenType::EQUAL: {
+                    auto target = binary->getLeft();
+                    if (target->getType() == NodeType::VARIABLE) {
+                        return variableType(static_cast<VariableNode*>(target)->getVar());
+                    }
+                    auto attribute = static_cast<BinaryNode*>(target);
+                    if (attribute->getOp()->getOp() != TokenType::DOT) {
+                        return StaticType::of(TypeKind::DYNAMIC); // array elements and map values
+                    }
+                    return attributeSlot(typeOf(attribute->getLeft()), static_cast<IdentifierNode*>(attribute->getRight())->getName());
+                }
+                case TokenType::DOT:
+                    return attributeSlot(typeOf(binary->getLeft()), static_cast<IdentifierNode*>(binary->getRight())->getName());
+                case TokenType::AND:
+                case TokenType::OR:
+                    return joinTypes(typeOf(binary->getLeft()), typeOf(binary->getRight()));
+                case TokenType::EQUAL_EQUAL:
+                case TokenType::BANG_EQUAL:
+                case TokenType::LESS:
+                case TokenType::LESS_EQUAL:
+                case TokenType::GREATER:
+                case TokenType::GREATER_EQUAL:
+                    return StaticType::of(TypeKind::BOOL);
+                default:
+                    if (isArithmetic(op)) {
+                        return arithmeticType(op, typeOf(binary->getLeft()), typeOf(binary->getRight()));
+                    }
+                    return StaticType::of(TypeKind::DYNAMIC);
+            }
+        }
+        case NodeType::CALL: {
+            auto call = static_cast<FunctionCallNode*>(node);
+            if (!arityMatches(call)) {
+                return StaticType::of(TypeKind::DYNAMIC);
+            }
+            if (call->getFunction() != nullptr) {
+                return declares(call->getFunction()) ? returnType(call->getFunction()) : StaticType::of(TypeKind::DYNAMIC);
+            }
+            if (call->getBuiltin() != nullptr) {
+                return builtinType(call->getBuiltin()->result);
+            }
+            if (!declares(call->getInstantiatedClass())) {
+                return StaticType::of(TypeKind::DYNAMIC);
+            }
+            return StaticType::instance(call->getInstantiatedClass());
+        }
+        case NodeType::METHOD_CALL: {
+            auto call = static_cast<MethodCallNode*>(node);
+            if (typeOf(call->getReceiver()).is(TypeKind::UNKNOWN)) {
+                return StaticType();
+            }
+            auto target = staticTarget(call);
+            return target != nullptr ? returnType(target) : StaticType::of(TypeKind::DYNAMIC);
+        }
+        default:
+            return StaticType::of(TypeKind::DYNAMIC);
+    }
+}
+
+// The operator doesn't change the result: ints stay ints under all of them, division
+// and modulo included, and any double operand makes a double. Only + takes strings,
+// which are dynamic anyway.
+StaticType TypeInference::arithmeticType(TokenType, StaticType a, StaticType b) {
+    if (a.is(TypeKind::UNKNOWN) || b.is(TypeKind::UNKNOWN)) {
+        return StaticType();
+    }
+    if (a.is(TypeKind::INT) && b.is(TypeKind::INT)) {
+        return StaticType::of(TypeKind::INT);
+    }
+    if (a.isNumber() && b.isNumber()) {
+        return StaticType::of(TypeKind::DOUBLE);
+    }
+    return StaticType::of(TypeKind::DYNAMIC); // strings, chars and operand errors
+}
+
+StaticType TypeInference::attributeSlot(StaticType receiver, const std::string& name) {
+    if (receiver.is(TypeKind::UNKNOWN)) {
+        return receiver;
+    }
+    if (receiver.is(TypeKind::INSTANCE) && receiver.klass->getAttribute(name) != nullptr) {
+        return attributeType(receiver.klass, name);
+    }
+    return StaticType::of(TypeKind::DYNAMIC);
+}
+
+// Propagation
+
+void TypeInference::flowInto(StaticType& slot, StaticType type) {
+    auto joined = joinTypes(slot, type);
+    if (joined != slot) {
+        slot = joined;
+        changed = true;
+    }
+}
+
+void TypeInference::flowIntoParams(Node* function, std::vector<Node*> const& args) {
+    auto params = getParams(function);
+    for (size_t i = 0; i < params.size(); i++) {
+        flowInto(variables[params[i]], typeOf(args[i]));
+    }
+}
+
+void TypeInference::visitStatement(Node* node) {
+    switch (node->getType()) {
+        case NodeType::SCOPE:
+            for (auto stmt : static_cast<ScopeNode*>(node)->getStatements()) {
+                visitStatement(stmt);
+            }
+            break;
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            visitExpression(ifNode->getCondition());
+            visitStatement(ifNode->getThenBranch());
+            if (ifNode->getElseBranch() != nullptr) {
+                visitStatement(ifNode->getElseBranch());
+            }
+            break;
+        }
+        case NodeType::WHILE:
+            visitExpression(static_cast<WhileNode*>(node)->getCondition());
+            visitStatement(static_cast<WhileNode*>(node)->getBody());
+            break;
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            if (forNode->getInitializer() != nullptr) {
+                visitStatement(forNode->getInitializer());
+            }
+            visitExpression(forNode->getCondition());
+            visitExpression(forNode->getIncrement());
+            visitStatement(forNode->getBody());
+            break;
+        }
+        case NodeType::VARIABLE_DECL: {
+            auto decl = static_cast<VariableDeclarationNode*>(node);
+            if (decl->getInitializer() != nullptr) {
+                visitExpression(decl->getInitializer());
+                flowInto(variables[decl], typeOf(decl->getInitializer()));
+            } else {
+                flowInto(variables[decl], StaticType::of(TypeKind::NIL));
+            }
+            break;
+        }
+        case NodeType::FUNCTION:
+        case NodeType::CLASS:
+            break;
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(node);
+            if (unary->getOp()->getOp() != TokenType::RETURN) {
+                visitExpression(node);
+                break;
+            }
+            auto value = StaticType::of(TypeKind::NIL);
+            if (unary->getNode() != nullptr) {
+                visitExpression(unary->getNode());
+                value = typeOf(unary->getNode());
+            }
+            if (currentFunction != nullptr) {
+                flowInto(returns[currentFunction], value);
+            }
+            break;
+        }
+        default:
+            visitExpression(node);
+            break;
+    }
+}
+
+void TypeInference::visitExpression(Node* node) {
+    if (node == nullptr) {
+        return;
+    }
+
+    switch (node->getType()) {
+        case NodeType::UNARY:
+            visitExpression(static_cast<UnaryNode*>(node)->getNode());
+            break;
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            switch (binary->getOp()->getOp()) {
+                case TokenType::EQUAL: visitAssignment(binary); break;
+                case TokenType::DOT: visitExpression(binary->getLeft()); break;
+                default:
+                    visitExpression(binary->getLeft());
+                    visitExpression(binary->getRight());
+                    break;
+            }
+            break;
+        }
+        case NodeType::CALL: visitCall(static_cast<FunctionCallNode*>(node)); break;
+        case NodeType::SPAWN: visitCall(static_cast<SpawnNode*>(node)->getCall()); break;
+        case NodeType::METHOD_CALL: visitMethodCall(static_cast<MethodCallNode*>(node)); break;
+        case NodeType::ARRAY:
+            for (auto element : static_cast<ArrayNode*>(node)->getElements()) {
+                visitExpression(element);
+            }
+            break;
+        case NodeType::MAP:
+            for (auto entry : static_cast<MapNode*>(node)->getEntries()) {
+                visitExpression(entry);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void TypeInference::visitCall(FunctionCallNode* node) {
+    for (auto arg : node->getArgs()) {
+        visitExpression(arg);
+    }
+
+    if (!arityMatches(node) || node->getBuiltin() != nullptr) {
+        return;
+    }
+    if (!declares(node->getFunction() != nullptr ? static_cast<Node*>(node->getFunction()) : node->getInstantiatedClass())) {
+        return;
+    }
+    if (node->getFunction() != nullptr) {
+        flowIntoParams(node->getFunction(), node->getArgs());
+    } else if (auto constructor = node->getInstantiatedClass()->getConstructor()) {
+        flowIntoParams(constructor, node->getArgs());
+    }
+}
+
+void TypeInference::visitMethodCall(MethodCallNode* node) {
+    visitExpression(node->getReceiver());
+    for (auto arg : node->getArgs()) {
+        visitExpression(arg);
+    }
+
+    auto receiver = typeOf(node->getReceiver());
+    if (receiver.is(TypeKind::UNKNOWN)) {
+        return;
+    }
+    if (receiver.is(TypeKind::INSTANCE)) {
+        if (auto target = staticTarget(node)) {
+            flowIntoParams(target, node->getArgs());
+        }
+        return;
+    }
+
+    // dispatched at runtime, any class with a matching method may receive the call
+    for (auto klass : classes) {
+        auto method = klass->getMethod(node->getCallee());
+        if (method != nullptr && method->getParams().size() == node->getArgs().size()) {
+            flowIntoParams(method, node->getArgs());
+        }
+    }
+}
+
+void TypeInference::visitAssignment(BinaryNode* node) {
+    auto target = node->getLeft();
+    visitExpression(node->getRight());
+    auto value = typeOf(node->getRight());
+
+    if (target->getType() == NodeType::VARIABLE) {
+        flowInto(variables[static_cast<VariableNode*>(target)->getVar()], value);
+        return;
+    }
+
+    auto attribute = static_cast<BinaryNode*>(target);
+    if (attribute->getOp()->getOp() != TokenType::DOT) {
+        // array elements and map values are always boxed, nothing to flow into
+        visitExpression(attribute->getLeft());
+        visitExpression(attribute->getRight());
+        return;
+    }
+    auto name = static_cast<IdentifierNode*>(attribute->getRight())->getName();
+    visitExpression(attribute->getLeft());
+    auto receiver = typeOf(attribute->getLeft());
+    if (receiver.is(TypeKind::UNKNOWN)) {
+        return;
+    }
+    if (receiver.is(TypeKind::INSTANCE)) {
+        if (receiver.klass->getAttribute(name) != nullptr) {
+            flowInto(attributes[receiver.klass][name], value);
+        }
+        return;
+    }
+
+    for (auto klass : classes) {
+        if (klass->getAttribute(name) != nullptr) {
+            flowInto(attributes[klass][name], value);
+        }
+    }
+}
+
+// Initialization
+
+void TypeInference::collectInitializedAttributes(ClassNode* klass) {
+    auto& slots = attributes[klass];
+    for (auto const& name : getAttributeNames(klass)) {
+        slots[name] = StaticType::of(TypeKind::NIL);
+    }
+    // static attributes are nil until assigned, whatever the constructor does
+    for (auto const& name : getAttributeNames(klass, true)) {
+        slots[name] = StaticType::of(TypeKind::NIL);
+    }
+
+    auto constructor = klass->getConstructor();
+    if (constructor == nullptr) {
+        return;
+    }
+
+    // Attributes assigned by the leading 'this.x = ...' statements of the constructor
+    // can't be observed as nil, as long as nothing before them calls out or reads 'this'.
+    auto self = getThis(constructor);
+    for (auto stmt : static_cast<ScopeNode*>(constructor->getBody())->getStatements()) {
+        if (stmt->getType() != NodeType::BINARY || static_cast<BinaryNode*>(stmt)->getOp()->getOp() != TokenType::EQUAL) {
+            break;
+        }
+
+        auto assignment = static_cast<BinaryNode*>(stmt);
+        auto target = assignment->getLeft();
+        if (target->getType() != NodeType::BINARY || static_cast<BinaryNode*>(target)->getOp()->getOp() != TokenType::DOT) {
+            break;
+        }
+        auto attribute = static_cast<BinaryNode*>(target);
+        if (attribute->getLeft()->getType() != NodeType::VARIABLE || static_cast<VariableNode*>(attribute->getLeft())->getVar() != self) {
+            break;
+        }
+
+        bool simple = !containsCall(assignment->getRight());
+        visitTree(assignment->getRight(), [&](Node* n) {
+            simple &= n->getType() != NodeType::VARIABLE || static_cast<VariableNode*>(n)->getVar() != self;
+        });
+        if (!simple) {
+            break;
+        }
+
+        auto name = static_cast<IdentifierNode*>(attribute->getRight())->getName();
+        if (klass->getAttribute(name) != nullptr && !klass->getAttribute(name)->isStatic()) {
+            slots[name] = StaticType();
+        }
+    }
+}
+
+void TypeInference::collectGlobalReads(Node* body) {
+    visitTree(body, [&](Node* n) {
+        if (n->getType() == NodeType::VARIABLE && static_cast<VariableNode*>(n)->getVar()->isGlobal()) {
+            globalsReadInFunctions.insert(static_cast<VariableNode*>(n)->getVar());
+        }
+    });
+}
+
+void TypeInference::markUnsafeGlobals() {
+    // A function reading a global before the script declared it sees nil. Functions
+    // only run through calls, so globals declared before the first call are safe.
+    bool called = false;
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::FUNCTION || stmt->getType() == NodeType::CLASS) {
+            continue;
+        }
+
+        called = called || containsCall(stmt);
+        if (!called) {
+            continue;
+        }
+
+        visitTree(stmt, [&](Node* n) {
+            if (n->getType() != NodeType::VARIABLE_DECL) {
+                return;
+            }
+            auto decl = static_cast<VariableDeclarationNode*>(n);
+            if (decl->isGlobal() && globalsReadInFunctions.contains(decl)) {
+                variables[decl] = StaticType::of(TypeKind::NIL);
+            }
+        });
+    }
+}
@@ -0,0 +1,182 @@
+#ifndef LEGBA_CODEGEN_TYPE_INFERENCE_H
+#define LEGBA_CODEGEN_TYPE_INFERENCE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTNode/ASTNode.h"
+
+// Static type of a variable, attribute, return value or expression. UNKNOWN is the
+// bottom of the lattice (no value seen yet), DYNAMIC the top (boxed at runtime).
+// Strings and chars are always DYNAMIC.
+enum class TypeKind {
+    UNKNOWN, NIL, INT, DOUBLE, BOOL, INSTANCE, DYNAMIC
+};
+
+struct StaticType {
+    TypeKind kind = TypeKind::UNKNOWN;
+    ClassNode* klass = nullptr; // only for INSTANCE
+
+    static StaticType of(TypeKind kind) { return { kind, nullptr }; }
+    static StaticType instance(ClassNode* klass) { return { TypeKind::INSTANCE, klass }; }
+
+    bool is(TypeKind k) const { return kind == k; }
+    bool isNumber() const { return kind == TypeKind::INT || kind == TypeKind::DOUBLE; }
+    // types that are not kept in a C value of their own
+    bool isBoxed() const { return kind == TypeKind::NIL || kind == TypeKind::DYNAMIC || kind == TypeKind::UNKNOWN; }
+
+    bool operator==(StaticType const& other) const { return kind == other.kind && klass == other.klass; }
+    bool operator!=(StaticType const& other) const { return !(*this == other); }
+};
+
+StaticType joinTypes(StaticType a, StaticType b);
+
+// Whole program type inference over the parsed AST. Type annotations are not
+// enforced by any engine, so types are derived from what flows into a slot instead:
+// literals, operators, call arguments into parameters, returns into call sites and
+// assignments into variables and attributes, iterated to a fixpoint. A slot that
+// can see two different types, or nil and something else, becomes DYNAMIC.
+class TypeInference {
+public:
+    explicit TypeInference(ScopeNode* rootScope);
+
+    // Other modules call the functions and methods of this one, see
+    // Build/ModuleBuilder.h: their parameters and the attributes of its classes take
+    // anything. Calls into those modules return anything too.
+    void setOpen(bool enabled) { open = enabled; }
+
+    void run();
+
+    StaticType typeOf(Node* expression);
+    StaticType variableType(VariableDeclarationNode* var);
+    StaticType returnType(Node* function); // FunctionNode or MethodNode
+    StaticType attributeType(ClassNode* klass, const std::string& name);
+
+    std::vector<FunctionNode*> const& getFunctions() const { return functions; }
+    std::vector<ClassNode*> const& getClasses() const { return classes; }
+    // whether a function, method or class is declared at the top level of this
+    // program rather than of a module it imports
+    bool declares(Node* node) const;
+    std::vector<MethodNode*> getMethods(ClassNode* klass) const;
+    std::vector<std::string> getAttributeNames(ClassNode* klass, bool statics = false) const;
+    static std::vector<VariableDeclarationNode*> getParams(Node* function);
+    static VariableDeclarationNode* getThis(MethodNode* method);
+
+    // Method a call on a receiver of static type INSTANCE resolves to, nullptr if
+    // the receiver is dynamic, the method is missing or the arity does not match.
+    MethodNode* staticTarget(MethodCallNode* call);
+    // Whether a function or constructor call passes the expected number of arguments.
+    static bool arityMatches(FunctionCallNode* call);
+
+    // Whether execution can run past the end of a statement.
+    static bool canComplete(Node* node);
+
+private:
+    void visitStatement(Node* node);
+    void visitExpression(Node* node);
+    void visitCall(FunctionCallNode* node);
+    void visitMethodCall(MethodCallNode* node);
+    void visitAssignment(BinaryNode* node);
+    void flowInto(StaticType& slot, StaticType type);
+    void flowIntoParams(Node* function, std::vector<Node*> const& args);
+    void collectInitializedAttributes(ClassNode* klass);
+    void collectGlobalReads(Node* node);
+    void markUnsafeGlobals();
+    StaticType settled(StaticType type) const;
+
+    StaticType arithmeticType(TokenType op, StaticType a, StaticType b);
+    StaticType attributeSlot(StaticType receiver, const std::string& name);
+
+private:
+    ScopeNode* rootScope;
+    std::vector<FunctionNode*> functions;
+    std::vector<ClassNode*> classes;
+    std::unordered_set<Node*> declared;    // the functions and classes above
+
+    std::unordered_map<VariableDeclarationNode*, StaticType> variables;
+    std::unordered_map<Node*, StaticType> returns;
+    std::unordered_map<ClassNode*, std::unordered_map<std::string, StaticType>> attributes;
+    std::unordered_set<VariableDeclarationNode*> globalsReadInFunctions;
+
+    Node* currentFunction = nullptr;
+    bool changed = false;
+    bool finished = false;
+    bool open = false;
+};
+
+// Calls visitor on node and everything below it, without descending into nested
+// function and class declarations.
+template<typename Visitor>
+void visitTree(Node* node, Visitor&& visitor) {
+    if (node == nullptr) {
+        return;
+    }
+
+    visitor(node);
+    switch (node->getType()) {
+        case NodeType::SCOPE:
+            for (auto stmt : static_cast<ScopeNode*>(node)->getStatements()) {
+                visitTree(stmt, visitor);
+            }
+            break;
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            visitTree(ifNode->getCondition(), visitor);
+            visitTree(ifNode->getThenBranch(), visitor);
+            visitTree(ifNode->getElseBranch(), visitor);
+            break;
+        }
+        case NodeType::WHILE:
+            visitTree(static_cast<WhileNode*>(node)->getCondition(), visitor);
+            visitTree(static_cast<WhileNode*>(node)->getBody(), visitor);
+            break;
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            visitTree(forNode->getInitializer(), visitor);
+            visitTree(forNode->getCondition(), visitor);
+            visitTree(forNode->getIncrement(), visitor);
+            visitTree(forNode->getBody(), visitor);
+            break;
+        }
+        case NodeType::VARIABLE_DECL:
+            visitTree(static_cast<VariableDeclarationNode*>(node)->getInitializer(), visitor);
+            break;
+        case NodeType::UNARY:
+            visitTree(static_cast<UnaryNode*>(node)->getNode(), visitor);
+            break;
+        case NodeType::BINARY:
+            visitTree(static_cast<BinaryNode*>(node)->getLeft(), visitor);
+            visitTree(static_cast<BinaryNode*>(node)->getRight(), visitor);
+            break;
+        case NodeType::CALL:
+            for (auto arg : static_cast<FunctionCallNode*>(node)->getArgs()) {
+                visitTree(arg, visitor);
+            }
+            break;
+        case NodeType::SPAWN:
+            visitTree(static_cast<SpawnNode*>(node)->getCall(), visitor);
+            break;
+        case NodeType::METHOD_CALL:
+            visitTree(static_cast<MethodCallNode*>(node)->getReceiver(), visitor);
+            for (auto arg : static_cast<MethodCallNode*>(node)->getArgs()) {
+                visitTree(arg, visitor);
+            }
+            break;
+        case NodeType::ARRAY:
+            for (auto element : static_cast<ArrayNode*>(node)->getElements()) {
+                visitTree(element, visitor);
+            }
+            break;
+        case NodeType::MAP:
+            for (auto entry : static_cast<MapNode*>(node)->getEntries()) {
+                visitTree(entry, visitor);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+#endif
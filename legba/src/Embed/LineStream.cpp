@@ -0,0 +1,234 @@
+#include "LineStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Error.h"
+#include "Runtime/Operations.h"
+
+namespace {
+
+void writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto count = ::write(fd, data.data(), static_cast<unsigned>(data.size()));
+        if (count < 0 && errno != EINTR) {
+            throw RuntimeError("Failed to write the results.");
+        }
+        data.remove_prefix(count > 0 ? static_cast<size_t>(count) : 0);
+    }
+}
+
+}
+
+// read by the main thread, run by whichever worker takes it
+struct LineStream::Chunk {
+    std::string data;
+    uint64_t line;  // the last line done
+    std::string out;
+    std::string error;
+    bool done = false;
+};
+
+LineStream::LineStream(Program const& program, std::string_view name, unsigned jobs) {
+    for (unsigned i = 0; i < std::max(jobs, 1u); i++) {
+        contexts.push_back(std::make_unique<Context>(program));
+    }
+    int index = contexts[0]->getVM().findFunction(name);
+    if (index < 0) {
+        throw RuntimeError("The script has no function named '" + std::string(name) + "'.");
+    }
+    if (program.functions[index]->paramCount != 1) {
+        throw RuntimeError("'" + std::string(name) + "' has to take one argument, the line.");
+    }
+    function = static_cast<uint32_t>(index);
+}
+
+LineStream::~LineStream() = default;
+
+void LineStream::setJitEnabled(bool enabled) {
+    for (auto& context : contexts) {
+        context->getVM().setJitEnabled(enabled);
+    }
+}
+
+// Takes whatever one read returns, so a pipe's lines go through as they come, and
+// reads on only while there is no complete line yet.
+bool LineStream::read(int input, std::string& chunk) {
+    chunk.clear();
+    chunk.swap(carry);
+    while (!ended) {
+        size_t old = chunk.size();
+        chunk.resize(old + CHUNK_SIZE);
+        auto count = ::read(input, chunk.data() + old, static_cast<unsigned>(CHUNK_SIZE));
+        if (count < 0 && errno != EINTR) {
+            throw RuntimeError("Failed to read the input.");
+        }
+        chunk.resize(old + std::max<decltype(count)>(count, 0));
+        if (count == 0) {
+            ended = true;
+            break;
+        }
+        bytes += static_cast<uint64_t>(std::max<decltype(count)>(count, 0));
+        size_t newline = std::string_view(chunk).substr(old).rfind('\n');
+        if (newline != std::string_view::npos) {
+            carry.assign(chunk, old + newline + 1);
+            chunk.resize(old + newline + 1);
+            return true;
+        }
+    }
+    return !chunk.empty();
+}
+
+void LineStream::process(Context& context, std::string_view chunk, uint64_t& line, std::string& out) {
+    try {
+        context.with([&] {
+            auto& vm = context.getVM();
+            while (!chunk.empty()) {
+                size_t end = std::min(chunk.find('\n'), chunk.size());
+                // a call copies its arguments before it allocates anything
+                Value argument = newString(chunk.substr(0, end));
+                chunk.remove_prefix(std::min(end + 1, chunk.size()));
+                Value result = vm.call(function, &argument, 1);
+                line++;
+                if (result.isNil()) {
+                    continue;
+                }
+                if (isObjectType(result, ObjectType::STRING)) {
+                    out += static_cast<StringObject*>(result.asObject())->view();
+                } else {
+                    out += result.toString();
+                }
+                out += '\n';
+            }
+            return Value::nil();
+        });
+    } catch (RuntimeError const& e) {
+        throw RuntimeError("Line " + std::to_string(line + 1) + ": " + e.what());
+    }
+}
+
+void LineStream::run(int input, int output) {
+    for (auto& context : contexts) {
+        context->run();
+    }
+    if (contexts.size() > 1) {
+        runParallel(input, output);
+        return;
+    }
+
+    std::string chunk;
+    std::string out;
+    while (read(input, chunk)) {
+        out.clear();
+        try {
+            process(*contexts[0], chunk, lines, out);
+        } catch (RuntimeError const&) {
+            writeAll(output, out);
+            throw;
+        }
+        writeAll(output, out);
+    }
+}
+
+// Up to two chunks per worker are read ahead, results are written as soon as the
+// oldest chunk is done.
+void LineStream::runParallel(int input, int output) {
+    std::mutex mutex;
+    std::condition_variable available;
+    std::condition_variable done;
+    std::deque<Chunk*> queue;
+    bool stopping = false;
+
+    auto work = [&](Context& context) {
+        while (true) {
+            Chunk* chunk;
+            {
+                std::unique_lock lock(mutex);
+                available.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                chunk = queue.front();
+                queue.pop_front();
+            }
+            try {
+                process(context, chunk->data, chunk->line, chunk->out);
+            } catch (RuntimeError const& e) {
+                chunk->error = e.what();
+            }
+            {
+                std::lock_guard lock(mutex);
+                chunk->done = true;
+            }
+            done.notify_all();
+        }
+    };
+
+    std::deque<std::unique_ptr<Chunk>> inFlight;
+    std::vector<std::thread> threads;
+    auto stop = [&] {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+
+    try {
+        for (auto& context : contexts) {
+            threads.emplace_back(work, std::ref(*context));
+        }
+
+        uint64_t nextLine = 0;
+        bool more = true;
+        while (true) {
+            while (more && inFlight.size() < 2 * contexts.size()) {
+                auto chunk = std::make_unique<Chunk>();
+                more = read(input, chunk->data);
+                if (!more) {
+                    break;
+                }
+                chunk->line = nextLine;
+                nextLine += std::count(chunk->data.begin(), chunk->data.end(), '\n') + (chunk->data.back() != '\n');
+                {
+                    std::lock_guard lock(mutex);
+                    queue.push_back(chunk.get());
+                }
+                available.notify_one();
+                inFlight.push_back(std::move(chunk));
+            }
+            if (inFlight.empty()) {
+                break;
+            }
+
+            auto& oldest = *inFlight.front();
+            {
+                std::unique_lock lock(mutex);
+                done.wait(lock, [&] { return oldest.done; });
+            }
+            writeAll(output, oldest.out);
+            lines = oldest.line;
+            if (!oldest.error.empty()) {
+                throw RuntimeError(oldest.error);
+            }
+            inFlight.pop_front();
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+}
@@ -0,0 +1,61 @@
+#ifndef LEGBA_EMBED_LINESTREAM_H
+#define LEGBA_EMBED_LINESTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "VM/Context.h"
+#include "VM/Program.h"
+
+// Streams the lines of a file through a function of a script taking one line, see
+// legba --each. Input is read in chunks of whole lines, each line becomes a string
+// of the context's nursery and the results that aren't nil are written in the order
+// of their lines, one per line, a chunk's worth at a time.
+//
+// With more than one job the chunks are run on as many threads, each with a context
+// of its own in which the top level code ran first. Globals and static attributes
+// are per context then, so a line only sees what earlier lines of the same context
+// did to them.
+class LineStream {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    // Throws RuntimeError if the program has no such function taking one argument.
+    LineStream(Program const& program, std::string_view function, unsigned jobs);
+    LineStream(LineStream const&) = delete;
+    LineStream& operator=(LineStream const&) = delete;
+    ~LineStream();
+
+    void setJitEnabled(bool enabled);
+
+    // Reads the file descriptor input to its end and writes the results to output.
+    // Throws RuntimeError naming the line of the first record that failed, the results
+    // of the lines before it are written.
+    void run(int input, int output);
+
+    uint64_t getLines() const { return lines; }
+    uint64_t getBytes() const { return bytes; }
+
+private:
+    struct Chunk;
+
+    // the next chunk of whole lines, false at the end of the input
+    bool read(int input, std::string& chunk);
+    // Appends the results of the lines of chunk to out, counting each line done in
+    // line, the number of the line before the chunk at first. Throws with the line number.
+    void process(Context& context, std::string_view chunk, uint64_t& line, std::string& out);
+    void runParallel(int input, int output);
+
+    std::vector<std::unique_ptr<Context>> contexts;
+    uint32_t function;
+    std::string carry;      // read past the last newline of the previous chunk
+    bool ended = false;
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Script.h"
+
+#include <fstream>
+#include <iterator>
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "Optimizer/DeadCodeEliminator.h"
+#include "VM/Bytecode.h"
+#include "VM/Compiler.h"
+
+std::unique_ptr<Script> Script::fromSource(std::string const& source) {
+    auto tokens = Lexer().lex(source);
+    auto parser = Parser();
+    if (!parser.parse(tokens)) {
+        throw CompileError("Failed to parse script.");
+    }
+
+    auto eliminator = DeadCodeEliminator(parser.getRootScope(), parser.getUnresolvedFunctionCalls());
+    eliminator.setKeepFunctions(true);
+    eliminator.run();
+
+    auto program = std::make_unique<Program>();
+    Compiler().compile(parser.getRootScope(), parser.getGlobalCount(), *program);
+    return std::unique_ptr<Script>(new Script(std::move(program)));
+}
+
+std::unique_ptr<Script> Script::fromFile(std::string const& path) {
+    if (isBytecodeFile(path)) {
+        auto program = std::make_unique<Program>();
+        loadBytecode(path, *program);
+        return std::unique_ptr<Script>(new Script(std::move(program)));
+    }
+
+    std::ifstream file(path, std::ios::in);
+    if (!file.is_open()) {
+        throw CompileError("Failed to open file '" + path + "'.");
+    }
+    return fromSource(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+}
+
+Script::Function Script::function(std::string_view name) {
+    int index = context->getVM().findFunction(name);
+    if (index < 0) {
+        throw RuntimeError("The script has no function named '" + std::string(name) + "'.");
+    }
+    return Function(static_cast<uint32_t>(index), program->functions[index]->paramCount);
+}
+
+void Script::arityError(Function const& function, size_t count) {
+    throw RuntimeError("Expected " + std::to_string(function.paramCount) + " arguments but got " + std::to_string(count) + '.');
+}
@@ -0,0 +1,95 @@
+#ifndef LEGBA_EMBED_SCRIPT_H
+#define LEGBA_EMBED_SCRIPT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Error.h"
+#include "Runtime/Value.h"
+#include "VM/Context.h"
+#include "VM/Program.h"
+
+// Embedding API: a script compiled once, whose functions C++ code calls by handle.
+//
+//     auto script = Script::fromFile("physics.leg");
+//     script->run();
+//     auto step = script->function("step");
+//     for (...) {
+//         double energy = script->call(step, x, 0.5).toNumber();
+//     }
+//
+// Functions are looked up by name once, a call with a handle copies its arguments
+// straight into the registers of the callee and returns its result, nothing is
+// allocated or looked up on the way. Arguments are ints, doubles, bools, chars or
+// Values that earlier calls returned; a result stays valid until the script runs
+// again, which may collect it.
+//
+// A script runs in a Context of its own, one thread at a time. Every function of
+// the script is kept and none is inlined, since the script alone doesn't tell what
+// the host will call with which arguments.
+class Script {
+public:
+    // Handle of a function of the script, valid as long as the script.
+    class Function {
+    public:
+        int getParamCount() const { return paramCount; }
+
+    private:
+        friend class Script;
+        Function(uint32_t index, int paramCount) : index(index), paramCount(paramCount) {}
+
+        uint32_t index;
+        int paramCount;
+    };
+
+    // Compiles source, the parser prints what it rejects. Throws CompileError.
+    static std::unique_ptr<Script> fromSource(std::string const& source);
+    // Compiles a script or loads a .legc file, whose unused functions are gone.
+    // Throws CompileError or BytecodeError.
+    static std::unique_ptr<Script> fromFile(std::string const& path);
+
+    Script(Script const&) = delete;
+    Script& operator=(Script const&) = delete;
+
+    // Runs the top level code, which sets the globals the functions use.
+    Value run() { return context->run(); }
+
+    // Throws RuntimeError if the script has no function with this name.
+    Function function(std::string_view name);
+
+    template <typename... Args>
+    Value call(Function const& function, Args... args);
+
+    // to turn the JIT off or print its stats
+    VM& getVM() { return context->getVM(); }
+
+private:
+    explicit Script(std::unique_ptr<Program> program)
+        : program(std::move(program)), context(std::make_unique<Context>(*this->program)) {}
+
+    static Value toValue(Value value) { return value; }
+    static Value toValue(int32_t value) { return Value::fromInt(value); }
+    static Value toValue(double value) { return Value::fromDouble(value); }
+    static Value toValue(bool value) { return Value::fromBool(value); }
+    static Value toValue(char value) { return Value::fromChar(value); }
+
+    [[noreturn]] static void arityError(Function const& function, size_t count);
+
+    std::unique_ptr<Program> program;
+    std::unique_ptr<Context> context;
+};
+
+template <typename... Args>
+Value Script::call(Function const& function, Args... args) {
+    constexpr size_t count = sizeof...(Args);
+    if (static_cast<size_t>(function.paramCount) != count) {
+        arityError(function, count);
+    }
+    // one more for calls without arguments
+    Value values[count + 1] = { toValue(args)... };
+    return context->call(function.index, values, count);
+}
+
+#endif
@@ -7,4 +7,22 @@ public:
 	ParserError() = default;
 	explicit ParserError(const char* msg) : std::runtime_error(msg) {}
     explicit ParserError(const std::string& arg) : std::runtime_error(arg) {}
-};
\ No newline at end of file
+};
+
+class RuntimeError : public std::runtime_error {
+public:
+	explicit RuntimeError(const char* msg) : std::runtime_error(msg) {}
+	explicit RuntimeError(const std::string& arg) : std::runtime_error(arg) {}
+};
+
+class CompileError : public std::runtime_error {
+public:
+	explicit CompileError(const char* msg) : std::runtime_error(msg) {}
+	explicit CompileError(const std::string& arg) : std::runtime_error(arg) {}
+};
+
+class BytecodeError : public std::runtime_error {
+public:
+	explicit BytecodeError(const char* msg) : std::runtime_error(msg) {}
+	explicit BytecodeError(const std::string& arg) : std::runtime_error(arg) {}
+};
@@ -0,0 +1,311 @@
+#include "Assembler.h"
+
+#include <cstring>
+
+static uint8_t id(Reg reg) { return static_cast<uint8_t>(reg); }
+static uint8_t id(Xmm reg) { return static_cast<uint8_t>(reg); }
+
+Assembler::Label Assembler::newLabel() {
+    labels.emplace_back();
+    return static_cast<Label>(labels.size() - 1);
+}
+
+void Assembler::bind(Label label) {
+    auto& data = labels[label];
+    data.position = static_cast<int>(code.size());
+    for (size_t fixup : data.fixups) {
+        auto rel = static_cast<int32_t>(data.position - static_cast<int>(fixup + 4));
+        std::memcpy(&code[fixup], &rel, sizeof(rel));
+    }
+    data.fixups.clear();
+}
+
+void Assembler::align(size_t alignment) {
+    while (code.size() % alignment != 0) {
+        byte(0xCC);
+    }
+}
+
+void Assembler::emitU64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        byte(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void Assembler::u32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        byte(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void Assembler::rex(bool w, uint8_t reg, uint8_t rm, bool force) {
+    uint8_t prefix = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (prefix != 0x40 || force) {
+        byte(prefix);
+    }
+}
+
+// [base + disp32], rsp and r12 as base need a SIB byte
+void Assembler::memory(uint8_t reg, Reg base, int32_t disp) {
+    modrm(2, reg, id(base));
+    if ((id(base) & 7) == 4) {
+        byte(0x24);
+    }
+    u32(static_cast<uint32_t>(disp));
+}
+
+void Assembler::rel32(Label label) {
+    auto& data = labels[label];
+    if (data.position >= 0) {
+        u32(static_cast<uint32_t>(data.position - static_cast<int>(code.size() + 4)));
+    } else {
+        data.fixups.push_back(code.size());
+        u32(0);
+    }
+}
+
+void Assembler::jmp(Label label) {
+    byte(0xE9);
+    rel32(label);
+}
+
+void Assembler::jcc(Cond cond, Label label) {
+    byte(0x0F);
+    byte(0x80 | static_cast<uint8_t>(cond));
+    rel32(label);
+}
+
+void Assembler::jmpTable(Reg table, Reg index) {
+    // rbp and r13 can't be the SIB base without a displacement, not used here
+    uint8_t prefix = 0x40 | ((id(index) & 8) ? 2 : 0) | ((id(table) & 8) ? 1 : 0);
+    if (prefix != 0x40) {
+        byte(prefix);
+    }
+    byte(0xFF);
+    modrm(0, 4, 4);
+    byte(static_cast<uint8_t>((3 << 6) | ((id(index) & 7) << 3) | (id(table) & 7)));
+}
+
+void Assembler::leaRip(Reg dst, Label label) {
+    rex(true, id(dst), 0);
+    byte(0x8D);
+    modrm(0, id(dst), 5);
+    rel32(label);
+}
+
+void Assembler::push(Reg reg) {
+    rex(false, 0, id(reg));
+    byte(0x50 | (id(reg) & 7));
+}
+
+void Assembler::pop(Reg reg) {
+    rex(false, 0, id(reg));
+    byte(0x58 | (id(reg) & 7));
+}
+
+void Assembler::call(Reg target) {
+    rex(false, 0, id(target));
+    byte(0xFF);
+    modrm(3, 2, id(target));
+}
+
+void Assembler::ret() {
+    byte(0xC3);
+}
+
+void Assembler::load(Reg dst, Reg base, int32_t disp) {
+    rex(true, id(dst), id(base));
+    byte(0x8B);
+    memory(id(dst), base, disp);
+}
+
+void Assembler::lea(Reg dst, Reg base, int32_t disp) {
+    rex(true, id(dst), id(base));
+    byte(0x8D);
+    memory(id(dst), base, disp);
+}
+
+void Assembler::load32(Reg dst, Reg base, int32_t disp) {
+    rex(false, id(dst), id(base));
+    byte(0x8B);
+    memory(id(dst), base, disp);
+}
+
+void Assembler::store32(Reg base, int32_t disp, Reg src) {
+    rex(false, id(src), id(base));
+    byte(0x89);
+    memory(id(src), base, disp);
+}
+
+void Assembler::store(Reg base, int32_t disp, Reg src) {
+    rex(true, id(src), id(base));
+    byte(0x89);
+    memory(id(src), base, disp);
+}
+
+void Assembler::mov(Reg dst, Reg src) {
+    rex(true, id(src), id(dst));
+    byte(0x89);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::mov32(Reg dst, Reg src) {
+    rex(false, id(src), id(dst));
+    byte(0x89);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::movImm(Reg dst, uint64_t imm) {
+    if (imm <= UINT32_MAX) {
+        rex(false, 0, id(dst));
+        byte(0xB8 | (id(dst) & 7));
+        u32(static_cast<uint32_t>(imm));
+        return;
+    }
+    rex(true, 0, id(dst));
+    byte(0xB8 | (id(dst) & 7));
+    emitU64(imm);
+}
+
+void Assembler::add32(Reg dst, Reg src) {
+    rex(false, id(src), id(dst));
+    byte(0x01);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::sub32(Reg dst, Reg src) {
+    rex(false, id(src), id(dst));
+    byte(0x29);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::imul32(Reg dst, Reg src) {
+    rex(false, id(dst), id(src));
+    byte(0x0F);
+    byte(0xAF);
+    modrm(3, id(dst), id(src));
+}
+
+void Assembler::neg32(Reg reg) {
+    rex(false, 0, id(reg));
+    byte(0xF7);
+    modrm(3, 3, id(reg));
+}
+
+void Assembler::cdq() {
+    byte(0x99);
+}
+
+void Assembler::idiv32(Reg divisor) {
+    rex(false, 0, id(divisor));
+    byte(0xF7);
+    modrm(3, 7, id(divisor));
+}
+
+void Assembler::add64(Reg dst, Reg src) {
+    rex(true, id(src), id(dst));
+    byte(0x01);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::or64(Reg dst, Reg src) {
+    rex(true, id(src), id(dst));
+    byte(0x09);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::and64(Reg dst, Reg src) {
+    rex(true, id(src), id(dst));
+    byte(0x21);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::shl64(Reg reg, uint8_t amount) {
+    rex(true, 0, id(reg));
+    byte(0xC1);
+    modrm(3, 4, id(reg));
+    byte(amount);
+}
+
+void Assembler::shr64(Reg reg, uint8_t amount) {
+    rex(true, 0, id(reg));
+    byte(0xC1);
+    modrm(3, 5, id(reg));
+    byte(amount);
+}
+
+void Assembler::cmp64(Reg a, Reg b) {
+    rex(true, id(b), id(a));
+    byte(0x39);
+    modrm(3, id(b), id(a));
+}
+
+void Assembler::cmp32(Reg a, Reg b) {
+    rex(false, id(b), id(a));
+    byte(0x39);
+    modrm(3, id(b), id(a));
+}
+
+void Assembler::cmp32(Reg a, int32_t imm) {
+    rex(false, 0, id(a));
+    byte(0x81);
+    modrm(3, 7, id(a));
+    u32(static_cast<uint32_t>(imm));
+}
+
+void Assembler::cmp8(Reg base, int32_t disp, uint8_t imm) {
+    rex(false, 0, id(base));
+    byte(0x80);
+    memory(7, base, disp);
+    byte(imm);
+}
+
+void Assembler::setcc(Cond cond, Reg dst) {
+    // setcc dst8; movzx dst32, dst8
+    rex(false, 0, id(dst), id(dst) >= 4);
+    byte(0x0F);
+    byte(0x90 | static_cast<uint8_t>(cond));
+    modrm(3, 0, id(dst));
+    rex(false, id(dst), id(dst), id(dst) >= 4);
+    byte(0x0F);
+    byte(0xB6);
+    modrm(3, id(dst), id(dst));
+}
+
+void Assembler::movq(Xmm dst, Reg src) {
+    byte(0x66);
+    rex(true, id(dst), id(src));
+    byte(0x0F);
+    byte(0x6E);
+    modrm(3, id(dst), id(src));
+}
+
+void Assembler::movq(Reg dst, Xmm src) {
+    byte(0x66);
+    rex(true, id(src), id(dst));
+    byte(0x0F);
+    byte(0x7E);
+    modrm(3, id(src), id(dst));
+}
+
+void Assembler::cvtsi2sd(Xmm dst, Reg src) {
+    byte(0xF2);
+    rex(false, id(dst), id(src));
+    byte(0x0F);
+    byte(0x2A);
+    modrm(3, id(dst), id(src));
+}
+
+void Assembler::sse(SseOp op, Xmm dst, Xmm src) {
+    byte(0xF2);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(op));
+    modrm(3, id(dst), id(src));
+}
+
+void Assembler::ucomisd(Xmm a, Xmm b) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x2E);
+    modrm(3, id(a), id(b));
+}
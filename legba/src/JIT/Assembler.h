@@ -0,0 +1,104 @@
+#ifndef LEGBA_JIT_ASSEMBLER_H
+#define LEGBA_JIT_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum class Xmm : uint8_t {
+    XMM0, XMM1
+};
+
+// Condition codes in their x86 encoding order.
+enum class Cond : uint8_t {
+    O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
+};
+
+enum class SseOp : uint8_t {
+    ADD = 0x58, MUL = 0x59, SUB = 0x5C, DIV = 0x5E
+};
+
+// Minimal x86-64 encoder for the baseline JIT. Jumps always use 32 bit
+// displacements and are resolved when their label is bound.
+class Assembler {
+public:
+    using Label = int;
+
+    Label newLabel();
+    void bind(Label label);
+    bool isBound(Label label) const { return labels[label].position >= 0; }
+    size_t labelOffset(Label label) const { return static_cast<size_t>(labels[label].position); }
+
+    size_t size() const { return code.size(); }
+    std::vector<uint8_t> const& bytes() const { return code; }
+    void align(size_t alignment);
+    void emitU64(uint64_t value);
+
+    // Control flow
+    void jmp(Label label);
+    void jcc(Cond cond, Label label);
+    void jmpTable(Reg table, Reg index);        // jmp [table + index * 8]
+    void leaRip(Reg dst, Label label);          // lea dst, [rip + label]
+    void push(Reg reg);
+    void pop(Reg reg);
+    void call(Reg target);                      // call target
+    void ret();
+
+    // Moves
+    void load(Reg dst, Reg base, int32_t disp);     // mov dst, [base + disp]
+    void store(Reg base, int32_t disp, Reg src);    // mov [base + disp], src
+    void lea(Reg dst, Reg base, int32_t disp);      // lea dst, [base + disp]
+    void load32(Reg dst, Reg base, int32_t disp);   // mov dst32, [base + disp], zero extended
+    void store32(Reg base, int32_t disp, Reg src);  // mov [base + disp], src32
+    void mov(Reg dst, Reg src);
+    void mov32(Reg dst, Reg src);
+    void movImm(Reg dst, uint64_t imm);
+
+    // Integer arithmetic, the 32 bit forms zero the upper half of dst
+    void add32(Reg dst, Reg src);
+    void sub32(Reg dst, Reg src);
+    void imul32(Reg dst, Reg src);
+    void neg32(Reg reg);
+    void cdq();
+    void idiv32(Reg divisor);
+    void add64(Reg dst, Reg src);
+    void or64(Reg dst, Reg src);
+    void and64(Reg dst, Reg src);
+    void shl64(Reg reg, uint8_t amount);
+    void shr64(Reg reg, uint8_t amount);
+    void cmp64(Reg a, Reg b);
+    void cmp32(Reg a, Reg b);
+    void cmp32(Reg a, int32_t imm);
+    void cmp8(Reg base, int32_t disp, uint8_t imm); // cmp byte [base + disp], imm
+    void setcc(Cond cond, Reg dst);             // dst = cond ? 1 : 0, full register
+
+    // Scalar doubles
+    void movq(Xmm dst, Reg src);
+    void movq(Reg dst, Xmm src);
+    void cvtsi2sd(Xmm dst, Reg src);            // dst = (double) src32
+    void sse(SseOp op, Xmm dst, Xmm src);
+    void ucomisd(Xmm a, Xmm b);
+
+private:
+    struct LabelData {
+        int position = -1;
+        std::vector<size_t> fixups;     // offsets of rel32 fields pointing at the label
+    };
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void u32(uint32_t value);
+    void rex(bool w, uint8_t reg, uint8_t rm, bool force = false);
+    void modrm(uint8_t mod, uint8_t reg, uint8_t rm) { byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
+    void memory(uint8_t reg, Reg base, int32_t disp);
+    void rel32(Label label);
+
+    std::vector<uint8_t> code;
+    std::vector<LabelData> labels;
+};
+
+#endif
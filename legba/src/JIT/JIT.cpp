@@ -0,0 +1,682 @@
+#include "JIT.h"
+
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <sstream>
+
+#include "JIT/Assembler.h"
+#include "Runtime/Builtins.h"
+#include "VM/Disassembler.h"
+
+#ifdef LEGBA_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+static constexpr uint64_t INT_TAG = static_cast<uint64_t>(Value::TAG_INT) << Value::TAG_SHIFT;
+static constexpr uint64_t BOOL_TAG = static_cast<uint64_t>(Value::TAG_BOOL) << Value::TAG_SHIFT;
+static constexpr uint64_t TRUE_BITS = Value::fromBool(true).bits;
+static constexpr uint64_t FALSE_BITS = Value::fromBool(false).bits;
+
+// ArrayObject layout: the element type and length follow the object header, the
+// elements the whole struct
+static constexpr int32_t ARRAY_ELEMENT_TYPE = sizeof(Object);
+static constexpr int32_t ARRAY_LENGTH = sizeof(Object) + sizeof(uint32_t);
+static constexpr int32_t ARRAY_ELEMENTS = sizeof(ArrayObject);
+static_assert(sizeof(ArrayObject) == sizeof(Object) + 2 * sizeof(uint32_t));
+
+JIT::~JIT() {
+#ifdef LEGBA_JIT_SUPPORTED
+    for (auto const& region : regions) {
+        munmap(region.memory, region.size);
+    }
+#endif
+}
+
+bool JIT::isSupported() {
+#ifdef LEGBA_JIT_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef LEGBA_JIT_SUPPORTED
+
+namespace {
+
+// Register usage: rbx holds the frame base, r12 the globals. rax, rcx, rdx, r8
+// and xmm0/xmm1 are scratch, rcx is clobbered by every type guard. r13 is only
+// saved to keep the stack aligned for calls of builtins, which clobber all scratch
+// registers.
+class FunctionCompiler {
+public:
+    FunctionCompiler(Program const& program, FunctionProto const& proto)
+        : program(program), proto(proto), labels(proto.code.size()), starts(proto.code.size()) {}
+
+    void compile();
+    Assembler const& assembler() const { return as; }
+    Assembler::Label tableLabel() const { return table; }
+    Assembler::Label instructionLabel(size_t at) const { return labels[at]; }
+    size_t instructionStart(size_t at) const { return at < starts.size() ? starts[at] : bodyEnd; }
+
+private:
+    void instruction(size_t at);
+
+    static int32_t slot(int reg) { return reg * 8; }
+    void loadRegister(Reg dst, int reg) { as.load(dst, Reg::RBX, slot(reg)); }
+    void storeRegister(int reg, Reg src) { as.store(Reg::RBX, slot(reg), src); }
+    void loadConstant(int reg, uint64_t bits);
+    void loadInstance(Reg dst, int reg);
+    static int32_t field(int index) { return static_cast<int32_t>(sizeof(InstanceObject)) + index * 8; }
+    void loadStatic(Reg dst, size_t at);
+
+    // Out of line exits to the interpreter at the instruction at. Guard exits tell
+    // the VM the compiled code made a wrong type assumption.
+    Assembler::Label guardExit(size_t at);
+    Assembler::Label sideExit(size_t at);
+    void exitTo(size_t at);
+    void guardInt(Reg value, Assembler::Label fail);
+    void guardDouble(Reg value, Assembler::Label fail);
+    void guardNumber(Reg value, Assembler::Label fail);
+    void boxInt(Reg value);
+    void boxBool(Cond cond);
+    void canonicalizeNaN(Reg value);
+
+    void arrayElement(size_t at, int array, int index, ElementType type);
+    void getIndex(size_t at, ElementType type);
+    void setIndex(size_t at, ElementType type);
+
+    void intArithmetic(size_t at, OpCode op);
+    void doubleArithmetic(size_t at, SseOp op);
+    void division(size_t at, bool modulo);
+    void intComparison(size_t at, Cond cond, bool fused, bool wide);
+    void doubleComparison(size_t at, OpCode op, bool fused);
+    void immediateArithmetic(size_t at, bool add);
+    void branch(size_t at, bool ifTrue);
+    void fusedBranch(size_t at);
+    void nativeCall(size_t at);
+
+    bool neverRan(size_t at) const { return proto.feedback.empty() || proto.feedback[at] == 0; }
+
+    Program const& program;
+    FunctionProto const& proto;
+    Assembler as;
+    std::vector<Assembler::Label> labels;
+    std::vector<size_t> starts;
+    size_t bodyEnd = 0;
+    std::vector<std::pair<Assembler::Label, uint32_t>> exits;     // out of line exits and their return value
+    Assembler::Label epilogue = 0;
+    Assembler::Label table = 0;
+};
+
+void FunctionCompiler::compile() {
+    for (auto& label : labels) {
+        label = as.newLabel();
+    }
+    epilogue = as.newLabel();
+    table = as.newLabel();
+
+    // uint32_t (Value* base, Value* globals, uint32_t offset)
+    as.push(Reg::RBX);
+    as.push(Reg::R12);
+    as.push(Reg::R13);
+    as.mov(Reg::RBX, Reg::RDI);
+    as.mov(Reg::R12, Reg::RSI);
+    as.mov32(Reg::RDX, Reg::RDX);
+    as.leaRip(Reg::RAX, table);
+    as.jmpTable(Reg::RAX, Reg::RDX);
+
+    for (size_t at = 0; at < proto.code.size(); at++) {
+        as.bind(labels[at]);
+        starts[at] = as.size();
+        instruction(at);
+    }
+    bodyEnd = as.size();
+
+    for (auto const& [label, resume] : exits) {
+        as.bind(label);
+        as.movImm(Reg::RAX, resume);
+        as.jmp(epilogue);
+    }
+
+    as.bind(epilogue);
+    as.pop(Reg::R13);
+    as.pop(Reg::R12);
+    as.pop(Reg::RBX);
+    as.ret();
+
+    // entry table, patched with absolute addresses once the code has its final place
+    as.align(8);
+    as.bind(table);
+    for (size_t at = 0; at < proto.code.size(); at++) {
+        as.emitU64(0);
+    }
+}
+
+void FunctionCompiler::instruction(size_t at) {
+    Instruction i = proto.code[at];
+    int a = getA(i), b = getB(i);
+
+    switch (getOp(i)) {
+        case OpCode::LOADK: loadConstant(a, proto.constants[getBx(i)].bits); break;
+        case OpCode::LOADI: loadConstant(a, Value::fromInt(getSBx(i)).bits); break;
+        case OpCode::LOADNIL: loadConstant(a, Value::nil().bits); break;
+        case OpCode::LOADBOOL: loadConstant(a, Value::fromBool(b != 0).bits); break;
+        case OpCode::MOVE:
+            loadRegister(Reg::RAX, b);
+            storeRegister(a, Reg::RAX);
+            break;
+        case OpCode::GETGLOBAL:
+            as.load(Reg::RAX, Reg::R12, slot(getBx(i)));
+            storeRegister(a, Reg::RAX);
+            break;
+        case OpCode::SETGLOBAL:
+            loadRegister(Reg::RAX, a);
+            as.store(Reg::R12, slot(getBx(i)), Reg::RAX);
+            break;
+        case OpCode::GETFIELD:
+            loadInstance(Reg::RAX, b);
+            as.load(Reg::RAX, Reg::RAX, field(getC(i)));
+            storeRegister(a, Reg::RAX);
+            break;
+        case OpCode::SETFIELD: {
+            // objects stored into an instance not yet remembered need the VM's write barrier
+            auto store = as.newLabel();
+            loadInstance(Reg::RAX, a);
+            loadRegister(Reg::RDX, b);
+            as.mov(Reg::RCX, Reg::RDX);
+            as.shr64(Reg::RCX, Value::TAG_SHIFT);
+            as.cmp32(Reg::RCX, static_cast<int32_t>(Value::TAG_OBJECT));
+            as.jcc(Cond::NE, store);
+            as.cmp8(Reg::RAX, static_cast<int32_t>(offsetof(Object, remembered)), 0);
+            as.jcc(Cond::E, sideExit(at));
+            as.bind(store);
+            as.store(Reg::RAX, field(getC(i)), Reg::RDX);
+            break;
+        }
+        case OpCode::GETSTATIC:
+            loadStatic(Reg::RAX, at);
+            as.load(Reg::RAX, Reg::RAX, 0);
+            storeRegister(a, Reg::RAX);
+            break;
+        case OpCode::SETSTATIC:
+            loadStatic(Reg::RAX, at);
+            loadRegister(Reg::RDX, a);
+            as.store(Reg::RAX, 0, Reg::RDX);
+            break;
+
+        // Generic forms are only compiled when they never ran: then assuming ints is as
+        // good a guess as any. A generic form that did run has seen mixed types.
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+            if (neverRan(at)) intArithmetic(at, getOp(i));
+            else exitTo(at);
+            break;
+        case OpCode::ADD_II: intArithmetic(at, OpCode::ADD); break;
+        case OpCode::SUB_II: intArithmetic(at, OpCode::SUB); break;
+        case OpCode::MUL_II: intArithmetic(at, OpCode::MUL); break;
+        case OpCode::ADD_DD: doubleArithmetic(at, SseOp::ADD); break;
+        case OpCode::SUB_DD: doubleArithmetic(at, SseOp::SUB); break;
+        case OpCode::MUL_DD: doubleArithmetic(at, SseOp::MUL); break;
+        case OpCode::DIV_DD: doubleArithmetic(at, SseOp::DIV); break;
+        case OpCode::DIV:
+            // no quick form for int division, but the feedback still knows
+            if (neverRan(at) || proto.feedback[at] == FEEDBACK_INT) division(at, false);
+            else exitTo(at);
+            break;
+        case OpCode::MOD: division(at, true); break;
+        case OpCode::ADDI_II: immediateArithmetic(at, true); break;
+        case OpCode::SUBI_II: immediateArithmetic(at, false); break;
+
+        case OpCode::EQ:
+        case OpCode::NE:
+        case OpCode::LT:
+        case OpCode::LE:
+        case OpCode::GT:
+        case OpCode::GE: {
+            if (!neverRan(at)) {
+                exitTo(at);
+                break;
+            }
+            static const Cond conds[] = { Cond::E, Cond::NE, Cond::L, Cond::LE, Cond::G, Cond::GE };
+            auto index = static_cast<int>(getOp(i)) - static_cast<int>(OpCode::EQ);
+            intComparison(at, conds[index], false, index < 2);
+            break;
+        }
+        case OpCode::EQ_II: intComparison(at, Cond::E, false, true); break;
+        case OpCode::NE_II: intComparison(at, Cond::NE, false, true); break;
+        case OpCode::LT_II: intComparison(at, Cond::L, false, false); break;
+        case OpCode::LE_II: intComparison(at, Cond::LE, false, false); break;
+        case OpCode::GT_II: intComparison(at, Cond::G, false, false); break;
+        case OpCode::GE_II: intComparison(at, Cond::GE, false, false); break;
+        case OpCode::EQ_II_JMP: intComparison(at, Cond::E, true, true); break;
+        case OpCode::NE_II_JMP: intComparison(at, Cond::NE, true, true); break;
+        case OpCode::LT_II_JMP: intComparison(at, Cond::L, true, false); break;
+        case OpCode::LE_II_JMP: intComparison(at, Cond::LE, true, false); break;
+        case OpCode::GT_II_JMP: intComparison(at, Cond::G, true, false); break;
+        case OpCode::GE_II_JMP: intComparison(at, Cond::GE, true, false); break;
+        case OpCode::LT_DD: doubleComparison(at, OpCode::LT, false); break;
+        case OpCode::LE_DD: doubleComparison(at, OpCode::LE, false); break;
+        case OpCode::GT_DD: doubleComparison(at, OpCode::GT, false); break;
+        case OpCode::GE_DD: doubleComparison(at, OpCode::GE, false); break;
+        case OpCode::LT_DD_JMP: doubleComparison(at, OpCode::LT, true); break;
+        case OpCode::LE_DD_JMP: doubleComparison(at, OpCode::LE, true); break;
+        case OpCode::GT_DD_JMP: doubleComparison(at, OpCode::GT, true); break;
+        case OpCode::GE_DD_JMP: doubleComparison(at, OpCode::GE, true); break;
+
+        case OpCode::NOT: {
+            auto isFalse = as.newLabel(), done = as.newLabel();
+            loadRegister(Reg::RAX, b);
+            as.movImm(Reg::RCX, FALSE_BITS);
+            as.cmp64(Reg::RAX, Reg::RCX);
+            as.jcc(Cond::E, isFalse);
+            as.movImm(Reg::RCX, TRUE_BITS);
+            as.cmp64(Reg::RAX, Reg::RCX);
+            as.jcc(Cond::NE, sideExit(at));
+            as.movImm(Reg::RAX, FALSE_BITS);
+            as.jmp(done);
+            as.bind(isFalse);
+            as.movImm(Reg::RAX, TRUE_BITS);
+            as.bind(done);
+            storeRegister(a, Reg::RAX);
+            break;
+        }
+        case OpCode::NEG: {
+            auto fail = sideExit(at);
+            loadRegister(Reg::RAX, b);
+            guardInt(Reg::RAX, fail);
+            as.neg32(Reg::RAX);
+            boxInt(Reg::RAX);
+            storeRegister(a, Reg::RAX);
+            break;
+        }
+
+        case OpCode::GETINDEX_I: getIndex(at, ElementType::INT); break;
+        case OpCode::GETINDEX_D: getIndex(at, ElementType::DOUBLE); break;
+        case OpCode::SETINDEX_I: setIndex(at, ElementType::INT); break;
+        case OpCode::SETINDEX_D: setIndex(at, ElementType::DOUBLE); break;
+
+        case OpCode::JMP:
+            as.jmp(labels[at + 1 + getSBx(i)]);
+            break;
+        case OpCode::JMPIF: branch(at, true); break;
+        case OpCode::JMPIFNOT: branch(at, false); break;
+        case OpCode::CALLNATIVE: nativeCall(at); break;
+
+        case OpCode::EXTRA:
+            break;
+
+        default:
+            // calls, returns, attributes by name, generic operations on mixed types
+            exitTo(at);
+            break;
+    }
+}
+
+void FunctionCompiler::loadConstant(int reg, uint64_t bits) {
+    as.movImm(Reg::RAX, bits);
+    storeRegister(reg, Reg::RAX);
+}
+
+// dst = the InstanceObject in reg, which the compiler guarantees to hold 'this'
+void FunctionCompiler::loadInstance(Reg dst, int reg) {
+    loadRegister(dst, reg);
+    as.movImm(Reg::RCX, Value::PAYLOAD_MASK);
+    as.and64(dst, Reg::RCX);
+}
+
+// dst = address of the static attribute accessed at; class storage never moves
+void FunctionCompiler::loadStatic(Reg dst, size_t at) {
+    auto klass = program.classes[getExtra(proto.code[at + 1])];
+    as.movImm(dst, reinterpret_cast<uint64_t>(&klass->statics[getBx(proto.code[at])]));
+}
+
+Assembler::Label FunctionCompiler::guardExit(size_t at) {
+    auto label = as.newLabel();
+    exits.emplace_back(label, static_cast<uint32_t>(at) | JIT_GUARD_FAILED);
+    return label;
+}
+
+Assembler::Label FunctionCompiler::sideExit(size_t at) {
+    auto label = as.newLabel();
+    exits.emplace_back(label, static_cast<uint32_t>(at));
+    return label;
+}
+
+void FunctionCompiler::exitTo(size_t at) {
+    as.movImm(Reg::RAX, static_cast<uint32_t>(at));
+    as.jmp(epilogue);
+}
+
+void FunctionCompiler::guardInt(Reg value, Assembler::Label fail) {
+    as.mov(Reg::RCX, value);
+    as.shr64(Reg::RCX, Value::TAG_SHIFT);
+    as.cmp32(Reg::RCX, static_cast<int32_t>(Value::TAG_INT));
+    as.jcc(Cond::NE, fail);
+}
+
+void FunctionCompiler::guardDouble(Reg value, Assembler::Label fail) {
+    as.mov(Reg::RCX, value);
+    as.shr64(Reg::RCX, Value::TAG_SHIFT);
+    as.cmp32(Reg::RCX, static_cast<int32_t>(Value::TAG_INT));
+    as.jcc(Cond::AE, fail);
+}
+
+void FunctionCompiler::guardNumber(Reg value, Assembler::Label fail) {
+    as.mov(Reg::RCX, value);
+    as.shr64(Reg::RCX, Value::TAG_SHIFT);
+    as.cmp32(Reg::RCX, static_cast<int32_t>(Value::TAG_INT));
+    as.jcc(Cond::A, fail);
+}
+
+// value holds a zero extended 32 bit result
+void FunctionCompiler::boxInt(Reg value) {
+    as.movImm(Reg::RCX, INT_TAG);
+    as.or64(value, Reg::RCX);
+}
+
+// rax = the flags as a boxed bool
+void FunctionCompiler::boxBool(Cond cond) {
+    as.setcc(cond, Reg::RAX);
+    as.movImm(Reg::RCX, BOOL_TAG);
+    as.or64(Reg::RAX, Reg::RCX);
+}
+
+// NaN results must be canonical, like Value::fromDouble makes them
+void FunctionCompiler::canonicalizeNaN(Reg value) {
+    auto ordered = as.newLabel();
+    as.movq(Xmm::XMM0, value);
+    as.ucomisd(Xmm::XMM0, Xmm::XMM0);
+    as.jcc(Cond::NP, ordered);
+    as.movImm(value, Value::CANONICAL_NAN);
+    as.bind(ordered);
+}
+
+// Leaves the address of element index of the array in rax, the quick forms only
+// compile for arrays of their element type indexed by ints. An index out of range
+// leaves to the interpreter, which raises the error.
+void FunctionCompiler::arrayElement(size_t at, int array, int index, ElementType type) {
+    auto fail = guardExit(at);
+    loadRegister(Reg::RAX, array);
+    loadRegister(Reg::RDX, index);
+    guardInt(Reg::RDX, fail);
+    as.mov(Reg::RCX, Reg::RAX);
+    as.shr64(Reg::RCX, Value::TAG_SHIFT);
+    as.cmp32(Reg::RCX, static_cast<int32_t>(Value::TAG_OBJECT));
+    as.jcc(Cond::NE, fail);
+    as.movImm(Reg::RCX, Value::PAYLOAD_MASK);
+    as.and64(Reg::RAX, Reg::RCX);
+    as.cmp8(Reg::RAX, static_cast<int32_t>(offsetof(Object, type)), static_cast<uint8_t>(ObjectType::ARRAY));
+    as.jcc(Cond::NE, fail);
+    as.cmp8(Reg::RAX, ARRAY_ELEMENT_TYPE, static_cast<uint8_t>(type));
+    as.jcc(Cond::NE, fail);
+    // unsigned, negative indices are out of range as well
+    as.load32(Reg::RCX, Reg::RAX, ARRAY_LENGTH);
+    as.cmp32(Reg::RDX, Reg::RCX);
+    as.jcc(Cond::AE, sideExit(at));
+    as.mov32(Reg::RDX, Reg::RDX);
+    as.shl64(Reg::RDX, type == ElementType::INT ? 2 : 3);
+    as.add64(Reg::RAX, Reg::RDX);
+}
+
+void FunctionCompiler::getIndex(size_t at, ElementType type) {
+    Instruction i = proto.code[at];
+    arrayElement(at, getB(i), getC(i), type);
+    if (type == ElementType::INT) {
+        as.load32(Reg::RAX, Reg::RAX, ARRAY_ELEMENTS);
+        boxInt(Reg::RAX);
+    } else {
+        as.load(Reg::RAX, Reg::RAX, ARRAY_ELEMENTS);
+        canonicalizeNaN(Reg::RAX);
+    }
+    storeRegister(getA(i), Reg::RAX);
+}
+
+// int[] takes ints, double[] numbers converted to double
+void FunctionCompiler::setIndex(size_t at, ElementType type) {
+    Instruction i = proto.code[at];
+    loadRegister(Reg::R8, getC(i));
+    if (type == ElementType::INT) {
+        guardInt(Reg::R8, guardExit(at));
+        arrayElement(at, getA(i), getB(i), type);
+        as.store32(Reg::RAX, ARRAY_ELEMENTS, Reg::R8);
+        return;
+    }
+
+    auto isDouble = as.newLabel();
+    guardNumber(Reg::R8, guardExit(at));
+    as.jcc(Cond::NE, isDouble); // flags still compare the tag with TAG_INT
+    as.cvtsi2sd(Xmm::XMM0, Reg::R8);
+    as.movq(Reg::R8, Xmm::XMM0);
+    as.bind(isDouble);
+    arrayElement(at, getA(i), getB(i), type);
+    as.store(Reg::RAX, ARRAY_ELEMENTS, Reg::R8);
+}
+
+void FunctionCompiler::intArithmetic(size_t at, OpCode op) {
+    Instruction i = proto.code[at];
+    auto fail = guardExit(at);
+    loadRegister(Reg::RAX, getB(i));
+    loadRegister(Reg::RDX, getC(i));
+    guardInt(Reg::RAX, fail);
+    guardInt(Reg::RDX, fail);
+    switch (op) {
+        case OpCode::ADD: as.add32(Reg::RAX, Reg::RDX); break;
+        case OpCode::SUB: as.sub32(Reg::RAX, Reg::RDX); break;
+        default: as.imul32(Reg::RAX, Reg::RDX); break;
+    }
+    boxInt(Reg::RAX);
+    storeRegister(getA(i), Reg::RAX);
+}
+
+void FunctionCompiler::doubleArithmetic(size_t at, SseOp op) {
+    Instruction i = proto.code[at];
+    auto fail = guardExit(at);
+    loadRegister(Reg::RAX, getB(i));
+    loadRegister(Reg::RDX, getC(i));
+    guardDouble(Reg::RAX, fail);
+    guardDouble(Reg::RDX, fail);
+    as.movq(Xmm::XMM0, Reg::RAX);
+    as.movq(Xmm::XMM1, Reg::RDX);
+    as.sse(op, Xmm::XMM0, Xmm::XMM1);
+    as.movq(Reg::RAX, Xmm::XMM0);
+    canonicalizeNaN(Reg::RAX);
+    storeRegister(getA(i), Reg::RAX);
+}
+
+// int division and modulo, INT_MIN / -1 wraps like in Operations
+void FunctionCompiler::division(size_t at, bool modulo) {
+    Instruction i = proto.code[at];
+    auto fail = sideExit(at);
+    auto minusOne = as.newLabel(), done = as.newLabel();
+    loadRegister(Reg::RAX, getB(i));
+    loadRegister(Reg::R8, getC(i));
+    guardInt(Reg::RAX, fail);
+    guardInt(Reg::R8, fail);
+    // the interpreter raises the division by zero
+    as.cmp32(Reg::R8, 0);
+    as.jcc(Cond::E, fail);
+    as.cmp32(Reg::R8, -1);
+    as.jcc(Cond::E, minusOne);
+    as.cdq();
+    as.idiv32(Reg::R8);
+    if (modulo) {
+        as.mov32(Reg::RAX, Reg::RDX);
+    }
+    as.jmp(done);
+    as.bind(minusOne);
+    if (modulo) {
+        as.movImm(Reg::RAX, 0);
+    } else {
+        as.neg32(Reg::RAX);
+    }
+    as.bind(done);
+    boxInt(Reg::RAX);
+    storeRegister(getA(i), Reg::RAX);
+}
+
+// wide compares the whole boxed value, which for two ints is (in)equality
+void FunctionCompiler::intComparison(size_t at, Cond cond, bool fused, bool wide) {
+    Instruction i = proto.code[at];
+    auto fail = guardExit(at);
+    loadRegister(Reg::RAX, getB(i));
+    loadRegister(Reg::RDX, getC(i));
+    guardInt(Reg::RAX, fail);
+    guardInt(Reg::RDX, fail);
+    if (wide) as.cmp64(Reg::RAX, Reg::RDX);
+    else as.cmp32(Reg::RAX, Reg::RDX);
+    boxBool(cond);
+    storeRegister(getA(i), Reg::RAX);
+    if (fused) {
+        fusedBranch(at);
+    }
+}
+
+void FunctionCompiler::doubleComparison(size_t at, OpCode op, bool fused) {
+    Instruction i = proto.code[at];
+    auto fail = guardExit(at);
+    loadRegister(Reg::RAX, getB(i));
+    loadRegister(Reg::RDX, getC(i));
+    guardDouble(Reg::RAX, fail);
+    guardDouble(Reg::RDX, fail);
+    as.movq(Xmm::XMM0, Reg::RAX);
+    as.movq(Xmm::XMM1, Reg::RDX);
+    // above/above-equal are false for unordered operands, so NaN compares false
+    bool swap = op == OpCode::LT || op == OpCode::LE;
+    if (swap) as.ucomisd(Xmm::XMM1, Xmm::XMM0);
+    else as.ucomisd(Xmm::XMM0, Xmm::XMM1);
+    boxBool(op == OpCode::LT || op == OpCode::GT ? Cond::A : Cond::AE);
+    storeRegister(getA(i), Reg::RAX);
+    if (fused) {
+        fusedBranch(at);
+    }
+}
+
+// after a fused comparison: rax holds the stored bool, the JMPIFNOT follows at + 1
+void FunctionCompiler::fusedBranch(size_t at) {
+    Instruction jump = proto.code[at + 1];
+    as.cmp32(Reg::RAX, 0);
+    as.jcc(Cond::E, labels[at + 2 + getSBx(jump)]);
+    as.jmp(labels[at + 2]);
+}
+
+// Leaf builtins are called directly on their argument registers once the arguments
+// passed the signature's checks, the VM reports the error otherwise. Others may
+// allocate or throw, they run in the VM.
+void FunctionCompiler::nativeCall(size_t at) {
+    Instruction i = proto.code[at];
+    auto const& builtin = BUILTINS[getExtra(proto.code[at + 1])];
+    if (!builtin.leaf) {
+        exitTo(at);
+        return;
+    }
+
+    for (int arg = 0; arg < builtin.arity; arg++) {
+        switch (builtin.params[arg]) {
+            case ValueTypeEnum::VT_INTEGER:
+                loadRegister(Reg::RAX, getA(i) + arg);
+                guardInt(Reg::RAX, sideExit(at));
+                break;
+            case ValueTypeEnum::VT_DOUBLE:
+                loadRegister(Reg::RAX, getA(i) + arg);
+                guardNumber(Reg::RAX, sideExit(at));
+                break;
+            default:
+                break;
+        }
+    }
+    as.lea(Reg::RDI, Reg::RBX, slot(getA(i)));
+    as.movImm(Reg::RAX, reinterpret_cast<uint64_t>(builtin.function));
+    as.call(Reg::RAX);
+    storeRegister(getA(i), Reg::RAX);
+}
+
+void FunctionCompiler::immediateArithmetic(size_t at, bool add) {
+    Instruction i = proto.code[at];
+    Instruction next = proto.code[at + 1];
+    auto fail = guardExit(at);
+    loadConstant(getA(i), Value::fromInt(getSBx(i)).bits);
+    loadRegister(Reg::RAX, getB(next));
+    guardInt(Reg::RAX, fail);
+    as.movImm(Reg::RDX, static_cast<uint32_t>(static_cast<int32_t>(getSBx(i))));
+    if (add) as.add32(Reg::RAX, Reg::RDX);
+    else as.sub32(Reg::RAX, Reg::RDX);
+    boxInt(Reg::RAX);
+    storeRegister(getA(next), Reg::RAX);
+    as.jmp(labels[at + 2]);
+}
+
+// bools branch natively, anything else is left to the interpreter's isTruthy
+void FunctionCompiler::branch(size_t at, bool ifTrue) {
+    Instruction i = proto.code[at];
+    auto target = labels[at + 1 + getSBx(i)];
+    auto next = labels[at + 1];
+    loadRegister(Reg::RAX, getA(i));
+    as.movImm(Reg::RCX, TRUE_BITS);
+    as.cmp64(Reg::RAX, Reg::RCX);
+    as.jcc(Cond::E, ifTrue ? target : next);
+    as.movImm(Reg::RCX, FALSE_BITS);
+    as.cmp64(Reg::RAX, Reg::RCX);
+    as.jcc(Cond::E, ifTrue ? next : target);
+    exitTo(at);
+}
+
+} // namespace
+
+bool JIT::compile(Program const& program, FunctionProto& proto) {
+    FunctionCompiler compiler(program, proto);
+    compiler.compile();
+    auto const& as = compiler.assembler();
+
+    size_t size = as.size();
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    auto bytes = static_cast<uint8_t*>(memory);
+    std::memcpy(bytes, as.bytes().data(), size);
+    auto table = reinterpret_cast<uint64_t*>(bytes + as.labelOffset(compiler.tableLabel()));
+    for (size_t at = 0; at < proto.code.size(); at++) {
+        table[at] = reinterpret_cast<uint64_t>(bytes + as.labelOffset(compiler.instructionLabel(at)));
+    }
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+    regions.push_back({ memory, size });
+    proto.jitCode = reinterpret_cast<JitFunction>(memory);
+
+    if (dump != nullptr) {
+        *dump << std::format("-- JIT compiled '{}' to {} bytes at {}\n", proto.name, size, memory);
+        for (size_t at = 0; at < proto.code.size(); at++) {
+            if (getOp(proto.code[at]) == OpCode::EXTRA) {
+                continue;
+            }
+            std::ostringstream line;
+            disassembleInstruction(program, proto, at, line);
+            auto text = line.str();
+            text.pop_back();
+
+            size_t end = compiler.instructionStart(at + 1);
+            *dump << std::format("{:<40} |", text);
+            for (size_t b = compiler.instructionStart(at); b < end; b++) {
+                *dump << std::format(" {:02x}", as.bytes()[b]);
+            }
+            *dump << '\n';
+        }
+        *dump << std::endl;
+    }
+    return true;
+}
+
+#else
+
+bool JIT::compile(Program const&, FunctionProto&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef LEGBA_JIT_JIT_H
+#define LEGBA_JIT_JIT_H
+
+#include <ostream>
+#include <vector>
+
+#include "VM/Program.h"
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(LEGBA_NO_JIT)
+#define LEGBA_JIT_SUPPORTED
+#endif
+
+// Set in the offset returned by compiled code when it left because a type guard
+// failed, as opposed to reaching an instruction it doesn't implement.
+constexpr uint32_t JIT_GUARD_FAILED = 1u << 31;
+
+// Baseline JIT translating the (quickened) bytecode of a hot function to x86-64.
+// Values stay in their frame registers, so the interpreter can take over at any
+// instruction: compiled code is entered at a bytecode offset through a jump table
+// and returns the offset of the first instruction it did not execute. Calls,
+// returns, attribute accesses and failed type guards all leave that way.
+class JIT {
+public:
+    JIT() = default;
+    JIT(JIT const&) = delete;
+    JIT& operator=(JIT const&) = delete;
+    ~JIT();
+
+    static bool isSupported();
+
+    // Compiles proto and installs the result as its jitCode. Returns false if
+    // this platform has no JIT.
+    bool compile(Program const& program, FunctionProto& proto);
+
+    // Print the generated machine code per bytecode instruction while compiling.
+    void setDump(std::ostream* os) { dump = os; }
+
+private:
+    struct Region {
+        void* memory;
+        size_t size;
+    };
+
+    std::vector<Region> regions;
+    std::ostream* dump = nullptr;
+};
+
+#endif
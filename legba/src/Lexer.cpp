@@ -46,6 +46,8 @@ Token Lexer::scanToken() {
         case '+': return makeToken(TokenType::PLUS);
         case '-': return makeToken(match('>') ? TokenType::RIGHT_ARROW : TokenType::MINUS);
         case '*': return makeToken(TokenType::STAR);
+        case '/': return makeToken(TokenType::SLASH);
+        case '%': return makeToken(TokenType::MODULO);
         case ';': return makeToken(TokenType::SEMICOLON);
         case ':': return makeToken(TokenType::COLON);
         case '.': return makeToken(TokenType::DOT);
@@ -240,11 +242,19 @@ TokenType Lexer::identifierType() {
                 }
             }
             break;
-        case 'i': return checkKeyword(1, 1, "f", TokenType::IF);
+        case 'i':
+            if (current - start > 1) {
+                switch (source[start + 1]) {
+                    case 'f': return checkKeyword(2, 0, "", TokenType::IF);
+                    case 'm': return checkKeyword(2, 4, "port", TokenType::IMPORT);
+                }
+            }
+            break;
         case 'p':
             if (current - start > 1) {
                 switch (source[start + 1]) {
-                    case 'r': return checkKeyword(2, 7, "otected", TokenType::PUBLIC);
+                    case 'a': return checkKeyword(2, 6, "rallel", TokenType::PARALLEL);
+                    case 'r': return checkKeyword(2, 7, "otected", TokenType::PROTECTED);
                     case 'u': return checkKeyword(2, 4, "blic", TokenType::PUBLIC);
                 }
             }
@@ -257,6 +267,7 @@ TokenType Lexer::identifierType() {
                     case 'u': return checkKeyword(2, 3, "per", TokenType::SUPER);
                 }
             }
+            break;
         case 't':
             if (current - start > 1) {
                 switch (source[start+1]) {
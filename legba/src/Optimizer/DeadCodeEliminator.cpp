@@ -0,0 +1,340 @@
+#include "DeadCodeEliminator.h"
+
+#include <queue>
+#include <algorithm>
+
+void DeadCodeEliminator::run() {
+    eliminateScope(rootScope);
+
+    collectCalls(rootScope, rootScope);
+    removeUnreachable();
+}
+
+// Unreachable statements
+
+Node* DeadCodeEliminator::eliminate(Node* node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    switch (node->getType()) {
+        case NodeType::SCOPE: return eliminateScope(static_cast<ScopeNode*>(node));
+        case NodeType::IF: return eliminateIf(static_cast<IfNode*>(node));
+        case NodeType::WHILE: return eliminateWhile(static_cast<WhileNode*>(node));
+        case NodeType::FOR: return eliminateFor(static_cast<ForNode*>(node));
+        case NodeType::FUNCTION: {
+            auto func = static_cast<FunctionNode*>(node);
+            func->setBody(eliminate(func->getBody()));
+            return func;
+        }
+        case NodeType::CLASS: {
+            auto klass = static_cast<ClassNode*>(node);
+            for (auto const& [_, method] : klass->getMethods()) {
+                method->setBody(eliminate(method->getBody()));
+            }
+            return klass;
+        }
+        default:
+            return node;
+    }
+}
+
+Node* DeadCodeEliminator::eliminateScope(ScopeNode* scope) {
+    auto statements = std::vector<Node*>();
+    bool returned = false;
+
+    for (auto stmt : scope->getStatements()) {
+        if (returned) {
+            // declarations are hoisted and stay reachable after a return
+            if (stmt->getType() == NodeType::FUNCTION || stmt->getType() == NodeType::CLASS) {
+                statements.emplace_back(eliminate(stmt));
+            } else {
+                removedStatements++;
+            }
+            continue;
+        }
+
+        auto result = eliminate(stmt);
+        if (result == nullptr) {
+            removedStatements++;
+            continue;
+        }
+
+        statements.emplace_back(result);
+        returned = alwaysReturns(result);
+    }
+
+    scope->setStatements(std::move(statements));
+    return scope;
+}
+
+Node* DeadCodeEliminator::eliminateIf(IfNode* node) {
+    bool value;
+    if (constantCondition(node->getCondition(), value)) {
+        removedStatements++;
+        return eliminate(value ? node->getThenBranch() : node->getElseBranch());
+    }
+
+    auto thenBranch = eliminate(node->getThenBranch());
+    node->setThenBranch(thenBranch != nullptr ? thenBranch : new ScopeNode());
+    node->setElseBranch(eliminate(node->getElseBranch()));
+    return node;
+}
+
+Node* DeadCodeEliminator::eliminateWhile(WhileNode* node) {
+    bool value;
+    if (constantCondition(node->getCondition(), value) && !value) {
+        return nullptr;
+    }
+
+    auto body = eliminate(node->getBody());
+    node->setBody(body != nullptr ? body : new ScopeNode());
+    return node;
+}
+
+Node* DeadCodeEliminator::eliminateFor(ForNode* node) {
+    bool value;
+    if (node->getCondition() != nullptr && constantCondition(node->getCondition(), value) && !value) {
+        // the initializer still runs once
+        if (node->getInitializer() != nullptr) {
+            removedStatements++;
+        }
+        return node->getInitializer();
+    }
+
+    auto body = eliminate(node->getBody());
+    node->setBody(body != nullptr ? body : new ScopeNode());
+    return node;
+}
+
+bool DeadCodeEliminator::constantCondition(Node* condition, bool& value) {
+    switch (condition->getType()) {
+        case NodeType::BOOL: value = static_cast<BoolNode*>(condition)->getValue(); return true;
+        case NodeType::INTEGER: value = static_cast<IntegerNode*>(condition)->getValue() != 0; return true;
+        case NodeType::DOUBLE: value = static_cast<DoubleNode*>(condition)->getValue() != 0.0; return true;
+        case NodeType::CHAR: value = static_cast<CharNode*>(condition)->getValue() != '\0'; return true;
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(condition);
+            if (unary->getOp()->getOp() == TokenType::BANG && constantCondition(unary->getNode(), value)) {
+                value = !value;
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+bool DeadCodeEliminator::alwaysReturns(Node* node) {
+    if (node == nullptr) {
+        return false;
+    }
+
+    switch (node->getType()) {
+        case NodeType::UNARY: return isReturn(node);
+        case NodeType::SCOPE: {
+            auto statements = static_cast<ScopeNode*>(node)->getStatements();
+            return std::any_of(statements.begin(), statements.end(), alwaysReturns);
+        }
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            return alwaysReturns(ifNode->getThenBranch()) && alwaysReturns(ifNode->getElseBranch());
+        }
+        default:
+            return false;
+    }
+}
+
+bool DeadCodeEliminator::isReturn(Node* node) {
+    return node->getType() == NodeType::UNARY
+        && static_cast<UnaryNode*>(node)->getOp()->getOp() == TokenType::RETURN;
+}
+
+// Call graph
+
+void DeadCodeEliminator::collectCalls(Node* node, Node* owner) {
+    if (node == nullptr) {
+        return;
+    }
+
+    switch (node->getType()) {
+        case NodeType::SCOPE: {
+            auto scope = static_cast<ScopeNode*>(node);
+            scopeOwners.emplace(scope, owner);
+            for (auto stmt : scope->getStatements()) {
+                collectCalls(stmt, owner);
+            }
+            break;
+        }
+        case NodeType::FUNCTION:
+            collectCalls(static_cast<FunctionNode*>(node)->getBody(), node);
+            break;
+        case NodeType::CLASS: {
+            auto klass = static_cast<ClassNode*>(node);
+            classes.emplace_back(klass);
+            for (auto const& [_, method] : klass->getMethods()) {
+                collectCalls(method->getBody(), method);
+            }
+            for (auto const& [_, attribute] : klass->getAttributes()) {
+                collectCalls(attribute->getInitializer(), owner);
+            }
+            break;
+        }
+        case NodeType::CALL: {
+            auto call = static_cast<FunctionCallNode*>(node);
+            liveCalls.emplace(call);
+            for (auto arg : call->getArgs()) {
+                collectCalls(arg, owner);
+            }
+            break;
+        }
+        case NodeType::SPAWN:
+            collectCalls(static_cast<SpawnNode*>(node)->getCall(), owner);
+            break;
+        case NodeType::METHOD_CALL: {
+            auto call = static_cast<MethodCallNode*>(node);
+            methodCalls[owner].emplace_back(call->getCallee());
+            collectCalls(call->getReceiver(), owner);
+            for (auto arg : call->getArgs()) {
+                collectCalls(arg, owner);
+            }
+            break;
+        }
+        case NodeType::VARIABLE_DECL:
+            collectCalls(static_cast<VariableDeclarationNode*>(node)->getInitializer(), owner);
+            break;
+        case NodeType::ARRAY:
+            for (auto element : static_cast<ArrayNode*>(node)->getElements()) {
+                collectCalls(element, owner);
+            }
+            break;
+        case NodeType::MAP:
+            for (auto entry : static_cast<MapNode*>(node)->getEntries()) {
+                collectCalls(entry, owner);
+            }
+            break;
+        case NodeType::UNARY:
+            collectCalls(static_cast<UnaryNode*>(node)->getNode(), owner);
+            break;
+        case NodeType::BINARY:
+            collectCalls(static_cast<BinaryNode*>(node)->getLeft(), owner);
+            collectCalls(static_cast<BinaryNode*>(node)->getRight(), owner);
+            break;
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            collectCalls(ifNode->getCondition(), owner);
+            collectCalls(ifNode->getThenBranch(), owner);
+            collectCalls(ifNode->getElseBranch(), owner);
+            break;
+        }
+        case NodeType::WHILE:
+            collectCalls(static_cast<WhileNode*>(node)->getCondition(), owner);
+            collectCalls(static_cast<WhileNode*>(node)->getBody(), owner);
+            break;
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            collectCalls(forNode->getInitializer(), owner);
+            collectCalls(forNode->getCondition(), owner);
+            collectCalls(forNode->getIncrement(), owner);
+            collectCalls(forNode->getBody(), owner);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DeadCodeEliminator::removeUnreachable() {
+    auto callees = std::unordered_map<Node*, std::vector<Node*>>();
+    for (auto [scope, call] : functionCalls) {
+        if (!liveCalls.contains(call)) {
+            continue;
+        }
+
+        Node* callee = call->getFunction();
+        if (callee == nullptr && call->getInstantiatedClass() != nullptr) {
+            callee = call->getInstantiatedClass()->getConstructor();
+        }
+        if (callee == nullptr) {
+            continue;
+        }
+
+        auto owner = scope;
+        while (owner != nullptr && !scopeOwners.contains(owner)) {
+            owner = owner->getEnclosing();
+        }
+        if (owner != nullptr) {
+            callees[scopeOwners[owner]].emplace_back(callee);
+        }
+    }
+
+    // methods are resolved by name, the receiver is not known statically
+    auto methodsByName = std::unordered_map<std::string, std::vector<Node*>>();
+    for (auto klass : classes) {
+        for (auto const& [name, method] : klass->getMethods()) {
+            methodsByName[name].emplace_back(method);
+        }
+    }
+
+    auto reachable = std::unordered_set<Node*>();
+    auto worklist = std::queue<Node*>();
+    reachable.emplace(rootScope);
+    worklist.emplace(rootScope);
+    if (keepFunctions) {
+        for (auto stmt : rootScope->getStatements()) {
+            if (stmt->getType() == NodeType::FUNCTION && reachable.emplace(stmt).second) {
+                worklist.emplace(stmt);
+            }
+        }
+    }
+    if (keepMethods) {
+        for (auto klass : classes) {
+            for (auto const& [_, method] : klass->getMethods()) {
+                if (reachable.emplace(method).second) {
+                    worklist.emplace(method);
+                }
+            }
+        }
+    }
+
+    while (!worklist.empty()) {
+        auto owner = worklist.front();
+        worklist.pop();
+
+        auto visit = [&](Node* callee) {
+            if (reachable.emplace(callee).second) {
+                worklist.emplace(callee);
+            }
+        };
+
+        for (auto callee : callees[owner]) {
+            visit(callee);
+        }
+        for (auto const& name : methodCalls[owner]) {
+            for (auto method : methodsByName[name]) {
+                visit(method);
+            }
+        }
+    }
+
+    auto statements = std::vector<Node*>();
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::FUNCTION && !reachable.contains(stmt)) {
+            rootScope->removeFunction(static_cast<FunctionNode*>(stmt)->getName());
+            removedFunctions++;
+            continue;
+        }
+        statements.emplace_back(stmt);
+    }
+    rootScope->setStatements(std::move(statements));
+
+    for (auto klass : classes) {
+        for (auto const& [name, method] : klass->getMethods()) {
+            if (!reachable.contains(method)) {
+                klass->removeMethod(name);
+                removedMethods++;
+            }
+        }
+    }
+}
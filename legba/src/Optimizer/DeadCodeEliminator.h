@@ -0,0 +1,61 @@
+#ifndef LEGBA_DEAD_CODE_ELIMINATOR_H
+#define LEGBA_DEAD_CODE_ELIMINATOR_H
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ASTNode/ASTNode.h"
+
+// Removes statements that can never execute (constant-false branches and loops,
+// code after a return) and functions/methods that are not reachable from the root scope.
+class DeadCodeEliminator {
+public:
+    DeadCodeEliminator(ScopeNode* rootScope, std::vector<std::pair<ScopeNode*, FunctionCallNode*>> const& functionCalls)
+        : rootScope(rootScope), functionCalls(functionCalls) {
+    }
+
+    void run();
+
+    // Keep every function of the root scope, for hosts calling them by name.
+    void setKeepFunctions(bool keep) { keepFunctions = keep; }
+    // Keep every method, for modules calling them on instances they get from here.
+    void setKeepMethods(bool keep) { keepMethods = keep; }
+
+    int getRemovedStatements() const { return removedStatements; }
+    int getRemovedFunctions() const { return removedFunctions; }
+    int getRemovedMethods() const { return removedMethods; }
+
+private:
+    // Unreachable statements
+    Node* eliminate(Node* node);
+    Node* eliminateScope(ScopeNode* scope);
+    Node* eliminateIf(IfNode* node);
+    Node* eliminateWhile(WhileNode* node);
+    Node* eliminateFor(ForNode* node);
+
+    static bool constantCondition(Node* condition, bool& value);
+    static bool alwaysReturns(Node* node);
+    static bool isReturn(Node* node);
+
+    // Call graph
+    void collectCalls(Node* node, Node* owner);
+    void removeUnreachable();
+
+private:
+    ScopeNode* rootScope;
+    std::vector<std::pair<ScopeNode*, FunctionCallNode*>> const& functionCalls;
+
+    std::unordered_map<ScopeNode*, Node*> scopeOwners;
+    std::unordered_set<FunctionCallNode*> liveCalls;
+    std::unordered_map<Node*, std::vector<std::string>> methodCalls;
+    std::vector<ClassNode*> classes;
+    bool keepFunctions = false;
+    bool keepMethods = false;
+
+    int removedStatements = 0;
+    int removedFunctions = 0;
+    int removedMethods = 0;
+};
+
+#endif
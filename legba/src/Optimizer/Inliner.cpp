@@ -0,0 +1,549 @@
+#include "Inliner.h"
+
+#include <algorithm>
+
+static bool isLiteral(Node* node) {
+    switch (node->getType()) {
+        case NodeType::INTEGER:
+        case NodeType::DOUBLE:
+        case NodeType::STRING:
+        case NodeType::CHAR:
+        case NodeType::BOOL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isVariable(Node* node, bool global) {
+    return node->getType() == NodeType::VARIABLE && static_cast<VariableNode*>(node)->getVar()->isGlobal() == global;
+}
+
+static bool isAssignment(Node* node) {
+    return node->getType() == NodeType::BINARY && static_cast<BinaryNode*>(node)->getOp()->getOp() == TokenType::EQUAL;
+}
+
+// First variable read or call when evaluating node, except reads skip accepts.
+// Literals have no effect.
+template<typename Skip>
+static Node* firstEvaluated(Node* node, Skip const& skip) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    auto first = [&](std::vector<Node*> const& nodes) -> Node* {
+        for (auto n : nodes) {
+            if (auto found = firstEvaluated(n, skip)) {
+                return found;
+            }
+        }
+        return nullptr;
+    };
+
+    switch (node->getType()) {
+        case NodeType::VARIABLE:
+            return skip(static_cast<VariableNode*>(node)) ? nullptr : node;
+        case NodeType::UNARY:
+            return firstEvaluated(static_cast<UnaryNode*>(node)->getNode(), skip);
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            if (isAssignment(node) && binary->getLeft()->getType() == NodeType::VARIABLE) {
+                return firstEvaluated(binary->getRight(), skip);
+            }
+            // attribute targets evaluate their object before the value
+            return first({ binary->getLeft(), binary->getRight() });
+        }
+        case NodeType::CALL: {
+            auto found = first(static_cast<FunctionCallNode*>(node)->getArgs());
+            return found != nullptr ? found : node;
+        }
+        case NodeType::SPAWN: {
+            auto found = first(static_cast<SpawnNode*>(node)->getCall()->getArgs());
+            return found != nullptr ? found : node;
+        }
+        case NodeType::METHOD_CALL: {
+            auto call = static_cast<MethodCallNode*>(node);
+            auto operands = call->getArgs();
+            operands.insert(operands.begin(), call->getReceiver());
+            auto found = first(operands);
+            return found != nullptr ? found : node;
+        }
+        case NodeType::ARRAY:
+            return first(static_cast<ArrayNode*>(node)->getElements());
+        case NodeType::MAP:
+            return first(static_cast<MapNode*>(node)->getEntries());
+        default:
+            return nullptr;
+    }
+}
+
+void Inliner::run() {
+    types.run();
+
+    currentFunction = rootScope;
+    statement(rootScope);
+}
+
+// Rewriting
+
+void Inliner::process(Node* function) {
+    auto& callee = callees[function];
+    if (callee.state != State::NEW) {
+        return;
+    }
+
+    // callees are rewritten before their callers, so inlined bodies are final
+    callee.state = State::ACTIVE;
+    auto saved = currentFunction;
+    currentFunction = function;
+    if (function->getType() == NodeType::FUNCTION) {
+        statement(static_cast<FunctionNode*>(function)->getBody());
+    } else {
+        statement(static_cast<MethodNode*>(function)->getBody());
+    }
+    currentFunction = saved;
+    callee.state = State::DONE;
+
+    classify(function, callee);
+}
+
+Node* Inliner::statement(Node* node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    switch (node->getType()) {
+        case NodeType::SCOPE: {
+            auto scope = static_cast<ScopeNode*>(node);
+            auto statements = std::vector<Node*>();
+            for (auto stmt : scope->getStatements()) {
+                if (auto result = statement(stmt)) {
+                    statements.emplace_back(result);
+                }
+            }
+            scope->setStatements(std::move(statements));
+            return scope;
+        }
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            ifNode->setCondition(expression(ifNode->getCondition()));
+            auto thenBranch = statement(ifNode->getThenBranch());
+            ifNode->setThenBranch(thenBranch != nullptr ? thenBranch : new ScopeNode());
+            ifNode->setElseBranch(statement(ifNode->getElseBranch()));
+            return ifNode;
+        }
+        case NodeType::WHILE: {
+            auto whileNode = static_cast<WhileNode*>(node);
+            whileNode->setCondition(expression(whileNode->getCondition()));
+            auto body = statement(whileNode->getBody());
+            whileNode->setBody(body != nullptr ? body : new ScopeNode());
+            return whileNode;
+        }
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            forNode->setInitializer(statement(forNode->getInitializer()));
+            if (forNode->getCondition() != nullptr) {
+                forNode->setCondition(expression(forNode->getCondition()));
+            }
+            forNode->setIncrement(statement(forNode->getIncrement()));
+            auto body = statement(forNode->getBody());
+            forNode->setBody(body != nullptr ? body : new ScopeNode());
+            return forNode;
+        }
+        case NodeType::VARIABLE_DECL: {
+            auto var = static_cast<VariableDeclarationNode*>(node);
+            if (var->getInitializer() != nullptr) {
+                var->setInitializer(expression(var->getInitializer()));
+            }
+            return var;
+        }
+        case NodeType::FUNCTION:
+            process(node);
+            return node;
+        case NodeType::CLASS:
+            for (auto const& [_, method] : static_cast<ClassNode*>(node)->getMethods()) {
+                process(method);
+            }
+            return node;
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(node);
+            if (unary->getOp()->getOp() == TokenType::RETURN) {
+                if (unary->getNode() != nullptr) {
+                    unary->setNode(expression(unary->getNode()));
+                }
+                return unary;
+            }
+            return expression(node);
+        }
+        case NodeType::CALL:
+        case NodeType::METHOD_CALL:
+            return call(node, true);
+        default:
+            return expression(node);
+    }
+}
+
+Node* Inliner::expression(Node* node) {
+    switch (node->getType()) {
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(node);
+            unary->setNode(expression(unary->getNode()));
+            return unary;
+        }
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            binary->setLeft(expression(binary->getLeft()));
+            binary->setRight(expression(binary->getRight()));
+            return binary;
+        }
+        case NodeType::CALL:
+        case NodeType::METHOD_CALL:
+            return call(node, false);
+        case NodeType::SPAWN: {
+            // the spawned call runs elsewhere, only its arguments are rewritten
+            auto call = static_cast<SpawnNode*>(node)->getCall();
+            auto args = std::vector<Node*>();
+            for (auto arg : call->getArgs()) {
+                args.emplace_back(expression(arg));
+            }
+            call->setArgs(std::move(args));
+            return node;
+        }
+        case NodeType::ARRAY: {
+            auto array = static_cast<ArrayNode*>(node);
+            auto elements = std::vector<Node*>();
+            for (auto element : array->getElements()) {
+                elements.emplace_back(expression(element));
+            }
+            array->setElements(std::move(elements));
+            return array;
+        }
+        case NodeType::MAP: {
+            auto map = static_cast<MapNode*>(node);
+            auto entries = std::vector<Node*>();
+            for (auto entry : map->getEntries()) {
+                entries.emplace_back(expression(entry));
+            }
+            map->setEntries(std::move(entries));
+            return map;
+        }
+        default:
+            return node;
+    }
+}
+
+Node* Inliner::call(Node* node, bool discarded) {
+    Node* target = nullptr;
+    auto args = std::vector<Node*>();
+
+    if (node->getType() == NodeType::CALL) {
+        auto call = static_cast<FunctionCallNode*>(node);
+        for (auto arg : call->getArgs()) {
+            args.emplace_back(expression(arg));
+        }
+        call->setArgs(args);
+        target = call->getFunction(); // constructors allocate, they stay calls
+    } else {
+        auto call = static_cast<MethodCallNode*>(node);
+        // resolved before the receiver gets rewritten, inference only knows the original nodes
+        MethodNode* method = call->getFunction() != nullptr ? call->getFunction() : types.staticTarget(call);
+        call->setReceiver(expression(call->getReceiver()));
+        for (auto arg : call->getArgs()) {
+            args.emplace_back(expression(arg));
+        }
+        call->setArgs(args);
+        args.insert(args.begin(), call->getReceiver());
+
+        if (method != nullptr && call->getFunction() == nullptr) {
+            call->setFunction(method);
+            devirtualizedCalls++;
+            report("Devirtualized call of '" + nameOf(method) + "' in '" + nameOf(currentFunction) + "'");
+        }
+        target = method;
+    }
+
+    if (target == nullptr || !types.declares(target)) {
+        return node;
+    }
+
+    process(target);
+    auto& callee = callees[target];
+    if (callee.state == State::ACTIVE) {
+        callee.recursive = true;
+        return node;
+    }
+    if (args.size() != callee.params.size()) {
+        return node; // fails at runtime
+    }
+    return inlineCall(node, target, args, discarded);
+}
+
+// Inlining
+
+void Inliner::classify(Node* function, Callee& callee) {
+    Node* body;
+    if (function->getType() == NodeType::FUNCTION) {
+        body = static_cast<FunctionNode*>(function)->getBody();
+        callee.params = TypeInference::getParams(function);
+    } else {
+        body = static_cast<MethodNode*>(function)->getBody();
+        callee.params = TypeInference::getParams(function);
+        callee.params.insert(callee.params.begin(), TypeInference::getThis(static_cast<MethodNode*>(function)));
+    }
+
+    auto statements = static_cast<ScopeNode*>(body)->getStatements();
+    if (statements.empty()) {
+        callee.shape = Shape::EMPTY;
+        return;
+    }
+    if (statements.size() > 1) {
+        callee.reason = "more than one statement";
+        return;
+    }
+
+    auto stmt = statements[0];
+    switch (stmt->getType()) {
+        case NodeType::UNARY:
+            if (static_cast<UnaryNode*>(stmt)->getOp()->getOp() != TokenType::RETURN) {
+                callee.shape = Shape::STATEMENT;
+                callee.expression = stmt;
+            } else if (static_cast<UnaryNode*>(stmt)->getNode() == nullptr) {
+                callee.shape = Shape::EMPTY;
+            } else {
+                callee.shape = Shape::RETURN;
+                callee.expression = static_cast<UnaryNode*>(stmt)->getNode();
+            }
+            break;
+        case NodeType::BINARY:
+        case NodeType::CALL:
+        case NodeType::METHOD_CALL:
+            callee.shape = Shape::STATEMENT;
+            callee.expression = stmt;
+            break;
+        default:
+            callee.reason = "not a single expression";
+            return;
+    }
+    if (callee.expression == nullptr) {
+        return;
+    }
+
+    int size = 0;
+    visitTree(callee.expression, [&](Node* n) {
+        size++;
+        if (n->getType() == NodeType::VARIABLE) {
+            auto var = static_cast<VariableNode*>(n)->getVar();
+            if (!var->isGlobal() && std::find(callee.params.begin(), callee.params.end(), var) == callee.params.end()) {
+                callee.reason = "reads variables of an enclosing function";
+            }
+        }
+        if (isAssignment(n) && isVariable(static_cast<BinaryNode*>(n)->getLeft(), false)) {
+            callee.reason = "assigns a parameter";
+        }
+    });
+    if (size > INLINE_BUDGET) {
+        callee.reason = "too large (" + std::to_string(size) + " nodes)";
+    }
+    if (!callee.reason.empty()) {
+        callee.shape = Shape::NONE;
+        callee.expression = nullptr;
+    }
+}
+
+Node* Inliner::inlineCall(Node* call, Node* function, std::vector<Node*> args, bool discarded) {
+    auto const& callee = callees[function];
+    std::string reason;
+    if (callee.recursive) {
+        reason = "recursive";
+    } else if (callee.shape == Shape::NONE) {
+        reason = callee.reason;
+    } else if (!discarded && callee.shape != Shape::RETURN) {
+        reason = "result is used but nothing is returned";
+    } else {
+        canSubstitute(callee, args, reason);
+    }
+    if (!reason.empty()) {
+        report("Not inlining '" + nameOf(function) + "' into '" + nameOf(currentFunction) + "': " + reason);
+        return call;
+    }
+
+    inlinedCalls++;
+    report("Inlined '" + nameOf(function) + "' into '" + nameOf(currentFunction) + "'");
+    if (callee.shape == Shape::EMPTY) {
+        return nullptr;
+    }
+
+    auto bindings = std::unordered_map<VariableDeclarationNode*, Node*>();
+    for (size_t i = 0; i < args.size(); i++) {
+        bindings.emplace(callee.params[i], args[i]);
+    }
+    auto result = substitute(callee.expression, bindings);
+    if (discarded) {
+        if (isLiteral(result)) {
+            return nullptr;
+        }
+        result->setLine(call->getLine());
+    }
+    return result;
+}
+
+// Arguments are evaluated before the body runs. Literals and locals of the caller
+// can be substituted anywhere, nothing the body does changes them. Globals only when
+// the body neither calls nor assigns globals. Any other argument is evaluated where
+// its parameter is used, so that has to happen exactly once and before anything else
+// the body reads, it must be the only such argument and can't assign the variables
+// passed along with it.
+bool Inliner::canSubstitute(Callee const& callee, std::vector<Node*> const& args, std::string& reason) {
+    bool writesGlobals = false;
+    auto uses = std::unordered_map<VariableDeclarationNode*, int>();
+    visitTree(callee.expression, [&](Node* n) {
+        if (n->getType() == NodeType::CALL || n->getType() == NodeType::METHOD_CALL) {
+            writesGlobals = true;
+        } else if (isAssignment(n) && isVariable(static_cast<BinaryNode*>(n)->getLeft(), true)) {
+            writesGlobals = true;
+        } else if (n->getType() == NodeType::VARIABLE) {
+            uses[static_cast<VariableNode*>(n)->getVar()]++;
+        }
+    });
+
+    int evaluated = -1;
+    bool readsGlobals = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        auto arg = args[i];
+        if (isLiteral(arg) || isVariable(arg, false)) {
+            continue;
+        }
+        if (isVariable(arg, true) && !writesGlobals) {
+            readsGlobals = true;
+            continue;
+        }
+        if (evaluated != -1) {
+            reason = "more than one argument has to be evaluated first";
+            return false;
+        }
+        evaluated = static_cast<int>(i);
+    }
+    if (evaluated == -1) {
+        return true;
+    }
+
+    auto param = callee.params[evaluated];
+    if (uses[param] != 1) {
+        reason = uses[param] == 0 ? "argument is never used" : "argument is used more than once";
+        return false;
+    }
+    bool assigns = false;
+    visitTree(args[evaluated], [&](Node* n) {
+        assigns |= isAssignment(n) && static_cast<BinaryNode*>(n)->getLeft()->getType() == NodeType::VARIABLE;
+    });
+    if (readsGlobals || assigns) {
+        reason = "argument could change a variable passed along with it";
+        return false;
+    }
+
+    // reads of the other parameters see the same values either way
+    auto first = firstEvaluated(callee.expression, [&](VariableNode* read) {
+        auto it = std::find(callee.params.begin(), callee.params.end(), read->getVar());
+        return it != callee.params.end() && *it != param;
+    });
+    if (first == nullptr || first->getType() != NodeType::VARIABLE || static_cast<VariableNode*>(first)->getVar() != param) {
+        reason = "argument is not evaluated first";
+        return false;
+    }
+    return true;
+}
+
+Node* Inliner::substitute(Node* node, std::unordered_map<VariableDeclarationNode*, Node*> const& bindings) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    auto list = [&](std::vector<Node*> const& nodes) {
+        auto result = std::vector<Node*>();
+        for (auto n : nodes) {
+            result.emplace_back(substitute(n, bindings));
+        }
+        return result;
+    };
+
+    Node* result;
+    switch (node->getType()) {
+        case NodeType::VARIABLE: {
+            auto var = static_cast<VariableNode*>(node)->getVar();
+            auto it = bindings.find(var);
+            if (it == bindings.end()) {
+                result = new VariableNode(var);
+            } else if (it->second->getType() == NodeType::VARIABLE) {
+                result = new VariableNode(static_cast<VariableNode*>(it->second)->getVar());
+            } else {
+                // literals are shared, anything else is used exactly once
+                return it->second;
+            }
+            break;
+        }
+        case NodeType::IDENTIFIER:
+            result = new IdentifierNode(static_cast<IdentifierNode*>(node)->getName());
+            break;
+        case NodeType::UNARY: {
+            auto unary = static_cast<UnaryNode*>(node);
+            result = new UnaryNode(new OpNode(unary->getOp()->getOp()), substitute(unary->getNode(), bindings));
+            break;
+        }
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            result = new BinaryNode(binary->getOp()->getOp(), substitute(binary->getLeft(), bindings), substitute(binary->getRight(), bindings));
+            break;
+        }
+        case NodeType::CALL: {
+            auto call = static_cast<FunctionCallNode*>(node);
+            auto copy = new FunctionCallNode(call->getCallee(), list(call->getArgs()), nullptr, call->getFunction());
+            copy->setInstantiatedClass(call->getInstantiatedClass());
+            copy->setBuiltin(call->getBuiltin());
+            result = copy;
+            break;
+        }
+        case NodeType::SPAWN:
+            result = new SpawnNode(static_cast<FunctionCallNode*>(substitute(static_cast<SpawnNode*>(node)->getCall(), bindings)),
+                static_cast<SpawnNode*>(node)->isCoroutine());
+            break;
+        case NodeType::METHOD_CALL: {
+            auto call = static_cast<MethodCallNode*>(node);
+            result = new MethodCallNode(call->getCallee(), list(call->getArgs()), substitute(call->getReceiver(), bindings), call->getFunction());
+            break;
+        }
+        case NodeType::ARRAY: {
+            auto array = static_cast<ArrayNode*>(node);
+            auto copy = new ArrayNode(list(array->getElements()));
+            copy->setElementType(array->getElementType());
+            result = copy;
+            break;
+        }
+        case NodeType::MAP:
+            result = new MapNode(list(static_cast<MapNode*>(node)->getEntries()));
+            break;
+        default:
+            return node; // literals never change
+    }
+
+    result->setResultType(node->getResultType());
+    return result;
+}
+
+std::string Inliner::nameOf(Node* function) const {
+    switch (function->getType()) {
+        case NodeType::FUNCTION:
+            return static_cast<FunctionNode*>(function)->getName();
+        case NodeType::METHOD: {
+            auto method = static_cast<MethodNode*>(function);
+            return method->getClass()->getName() + '.' + method->getName();
+        }
+        default:
+            return "<script>";
+    }
+}
+
+void Inliner::report(const std::string& message) {
+    if (log != nullptr) {
+        *log << "-- " << message << std::endl;
+    }
+}
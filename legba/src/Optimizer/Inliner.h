@@ -0,0 +1,80 @@
+#ifndef LEGBA_INLINER_H
+#define LEGBA_INLINER_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTNode/ASTNode.h"
+#include "Codegen/TypeInference.h"
+
+// Replaces calls of small functions and methods by their bodies. A callee qualifies
+// when its body is a single `return expression;`, or a single expression statement
+// for calls whose result is discarded, of at most INLINE_BUDGET nodes and it is not
+// recursive. Method calls are resolved with whole program type inference: when the
+// receiver can only be an instance of one class the call gets devirtualized, engines
+// then call the method without looking it up, and inlined if the method qualifies.
+//
+// Arguments are substituted for the parameters instead of being stored in
+// temporaries, so a call is only inlined when that evaluates the same things in the
+// same order, see canSubstitute.
+class Inliner {
+public:
+    Inliner(ScopeNode* rootScope, std::ostream* log = nullptr)
+        : rootScope(rootScope), types(rootScope), log(log) {
+    }
+
+    // Compiling a module, see TypeInference::setOpen. Functions of the modules it
+    // imports are never inlined, their globals are not this module's.
+    void setOpen(bool enabled) { types.setOpen(enabled); }
+
+    void run();
+
+    int getInlinedCalls() const { return inlinedCalls; }
+    int getDevirtualizedCalls() const { return devirtualizedCalls; }
+
+private:
+    static constexpr int INLINE_BUDGET = 16;
+
+    enum class State { NEW, ACTIVE, DONE };
+    enum class Shape { NONE, EMPTY, STATEMENT, RETURN };
+
+    struct Callee {
+        State state = State::NEW;
+        bool recursive = false;
+        Shape shape = Shape::NONE;
+        Node* expression = nullptr;           // returned or evaluated
+        std::vector<VariableDeclarationNode*> params; // 'this' first for methods
+        std::string reason;                   // why it can't be inlined
+    };
+
+    // Rewriting
+    void process(Node* function);
+    Node* statement(Node* node);
+    Node* expression(Node* node);
+    Node* call(Node* node, bool discarded);
+
+    // Inlining
+    void classify(Node* function, Callee& callee);
+    Node* inlineCall(Node* call, Node* function, std::vector<Node*> args, bool discarded);
+    bool canSubstitute(Callee const& callee, std::vector<Node*> const& args, std::string& reason);
+    Node* substitute(Node* node, std::unordered_map<VariableDeclarationNode*, Node*> const& bindings);
+
+    std::string nameOf(Node* function) const;
+    void report(const std::string& message);
+
+private:
+    ScopeNode* rootScope;
+    TypeInference types;
+    std::ostream* log;
+
+    std::unordered_map<Node*, Callee> callees;
+    Node* currentFunction = nullptr;
+
+    int inlinedCalls = 0;
+    int devirtualizedCalls = 0;
+};
+
+#endif
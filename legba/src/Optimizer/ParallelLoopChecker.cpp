@@ -0,0 +1,425 @@
+#include "ParallelLoopChecker.h"
+
+#include <vector>
+
+#include "Runtime/Builtins.h"
+
+namespace {
+
+// the nodes evaluated as part of node, the arguments only of spawned calls
+std::vector<Node*> children(Node* node) {
+    switch (node->getType()) {
+        case NodeType::SCOPE: return static_cast<ScopeNode*>(node)->getStatements();
+        case NodeType::IF: {
+            auto ifNode = static_cast<IfNode*>(node);
+            return { ifNode->getCondition(), ifNode->getThenBranch(), ifNode->getElseBranch() };
+        }
+        case NodeType::WHILE: {
+            auto whileNode = static_cast<WhileNode*>(node);
+            return { whileNode->getCondition(), whileNode->getBody() };
+        }
+        case NodeType::FOR: {
+            auto forNode = static_cast<ForNode*>(node);
+            return { forNode->getInitializer(), forNode->getCondition(), forNode->getIncrement(), forNode->getBody() };
+        }
+        case NodeType::VARIABLE_DECL: return { static_cast<VariableDeclarationNode*>(node)->getInitializer() };
+        case NodeType::UNARY: return { static_cast<UnaryNode*>(node)->getNode() };
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(node);
+            if (binary->getOp()->getOp() == TokenType::DOT) {
+                return { binary->getLeft() };
+            }
+            return { binary->getLeft(), binary->getRight() };
+        }
+        case NodeType::CALL: return static_cast<FunctionCallNode*>(node)->getArgs();
+        case NodeType::SPAWN: return static_cast<SpawnNode*>(node)->getCall()->getArgs();
+        case NodeType::METHOD_CALL: {
+            auto call = static_cast<MethodCallNode*>(node);
+            auto nodes = call->getArgs();
+            nodes.insert(nodes.begin(), call->getReceiver());
+            return nodes;
+        }
+        case NodeType::ARRAY: return static_cast<ArrayNode*>(node)->getElements();
+        case NodeType::MAP: return static_cast<MapNode*>(node)->getEntries();
+        default: return {};
+    }
+}
+
+template<typename F>
+void forEachNode(Node* node, F const& visit) {
+    if (node == nullptr) {
+        return;
+    }
+    visit(node);
+    for (auto child : children(node)) {
+        forEachNode(child, visit);
+    }
+}
+
+bool isOp(Node* node, TokenType op) {
+    return node->getType() == NodeType::BINARY && static_cast<BinaryNode*>(node)->getOp()->getOp() == op;
+}
+
+bool isVariable(Node* node, VariableDeclarationNode* var) {
+    return node->getType() == NodeType::VARIABLE && static_cast<VariableNode*>(node)->getVar() == var;
+}
+
+std::string reductionForm(std::string const& name, ParallelLoop::Reduction kind) {
+    switch (kind) {
+        case ParallelLoop::Reduction::SUM: return name + " = " + name + " + ...";
+        case ParallelLoop::Reduction::MIN: return name + " = min(" + name + ", ...)";
+        case ParallelLoop::Reduction::MAX: return name + " = max(" + name + ", ...)";
+    }
+    return name;
+}
+
+}
+
+bool ParallelLoopChecker::Region::isOuter(VariableDeclarationNode* var) const {
+    return var->isGlobal() || outer.contains(var) || var->getSlot() < paramCount;
+}
+
+// The effects of every function and method are known up front: they only ever grow
+// while the calls are followed, until nothing changes anymore.
+ParallelLoopChecker::ParallelLoopChecker(ScopeNode* rootScope, std::ostream& diagnostics) : diagnostics(diagnostics) {
+    auto regions = std::vector<std::pair<Node*, Region>>();
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::FUNCTION) {
+            auto func = static_cast<FunctionNode*>(stmt);
+            Region own;
+            own.paramCount = static_cast<int>(func->getParams().size());
+            findForeign(func->getBody(), own);
+            regions.emplace_back(func, std::move(own));
+        } else if (stmt->getType() == NodeType::CLASS) {
+            auto klass = static_cast<ClassNode*>(stmt);
+            for (auto const& [name, method] : klass->getMethods()) {
+                methodsByName[name].push_back(method);
+                Region own;
+                own.paramCount = static_cast<int>(method->getParams().size()) + 1; // this
+                own.isConstructor = name == klass->getName();
+                findForeign(method->getBody(), own);
+                regions.emplace_back(method, std::move(own));
+            }
+            for (auto const& [name, attribute] : klass->getAttributes()) {
+                if (attribute->isStatic()) {
+                    statics.insert(name);
+                }
+            }
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& [owner, own] : regions) {
+            Effects found;
+            auto body = owner->getType() == NodeType::FUNCTION ? static_cast<FunctionNode*>(owner)->getBody()
+                : static_cast<MethodNode*>(owner)->getBody();
+            collectEffects(body, own, found);
+            auto& effects = known[owner];
+            if (found.throughThis != effects.throughThis || found.other != effects.other) {
+                effects = found;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool ParallelLoopChecker::check(ParallelLoop const& loop) {
+    this->loop = &loop;
+    ok = true;
+    region = Region();
+    reductions.clear();
+    updates.clear();
+    for (auto var : loop.captures) {
+        region.outer.insert(var);
+    }
+    for (auto [var, kind] : loop.reductions) {
+        region.outer.insert(var);
+        reductions.emplace(var, kind);
+    }
+    findForeign(loop.body, region);
+
+    checkNode(loop.body);
+    return ok;
+}
+
+void ParallelLoopChecker::checkNode(Node* node) {
+    if (node == nullptr) {
+        return;
+    }
+
+    switch (node->getType()) {
+        case NodeType::VARIABLE: {
+            auto var = static_cast<VariableNode*>(node)->getVar();
+            if (reductions.contains(var) && !updates.contains(node)) {
+                report("uses the reduction '" + var->getName() + "' other than in '" + reductionForm(var->getName(), reductions[var]) + "'");
+            }
+            return;
+        }
+        case NodeType::UNARY:
+            if (static_cast<UnaryNode*>(node)->getOp()->getOp() == TokenType::RETURN) {
+                report("returns from inside the loop");
+            }
+            break;
+        case NodeType::BINARY:
+            if (isOp(node, TokenType::EQUAL)) {
+                checkAssignment(static_cast<BinaryNode*>(node));
+                return;
+            }
+            break;
+        case NodeType::CALL:
+            checkCall(static_cast<FunctionCallNode*>(node));
+            break;
+        case NodeType::METHOD_CALL:
+            checkMethodCall(static_cast<MethodCallNode*>(node));
+            break;
+        default:
+            break;
+    }
+
+    for (auto child : children(node)) {
+        checkNode(child);
+    }
+}
+
+void ParallelLoopChecker::checkAssignment(BinaryNode* node) {
+    auto target = node->getLeft();
+    if (target->getType() == NodeType::VARIABLE) {
+        auto var = static_cast<VariableNode*>(target)->getVar();
+        if (auto it = reductions.find(var); it != reductions.end()) {
+            checkReduction(node, it->second);
+            return;
+        }
+        if (var == loop->index) {
+            report("assigns its index '" + var->getName() + "'");
+        } else if (region.isOuter(var)) {
+            report("assigns '" + var->getName() + "', which is declared outside of it");
+        }
+        checkNode(node->getRight());
+        return;
+    }
+
+    auto store = static_cast<BinaryNode*>(target);
+    auto root = storeRoot(store);
+    if (store->getOp()->getOp() == TokenType::DOT && isStatic(static_cast<IdentifierNode*>(store->getRight())->getName())) {
+        report("assigns the static attribute '" + static_cast<IdentifierNode*>(store->getRight())->getName() + "'");
+    } else if (mayBeForeign(root, region)) {
+        if (root->getType() == NodeType::VARIABLE) {
+            report("stores into '" + static_cast<VariableNode*>(root)->getVar()->getName() + "', which may hold an object from outside the loop");
+        } else {
+            report("stores into an object from outside the loop");
+        }
+    }
+    for (auto child : children(store)) {
+        checkNode(child);
+    }
+    checkNode(node->getRight());
+}
+
+// x = x + e or x = e + x for sums, also x = x + e + f, and x = min(x, e) or
+// x = min(e, x) for minimums
+void ParallelLoopChecker::checkReduction(BinaryNode* node, ParallelLoop::Reduction kind) {
+    auto var = static_cast<VariableNode*>(node->getLeft())->getVar();
+    auto value = node->getRight();
+    Node* own = nullptr;
+    std::vector<Node*> others;
+    auto pick = [&](Node* first, Node* second) {
+        if (isVariable(first, var)) {
+            own = first;
+            others.push_back(second);
+        } else if (isVariable(second, var)) {
+            own = second;
+            others.push_back(first);
+        }
+    };
+
+    if (kind == ParallelLoop::Reduction::SUM && isOp(value, TokenType::PLUS)) {
+        // a + b + c is (a + b) + c, x may be the innermost left operand
+        auto sum = static_cast<BinaryNode*>(value);
+        while (isOp(sum->getLeft(), TokenType::PLUS) && !isVariable(sum->getRight(), var)) {
+            others.push_back(sum->getRight());
+            sum = static_cast<BinaryNode*>(sum->getLeft());
+        }
+        pick(sum->getLeft(), sum->getRight());
+    } else if (kind != ParallelLoop::Reduction::SUM && value->getType() == NodeType::CALL) {
+        auto call = static_cast<FunctionCallNode*>(value);
+        std::string name = kind == ParallelLoop::Reduction::MIN ? "min" : "max";
+        if (call->getBuiltin() != nullptr && call->getBuiltin()->name == name) {
+            pick(call->getArgs()[0], call->getArgs()[1]);
+        }
+    }
+
+    if (own == nullptr) {
+        report("updates the reduction '" + var->getName() + "' other than by '" + reductionForm(var->getName(), kind) + "'");
+        return;
+    }
+    updates.insert(node->getLeft());
+    updates.insert(own);
+    for (auto other : others) {
+        checkNode(other);
+    }
+}
+
+void ParallelLoopChecker::checkCall(FunctionCallNode* call) {
+    if (call->getBuiltin() != nullptr) {
+        if (isMutatingBuiltin(call) && mayBeForeign(call->getArgs()[0], region)) {
+            report("passes an object from outside the loop to '" + call->getCallee() + "', which changes it");
+        }
+    } else if (auto func = call->getFunction()) {
+        if (known[func].other) {
+            report("calls '" + call->getCallee() + "', which changes globals or objects passed to it");
+        }
+    } else if (auto klass = call->getInstantiatedClass(); klass != nullptr && klass->getConstructor() != nullptr) {
+        if (known[klass->getConstructor()].other) {
+            report("creates a '" + klass->getName() + "', whose constructor changes globals or objects passed to it");
+        }
+    }
+}
+
+// The method is only known by name, any method of that name may run.
+void ParallelLoopChecker::checkMethodCall(MethodCallNode* call) {
+    auto candidates = call->getFunction() != nullptr ? std::vector<MethodNode*> { call->getFunction() } : methodsByName[call->getCallee()];
+    for (auto method : candidates) {
+        auto const& effects = known[method];
+        if (effects.other) {
+            report("calls '" + call->getCallee() + "', which changes globals or objects passed to it");
+            return;
+        }
+        if (effects.throughThis && mayBeForeign(call->getReceiver(), region)) {
+            report("calls '" + call->getCallee() + "' on an object from outside the loop, which changes it");
+            return;
+        }
+    }
+}
+
+void ParallelLoopChecker::collectEffects(Node* node, Region& region, Effects& result) {
+    // stores into the receiver count as such, a constructor's receiver is new
+    auto storeInto = [&](Node* object) {
+        if (isThis(object)) {
+            result.throughThis |= !region.isConstructor;
+        } else if (mayBeForeign(object, region)) {
+            result.other = true;
+        }
+    };
+
+    forEachNode(node, [&](Node* node) {
+        if (isOp(node, TokenType::EQUAL)) {
+            auto target = static_cast<BinaryNode*>(node)->getLeft();
+            if (target->getType() == NodeType::VARIABLE) {
+                result.other |= static_cast<VariableNode*>(target)->getVar()->isGlobal();
+            } else if (isOp(target, TokenType::DOT) && isStatic(static_cast<IdentifierNode*>(static_cast<BinaryNode*>(target)->getRight())->getName())) {
+                result.other = true;
+            } else {
+                storeInto(storeRoot(target));
+            }
+        } else if (node->getType() == NodeType::CALL) {
+            auto call = static_cast<FunctionCallNode*>(node);
+            if (call->getBuiltin() != nullptr) {
+                if (isMutatingBuiltin(call)) {
+                    storeInto(call->getArgs()[0]);
+                }
+            } else if (call->getFunction() != nullptr) {
+                result.other |= known[call->getFunction()].other;
+            } else if (call->getInstantiatedClass() != nullptr && call->getInstantiatedClass()->getConstructor() != nullptr) {
+                result.other |= known[call->getInstantiatedClass()->getConstructor()].other;
+            }
+        } else if (node->getType() == NodeType::METHOD_CALL) {
+            auto call = static_cast<MethodCallNode*>(node);
+            auto candidates = call->getFunction() != nullptr ? std::vector<MethodNode*> { call->getFunction() } : methodsByName[call->getCallee()];
+            for (auto method : candidates) {
+                auto const& effects = known[method];
+                result.other |= effects.other;
+                if (effects.throughThis) {
+                    storeInto(call->getReceiver());
+                }
+            }
+        }
+    });
+}
+
+void ParallelLoopChecker::findForeign(Node* body, Region& region) {
+    for (bool changed = true; changed;) {
+        changed = false;
+        auto assigned = [&](VariableDeclarationNode* var, Node* value) {
+            if (value != nullptr && !region.isOuter(var) && !region.foreign.contains(var) && mayBeForeign(value, region)) {
+                region.foreign.insert(var);
+                changed = true;
+            }
+        };
+        forEachNode(body, [&](Node* node) {
+            if (node->getType() == NodeType::VARIABLE_DECL) {
+                auto decl = static_cast<VariableDeclarationNode*>(node);
+                assigned(decl, decl->getInitializer());
+            } else if (isOp(node, TokenType::EQUAL) && static_cast<BinaryNode*>(node)->getLeft()->getType() == NodeType::VARIABLE) {
+                auto assignment = static_cast<BinaryNode*>(node);
+                assigned(static_cast<VariableNode*>(assignment->getLeft())->getVar(), assignment->getRight());
+            }
+        });
+    }
+}
+
+bool ParallelLoopChecker::mayBeForeign(Node* expr, Region const& region) {
+    switch (expr->getType()) {
+        case NodeType::VARIABLE: {
+            auto var = static_cast<VariableNode*>(expr)->getVar();
+            if (region.isConstructor && isThis(expr)) {
+                return false;
+            }
+            return region.isOuter(var) || region.foreign.contains(var);
+        }
+        case NodeType::BINARY: {
+            auto binary = static_cast<BinaryNode*>(expr);
+            switch (binary->getOp()->getOp()) {
+                case TokenType::DOT:
+                case TokenType::LEFT_BRACKET:
+                    return true;
+                case TokenType::EQUAL:
+                    return mayBeForeign(binary->getRight(), region);
+                case TokenType::AND:
+                case TokenType::OR:
+                    return mayBeForeign(binary->getLeft(), region) || mayBeForeign(binary->getRight(), region);
+                default:
+                    return false;
+            }
+        }
+        case NodeType::CALL: {
+            auto call = static_cast<FunctionCallNode*>(expr);
+            return call->getBuiltin() == nullptr && call->getInstantiatedClass() == nullptr;
+        }
+        case NodeType::METHOD_CALL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the object a[i][j] or a.b.c ends up in is reached from a
+Node* ParallelLoopChecker::storeRoot(Node* target) {
+    while (isOp(target, TokenType::DOT) || isOp(target, TokenType::LEFT_BRACKET)) {
+        target = static_cast<BinaryNode*>(target)->getLeft();
+    }
+    return target;
+}
+
+bool ParallelLoopChecker::isThis(Node* node) {
+    if (node->getType() != NodeType::VARIABLE) {
+        return false;
+    }
+    auto var = static_cast<VariableNode*>(node)->getVar();
+    return !var->isGlobal() && var->getName() == "this";
+}
+
+bool ParallelLoopChecker::isStatic(std::string const& attribute) const {
+    return statics.contains(attribute);
+}
+
+// fill(a, x) and copy(a, b) change a, remove(m, k) changes m
+bool ParallelLoopChecker::isMutatingBuiltin(FunctionCallNode* call) const {
+    std::string name = call->getBuiltin()->name;
+    return name == "fill" || name == "copy" || name == "remove";
+}
+
+void ParallelLoopChecker::report(std::string const& problem) {
+    diagnostics << "Error: The parallel loop at line " << loop->line << ' ' << problem << '.' << std::endl;
+    ok = false;
+}
@@ -0,0 +1,97 @@
+#ifndef LEGBA_PARALLEL_LOOP_CHECKER_H
+#define LEGBA_PARALLEL_LOOP_CHECKER_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTNode/ASTNode.h"
+
+// A parallel for as the parser outlined it: a function running the body for one
+// chunk of the range, see Parser::parallelStatement.
+struct ParallelLoop {
+    enum class Reduction { SUM, MIN, MAX };
+
+    int line;
+    FunctionNode* function;
+    Node* body;                             // as written, inside the function
+    VariableDeclarationNode* index;
+    // the function's own copies of the reduced variables, returned at its end
+    std::vector<std::pair<VariableDeclarationNode*, Reduction>> reductions;
+    // the function's parameters standing in for locals of the code around the loop
+    std::vector<VariableDeclarationNode*> captures;
+};
+
+// Chunks of a parallel loop run as tasks on copies of everything they use, so the
+// loop only does what it says if no iteration depends on what another one changed.
+// Its body may update the reductions, each in its one form, but must not assign
+// any other variable declared outside of it, nor store into an object it did not
+// create. Neither may the functions and methods it calls, which are judged by
+// their own bodies: they may not assign globals or static attributes, nor store
+// into objects passed to them.
+//
+// Objects are told apart by the variables holding them: a local holds an object of
+// its own unless it was ever assigned one read from an element, an attribute, a
+// call that isn't a builtin, or a variable that may hold a foreign one.
+class ParallelLoopChecker {
+public:
+    // errors are printed to diagnostics
+    ParallelLoopChecker(ScopeNode* rootScope, std::ostream& diagnostics);
+
+    // prints an error for every problem, false if there was one
+    bool check(ParallelLoop const& loop);
+
+private:
+    struct Effects {
+        bool throughThis = false;   // stores into the receiver of the method
+        bool other = false;         // any other change seen outside the call
+    };
+
+    // the variables a piece of code may not change and the locals that may hold
+    // objects from outside of it
+    struct Region {
+        std::unordered_set<VariableDeclarationNode*> outer;
+        std::unordered_set<VariableDeclarationNode*> foreign;
+        int paramCount = 0;         // locals below are parameters, outer unless constructing
+        bool isConstructor = false;
+
+        bool isOuter(VariableDeclarationNode* var) const;
+    };
+
+    void checkNode(Node* node);
+    void checkAssignment(BinaryNode* node);
+    void checkReduction(BinaryNode* node, ParallelLoop::Reduction kind);
+    void checkCall(FunctionCallNode* call);
+    void checkMethodCall(MethodCallNode* call);
+
+    Effects effects(Node* owner);
+    void collectEffects(Node* node, Region& region, Effects& result);
+
+    // what may hold objects not created in the region, found before looking at it
+    static void findForeign(Node* body, Region& region);
+    static bool mayBeForeign(Node* expr, Region const& region);
+    static Node* storeRoot(Node* target);
+    static bool isThis(Node* node);
+    bool isStatic(std::string const& attribute) const;
+    bool isMutatingBuiltin(FunctionCallNode* call) const;
+
+    void report(std::string const& problem);
+
+private:
+    std::ostream& diagnostics;
+    std::unordered_map<std::string, std::vector<MethodNode*>> methodsByName;
+    std::unordered_set<std::string> statics;
+
+    ParallelLoop const* loop = nullptr;
+    Region region;
+    std::unordered_map<VariableDeclarationNode*, ParallelLoop::Reduction> reductions;
+    std::unordered_set<Node*> updates;      // reads of a reduction by its own update
+    bool ok = true;
+
+    std::unordered_map<Node*, Effects> known;
+    std::unordered_set<Node*> inProgress;   // recursive calls add nothing new
+};
+
+#endif
@@ -4,38 +4,140 @@
 #include <algorithm>
 
 #include "Error.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Operations.h"
 
 Parser::Parser()
-    : hadError(false), current(0), tokens(), unresolvedFunctionCalls(), rootScope(nullptr), curScope(nullptr) {
+    : hadError(false), current(0), tokens(), unresolvedFunctionCalls(), rootScope(nullptr), curScope(nullptr),
+      inFunction(false), localCount(0), globalCount(0) {
+}
+
+ScopeNode* Parser::getRootScope() const {
+    return rootScope;
+}
+
+std::vector<std::pair<ScopeNode*, FunctionCallNode*>> const& Parser::getUnresolvedFunctionCalls() const {
+    return unresolvedFunctionCalls;
+}
+
+void Parser::setDiagnostics(std::ostream& os) {
+    diagnostics = &os;
 }
 
 bool Parser::parse(const std::vector<Token> &tokens) {
+    allowImports = false;
+    declarations(tokens);
+    resolve({});
+    // the checks follow calls, which only makes sense once they all resolved
+    if (!hadError) {
+        checkParallelLoops();
+    }
+    return !hadError;
+}
+
+bool Parser::parseModule(const std::vector<Token> &tokens) {
+    allowImports = true;
+    declarations(tokens);
+    return !hadError;
+}
+
+void Parser::declarations(const std::vector<Token> &tokens) {
     this->tokens = tokens;
     hadError = false;
+    spawnedCalls.clear();
+    parallelLoops.clear();
+    imports.clear();
     rootScope = new ScopeNode();
     curScope = rootScope;
+    inFunction = false;
+    localCount = 0;
+    globalCount = 0;
     
     while (!isAtEnd()) {
         try {
+            if (match(TokenType::IMPORT)) {
+                importDeclaration();
+                continue;
+            }
             curScope->addStatement(declaration());
         } catch (ParserError const& e) {
             synchronize();
         }
     }
+}
+
+bool Parser::resolve(std::vector<std::pair<std::string, ScopeNode*>> const& imported) {
+    // what the imported modules declare at their top level, unless declared here
+    auto findImported = [&](FunctionCallNode* callee, FunctionNode*& func, ClassNode*& klass) {
+        std::string found;
+        for (auto const& [path, scope] : imported) {
+            auto f = scope->getFunction(callee);
+            auto k = f == nullptr ? scope->getClass(callee->getCallee()) : nullptr;
+            if (f == nullptr && k == nullptr) {
+                continue;
+            }
+            if (!found.empty()) {
+                *diagnostics << "Error: Both '" << found << "' and '" << path << "' declare '" << callee->getCallee() << "'." << std::endl;
+                hadError = true;
+                return;
+            }
+            found = path;
+            func = f;
+            klass = k;
+        }
+    };
 
     for (auto [scope, callee] : unresolvedFunctionCalls) {
-        auto func = scope->getFunction(callee);
-        if (func == nullptr) {
-            std::cout << "Error: No function named '" << callee->getCallee() << "'." << std::endl;
-        } else {
+        FunctionNode* func = scope->getFunction(callee);
+        ClassNode* klass = func == nullptr ? scope->getClass(callee->getCallee()) : nullptr;
+        if (func == nullptr && klass == nullptr) {
+            findImported(callee, func, klass);
+        }
+
+        if (func != nullptr) {
             callee->setFunction(func);
+        } else if (klass != nullptr) {
+            callee->setInstantiatedClass(klass);
+        } else if (auto builtin = findBuiltin(callee->getCallee()); builtin != nullptr) {
+            // the signature is known up front, calls of functions are only checked when they run
+            if (callee->getArgs().size() != static_cast<size_t>(builtin->arity)) {
+                *diagnostics << "Error: '" << builtin->name << "' expects " << builtin->arity << " arguments but got "
+                          << callee->getArgs().size() << '.' << std::endl;
+                hadError = true;
+            }
+            callee->setBuiltin(builtin);
+        } else {
+            *diagnostics << "Error: No function named '" << callee->getCallee() << "'." << std::endl;
+            hadError = true;
         }
 
     }
 
+    for (auto spawned : spawnedCalls) {
+        auto call = spawned->getCall();
+        if (call->getFunction() == nullptr && (call->getInstantiatedClass() != nullptr || call->getBuiltin() != nullptr)) {
+            *diagnostics << "Error: '" << spawned->keyword() << "' only runs functions, '" << call->getCallee() << "' is not one." << std::endl;
+            hadError = true;
+        }
+    }
+
     return !hadError;
 }
 
+bool Parser::checkParallelLoops() {
+    if (!parallelLoops.empty()) {
+        ParallelLoopChecker checker(rootScope, *diagnostics);
+        for (auto const& loop : parallelLoops) {
+            hadError |= !checker.check(loop);
+        }
+    }
+    return !hadError;
+}
+
+std::vector<Parser::Import> const& Parser::getImports() const {
+    return imports;
+}
+
 // Error
 
 void Parser::errorAtCurrent(const std::string &msg, bool noThrow) {
@@ -59,7 +161,7 @@ void Parser::errorAt(Token *token, const std::string &msg, bool noThrow) {
 
     e += ": " + msg;
 
-    std::cout << e << std::endl;
+    *diagnostics << e << std::endl;
     hadError = true;
 
     if (!noThrow) {
@@ -74,9 +176,11 @@ void Parser::synchronize() {
             case TokenType::CLASS:
             case TokenType::FUNCTION:
                 curScope = rootScope;
+                inFunction = false;
                 return;
             case TokenType::VAR:
             case TokenType::FOR:
+            case TokenType::PARALLEL:
             case TokenType::IF:
             case TokenType::WHILE:
             case TokenType::RETURN:
@@ -134,9 +238,18 @@ void Parser::printEnv() {
     std::cout << rootScope->toString() << std::endl;
 }
 
+int Parser::getGlobalCount() const {
+    return globalCount;
+}
+
 ValueType Parser::valueType() {
     Token type = consume(TokenType::IDENTIFIER, "Expected type.");
 
+    if (match(TokenType::LEFT_BRACKET)) {
+        consume(TokenType::RIGHT_BRACKET, "Expected ']' after array element type.");
+        return ValueType(ValueTypeEnum::VT_ARRAY, type.lexeme);
+    }
+
     return ValueType::fromString(type.lexeme);
 }
 
@@ -157,6 +270,15 @@ Node* Parser::assignement() {
     Node* value = assignement();
 
     if (expr->getType() == NodeType::VARIABLE) {
+        // methods rely on 'this' being their receiver
+        if (static_cast<VariableNode*>(expr)->getVar()->getName() == "this") {
+            errorAt(&equals, "Can't assign to 'this'.");
+        }
+        return new BinaryNode(new OpNode(TokenType::EQUAL), expr, value);
+    }
+
+    if (expr->getType() == NodeType::BINARY && (static_cast<BinaryNode*>(expr)->getOp()->getOp() == TokenType::DOT
+            || static_cast<BinaryNode*>(expr)->getOp()->getOp() == TokenType::LEFT_BRACKET)) {
         return new BinaryNode(new OpNode(TokenType::EQUAL), expr, value);
     }
 
@@ -224,11 +346,11 @@ Node* Parser::term() {
 }
 
 Node* Parser::factor() {
-    Node* expr = primary();
+    Node* expr = unary();
 
-    while (match(TokenType::STAR) || match(TokenType::SLASH)) {
+    while (match(TokenType::STAR) || match(TokenType::SLASH) || match(TokenType::MODULO)) {
         OpNode* op = new OpNode(previous().type);
-        Node* right = primary();
+        Node* right = unary();
         expr = new BinaryNode(op, expr, right);
     }
 
@@ -258,6 +380,10 @@ Node* Parser::call() {
         } else if (match(TokenType::DOT)) {
             auto name = consume(TokenType::IDENTIFIER, "Expected attribute name after '.'.").lexeme;
             expr = new BinaryNode(TokenType::DOT, expr, new IdentifierNode(name));
+        } else if (match(TokenType::LEFT_BRACKET)) {
+            auto index = expression();
+            consume(TokenType::RIGHT_BRACKET, "Expected ']' after index.");
+            expr = new BinaryNode(TokenType::LEFT_BRACKET, expr, index);
         } else {
             break;
         }
@@ -266,8 +392,46 @@ Node* Parser::call() {
     return expr;
 }
 
+Node* Parser::finishFunctionCall(Node* callee) {
+    auto args = arguments();
+    auto name = static_cast<IdentifierNode*>(callee)->getName();
+
+    // spawn(f, args...) runs a call of f as a task, async(f, args...) as a coroutine,
+    // f is resolved like any callee
+    bool spawn = name == "spawn" || name == "async";
+    bool coroutine = name == "async";
+    if (spawn) {
+        if (args.empty() || args[0]->getType() != NodeType::IDENTIFIER) {
+            error("'" + name + "' expects the name of a function first.");
+        }
+        name = static_cast<IdentifierNode*>(args[0])->getName();
+        args.erase(args.begin());
+    }
+
+    auto call = new FunctionCallNode(name, args);
+
+    unresolvedFunctionCalls.emplace_back(std::make_pair(curScope, call));
+
+    if (spawn) {
+        auto node = new SpawnNode(call, coroutine);
+        spawnedCalls.push_back(node);
+        return node;
+    }
+    return call;
+}
+
 Node* Parser::finishCall(Node* callee) {
+    if (callee->getType() != NodeType::BINARY || static_cast<BinaryNode*>(callee)->getOp()->getOp() != TokenType::DOT) {
+        error("Can only call functions and methods.");
+    }
+
+    auto dot = static_cast<BinaryNode*>(callee);
+    auto args = arguments();
 
+    return new MethodCallNode(static_cast<IdentifierNode*>(dot->getRight())->getName(), args, dot->getLeft());
+}
+
+std::vector<Node*> Parser::arguments() {
     auto args = std::vector<Node*>();
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
@@ -280,11 +444,7 @@ Node* Parser::finishCall(Node* callee) {
 
     consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments.");
 
-    FunctionCallNode* call = new FunctionCallNode(, args);
-
-    unresolvedCalls.emplace_back(std::make_pair(curScope, call));
-
-    return call;
+    return args;
 }
 
 Node* Parser::primary() {
@@ -296,7 +456,9 @@ Node* Parser::primary() {
     }
     
     if (match(TokenType::STRING)) {
-        return new StringNode(previous());
+        auto string = new StringNode(previous());
+        string->setConstant(newConstantString(string->getValue()));
+        return string;
     }
 
     if (match(TokenType::INTEGER)) {
@@ -312,15 +474,57 @@ Node* Parser::primary() {
     }
 
     if (match(TokenType::IDENTIFIER)) {
+        auto var = curScope->getVariable(previous().lexeme);
+        if (var != nullptr) {
+            return new VariableNode(var);
+        }
         return new IdentifierNode(previous().lexeme);
     }
 
+    if (match(TokenType::THIS)) {
+        auto var = curScope->getVariable("this");
+        if (var == nullptr) {
+            error("Can't use 'this' outside of a method.");
+        }
+        return new VariableNode(var);
+    }
+
     if (match(TokenType::LEFT_PAREN)) {
         Node* node = expression();
         consume(TokenType::RIGHT_PAREN, "Expected ')' after expression");
         return node;
     }
 
+    if (match(TokenType::LEFT_BRACKET)) {
+        auto elements = std::vector<Node*>();
+        if (!check(TokenType::RIGHT_BRACKET)) {
+            do {
+                if (elements.size() >= 255) {
+                    errorAtCurrent("No more than 255 elements are allowed in an array literal.", true);
+                }
+                elements.emplace_back(expression());
+            } while (match(TokenType::COMMA));
+        }
+        consume(TokenType::RIGHT_BRACKET, "Expected ']' after array elements.");
+        return new ArrayNode(elements);
+    }
+
+    if (match(TokenType::LEFT_BRACE)) {
+        auto entries = std::vector<Node*>();
+        if (!check(TokenType::RIGHT_BRACE)) {
+            do {
+                if (entries.size() >= 2 * 127) {
+                    errorAtCurrent("No more than 127 entries are allowed in a map literal.", true);
+                }
+                entries.emplace_back(expression());
+                consume(TokenType::COLON, "Expected ':' after map key.");
+                entries.emplace_back(expression());
+            } while (match(TokenType::COMMA));
+        }
+        consume(TokenType::RIGHT_BRACE, "Expected '}' after map entries.");
+        return new MapNode(entries);
+    }
+
     advance();
     errorAt(&tokens[current - 1], "Malformed expression");
 }
@@ -328,17 +532,35 @@ Node* Parser::primary() {
 // Statements
 
 Node* Parser::declaration() {
+    int line = peek().line;
     uint16_t flags = qualifiers();
+    Node* node;
     switch (peek().type) {
-        case TokenType::VAR: return varDeclaration(flags);
-        case TokenType::FUNCTION: return funcDeclaration(flags);
-        case TokenType::CLASS: return classDeclaration(flags);
+        case TokenType::VAR: node = varDeclaration(flags); break;
+        case TokenType::FUNCTION: node = funcDeclaration(flags); break;
+        case TokenType::CLASS: node = classDeclaration(flags); break;
+        default:
+            if (flags != 0) {
+                errorAtCurrent("Expected a variable, function or class declaration after qualifiers.");
+            }
+            node = statement();
+            break;
     }
-    if (flags != 0) {
-        errorAtCurrent("Expected a variable, function or class declaration after qualifiers.");
+
+    if (node != nullptr && node->getLine() == 0) {
+        node->setLine(line);
     }
+    return node;
+}
 
-    return statement();
+void Parser::importDeclaration() {
+    int line = previous().line;
+    if (!allowImports) {
+        error("Only modules import, this script is built on its own.");
+    }
+    Token path = consume(TokenType::STRING, "Expected the path of a module after 'import'.");
+    consume(TokenType::SEMICOLON, "Expected ';' after the import.");
+    imports.push_back({path.lexeme, line});
 }
 
 Node* Parser::varDeclaration(uint16_t flags) {
@@ -348,20 +570,59 @@ Node* Parser::varDeclaration(uint16_t flags) {
 
     Token name = consume(TokenType::IDENTIFIER, "Expected variable name.");
 
+    // like result types the type is not checked, only array literals take their
+    // element type from it
+    ValueType type;
+    if (match(TokenType::COLON)) {
+        type = valueType();
+    }
+
     Node* initializer = nullptr;
     if (match(TokenType::EQUAL)) {
         initializer = expression();
     }
+    if (type.getType() == ValueTypeEnum::VT_ARRAY && initializer != nullptr && initializer->getType() == NodeType::ARRAY) {
+        static_cast<ArrayNode*>(initializer)->setElementType(ValueType::fromString(type.getName()).getType());
+    }
 
     consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
 
-    auto var = new VariableDeclarationNode(name.lexeme, flags, initializer);
-    
-    curScope->addVariable(name.lexeme, var);
+    return declareVariable(name.lexeme, flags, initializer);
+}
+
+VariableDeclarationNode* Parser::declareVariable(const std::string& name, uint16_t flags, Node* initializer) {
+    auto var = new VariableDeclarationNode(name, flags, initializer);
+
+    if (inFunction) {
+        var->setSlot(localCount++, false);
+    } else {
+        var->setSlot(globalCount++, true);
+    }
+
+    curScope->addVariable(name, var);
 
     return var;
 }
 
+void Parser::beginFunction(std::vector<std::string> const& params, bool isMethod) {
+    inFunction = true;
+    localCount = 0;
+    curScope = new ScopeNode(curScope); // parameters live in their own scope around the body
+
+    if (isMethod) {
+        declareVariable("this", SymbolFlag::SF_NONE, nullptr);
+    }
+    for (auto const& param : params) {
+        declareVariable(param, SymbolFlag::SF_NONE, nullptr);
+    }
+}
+
+int Parser::endFunction() {
+    curScope = curScope->getEnclosing();
+    inFunction = false;
+    return localCount;
+}
+
 Node* Parser::funcDeclaration(uint16_t flags) {
     advance(); // FN
 
@@ -397,10 +658,13 @@ Node* Parser::funcDeclaration(uint16_t flags) {
     if (!check(TokenType::LEFT_BRACE)) {
         error("Expected '{' before function body.");
     }
+    beginFunction(params, false);
     Node* body = block();
+    int frameSize = endFunction();
 
     auto func = new FunctionNode(name, flags, params, body);
     func->setResultType(resultType);
+    func->setFrameSize(frameSize);
 
     curScope->addFunction(name, func);
 
@@ -419,6 +683,7 @@ Node* Parser::classDeclaration(uint16_t flags) {
     consume(TokenType::LEFT_BRACE, "Expected '{' after class name.");
 
     ClassNode* klass = new ClassNode(className);
+    curScope->addClass(className, klass);
 
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         uint16_t flags = qualifiers();
@@ -468,10 +733,13 @@ Node* Parser::classDeclaration(uint16_t flags) {
                 if (!check(TokenType::LEFT_BRACE)) {
                     error("Expected '{' before method body.");
                 }
+                beginFunction(params, true);
                 Node* body = block();
+                int frameSize = endFunction();
 
                 auto method = new MethodNode(name, flags, params, body, klass);
                 method->setResultType(resultType);
+                method->setFrameSize(frameSize);
                 klass->addMethod(name, method);
 
                 break;
@@ -515,14 +783,25 @@ uint16_t Parser::qualifiers() {
 }
 
 Node* Parser::statement() {
+    int line = peek().line;
+    if (check(TokenType::IMPORT)) {
+        errorAtCurrent("Imports are only allowed at the top level.");
+    }
+    Node* node;
     switch (peek().type) {
-        case TokenType::LEFT_BRACE: return block();
-        case TokenType::IF: return ifStatement();
-        case TokenType::WHILE: return whileStatement();
-        case TokenType::FOR: return forStatement();
-        case TokenType::RETURN: return returnStatement();
-        default: return expressionStatement();
+        case TokenType::LEFT_BRACE: node = block(); break;
+        case TokenType::IF: node = ifStatement(); break;
+        case TokenType::WHILE: node = whileStatement(); break;
+        case TokenType::FOR: node = forStatement(); break;
+        case TokenType::PARALLEL: node = parallelStatement(); break;
+        case TokenType::RETURN: node = returnStatement(); break;
+        default: node = expressionStatement(); break;
+    }
+
+    if (node->getLine() == 0) {
+        node->setLine(line);
     }
+    return node;
 }
 
 Node* Parser::block() {
@@ -610,6 +889,245 @@ Node* Parser::forStatement() {
     return new ForNode(initializer, condition, increment, body);
 }
 
+// parallel(sum: s, min: lo, max: hi, chunks: n) for (var i = a; i < b; i = i + 1) { ... }
+// The body goes into a function of its own running one chunk of the range, with
+// the locals it uses as parameters and its own copies of the reduced variables,
+// which it returns. In place of the loop goes code spawning that function for each
+// chunk and reducing the results in chunk order. Chunks default to one per thread.
+Node* Parser::parallelStatement() {
+    int line = peek().line;
+    advance(); // PARALLEL
+
+    auto reduced = std::vector<std::pair<VariableDeclarationNode*, ParallelLoop::Reduction>>();
+    Node* chunks = nullptr;
+    if (match(TokenType::LEFT_PAREN)) {
+        do {
+            auto key = consume(TokenType::IDENTIFIER, "Expected 'sum', 'min', 'max' or 'chunks'.").lexeme;
+            consume(TokenType::COLON, "Expected ':' after '" + key + "'.");
+            if (key == "chunks") {
+                chunks = expression();
+                continue;
+            }
+
+            auto kind = ParallelLoop::Reduction::SUM;
+            if (key == "min") {
+                kind = ParallelLoop::Reduction::MIN;
+            } else if (key == "max") {
+                kind = ParallelLoop::Reduction::MAX;
+            } else if (key != "sum") {
+                error("Expected 'sum', 'min', 'max' or 'chunks'.");
+            }
+            auto name = consume(TokenType::IDENTIFIER, "Expected the name of the variable to reduce.").lexeme;
+            auto var = curScope->getVariable(name);
+            if (var == nullptr) {
+                error("There is no variable named '" + name + "' to reduce.");
+            }
+            for (auto [other, _] : reduced) {
+                if (other == var) {
+                    error("'" + name + "' is reduced twice.");
+                }
+            }
+            reduced.emplace_back(var, kind);
+        } while (match(TokenType::COMMA));
+        consume(TokenType::RIGHT_PAREN, "Expected ')' after reductions.");
+    }
+
+    std::string shape = "A parallel loop counts up by one: 'for (var i = a; i < b; i = i + 1)'.";
+    consume(TokenType::FOR, "Expected 'for' after 'parallel'.");
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'for'.");
+    consume(TokenType::VAR, shape);
+    auto index = consume(TokenType::IDENTIFIER, "Expected variable name.").lexeme;
+    consume(TokenType::EQUAL, shape);
+    Node* from = expression();
+    consume(TokenType::SEMICOLON, shape);
+    if (consume(TokenType::IDENTIFIER, shape).lexeme != index) {
+        error(shape);
+    }
+    bool inclusive = match(TokenType::LESS_EQUAL);
+    if (!inclusive) {
+        consume(TokenType::LESS, shape);
+    }
+    Node* to = expression();
+    consume(TokenType::SEMICOLON, shape);
+    for (auto type : { TokenType::IDENTIFIER, TokenType::EQUAL, TokenType::IDENTIFIER, TokenType::PLUS, TokenType::INTEGER }) {
+        auto token = consume(type, shape);
+        if ((type == TokenType::IDENTIFIER && token.lexeme != index) || (type == TokenType::INTEGER && token.lexeme != "1")) {
+            error(shape);
+        }
+    }
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after for clause.");
+    if (!check(TokenType::LEFT_BRACE)) {
+        errorAtCurrent("Expected '{' before the body of a parallel loop.");
+    }
+
+    auto isReduced = [&](std::string const& name) {
+        return std::any_of(reduced.begin(), reduced.end(), [&](auto const& reduction) { return reduction.first->getName() == name; });
+    };
+
+    // Globals are read in the function as they are, other variables of the code
+    // around the loop the body names become parameters. Names that turn out to be
+    // the body's own just pass a value that isn't used.
+    auto captured = std::vector<VariableDeclarationNode*>();
+    int depth = 0;
+    for (size_t i = current; i < tokens.size(); i++) {
+        auto const& token = tokens[i];
+        if (token.type == TokenType::LEFT_BRACE) {
+            depth++;
+        } else if (token.type == TokenType::RIGHT_BRACE && --depth == 0) {
+            break;
+        } else if ((token.type == TokenType::IDENTIFIER && tokens[i - 1].type != TokenType::DOT) || token.type == TokenType::THIS) {
+            auto name = token.type == TokenType::THIS ? std::string("this") : token.lexeme;
+            auto var = curScope->getVariable(name);
+            if (var == nullptr || var == rootScope->getVariable(name) || name == index || isReduced(name)
+                || std::find(captured.begin(), captured.end(), var) != captured.end()) {
+                continue;
+            }
+            captured.push_back(var);
+        }
+    }
+
+    auto integer = [line](int value) {
+        return new IntegerNode(Token { TokenType::INTEGER, std::to_string(value), line, 0 });
+    };
+    auto builtin = [](std::string const& name, std::vector<Node*> args) {
+        auto call = new FunctionCallNode(name, std::move(args));
+        call->setBuiltin(findBuiltin(name));
+        return call;
+    };
+    auto statement = [line](Node* node) {
+        node->setLine(line);
+        return node;
+    };
+
+    // the function, parameters first: the range, the reductions' start values, the captures
+    auto name = "<parallel for " + std::to_string(parallelLoops.size() + 1) + ">";
+    auto params = std::vector<std::string> { "(from)", "(to)" };
+    for (auto [var, _] : reduced) {
+        params.push_back(var->getName());
+    }
+    for (auto var : captured) {
+        params.push_back(var->getName());
+    }
+
+    auto outerScope = curScope;
+    bool outerInFunction = inFunction;
+    int outerLocalCount = localCount;
+    curScope = rootScope;
+    beginFunction(params, false);
+    auto paramScope = curScope;
+
+    ParallelLoop loop;
+    loop.line = line;
+    for (auto [var, kind] : reduced) {
+        loop.reductions.emplace_back(paramScope->getVariable(var->getName()), kind);
+    }
+    for (auto var : captured) {
+        loop.captures.push_back(paramScope->getVariable(var->getName()));
+    }
+
+    auto scope = new ScopeNode(paramScope);
+    curScope = scope;
+    loop.index = declareVariable(index, SymbolFlag::SF_NONE, new VariableNode(paramScope->getVariable("(from)")));
+    loop.body = block();
+    auto increment = new BinaryNode(TokenType::PLUS, new VariableNode(loop.index), integer(1));
+    scope->addStatement(statement(new ForNode(loop.index,
+        new BinaryNode(TokenType::LESS, new VariableNode(loop.index), new VariableNode(paramScope->getVariable("(to)"))),
+        new BinaryNode(TokenType::EQUAL, new VariableNode(loop.index), increment), loop.body)));
+
+    // one reduced value is returned as it is, more in an array
+    Node* result = nullptr;
+    if (loop.reductions.size() == 1) {
+        result = new VariableNode(loop.reductions[0].first);
+    } else if (loop.reductions.size() > 1) {
+        auto values = std::vector<Node*>();
+        for (auto [var, _] : loop.reductions) {
+            values.push_back(new VariableNode(var));
+        }
+        auto array = new ArrayNode(values);
+        array->setElementType(ValueTypeEnum::VT_ARRAY);
+        result = array;
+    }
+    if (result != nullptr) {
+        scope->addStatement(statement(new UnaryNode(new OpNode(TokenType::RETURN), result)));
+    }
+
+    curScope = paramScope;
+    int frameSize = endFunction();
+    auto function = new FunctionNode(name, SymbolFlag::SF_NONE, params, scope);
+    ValueType resultType;
+    resultType.setType(ValueTypeEnum::VT_VOID);
+    function->setResultType(resultType);
+    function->setFrameSize(frameSize);
+    function->setLine(line);
+    rootScope->addFunction(name, function);
+    rootScope->addStatement(function);
+    loop.function = function;
+    parallelLoops.push_back(loop);
+
+    curScope = outerScope;
+    inFunction = outerInFunction;
+    localCount = outerLocalCount;
+
+    // the code in place of the loop
+    auto driver = new ScopeNode(curScope);
+    curScope = driver;
+    auto hidden = [&](std::string const& name, Node* initializer) {
+        auto var = declareVariable(name, SymbolFlag::SF_NONE, initializer);
+        driver->addStatement(statement(var));
+        return var;
+    };
+    auto read = [](VariableDeclarationNode* var) { return new VariableNode(var); };
+    auto assign = [](VariableDeclarationNode* var, Node* value) { return new BinaryNode(TokenType::EQUAL, new VariableNode(var), value); };
+
+    auto fromVar = hidden("(from)", from);
+    auto toVar = hidden("(to)", inclusive ? new BinaryNode(TokenType::PLUS, to, integer(1)) : to);
+    auto countVar = hidden("(chunks)", builtin("max", { chunks != nullptr ? chunks : builtin("threads", {}), integer(1) }));
+    auto quotientVar = hidden("(quotient)", new BinaryNode(TokenType::SLASH, new BinaryNode(TokenType::MINUS, read(toVar), read(fromVar)), read(countVar)));
+    auto remainderVar = hidden("(remainder)", new BinaryNode(TokenType::MODULO, new BinaryNode(TokenType::MINUS, read(toVar), read(fromVar)), read(countVar)));
+    auto tasksVar = hidden("(tasks)", builtin("array", { read(countVar) }));
+    auto chunkVar = hidden("(chunk)", nullptr);
+    auto partialVar = hidden("(partial)", nullptr);
+
+    // chunk c starts at from + c * quotient + min(c, remainder), the first ones are one longer
+    auto bound = [&](int offset) {
+        Node* chunk = offset == 0 ? static_cast<Node*>(read(chunkVar)) : new BinaryNode(TokenType::PLUS, read(chunkVar), integer(offset));
+        Node* again = offset == 0 ? static_cast<Node*>(read(chunkVar)) : new BinaryNode(TokenType::PLUS, read(chunkVar), integer(offset));
+        return new BinaryNode(TokenType::PLUS, new BinaryNode(TokenType::PLUS, read(fromVar), new BinaryNode(TokenType::STAR, read(quotientVar), chunk)),
+            builtin("min", { again, read(remainderVar) }));
+    };
+    auto eachChunk = [&](Node* body) {
+        return statement(new ForNode(assign(chunkVar, integer(0)), new BinaryNode(TokenType::LESS, read(chunkVar), read(countVar)),
+            assign(chunkVar, new BinaryNode(TokenType::PLUS, read(chunkVar), integer(1))), body));
+    };
+
+    auto args = std::vector<Node*> { bound(0), bound(1) };
+    for (auto [var, kind] : reduced) {
+        args.push_back(kind == ParallelLoop::Reduction::SUM ? static_cast<Node*>(integer(0)) : read(var));
+    }
+    for (auto var : captured) {
+        args.push_back(read(var));
+    }
+    auto call = new FunctionCallNode(name, args);
+    unresolvedFunctionCalls.emplace_back(driver, call);
+    driver->addStatement(eachChunk(statement(new BinaryNode(TokenType::EQUAL,
+        new BinaryNode(TokenType::LEFT_BRACKET, read(tasksVar), read(chunkVar)), new SpawnNode(call)))));
+
+    auto combine = new ScopeNode(driver);
+    combine->addStatement(statement(assign(partialVar, builtin("join", { new BinaryNode(TokenType::LEFT_BRACKET, read(tasksVar), read(chunkVar)) }))));
+    for (size_t i = 0; i < reduced.size(); i++) {
+        auto [var, kind] = reduced[i];
+        Node* partial = reduced.size() == 1 ? static_cast<Node*>(read(partialVar))
+            : new BinaryNode(TokenType::LEFT_BRACKET, read(partialVar), integer(static_cast<int>(i)));
+        Node* value = kind == ParallelLoop::Reduction::SUM ? static_cast<Node*>(new BinaryNode(TokenType::PLUS, read(var), partial))
+            : builtin(kind == ParallelLoop::Reduction::MIN ? "min" : "max", { read(var), partial });
+        combine->addStatement(statement(assign(var, value)));
+    }
+    driver->addStatement(eachChunk(combine));
+
+    curScope = outerScope;
+    return driver;
+}
+
 Node* Parser::returnStatement() {
     advance(); // RETURN
 
@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
 
 #include "Token.h"
 #include "ASTNode/Node.h"
@@ -11,13 +14,35 @@
 #include "ASTNode/Expression.h"
 #include "ASTNode/Literal.h"
 #include "ASTNode/Symbol.h"
+#include "Optimizer/ParallelLoopChecker.h"
 
 class Parser {
 public:
+    // a module imported by `import "path";`, at line
+    struct Import {
+        std::string path;
+        int line;
+    };
+
     Parser();
 
+    // Parses a script on its own and resolves its calls, imports are errors.
     bool parse(std::vector<Token> const& tokens);
 
+    // Parses a module without resolving its calls, the modules it imports have to be
+    // parsed first, see Build/ModuleBuilder.h. Then resolve with the root scopes of
+    // those modules by their paths and, once all of them are resolved, check the
+    // parallel loops, which may call into them.
+    bool parseModule(std::vector<Token> const& tokens);
+    bool resolve(std::vector<std::pair<std::string, ScopeNode*>> const& imported);
+    bool checkParallelLoops();
+    std::vector<Import> const& getImports() const;
+
+    ScopeNode* getRootScope() const;
+    std::vector<std::pair<ScopeNode*, FunctionCallNode*>> const& getUnresolvedFunctionCalls() const;
+    // where errors are printed, std::cout unless set
+    void setDiagnostics(std::ostream& os);
+
     // Error
     void errorAtCurrent(const std::string& msg, bool noThrow = false);
     void error(const std::string& msg, bool noThrow = false);
@@ -33,6 +58,7 @@ public:
     Token peek();
     Token previous();
     void printEnv();
+    int getGlobalCount() const;
 
     ValueType valueType();
 
@@ -48,14 +74,20 @@ public:
     Node* unary();
     Node* primary();
     Node* call();
+    Node* finishFunctionCall(Node* callee);
     Node* finishCall(Node* callee);
+    std::vector<Node*> arguments();
 
     // Statement
     Node* declaration();
+    void importDeclaration();
 
     Node* varDeclaration(uint16_t flags);
     Node* funcDeclaration(uint16_t flags);
     Node* classDeclaration(uint16_t flags);
+    VariableDeclarationNode* declareVariable(const std::string& name, uint16_t flags, Node* initializer);
+    void beginFunction(std::vector<std::string> const& params, bool isMethod);
+    int endFunction();
     uint16_t qualifiers();
     void checkQualifiers(uint16_t flags, uint16_t forbiddenFlags, std::string type);
 
@@ -65,17 +97,28 @@ public:
     Node* ifStatement();
     Node* whileStatement();
     Node* forStatement();
+    Node* parallelStatement();
     Node* returnStatement();
     Node* expressionStatement();
 
 
 private:
+    void declarations(std::vector<Token> const& tokens);
+
     std::vector<Token> tokens;
     int current;
     bool hadError;
     ScopeNode* rootScope;
     ScopeNode* curScope;
+    bool inFunction;
+    int localCount;
+    int globalCount;
     std::vector<std::pair<ScopeNode*, FunctionCallNode*>> unresolvedFunctionCalls;
+    std::vector<SpawnNode*> spawnedCalls;    // must resolve to functions
+    std::vector<ParallelLoop> parallelLoops;        // checked once all calls are resolved
+    std::ostream* diagnostics = &std::cout;
+    bool allowImports = false;
+    std::vector<Import> imports;
 };
 
 
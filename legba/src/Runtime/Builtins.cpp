@@ -0,0 +1,554 @@
+#include "Builtins.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "Error.h"
+#include "Runtime/Coroutines.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Kernels.h"
+#include "Runtime/Map.h"
+#include "Runtime/Operations.h"
+#include "Runtime/Scheduler.h"
+
+using VT = ValueTypeEnum;
+
+// named like in scripts, hence their own namespace
+namespace natives {
+
+Value print(Value* args) {
+    // tasks print from several threads, their lines must not mix
+    static std::mutex mutex;
+    auto line = args[0].toString();
+    std::lock_guard lock(mutex);
+    std::cout << line << '\n';
+    return Value::nil();
+}
+
+Value str(Value* args) {
+    if (isObjectType(args[0], ObjectType::STRING)) {
+        return args[0];
+    }
+    return newString(args[0].toString());
+}
+
+Value fixed(Value* args) {
+    int digits = args[1].asInt();
+    if (digits < 0 || digits > 20) {
+        throw RuntimeError("'fixed' takes 0 to 20 digits, got " + std::to_string(digits) + '.');
+    }
+    // printf rounds like the C runtime's lg_builtin_fixed
+    char buffer[400];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.*f", digits, args[0].toNumber());
+    return newString(std::string_view(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1)));
+}
+
+// The int or double the whole string spells, nil if it is no number.
+Value number(Value* args) {
+    auto text = asString(args[0])->view();
+    auto first = text.data(), last = text.data() + text.size();
+
+    int32_t i;
+    auto [intEnd, intError] = std::from_chars(first, last, i);
+    if (intError == std::errc() && intEnd == last) {
+        return Value::fromInt(i);
+    }
+    double d;
+    auto [doubleEnd, doubleError] = std::from_chars(first, last, d);
+    if (doubleError == std::errc() && doubleEnd == last && first != last) {
+        return Value::fromDouble(d);
+    }
+    return Value::nil();
+}
+
+Value len(Value* args) {
+    if (isObjectType(args[0], ObjectType::ARRAY)) {
+        return Value::fromInt(static_cast<int32_t>(asArray(args[0])->length));
+    }
+    if (isObjectType(args[0], ObjectType::MAP)) {
+        return Value::fromInt(static_cast<int32_t>(asMap(args[0])->count));
+    }
+    if (!isObjectType(args[0], ObjectType::STRING)) {
+        throw RuntimeError("'len' expects a string, an array or a map as argument 1, got " + args[0].typeName() + '.');
+    }
+    return Value::fromInt(static_cast<int32_t>(asString(args[0])->length));
+}
+
+// Truncates towards zero, saturating at the int range. NaN becomes 0.
+Value toInt(Value* args) {
+    if (args[0].isInt()) {
+        return args[0];
+    }
+    double d = std::trunc(args[0].asDouble());
+    if (d != d) {
+        return Value::fromInt(0);
+    }
+    return Value::fromInt(static_cast<int32_t>(std::clamp(d, static_cast<double>(INT32_MIN), static_cast<double>(INT32_MAX))));
+}
+
+Value sqrt(Value* args) { return Value::fromDouble(std::sqrt(args[0].toNumber())); }
+Value floor(Value* args) { return Value::fromDouble(std::floor(args[0].toNumber())); }
+Value ceil(Value* args) { return Value::fromDouble(std::ceil(args[0].toNumber())); }
+Value sin(Value* args) { return Value::fromDouble(std::sin(args[0].toNumber())); }
+Value cos(Value* args) { return Value::fromDouble(std::cos(args[0].toNumber())); }
+Value pow(Value* args) { return Value::fromDouble(std::pow(args[0].toNumber(), args[1].toNumber())); }
+
+// abs, min and max keep ints ints, ints wrap like the operators do
+Value abs(Value* args) {
+    if (args[0].isInt()) {
+        int32_t i = args[0].asInt();
+        return Value::fromInt(i < 0 ? static_cast<int32_t>(0u - static_cast<uint32_t>(i)) : i);
+    }
+    return Value::fromDouble(std::fabs(args[0].asDouble()));
+}
+
+Value min(Value* args) {
+    if (args[0].isInt() && args[1].isInt()) {
+        return Value::fromInt(std::min(args[0].asInt(), args[1].asInt()));
+    }
+    return Value::fromDouble(std::fmin(args[0].toNumber(), args[1].toNumber()));
+}
+
+Value max(Value* args) {
+    if (args[0].isInt() && args[1].isInt()) {
+        return Value::fromInt(std::max(args[0].asInt(), args[1].asInt()));
+    }
+    return Value::fromDouble(std::fmax(args[0].toNumber(), args[1].toNumber()));
+}
+
+// Seconds on a monotonic clock, only differences between two calls mean something.
+Value clock(Value*) {
+    return Value::fromDouble(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Value ints(Value* args) { return newArray(ElementType::INT, args[0].asInt()); }
+Value doubles(Value* args) { return newArray(ElementType::DOUBLE, args[0].asInt()); }
+Value array(Value* args) { return newArray(ElementType::VALUE, args[0].asInt()); }
+
+// The bulk operations below run kernels on int and double arrays, arrays of values
+// have none.
+static ArrayObject* typedArray(const char* name, int index, Value value) {
+    auto array = asArray(value);
+    if (array->elementType == ElementType::VALUE) {
+        throw RuntimeError("'" + std::string(name) + "' expects an int[] or double[] as argument " + std::to_string(index) + ", got array.");
+    }
+    return array;
+}
+
+static void checkLengths(const char* name, ArrayObject* a, ArrayObject* b) {
+    if (a->length != b->length) {
+        throw RuntimeError("'" + std::string(name) + "' expects arrays of the same length, got " + std::to_string(a->length)
+            + " and " + std::to_string(b->length) + '.');
+    }
+}
+
+// Ints wrap around like the operators do.
+Value sum(Value* args) {
+    auto a = typedArray("sum", 1, args[0]);
+    if (a->elementType == ElementType::INT) {
+        return Value::fromInt(kernels::sumInts(a->ints(), a->length));
+    }
+    return Value::fromDouble(kernels::sumDoubles(a->doubles(), a->length));
+}
+
+Value dot(Value* args) {
+    auto a = typedArray("dot", 1, args[0]), b = typedArray("dot", 2, args[1]);
+    checkLengths("dot", a, b);
+    if (a->elementType == ElementType::INT && b->elementType == ElementType::INT) {
+        return Value::fromInt(kernels::dotInts(a->ints(), b->ints(), a->length));
+    }
+    if (a->elementType == b->elementType) {
+        return Value::fromDouble(kernels::dotDoubles(a->doubles(), b->doubles(), a->length));
+    }
+    // an int[] with a double[], the ints are converted first
+    auto x = a->elementType == ElementType::INT ? a : b, y = a->elementType == ElementType::INT ? b : a;
+    std::vector<double> converted(x->length);
+    kernels::intsToDoubles(converted.data(), x->ints(), x->length);
+    return Value::fromDouble(kernels::dotDoubles(converted.data(), y->doubles(), y->length));
+}
+
+// The first store checks the value and takes the write barrier for all of them.
+Value fill(Value* args) {
+    auto array = asArray(args[0]);
+    if (array->length == 0) {
+        return Value::nil();
+    }
+    setArrayElement(array, 0, args[1]);
+    switch (array->elementType) {
+        case ElementType::INT: std::fill_n(array->ints() + 1, array->length - 1, array->ints()[0]); break;
+        case ElementType::DOUBLE: std::fill_n(array->doubles() + 1, array->length - 1, array->doubles()[0]); break;
+        default: std::fill_n(array->values() + 1, array->length - 1, array->values()[0]); break;
+    }
+    return Value::nil();
+}
+
+// Copies the second array into the start of the first, converting elements like
+// stores do.
+Value copy(Value* args) {
+    auto dst = asArray(args[0]), src = asArray(args[1]);
+    if (src->length > dst->length) {
+        throw RuntimeError("'copy' can't copy " + std::to_string(src->length) + " elements into an array of length "
+            + std::to_string(dst->length) + '.');
+    }
+
+    if (dst->elementType == src->elementType) {
+        std::memmove(static_cast<void*>(dst + 1), src + 1, src->length * ArrayObject::elementSize(src->elementType));
+        if (dst->elementType == ElementType::VALUE && src->length > 0 && !dst->remembered) {
+            Heap::get().remember(dst);
+        }
+    } else if (dst->elementType == ElementType::DOUBLE && src->elementType == ElementType::INT) {
+        kernels::intsToDoubles(dst->doubles(), src->ints(), src->length);
+    } else {
+        for (uint32_t i = 0; i < src->length; i++) {
+            setArrayElement(dst, i, arrayElement(src, i));
+        }
+    }
+    return Value::nil();
+}
+
+// Same length and elements equal like ==, arrays of any types.
+Value equal(Value* args) {
+    auto a = asArray(args[0]), b = asArray(args[1]);
+    if (a->length != b->length) {
+        return Value::fromBool(false);
+    }
+    if (a->elementType == ElementType::INT && b->elementType == ElementType::INT) {
+        return Value::fromBool(std::memcmp(a->ints(), b->ints(), a->length * sizeof(int32_t)) == 0);
+    }
+    if (a->elementType == ElementType::DOUBLE && b->elementType == ElementType::DOUBLE) {
+        return Value::fromBool(kernels::equalDoubles(a->doubles(), b->doubles(), a->length));
+    }
+    for (uint32_t i = 0; i < a->length; i++) {
+        if (!valuesEqual(arrayElement(a, i), arrayElement(b, i))) {
+            return Value::fromBool(false);
+        }
+    }
+    return Value::fromBool(true);
+}
+
+// A new array of a[i] op b[i], or a[i] op b for a number b. It holds ints if both
+// operands do, doubles otherwise.
+static Value elementwise(kernels::Op op, const char* name, Value* args) {
+    auto a = typedArray(name, 1, args[0]);
+    bool scalar = !isObjectType(args[1], ObjectType::ARRAY);
+    if (scalar && !args[1].isNumber()) {
+        throw RuntimeError("'" + std::string(name) + "' expects an array or a number as argument 2, got " + args[1].typeName() + '.');
+    }
+    if (!scalar) {
+        checkLengths(name, a, typedArray(name, 2, args[1]));
+    }
+    bool ints = a->elementType == ElementType::INT && (scalar ? args[1].isInt() : asArray(args[1])->elementType == ElementType::INT);
+    uint32_t n = a->length;
+
+    // allocating may move both operands
+    auto out = asArray(newArray(ints ? ElementType::INT : ElementType::DOUBLE, n));
+    a = asArray(args[0]);
+    auto b = scalar ? nullptr : asArray(args[1]);
+    if (ints) {
+        if (scalar) kernels::arithmetic(op, out->ints(), a->ints(), args[1].asInt(), n);
+        else kernels::arithmetic(op, out->ints(), a->ints(), b->ints(), n);
+        return Value::fromObject(out);
+    }
+
+    double const* x = a->doubles();
+    if (a->elementType == ElementType::INT) {
+        kernels::intsToDoubles(out->doubles(), a->ints(), n);
+        x = out->doubles();
+    }
+    if (scalar) {
+        kernels::arithmetic(op, out->doubles(), x, args[1].toNumber(), n);
+    } else if (b->elementType == ElementType::DOUBLE) {
+        kernels::arithmetic(op, out->doubles(), x, b->doubles(), n);
+    } else {
+        std::vector<double> y(n);
+        kernels::intsToDoubles(y.data(), b->ints(), n);
+        kernels::arithmetic(op, out->doubles(), x, y.data(), n);
+    }
+    return Value::fromObject(out);
+}
+
+Value add(Value* args) { return elementwise(kernels::Op::ADD, "add", args); }
+Value sub(Value* args) { return elementwise(kernels::Op::SUB, "sub", args); }
+Value mul(Value* args) { return elementwise(kernels::Op::MUL, "mul", args); }
+
+Value has(Value* args) { return Value::fromBool(maps::find(asMap(args[0]), args[1]) != nullptr); }
+Value remove(Value* args) { return Value::fromBool(maps::remove(args[0], args[1])); }
+
+// The keys or values of a map in iteration order, typed like an array literal of them.
+static Value entries(Value* args, bool keys) {
+    bool ints = asMap(args[0])->count > 0, numbers = ints;
+    maps::forEach(asMap(args[0]), [&](Value key, Value value) {
+        ints = ints && (keys ? key : value).isInt();
+        numbers = numbers && (keys ? key : value).isNumber();
+    });
+
+    // allocating may move the map, args are roots
+    auto type = ints ? ElementType::INT : numbers ? ElementType::DOUBLE : ElementType::VALUE;
+    auto array = asArray(newArray(type, asMap(args[0])->count));
+    uint32_t i = 0;
+    maps::forEach(asMap(args[0]), [&](Value key, Value value) {
+        setArrayElement(array, i++, keys ? key : value);
+    });
+    return Value::fromObject(array);
+}
+
+Value keys(Value* args) { return entries(args, true); }
+Value values(Value* args) { return entries(args, false); }
+
+// Runs other tasks until this one is done, see Scheduler::join.
+Value join(Value* args) {
+    return Scheduler::current()->join(asTask(args[0])->task);
+}
+
+// Threads running tasks, once they are started.
+Value threads(Value*) {
+    return Value::fromInt(static_cast<int32_t>(Scheduler::threads()));
+}
+
+// The builtins below park the running coroutine where they would block, see
+// Coroutines. The tree walking interpreter has no coroutines, there they block.
+
+Value sleep(Value* args) {
+    double seconds = std::max(args[0].toNumber(), 0.0);
+    auto coroutines = Coroutines::current();
+    if (coroutines == nullptr) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    } else if (!coroutines->resumed()) {
+        coroutines->loop().sleep(coroutines->self(), seconds);
+        coroutines->park();
+    }
+    return Value::nil();
+}
+
+// lets the other coroutines that can run go first
+Value yield(Value*) {
+    auto coroutines = Coroutines::current();
+    if (coroutines != nullptr && !coroutines->resumed()) {
+        coroutines->loop().ready(coroutines->self());
+        coroutines->park();
+    }
+    return Value::nil();
+}
+
+Value await(Value* args) {
+    auto handle = asCoroutine(args[0]);
+    if (handle->done) {
+        return handle->result;
+    }
+    auto coroutines = Coroutines::current();
+    if (coroutines == nullptr) {
+        throw RuntimeError("Coroutines only run on the bytecode VM.");
+    }
+    coroutines->await(handle);
+    return Value::nil();
+}
+
+// whether fd can be read or written right away, errors count as ready for the read
+// or write to report them
+static bool readyNow(int fd, bool write) {
+#if defined(_WIN32)
+    (void)fd;
+    (void)write;
+    return true;
+#else
+    pollfd descriptor { fd, static_cast<short>(write ? POLLOUT : POLLIN), 0 };
+    return ::poll(&descriptor, 1, 0) != 0;
+#endif
+}
+
+// Parks the running coroutine until fd is ready, true if it did. Regular files are
+// always ready.
+static bool parkUntilReady(int fd, bool write) {
+    auto coroutines = Coroutines::current();
+    if (coroutines == nullptr || readyNow(fd, write) || !coroutines->loop().wait(coroutines->self(), fd, write)) {
+        return false;
+    }
+    coroutines->park();
+    return true;
+}
+
+// what was read from a descriptor past the lines returned, per thread
+struct Input {
+    std::string data;
+    size_t start = 0;
+    bool eof = false;
+};
+static thread_local std::unordered_map<int, Input> inputs;
+
+// "r" reads, "w" truncates or creates, "a" appends
+Value open(Value* args) {
+    auto path = args[0].toString();
+    auto mode = args[1].toString();
+    int flags = mode == "r" ? O_RDONLY : mode == "w" ? O_WRONLY | O_CREAT | O_TRUNC : mode == "a" ? O_WRONLY | O_CREAT | O_APPEND : -1;
+    if (flags < 0) {
+        throw RuntimeError("'open' expects the mode \"r\", \"w\" or \"a\", got \"" + mode + "\".");
+    }
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        throw RuntimeError("Failed to open '" + path + "'.");
+    }
+    inputs.erase(fd);
+    return Value::fromInt(fd);
+}
+
+Value close(Value* args) {
+    int fd = args[0].asInt();
+    inputs.erase(fd);
+    if (::close(fd) != 0) {
+        throw RuntimeError("Failed to close file " + std::to_string(fd) + '.');
+    }
+    return Value::nil();
+}
+
+// the next line without its newline, nil at the end
+Value readLine(Value* args) {
+    int fd = args[0].asInt();
+    auto& input = inputs[fd];
+    while (true) {
+        size_t end = input.data.find('\n', input.start);
+        if (end != std::string::npos) {
+            Value line = newString(std::string_view(input.data).substr(input.start, end - input.start));
+            input.start = end + 1;
+            return line;
+        }
+        if (input.eof) {
+            if (input.start == input.data.size()) {
+                return Value::nil();
+            }
+            Value rest = newString(std::string_view(input.data).substr(input.start));
+            input.start = input.data.size();
+            return rest;
+        }
+        if (parkUntilReady(fd, false)) {
+            return Value::nil();
+        }
+
+        input.data.erase(0, input.start);
+        input.start = 0;
+        char chunk[1 << 16];
+        auto count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno != EINTR) {
+            throw RuntimeError("Failed to read from file " + std::to_string(fd) + '.');
+        }
+        if (count == 0) {
+            input.eof = true;
+        }
+        if (count > 0) {
+            input.data.append(chunk, static_cast<size_t>(count));
+        }
+    }
+}
+
+// Writes the value like print, without a newline. Once the descriptor takes any of it
+// the rest is written blocking.
+Value write(Value* args) {
+    int fd = args[0].asInt();
+    if (parkUntilReady(fd, true)) {
+        return Value::nil();
+    }
+    if (fd == 1) {
+        std::cout.flush();
+    }
+    auto text = args[1].toString();
+    size_t written = 0;
+    while (written < text.size()) {
+        auto count = ::write(fd, text.data() + written, static_cast<unsigned>(text.size() - written));
+        if (count < 0 && errno != EINTR) {
+            throw RuntimeError("Failed to write to file " + std::to_string(fd) + '.');
+        }
+        written += count > 0 ? static_cast<size_t>(count) : 0;
+    }
+    return Value::nil();
+}
+
+}
+
+const Builtin BUILTINS[] = {
+    { "print",  1, { VT::VT_NONE },                   VT::VT_VOID,    false, natives::print },
+    { "str",    1, { VT::VT_NONE },                   VT::VT_STRING,  false, natives::str },
+    { "fixed",  2, { VT::VT_DOUBLE, VT::VT_INTEGER }, VT::VT_STRING,  false, natives::fixed },
+    { "number", 1, { VT::VT_STRING },                 VT::VT_NONE,    false, natives::number },
+    { "len",    1, { VT::VT_NONE },                   VT::VT_INTEGER, false, natives::len },
+    { "int",    1, { VT::VT_DOUBLE },                 VT::VT_INTEGER, true,  natives::toInt },
+    { "sqrt",   1, { VT::VT_DOUBLE },                 VT::VT_DOUBLE,  true,  natives::sqrt },
+    { "floor",  1, { VT::VT_DOUBLE },                 VT::VT_DOUBLE,  true,  natives::floor },
+    { "ceil",   1, { VT::VT_DOUBLE },                 VT::VT_DOUBLE,  true,  natives::ceil },
+    { "sin",    1, { VT::VT_DOUBLE },                 VT::VT_DOUBLE,  true,  natives::sin },
+    { "cos",    1, { VT::VT_DOUBLE },                 VT::VT_DOUBLE,  true,  natives::cos },
+    { "pow",    2, { VT::VT_DOUBLE, VT::VT_DOUBLE },  VT::VT_DOUBLE,  true,  natives::pow },
+    { "abs",    1, { VT::VT_DOUBLE },                 VT::VT_NONE,    true,  natives::abs },
+    { "min",    2, { VT::VT_DOUBLE, VT::VT_DOUBLE },  VT::VT_NONE,    true,  natives::min },
+    { "max",    2, { VT::VT_DOUBLE, VT::VT_DOUBLE },  VT::VT_NONE,    true,  natives::max },
+    { "clock",  0, {},                                VT::VT_DOUBLE,  true,  natives::clock },
+    { "ints",   1, { VT::VT_INTEGER },                VT::VT_ARRAY,   false, natives::ints },
+    { "doubles", 1, { VT::VT_INTEGER },               VT::VT_ARRAY,   false, natives::doubles },
+    { "array",  1, { VT::VT_INTEGER },                VT::VT_ARRAY,   false, natives::array },
+    { "sum",    1, { VT::VT_ARRAY },                  VT::VT_NONE,    false, natives::sum },
+    { "dot",    2, { VT::VT_ARRAY, VT::VT_ARRAY },    VT::VT_NONE,    false, natives::dot },
+    { "fill",   2, { VT::VT_ARRAY, VT::VT_NONE },     VT::VT_VOID,    false, natives::fill },
+    { "copy",   2, { VT::VT_ARRAY, VT::VT_ARRAY },    VT::VT_VOID,    false, natives::copy },
+    { "equal",  2, { VT::VT_ARRAY, VT::VT_ARRAY },    VT::VT_BOOL,    false, natives::equal },
+    { "add",    2, { VT::VT_ARRAY, VT::VT_NONE },     VT::VT_ARRAY,   false, natives::add },
+    { "sub",    2, { VT::VT_ARRAY, VT::VT_NONE },     VT::VT_ARRAY,   false, natives::sub },
+    { "mul",    2, { VT::VT_ARRAY, VT::VT_NONE },     VT::VT_ARRAY,   false, natives::mul },
+    { "has",    2, { VT::VT_MAP, VT::VT_NONE },       VT::VT_BOOL,    false, natives::has },
+    { "remove", 2, { VT::VT_MAP, VT::VT_NONE },       VT::VT_BOOL,    false, natives::remove },
+    { "keys",   1, { VT::VT_MAP },                    VT::VT_ARRAY,   false, natives::keys },
+    { "values", 1, { VT::VT_MAP },                    VT::VT_ARRAY,   false, natives::values },
+    { "join",   1, { VT::VT_TASK },                   VT::VT_NONE,    false, natives::join },
+    { "threads", 0, {},                               VT::VT_INTEGER, true,  natives::threads },
+    { "sleep",  1, { VT::VT_DOUBLE },                 VT::VT_VOID,    false, natives::sleep },
+    { "yield",  0, {},                                VT::VT_VOID,    false, natives::yield },
+    { "await",  1, { VT::VT_COROUTINE },              VT::VT_NONE,    false, natives::await },
+    { "open",   2, { VT::VT_STRING, VT::VT_STRING },  VT::VT_INTEGER, false, natives::open },
+    { "close",  1, { VT::VT_INTEGER },                VT::VT_VOID,    false, natives::close },
+    { "readLine", 1, { VT::VT_INTEGER },              VT::VT_NONE,    false, natives::readLine },
+    { "write",  2, { VT::VT_INTEGER, VT::VT_NONE },   VT::VT_VOID,    false, natives::write },
+};
+
+const size_t BUILTIN_COUNT = std::size(BUILTINS);
+
+Builtin const* findBuiltin(std::string_view name) {
+    for (auto const& builtin : BUILTINS) {
+        if (name == builtin.name) {
+            return &builtin;
+        }
+    }
+    return nullptr;
+}
+
+static std::string paramName(VT param) {
+    switch (param) {
+        case VT::VT_DOUBLE: return "a number";
+        case VT::VT_INTEGER: return "an int";
+        case VT::VT_STRING: return "a string";
+        case VT::VT_ARRAY: return "an array";
+        case VT::VT_MAP: return "a map";
+        case VT::VT_TASK: return "a task";
+        case VT::VT_COROUTINE: return "a coroutine";
+        default: return "a value";
+    }
+}
+
+void argumentError(Builtin const& builtin, int index, Value value) {
+    throw RuntimeError("'" + std::string(builtin.name) + "' expects " + paramName(builtin.params[index]) + " as argument "
+        + std::to_string(index + 1) + ", got " + value.typeName() + '.');
+}
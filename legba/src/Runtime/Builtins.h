@@ -0,0 +1,68 @@
+#ifndef LEGBA_RUNTIME_BUILTINS_H
+#define LEGBA_RUNTIME_BUILTINS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "ValueType.h"
+#include "Runtime/Object.h"
+#include "Runtime/Value.h"
+
+// Native function every script can call by name, unless it declares a function or
+// class of the same name. Calls are resolved by the parser, which also checks the
+// number of arguments; their types are checked at the call against the signature.
+//
+// A builtin reads its arguments from the caller's registers and returns its result
+// directly, nothing is boxed into a vector or frame of its own.
+struct Builtin {
+    static constexpr int MAX_PARAMS = 2;
+    using Function = Value (*)(Value* args);
+
+    const char* name;
+    int arity;
+    // VT_NONE takes any value, VT_DOUBLE any number, VT_INTEGER ints, VT_STRING
+    // strings, VT_ARRAY arrays, VT_MAP maps, VT_TASK tasks and VT_COROUTINE coroutines
+    ValueTypeEnum params[MAX_PARAMS];
+    // VT_NONE if it depends on the arguments, VT_VOID for nil
+    ValueTypeEnum result;
+    // Never allocates, prints or throws once the arguments are checked, compiled code
+    // may call it like a plain C function.
+    bool leaf;
+    Function function;
+};
+
+extern const Builtin BUILTINS[];
+extern const size_t BUILTIN_COUNT;
+
+// nullptr if there is no builtin with this name
+Builtin const* findBuiltin(std::string_view name);
+
+inline uint32_t builtinIndex(Builtin const* builtin) { return static_cast<uint32_t>(builtin - BUILTINS); }
+
+inline bool acceptsArgument(ValueTypeEnum param, Value value) {
+    switch (param) {
+        case ValueTypeEnum::VT_DOUBLE: return value.isNumber();
+        case ValueTypeEnum::VT_INTEGER: return value.isInt();
+        case ValueTypeEnum::VT_STRING: return isObjectType(value, ObjectType::STRING);
+        case ValueTypeEnum::VT_ARRAY: return isObjectType(value, ObjectType::ARRAY);
+        case ValueTypeEnum::VT_MAP: return isObjectType(value, ObjectType::MAP);
+        case ValueTypeEnum::VT_TASK: return isObjectType(value, ObjectType::TASK);
+        case ValueTypeEnum::VT_COROUTINE: return isObjectType(value, ObjectType::COROUTINE);
+        default: return true;
+    }
+}
+
+[[noreturn]] void argumentError(Builtin const& builtin, int index, Value value);
+
+// args holds the builtin's arity values
+inline Value callBuiltin(Builtin const& builtin, Value* args) {
+    for (int i = 0; i < builtin.arity; i++) {
+        if (!acceptsArgument(builtin.params[i], args[i])) {
+            argumentError(builtin, i, args[i]);
+        }
+    }
+    return builtin.function(args);
+}
+
+#endif
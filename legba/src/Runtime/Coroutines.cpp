@@ -0,0 +1,151 @@
+#include "Coroutines.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "Error.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#define LEGBA_EPOLL
+#endif
+
+EventLoop::~EventLoop() {
+#ifdef LEGBA_EPOLL
+    if (epoll >= 0) {
+        close(epoll);
+    }
+#endif
+}
+
+void EventLoop::ready(void* waiter) {
+    readyWaiters.push_back(waiter);
+}
+
+void EventLoop::sleep(void* waiter, double seconds) {
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(seconds, 0.0)));
+    timers.push({ deadline, timerSequence++, waiter });
+}
+
+bool EventLoop::wait(void* waiter, int fd, bool write) {
+#ifdef LEGBA_EPOLL
+    if (epoll < 0) {
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll < 0) {
+            throw RuntimeError("Failed to create the event loop.");
+        }
+    }
+    auto& watch = watches[fd];
+    auto& waiters = write ? watch.writers : watch.readers;
+    waiters.push_back(waiter);
+    if (!update(fd, watch)) {
+        waiters.pop_back();
+        if (watch.events == 0) {
+            watches.erase(fd);
+        }
+        return false;
+    }
+    watching++;
+    return true;
+#else
+    (void)waiter;
+    (void)fd;
+    (void)write;
+    return false;
+#endif
+}
+
+// Level triggered, a descriptor stays registered only while someone waits for it.
+// Regular files and the like can't be registered, they never block anyway.
+bool EventLoop::update(int fd, Watch& watch) {
+#ifdef LEGBA_EPOLL
+    uint32_t events = (watch.readers.empty() ? 0u : static_cast<uint32_t>(EPOLLIN)) | (watch.writers.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    if (events == watch.events) {
+        return true;
+    }
+    if (events == 0) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        watches.erase(fd);
+        return true;
+    }
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll, watch.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) < 0) {
+        return false;
+    }
+    watch.events = events;
+    return true;
+#else
+    (void)fd;
+    (void)watch;
+    return false;
+#endif
+}
+
+void EventLoop::poll(std::vector<void*>& woken, bool block) {
+    size_t before = woken.size();
+    woken.insert(woken.end(), readyWaiters.begin(), readyWaiters.end());
+    readyWaiters.clear();
+    block = block && woken.size() == before;
+
+    // milliseconds until the first timer is due, rounded up so it is due then
+    int timeout = -1;
+    if (!block) {
+        timeout = 0;
+    } else if (!timers.empty()) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers.top().deadline - Clock::now()).count();
+        timeout = static_cast<int>(std::clamp<decltype(wait)>(wait, 0, 1 << 30));
+    } else if (watching == 0) {
+        return;
+    }
+
+#ifdef LEGBA_EPOLL
+    if (watching > 0) {
+        epoll_event events[64];
+        int count = epoll_wait(epoll, events, std::size(events), timeout);
+        for (int e = 0; e < count; e++) {
+            int fd = events[e].data.fd;
+            auto it = watches.find(fd);
+            if (it == watches.end()) {
+                continue;
+            }
+            auto& watch = it->second;
+            bool failed = events[e].events & (EPOLLERR | EPOLLHUP);
+            if (events[e].events & EPOLLIN || failed) {
+                woken.insert(woken.end(), watch.readers.begin(), watch.readers.end());
+                watching -= watch.readers.size();
+                watch.readers.clear();
+            }
+            if (events[e].events & EPOLLOUT || failed) {
+                woken.insert(woken.end(), watch.writers.begin(), watch.writers.end());
+                watching -= watch.writers.size();
+                watch.writers.clear();
+            }
+            update(fd, watch);
+        }
+    } else
+#endif
+    if (timeout > 0) {
+        std::this_thread::sleep_until(timers.top().deadline);
+    }
+
+    auto now = Clock::now();
+    while (!timers.empty() && timers.top().deadline <= now) {
+        woken.push_back(timers.top().waiter);
+        timers.pop();
+    }
+}
+
+void EventLoop::clear() {
+#ifdef LEGBA_EPOLL
+    for (auto const& [fd, watch] : watches) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+#endif
+    watches.clear();
+    watching = 0;
+    readyWaiters.clear();
+    timers = {};
+}
@@ -0,0 +1,98 @@
+#ifndef LEGBA_RUNTIME_COROUTINES_H
+#define LEGBA_RUNTIME_COROUTINES_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "Runtime/Object.h"
+
+// Waits for timers and file descriptors on behalf of parked coroutines. All
+// coroutines of a thread share one loop, which sleeps in epoll_wait once every one
+// of them waits for something. Waiters are the engine's handles of its coroutines,
+// a wait is over once the waiter was woken, each wait wakes it once.
+//
+// Without epoll, outside of Linux, only timers are waited for: wait refuses every
+// descriptor and the builtins read and write it blocking.
+class EventLoop {
+public:
+    EventLoop() = default;
+    EventLoop(EventLoop const&) = delete;
+    EventLoop& operator=(EventLoop const&) = delete;
+    ~EventLoop();
+
+    // wakes waiter at the next poll, after the waiters woken before
+    void ready(void* waiter);
+    void sleep(void* waiter, double seconds);
+    // Wakes waiter once fd can be read or written without blocking. False if fd
+    // can't be waited for, e.g. a regular file, which never blocks anyway.
+    bool wait(void* waiter, int fd, bool write);
+
+    // Appends the waiters whose wait is over to woken. With block it first sleeps
+    // until there are some, unless nothing waits at all.
+    void poll(std::vector<void*>& woken, bool block);
+
+    bool empty() const { return readyWaiters.empty() && timers.empty() && watching == 0; }
+    // forgets every waiter
+    void clear();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Clock::time_point deadline;
+        uint64_t sequence;      // timers with the same deadline wake in order
+        void* waiter;
+
+        bool operator>(Timer const& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    struct Watch {
+        std::vector<void*> readers;
+        std::vector<void*> writers;
+        uint32_t events = 0;    // registered with epoll
+    };
+
+    // registers fd for what its waiters wait for, or not at all if nobody does
+    bool update(int fd, Watch& watch);
+
+    int epoll = -1;
+    std::vector<void*> readyWaiters;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers;
+    uint64_t timerSequence = 0;
+    std::unordered_map<int, Watch> watches;
+    size_t watching = 0;    // waiters in watches
+};
+
+// Implemented by the engine running coroutines on the calling thread, see VM. A
+// builtin that would block registers the running coroutine with the loop and parks
+// it instead: the engine switches to another coroutine once the builtin returned,
+// and once the loop woke the parked one calls the same builtin again with the same
+// arguments, resumed() set.
+class Coroutines {
+public:
+    // nullptr where there are no coroutines, builtins block there
+    static Coroutines* current() { return running; }
+
+    virtual ~Coroutines() = default;
+
+    virtual EventLoop& loop() = 0;
+    // the running coroutine, as a waiter of the loop
+    virtual void* self() = 0;
+    // whether the builtin is called again by the coroutine it parked
+    virtual bool resumed() const = 0;
+    // switches once the builtin returns, which registered self() with the loop
+    virtual void park() = 0;
+    // parks the running coroutine until the one of handle returned
+    virtual void await(CoroutineObject* handle) = 0;
+
+protected:
+    static inline thread_local Coroutines* running = nullptr;
+};
+
+#endif
@@ -0,0 +1,282 @@
+#include "Heap.h"
+
+#include <chrono>
+#include <format>
+
+Heap& Heap::mainHeap() {
+    static Heap heap;
+    return heap;
+}
+
+Heap::InternTable& Heap::constants() {
+    static InternTable table;
+    return table;
+}
+
+Heap::~Heap() {
+    for (auto object : oldObjects) {
+        release(object);
+    }
+}
+
+void Heap::configure(size_t nurserySize, size_t oldLimit) {
+    // survivors of the current nursery would be lost with it
+    collect(false);
+    this->nurserySize = std::max(nurserySize, MIN_SIZE);
+    this->oldLimit = initialOldLimit = oldLimit;
+    nursery.reset();
+    top = end = nullptr;
+}
+
+void Heap::configureLike(Heap const& other) {
+    configure(other.nurserySize, other.initialOldLimit);
+    stress = other.stress;
+}
+
+// Constants are only added while no other thread runs, reading them needs no lock.
+StringObject* Heap::intern(std::string_view value, bool permanent) {
+    auto& table = constants();
+    if (auto constant = table.find(value); constant != table.end()) {
+        return *constant;
+    }
+
+    permanent = permanent && this == &mainHeap();
+    auto it = interned.find(value);
+    if (it != interned.end()) {
+        if (!permanent) {
+            return *it;
+        }
+        // a constant replaces the collectable string, which isn't unique anymore
+        (*it)->interned = false;
+        interned.erase(it);
+    }
+
+    StringObject* string;
+    if (permanent) {
+        auto size = roundUp(StringObject::sizeFor(value.size()));
+        string = initialize(new (::operator new(size)) StringObject(value), Generation::PERMANENT, size);
+        string->interned = true;
+        table.insert(string);
+    } else {
+        string = createOld<StringObject>(StringObject::sizeFor(value.size()), value);
+        string->interned = true;
+        interned.insert(string);
+    }
+    return string;
+}
+
+int Heap::addRoots(Roots roots) {
+    rootSets.emplace_back(nextRootSet, std::move(roots));
+    return nextRootSet++;
+}
+
+void Heap::removeRoots(int id) {
+    std::erase_if(rootSets, [id](auto const& entry) { return entry.first == id; });
+}
+
+void* Heap::allocate(size_t size, Generation& generation) {
+    stats.bytesAllocated += size;
+    if (stress) {
+        collect(true);
+    }
+
+    // large objects would fill the nursery alone, they start out old
+    if (size > nurserySize / 4) {
+        generation = Generation::OLD;
+        if (oldBytes + size > oldLimit) {
+            collect(true);
+        }
+        return allocateOld(size);
+    }
+
+    if (nursery == nullptr) {
+        nursery = std::make_unique_for_overwrite<char[]>(nurserySize);
+        top = nursery.get();
+        end = top + nurserySize;
+    }
+    if (static_cast<size_t>(end - top) < size) {
+        collect(false);
+    }
+    generation = Generation::NURSERY;
+    void* memory = top;
+    top += size;
+    return memory;
+}
+
+void* Heap::allocateOld(size_t size) {
+    auto object = static_cast<Object*>(::operator new(size));
+    oldObjects.push_back(object);
+    oldBytes += size;
+    return object;
+}
+
+void Heap::collect(bool major) {
+    auto start = std::chrono::steady_clock::now();
+
+    minor();
+    if (major || oldBytes > oldLimit) {
+        this->major();
+    }
+
+    double pause = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.totalPause += pause;
+    stats.maxPause = std::max(stats.maxPause, pause);
+}
+
+// Copies everything reachable in the nursery into the old generation. Survivors are
+// promoted on their first collection, there are no survivor spaces.
+void Heap::minor() {
+    stats.minorCollections++;
+    phase = Phase::MINOR;
+
+    visitRoots();
+    for (auto object : remembered) {
+        object->remembered = false;
+        trace(object);
+    }
+    remembered.clear();
+    while (!worklist.empty()) {
+        auto object = worklist.back();
+        worklist.pop_back();
+        trace(object);
+    }
+
+    top = nursery.get();
+    phase = Phase::IDLE;
+}
+
+// Marks the old generation from the roots and frees what wasn't reached. Runs right
+// after a minor collection, so nothing points into the nursery.
+void Heap::major() {
+    stats.majorCollections++;
+    phase = Phase::MAJOR;
+
+    visitRoots();
+    while (!worklist.empty()) {
+        auto object = worklist.back();
+        worklist.pop_back();
+        trace(object);
+    }
+
+    std::erase_if(interned, [](StringObject* string) {
+        return !string->marked;
+    });
+    size_t live = 0;
+    std::erase_if(oldObjects, [&live](Object* object) {
+        if (!object->marked) {
+            release(object);
+            return true;
+        }
+        object->marked = false;
+        live += object->size;
+        return false;
+    });
+    oldBytes = live;
+    oldLimit = std::max(initialOldLimit, 2 * live);
+    phase = Phase::IDLE;
+}
+
+void Heap::visitRoots() {
+    for (auto const& [id, roots] : rootSets) {
+        roots(*this);
+    }
+    for (auto handle : handles) {
+        visit(*handle);
+    }
+}
+
+void Heap::visit(Value& value) {
+    if (!value.isObject()) {
+        return;
+    }
+
+    auto object = value.asObject();
+    switch (object->generation) {
+        case Generation::NURSERY:
+            if (phase == Phase::MINOR) {
+                value = Value::fromObject(promote(object));
+            }
+            break;
+        case Generation::FORWARDED:
+            value = Value::fromObject(forwardee(object));
+            break;
+        case Generation::OLD:
+            if (phase == Phase::MAJOR && !object->marked) {
+                object->marked = true;
+                worklist.push_back(object);
+            }
+            break;
+        case Generation::PERMANENT:
+            break;
+    }
+}
+
+Object* Heap::promote(Object* object) {
+    auto copy = static_cast<Object*>(allocateOld(object->size));
+    std::memcpy(copy, object, object->size);
+    copy->generation = Generation::OLD;
+    copy->remembered = false;
+    stats.bytesPromoted += object->size;
+    worklist.push_back(copy);
+
+    object->generation = Generation::FORWARDED;
+    std::memcpy(reinterpret_cast<char*>(object) + sizeof(Object), &copy, sizeof(copy));
+    return copy;
+}
+
+// Frees an old object, task handles drop their task first.
+void Heap::release(Object* object) {
+    if (object->type == ObjectType::TASK) {
+        std::destroy_at(static_cast<TaskObject*>(object));
+    }
+    ::operator delete(object);
+}
+
+Object* Heap::forwardee(Object* object) {
+    Object* copy;
+    std::memcpy(&copy, reinterpret_cast<char*>(object) + sizeof(Object), sizeof(copy));
+    return copy;
+}
+
+void Heap::trace(Object* object) {
+    if (object->type == ObjectType::INSTANCE) {
+        auto instance = static_cast<InstanceObject*>(object);
+        visit(instance->fields(), instance->fields() + instance->fieldCount());
+    } else if (object->type == ObjectType::ARRAY) {
+        auto array = static_cast<ArrayObject*>(object);
+        if (array->elementType == ElementType::VALUE) {
+            visit(array->values(), array->values() + array->length);
+        }
+    } else if (object->type == ObjectType::MAP) {
+        visit(static_cast<MapObject*>(object)->table);
+    } else if (object->type == ObjectType::COROUTINE) {
+        visit(static_cast<CoroutineObject*>(object)->result);
+    } else if (object->type == ObjectType::TABLE) {
+        auto table = static_cast<TableObject*>(object);
+        for (uint32_t slot = 0; slot < table->capacity; slot++) {
+            if (table->control(slot) < TableObject::EMPTY) {
+                visit(table->entry(slot), table->entry(slot) + 2);
+            }
+        }
+    } else if (object->type == ObjectType::STRING && static_cast<StringObject*>(object)->rope) {
+        auto rope = static_cast<RopeObject*>(object);
+        visit(rope->left);
+        visit(rope->right);
+    }
+}
+
+static std::string bytesAsString(uint64_t bytes) {
+    if (bytes < 1024) {
+        return std::to_string(bytes) + "B";
+    }
+    if (bytes < 1024 * 1024) {
+        return std::format("{:.1f}KB", bytes / 1024.0);
+    }
+    return std::format("{:.1f}MB", bytes / (1024.0 * 1024.0));
+}
+
+void Heap::printStats(std::ostream& os) const {
+    os << "-- GC: " << stats.minorCollections << " minor and " << stats.majorCollections << " major collections, paused "
+       << std::format("{:.3f}ms in total, {:.3f}ms at most", stats.totalPause * 1000, stats.maxPause * 1000)
+       << ", allocated " << bytesAsString(stats.bytesAllocated) << ", promoted " << bytesAsString(stats.bytesPromoted) << std::endl;
+}
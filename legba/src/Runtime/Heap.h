@@ -0,0 +1,237 @@
+#ifndef LEGBA_RUNTIME_HEAP_H
+#define LEGBA_RUNTIME_HEAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Runtime/Object.h"
+#include "Runtime/Value.h"
+
+// Generational, precise garbage collector for strings, instances, arrays and maps.
+// New objects are bump allocated in the nursery. When it is full a minor collection
+// copies the survivors into the old generation and starts over, finding them from
+// the roots and the remembered set: old objects that got young ones stored into
+// them. The old generation is collected by mark and sweep once it grew past its
+// limit.
+//
+// Interned strings are unique by their contents, equal ones are the same object.
+// The table holds them weakly, unreachable ones are collected.
+//
+// Every thread running tasks has a heap of its own, see Scheduler, and objects never
+// point into another thread's heap: values cross over as copies, see Message. The
+// exception are constant strings, which are created by the main thread while
+// parsing, compiling or loading, before anything runs. They never change and are
+// shared by all heaps.
+//
+// Roots are registered by the engines and must be exact: every Value they visit is
+// either not an object or points to a live one. Objects move, so no raw object
+// pointer may be held in C++ across an allocation.
+class Heap {
+public:
+    static constexpr size_t DEFAULT_NURSERY_SIZE = 1 << 20;
+    static constexpr size_t DEFAULT_OLD_LIMIT = 16 << 20;
+
+    struct Stats {
+        uint64_t minorCollections = 0;
+        uint64_t majorCollections = 0;
+        double totalPause = 0;      // seconds
+        double maxPause = 0;
+        uint64_t bytesAllocated = 0;
+        uint64_t bytesPromoted = 0;
+    };
+
+    // Visits all values a root set keeps outside the heap with Heap::visit.
+    using Roots = std::function<void(Heap&)>;
+
+    // the heap of the calling thread, the main heap unless it set one with setCurrent
+    static Heap& get() { return current != nullptr ? *current : mainHeap(); }
+    static Heap& mainHeap();
+    // heap for the calling thread, nullptr for the main heap again
+    static void setCurrent(Heap* heap) { current = heap; }
+
+    Heap() = default;
+    Heap(Heap const&) = delete;
+    Heap& operator=(Heap const&) = delete;
+    ~Heap();
+
+    // Sizes in bytes. The old generation limit grows to twice the live data after
+    // each major collection.
+    void configure(size_t nurserySize, size_t oldLimit);
+    // collect everything at every allocation, to find missing roots and barriers
+    void setStress(bool enabled) { stress = enabled; }
+    // same nursery size, old generation limit and stress mode as other
+    void configureLike(Heap const& other);
+
+    // Constructs a T of size bytes, which may collect first: args must not point
+    // into the heap.
+    template <typename T, typename... Args>
+    T* create(size_t size, Args&&... args);
+    // Same in the old generation without ever collecting, for code that holds raw
+    // object pointers. The next regular allocation collects if that was too much.
+    template <typename T, typename... Args>
+    T* createOld(size_t size, Args&&... args);
+
+    // The interned string with these contents, created if there is none. Permanent
+    // strings are never collected, for constants of the program. Only the main heap
+    // creates them, other heaps make collectable strings instead.
+    StringObject* intern(std::string_view value, bool permanent);
+
+    int addRoots(Roots roots);
+    void removeRoots(int id);
+
+    // values held by C++ code across allocations, see Root
+    void pushRoot(Value* value) { handles.push_back(value); }
+    void popRoot() { handles.pop_back(); }
+
+    void visit(Value& value);
+    void visit(Value* begin, Value* end) {
+        for (; begin != end; ++begin) {
+            visit(*begin);
+        }
+    }
+
+    // Records an old object that a young one may have been stored into, see writeBarrier.
+    void remember(Object* object) {
+        object->remembered = true;
+        remembered.push_back(object);
+    }
+
+    // Empties the nursery, then collects the old generation too if major is set.
+    void collect(bool major);
+
+    Stats const& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+    void printStats(std::ostream& os) const;
+
+private:
+    enum class Phase { IDLE, MINOR, MAJOR };
+
+    static constexpr size_t ALIGNMENT = 8;
+    static constexpr size_t MIN_SIZE = 16; // room for the forwarding pointer
+
+    void* allocate(size_t size, Generation& generation);
+    void* allocateOld(size_t size);
+    void minor();
+    void major();
+    void visitRoots();
+    Object* promote(Object* object);
+    void trace(Object* object);
+
+    static Object* forwardee(Object* object);
+    static void release(Object* object);
+    static size_t roundUp(size_t size) { return std::max((size + ALIGNMENT - 1) & ~(ALIGNMENT - 1), MIN_SIZE); }
+    template <typename T>
+    static T* initialize(T* object, Generation generation, size_t size);
+
+    struct InternHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const { return hashString(value); }
+        size_t operator()(StringObject* string) const { return string->hashCode(); }
+    };
+    struct InternEqual {
+        using is_transparent = void;
+        static std::string_view contents(std::string_view value) { return value; }
+        static std::string_view contents(StringObject* string) { return string->view(); }
+        template <typename L, typename R>
+        bool operator()(L const& l, R const& r) const { return contents(l) == contents(r); }
+    };
+
+    std::unique_ptr<char[]> nursery;
+    size_t nurserySize = DEFAULT_NURSERY_SIZE;
+    char* top = nullptr;
+    char* end = nullptr;
+
+    std::vector<Object*> oldObjects;
+    size_t oldBytes = 0;
+    size_t oldLimit = DEFAULT_OLD_LIMIT;
+    size_t initialOldLimit = DEFAULT_OLD_LIMIT;
+
+    using InternTable = std::unordered_set<StringObject*, InternHash, InternEqual>;
+
+    // the permanent strings of all heaps
+    static InternTable& constants();
+
+    static inline thread_local Heap* current = nullptr;
+
+    InternTable interned;   // collectable strings only
+
+    std::vector<Object*> remembered;
+    std::vector<Value*> handles;
+    std::vector<Object*> worklist; // promoted or marked, their fields still to visit
+    std::vector<std::pair<int, Roots>> rootSets;
+    int nextRootSet = 0;
+
+    Phase phase = Phase::IDLE;
+    bool stress = false;
+    Stats stats;
+};
+
+template <typename T>
+T* Heap::initialize(T* object, Generation generation, size_t size) {
+    object->generation = generation;
+    object->remembered = generation == Generation::NURSERY;
+    object->size = static_cast<uint32_t>(size);
+    return object;
+}
+
+template <typename T, typename... Args>
+T* Heap::create(size_t size, Args&&... args) {
+    size = roundUp(size);
+    Generation generation;
+    auto memory = allocate(size, generation);
+    return initialize(new (memory) T(std::forward<Args>(args)...), generation, size);
+}
+
+template <typename T, typename... Args>
+T* Heap::createOld(size_t size, Args&&... args) {
+    size = roundUp(size);
+    stats.bytesAllocated += size;
+    auto memory = allocateOld(size);
+    return initialize(new (memory) T(std::forward<Args>(args)...), Generation::OLD, size);
+}
+
+// Keeps a value visited by collections while it is held in C++, for code that
+// allocates more than once. Roots are released in reverse order.
+class Root {
+public:
+    explicit Root(Value value) : value(value) { Heap::get().pushRoot(&this->value); }
+    Root(Root const&) = delete;
+    Root& operator=(Root const&) = delete;
+    ~Root() { Heap::get().popRoot(); }
+
+    Value value;
+};
+
+// Root for a number of values, e.g. arguments gathered in C++. Unlike Root it may be
+// released in any order.
+class RootArray {
+public:
+    explicit RootArray(size_t count) : values(count) {
+        id = Heap::get().addRoots([this](Heap& heap) { heap.visit(values.data(), values.data() + values.size()); });
+    }
+    RootArray(RootArray const&) = delete;
+    RootArray& operator=(RootArray const&) = delete;
+    ~RootArray() { Heap::get().removeRoots(id); }
+
+    std::vector<Value> values;
+
+private:
+    int id;
+};
+
+// Every store of a value into a heap object goes through here, minor collections
+// have to find the young objects that only old ones point to.
+inline void writeBarrier(Object* target, Value value) {
+    if (!target->remembered && value.isObject()) {
+        Heap::get().remember(target);
+    }
+}
+
+#endif
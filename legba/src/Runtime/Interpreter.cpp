@@ -0,0 +1,534 @@
+#include "Interpreter.h"
+
+#include <algorithm>
+
+#include "Error.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Map.h"
+#include "Runtime/Operations.h"
+
+Interpreter::Interpreter(ScopeNode* rootScope, int globalCount)
+    : rootScope(rootScope), globals(globalCount), stack(STACK_SIZE), callDepth(0), returning(false), tailCall(nullptr) {
+    frame = stack.data();
+    stackTop = stack.data();
+    gcRoots = Heap::get().addRoots([this](Heap& heap) { visitRoots(heap); });
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::CLASS) {
+            classNodes.push_back(static_cast<ClassNode*>(stmt));
+        }
+    }
+}
+
+Interpreter::~Interpreter() {
+    // the tasks still running may use this interpreter's roots
+    scheduler.reset();
+    Heap::get().removeRoots(gcRoots);
+}
+
+Value Interpreter::run() {
+    returning = false;
+    returnValue = Value::nil();
+
+    executeScope(rootScope);
+
+    return returnValue;
+}
+
+void Interpreter::printStats(std::ostream& os) const {
+    if (scheduler != nullptr) {
+        scheduler->printStats(os);
+    }
+}
+
+void Interpreter::saveEnvironment(std::vector<Value>& values) {
+    values.insert(values.end(), globals.begin(), globals.end());
+    for (auto node : classNodes) {
+        auto klass = classObject(node);
+        values.insert(values.end(), klass->statics.begin(), klass->statics.end());
+    }
+}
+
+void Interpreter::loadEnvironment(Value const* values) {
+    std::copy_n(values, globals.size(), globals.begin());
+    values += globals.size();
+    for (auto node : classNodes) {
+        auto klass = classObject(node);
+        std::copy_n(values, klass->statics.size(), klass->statics.begin());
+        values += klass->statics.size();
+    }
+}
+
+// The task's frame goes above whatever joins it. An error leaves the evaluation
+// state wherever it was thrown, the code below gets it back along with its globals
+// and statics.
+Value Interpreter::runTask(uintptr_t function, Value* args, size_t count, Value const* environment) {
+    size_t saved = suspended.size();
+    saveEnvironment(suspended);
+    loadEnvironment(environment);
+
+    Value* savedFrame = frame;
+    Value* savedTop = stackTop;
+    int savedDepth = callDepth;
+    Value result;
+    try {
+        result = callFunction(reinterpret_cast<FunctionNode*>(function), args, count);
+    } catch (...) {
+        frame = savedFrame;
+        stackTop = savedTop;
+        callDepth = savedDepth;
+        returning = false;
+        returnValue = Value::nil();
+        tailCall = nullptr;
+        loadEnvironment(suspended.data() + saved);
+        suspended.resize(saved);
+        throw;
+    }
+    loadEnvironment(suspended.data() + saved);
+    suspended.resize(saved);
+    return result;
+}
+
+ClassObject* Interpreter::findClass(std::string const& name) {
+    for (auto node : classNodes) {
+        if (node->getName() == name) {
+            return classObject(node);
+        }
+    }
+    return nullptr;
+}
+
+Value Interpreter::evaluate(Node* node) {
+    switch (node->getType()) {
+        case NodeType::INTEGER: return Value::fromInt(static_cast<IntegerNode*>(node)->getValue());
+        case NodeType::DOUBLE: return Value::fromDouble(static_cast<DoubleNode*>(node)->getValue());
+        case NodeType::BOOL: return Value::fromBool(static_cast<BoolNode*>(node)->getValue());
+        case NodeType::CHAR: return Value::fromChar(static_cast<CharNode*>(node)->getValue());
+        case NodeType::STRING: return static_cast<StringNode*>(node)->getConstant();
+        case NodeType::ARRAY: return evaluateArray(static_cast<ArrayNode*>(node));
+        case NodeType::MAP: return evaluateMap(static_cast<MapNode*>(node));
+
+        case NodeType::VARIABLE: return variable(static_cast<VariableNode*>(node)->getVar());
+        case NodeType::VARIABLE_DECL: {
+            auto decl = static_cast<VariableDeclarationNode*>(node);
+            variable(decl) = decl->getInitializer() != nullptr ? evaluate(decl->getInitializer()) : Value::nil();
+            return Value::nil();
+        }
+        case NodeType::IDENTIFIER:
+            throw RuntimeError("Undefined variable '" + static_cast<IdentifierNode*>(node)->getName() + "'.");
+
+        case NodeType::UNARY: return evaluateUnary(static_cast<UnaryNode*>(node));
+        case NodeType::BINARY: return evaluateBinary(static_cast<BinaryNode*>(node));
+        case NodeType::CALL: return evaluateCall(static_cast<FunctionCallNode*>(node));
+        case NodeType::METHOD_CALL: return evaluateMethodCall(static_cast<MethodCallNode*>(node));
+        case NodeType::SPAWN: return evaluateSpawn(static_cast<SpawnNode*>(node));
+
+        case NodeType::SCOPE: executeScope(static_cast<ScopeNode*>(node)); return Value::nil();
+        case NodeType::IF: executeIf(static_cast<IfNode*>(node)); return Value::nil();
+        case NodeType::WHILE: executeWhile(static_cast<WhileNode*>(node)); return Value::nil();
+        case NodeType::FOR: executeFor(static_cast<ForNode*>(node)); return Value::nil();
+
+        case NodeType::FUNCTION:
+        case NodeType::CLASS:
+            return Value::nil(); // declarations are resolved by the parser
+
+        case NodeType::OP:
+        case NodeType::METHOD:
+            break;
+    }
+
+    throw RuntimeError("Cannot evaluate " + node->toString() + '.');
+}
+
+void Interpreter::executeScope(ScopeNode* scope) {
+    for (auto stmt : scope->getStatements()) {
+        evaluate(stmt);
+        if (returning) {
+            return;
+        }
+    }
+}
+
+void Interpreter::executeIf(IfNode* node) {
+    if (evaluate(node->getCondition()).isTruthy()) {
+        evaluate(node->getThenBranch());
+    } else if (node->getElseBranch() != nullptr) {
+        evaluate(node->getElseBranch());
+    }
+}
+
+void Interpreter::executeWhile(WhileNode* node) {
+    while (evaluate(node->getCondition()).isTruthy()) {
+        evaluate(node->getBody());
+        if (returning) {
+            return;
+        }
+    }
+}
+
+void Interpreter::executeFor(ForNode* node) {
+    if (node->getInitializer() != nullptr) {
+        evaluate(node->getInitializer());
+    }
+
+    while (node->getCondition() == nullptr || evaluate(node->getCondition()).isTruthy()) {
+        evaluate(node->getBody());
+        if (returning) {
+            return;
+        }
+        if (node->getIncrement() != nullptr) {
+            evaluate(node->getIncrement());
+        }
+    }
+}
+
+Value Interpreter::evaluateUnary(UnaryNode* node) {
+    switch (node->getOp()->getOp()) {
+        case TokenType::RETURN:
+            // a function called in tail position takes over the frame, see invoke
+            if (callDepth > 0 && node->getNode() != nullptr && node->getNode()->getType() == NodeType::CALL
+                && static_cast<FunctionCallNode*>(node->getNode())->getFunction() != nullptr) {
+                tailCall = static_cast<FunctionCallNode*>(node->getNode());
+                returning = true;
+                return Value::nil();
+            }
+            returnValue = node->getNode() != nullptr ? evaluate(node->getNode()) : Value::nil();
+            returning = true;
+            return Value::nil();
+        case TokenType::BANG:
+            return Value::fromBool(!evaluate(node->getNode()).isTruthy());
+        case TokenType::MINUS:
+            return negate(evaluate(node->getNode()));
+        default:
+            break;
+    }
+
+    throw RuntimeError("Unknown unary operator " + tokenTypeToString(node->getOp()->getOp()) + '.');
+}
+
+Value Interpreter::evaluateBinary(BinaryNode* node) {
+    auto op = node->getOp()->getOp();
+    switch (op) {
+        case TokenType::EQUAL:
+            return evaluateAssignment(node);
+        case TokenType::AND: {
+            Value left = evaluate(node->getLeft());
+            return left.isTruthy() ? evaluate(node->getRight()) : left;
+        }
+        case TokenType::OR: {
+            Value left = evaluate(node->getLeft());
+            return left.isTruthy() ? left : evaluate(node->getRight());
+        }
+        case TokenType::DOT:
+            return getAttribute(evaluate(node->getLeft()), static_cast<IdentifierNode*>(node->getRight())->getName());
+        case TokenType::LEFT_BRACKET: {
+            Value* array = push(evaluate(node->getLeft()));
+            Value index = evaluate(node->getRight());
+            stackTop = array;
+            return getIndex(*array, index);
+        }
+        default:
+            break;
+    }
+
+    // evaluating the right operand may collect, which moves the left one
+    Value* pushed = push(evaluate(node->getLeft()));
+    Value right = evaluate(node->getRight());
+    Value left = *pushed;
+    stackTop = pushed;
+
+    switch (op) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::MODULO:
+            if (left.isInt() && right.isInt()) {
+                if (op == TokenType::PLUS) return Value::fromInt(static_cast<int32_t>(static_cast<uint32_t>(left.asInt()) + static_cast<uint32_t>(right.asInt())));
+                if (op == TokenType::MINUS) return Value::fromInt(static_cast<int32_t>(static_cast<uint32_t>(left.asInt()) - static_cast<uint32_t>(right.asInt())));
+            }
+            return arithmetic(op, left, right);
+        default:
+            return comparison(op, left, right);
+    }
+}
+
+Value Interpreter::evaluateAssignment(BinaryNode* node) {
+    if (node->getLeft()->getType() != NodeType::VARIABLE) {
+        auto target = static_cast<BinaryNode*>(node->getLeft());
+        if (target->getOp()->getOp() == TokenType::LEFT_BRACKET) {
+            Value* array = push(evaluate(target->getLeft()));
+            push(evaluate(target->getRight()));
+            Value value = evaluate(node->getRight());
+            setIndex(array[0], array[1], value);
+            stackTop = array;
+            return value;
+        }
+        Value* object = push(evaluate(target->getLeft()));
+        Value value = evaluate(node->getRight());
+        setAttribute(*object, static_cast<IdentifierNode*>(target->getRight())->getName(), value);
+        stackTop = object;
+        return value;
+    }
+
+    Value value = evaluate(node->getRight());
+    variable(static_cast<VariableNode*>(node->getLeft())->getVar()) = value;
+    return value;
+}
+
+Value Interpreter::evaluateCall(FunctionCallNode* call) {
+    auto func = call->getFunction();
+    if (func != nullptr) {
+        return invoke(func->getBody(), func->getFrameSize(), call->getArgs(), func->getParams().size(), nullptr);
+    }
+    if (auto builtin = call->getBuiltin()) {
+        return callNative(*builtin, call->getArgs());
+    }
+
+    auto klass = call->getInstantiatedClass();
+    if (klass == nullptr) {
+        throw RuntimeError("Undefined function '" + call->getCallee() + "'.");
+    }
+
+    Value* instance = push(newInstance(classObject(klass)));
+    auto constructor = klass->getConstructor();
+    if (constructor != nullptr) {
+        invoke(constructor->getBody(), constructor->getFrameSize(), call->getArgs(), constructor->getParams().size(), instance);
+    } else if (!call->getArgs().empty()) {
+        throw RuntimeError("Class '" + klass->getName() + "' has no constructor taking arguments.");
+    }
+    stackTop = instance;
+    return *instance;
+}
+
+Value Interpreter::evaluateMethodCall(MethodCallNode* call) {
+    Value receiver = evaluate(call->getReceiver());
+    if (!isObjectType(receiver, ObjectType::INSTANCE)) {
+        throw RuntimeError("Only instances have methods, got " + receiver.typeName() + '.');
+    }
+
+    // devirtualized calls were proven to only ever see instances of the method's class
+    auto klass = asInstance(receiver)->klass->node;
+    auto method = call->getFunction() != nullptr ? call->getFunction() : klass->getMethod(call);
+    if (method == nullptr) {
+        throw RuntimeError("Class '" + klass->getName() + "' has no method '" + call->getCallee() + "'.");
+    }
+
+    return invoke(method->getBody(), method->getFrameSize(), call->getArgs(), method->getParams().size(), &receiver);
+}
+
+// Arguments are evaluated onto the stack like those of a builtin. The first spawn
+// starts the scheduler, with an interpreter of the same tree for each worker.
+Value Interpreter::evaluateSpawn(SpawnNode* node) {
+    if (node->isCoroutine()) {
+        throw RuntimeError("Coroutines only run on the bytecode VM.");
+    }
+    auto call = node->getCall();
+    auto func = call->getFunction();
+    auto const& args = call->getArgs();
+    if (args.size() != func->getParams().size()) {
+        throw RuntimeError("Expected " + std::to_string(func->getParams().size()) + " arguments but got " + std::to_string(args.size()) + '.');
+    }
+
+    Value* values = stackTop;
+    if (values + args.size() > stack.data() + stack.size()) {
+        throw RuntimeError("Stack overflow.");
+    }
+    stackTop += args.size();
+    std::fill(values, stackTop, Value::nil());
+    for (size_t i = 0; i < args.size(); i++) {
+        values[i] = evaluate(args[i]);
+    }
+
+    auto current = Scheduler::current();
+    if (current == nullptr) {
+        scheduler = std::make_unique<Scheduler>(*this, [this]() -> std::unique_ptr<TaskEngine> {
+            return std::make_unique<Interpreter>(rootScope, static_cast<int>(globals.size()));
+        });
+        current = scheduler.get();
+    }
+    Value task = current->spawn(reinterpret_cast<uintptr_t>(func), values, args.size());
+    stackTop = values;
+    return task;
+}
+
+Value Interpreter::invoke(Node* body, int frameSize, std::vector<Node*> const& args, size_t paramCount, Value* self) {
+    if (args.size() != paramCount) {
+        throw RuntimeError("Expected " + std::to_string(paramCount) + " arguments but got " + std::to_string(args.size()) + '.');
+    }
+
+    if (stackTop + frameSize > stack.data() + stack.size() || callDepth >= MAX_CALL_DEPTH) {
+        throw RuntimeError("Stack overflow.");
+    }
+
+    // arguments are evaluated in the caller's frame, straight into the callee's slots,
+    // which are cleared first: the collector visits everything below stackTop
+    Value* newFrame = stackTop;
+    stackTop += frameSize;
+    std::fill(newFrame, stackTop, Value::nil());
+    int first = 0;
+    if (self != nullptr) {
+        newFrame[first++] = *self;
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        newFrame[first + i] = evaluate(args[i]);
+    }
+
+    return execute(body, newFrame);
+}
+
+Value Interpreter::callFunction(FunctionNode* func, Value const* args, size_t count) {
+    if (count != func->getParams().size()) {
+        throw RuntimeError("Expected " + std::to_string(func->getParams().size()) + " arguments but got " + std::to_string(count) + '.');
+    }
+
+    int frameSize = func->getFrameSize();
+    if (stackTop + frameSize > stack.data() + stack.size() || callDepth >= MAX_CALL_DEPTH) {
+        throw RuntimeError("Stack overflow.");
+    }
+
+    Value* newFrame = stackTop;
+    stackTop += frameSize;
+    std::fill(newFrame, stackTop, Value::nil());
+    std::copy_n(args, count, newFrame);
+    return execute(func->getBody(), newFrame);
+}
+
+Value Interpreter::execute(Node* body, Value* newFrame) {
+    Value* savedFrame = frame;
+    frame = newFrame;
+    callDepth++;
+
+    evaluate(body);
+    while (tailCall != nullptr) {
+        auto call = tailCall;
+        auto func = call->getFunction();
+        tailCall = nullptr;
+        returning = false;
+        if (call->getArgs().size() != func->getParams().size()) {
+            throw RuntimeError("Expected " + std::to_string(func->getParams().size()) + " arguments but got " + std::to_string(call->getArgs().size()) + '.');
+        }
+
+        // arguments still read the finished frame, they are collected above it first
+        auto args = call->getArgs();
+        Value* values = stackTop;
+        if (values + args.size() > stack.data() + stack.size()) {
+            throw RuntimeError("Stack overflow.");
+        }
+        stackTop += args.size();
+        std::fill(values, stackTop, Value::nil());
+        for (size_t i = 0; i < args.size(); i++) {
+            values[i] = evaluate(args[i]);
+        }
+
+        int frameSize = func->getFrameSize();
+        if (newFrame + frameSize > stack.data() + stack.size()) {
+            throw RuntimeError("Stack overflow.");
+        }
+        for (size_t i = 0; i < args.size(); i++) {
+            newFrame[i] = values[i];
+        }
+        for (int i = static_cast<int>(args.size()); i < frameSize; i++) {
+            newFrame[i] = Value::nil();
+        }
+        stackTop = newFrame + frameSize;
+
+        evaluate(func->getBody());
+    }
+
+    Value result = returning ? returnValue : Value::nil();
+    returning = false;
+    returnValue = Value::nil();
+
+    callDepth--;
+    frame = savedFrame;
+    stackTop = newFrame;
+
+    return result;
+}
+
+// Arguments are evaluated onto the stack, where the builtin reads them and the
+// collector finds them.
+Value Interpreter::callNative(Builtin const& builtin, std::vector<Node*> const& args) {
+    Value* values = stackTop;
+    if (values + args.size() > stack.data() + stack.size()) {
+        throw RuntimeError("Stack overflow.");
+    }
+    stackTop += args.size();
+    std::fill(values, stackTop, Value::nil());
+    for (size_t i = 0; i < args.size(); i++) {
+        values[i] = evaluate(args[i]);
+    }
+
+    Value result = callBuiltin(builtin, values);
+    stackTop = values;
+    return result;
+}
+
+// Elements are evaluated onto the stack like arguments.
+Value Interpreter::evaluateArray(ArrayNode* node) {
+    auto const& elements = node->getElements();
+    Value* values = stackTop;
+    if (values + elements.size() > stack.data() + stack.size()) {
+        throw RuntimeError("Stack overflow.");
+    }
+    stackTop += elements.size();
+    std::fill(values, stackTop, Value::nil());
+    for (size_t i = 0; i < elements.size(); i++) {
+        values[i] = evaluate(elements[i]);
+    }
+
+    Value array = newArray(values, elements.size(), declaredElementType(node->getElementType()));
+    stackTop = values;
+    return array;
+}
+
+// Keys and values are evaluated onto the stack like array elements.
+Value Interpreter::evaluateMap(MapNode* node) {
+    auto const& entries = node->getEntries();
+    Value* values = stackTop;
+    if (values + entries.size() > stack.data() + stack.size()) {
+        throw RuntimeError("Stack overflow.");
+    }
+    stackTop += entries.size();
+    std::fill(values, stackTop, Value::nil());
+    for (size_t i = 0; i < entries.size(); i++) {
+        values[i] = evaluate(entries[i]);
+    }
+
+    Value map = maps::newMap(values, entries.size() / 2);
+    stackTop = values;
+    return map;
+}
+
+ClassObject* Interpreter::classObject(ClassNode* node) {
+    auto it = classes.find(node);
+    if (it != classes.end()) {
+        return it->second;
+    }
+
+    auto klass = newClass(node);
+    classes.emplace(node, klass);
+    return klass;
+}
+
+Value& Interpreter::variable(VariableDeclarationNode* var) {
+    return var->isGlobal() ? globals[var->getSlot()] : frame[var->getSlot()];
+}
+
+Value* Interpreter::push(Value value) {
+    if (stackTop == stack.data() + stack.size()) {
+        throw RuntimeError("Stack overflow.");
+    }
+    *stackTop = value;
+    return stackTop++;
+}
+
+void Interpreter::visitRoots(Heap& heap) {
+    heap.visit(stack.data(), stackTop);
+    heap.visit(globals.data(), globals.data() + globals.size());
+    heap.visit(returnValue);
+    for (auto const& [node, klass] : classes) {
+        heap.visit(klass->statics.data(), klass->statics.data() + klass->statics.size());
+    }
+    heap.visit(suspended.data(), suspended.data() + suspended.size());
+}
@@ -0,0 +1,87 @@
+#ifndef LEGBA_RUNTIME_INTERPRETER_H
+#define LEGBA_RUNTIME_INTERPRETER_H
+
+#include <memory>
+#include <ostream>
+#include <vector>
+#include <unordered_map>
+
+#include "ASTNode/ASTNode.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Value.h"
+#include "Runtime/Object.h"
+#include "Runtime/Scheduler.h"
+
+// Tree-walking evaluator over the parsed AST. Variables live in frame slots assigned
+// by the parser; dispatch switches on the NodeType instead of calling virtuals.
+class Interpreter : public TaskEngine {
+public:
+    Interpreter(ScopeNode* rootScope, int globalCount);
+    Interpreter(Interpreter const&) = delete;
+    Interpreter& operator=(Interpreter const&) = delete;
+    ~Interpreter() override;
+
+    Value run();
+
+    // tasks spawned, if any
+    void printStats(std::ostream& os) const;
+
+    void saveEnvironment(std::vector<Value>& values) override;
+    Value runTask(uintptr_t function, Value* args, size_t count, Value const* environment) override;
+    ClassObject* findClass(std::string const& name) override;
+
+private:
+    Value evaluate(Node* node);
+
+    void executeScope(ScopeNode* scope);
+    void executeIf(IfNode* node);
+    void executeWhile(WhileNode* node);
+    void executeFor(ForNode* node);
+
+    Value evaluateUnary(UnaryNode* node);
+    Value evaluateBinary(BinaryNode* node);
+    Value evaluateAssignment(BinaryNode* node);
+    Value evaluateArray(ArrayNode* node);
+    Value evaluateMap(MapNode* node);
+    Value evaluateCall(FunctionCallNode* call);
+    Value evaluateMethodCall(MethodCallNode* call);
+    Value evaluateSpawn(SpawnNode* node);
+    Value invoke(Node* body, int frameSize, std::vector<Node*> const& args, size_t paramCount, Value* self);
+    Value callFunction(FunctionNode* func, Value const* args, size_t count);
+    // runs body in newFrame, whose arguments are in place, and pops it again
+    Value execute(Node* body, Value* newFrame);
+    Value callNative(Builtin const& builtin, std::vector<Node*> const& args);
+
+    ClassObject* classObject(ClassNode* node);
+
+    Value& variable(VariableDeclarationNode* var);
+    void loadEnvironment(Value const* values);
+
+    // Keeps a value where the collector finds it while more code is evaluated, until
+    // stackTop is reset below it.
+    Value* push(Value value);
+    void visitRoots(Heap& heap);
+
+private:
+    static constexpr size_t STACK_SIZE = 1 << 20;
+    static constexpr int MAX_CALL_DEPTH = 3000; // every call recurses on the native stack
+
+    ScopeNode* rootScope;
+    std::vector<Value> globals;
+    std::vector<Value> stack;
+    Value* frame;
+    Value* stackTop;
+    int callDepth;
+    std::unordered_map<ClassNode*, ClassObject*> classes;
+    std::vector<ClassNode*> classNodes;     // in declaration order, for the environment of tasks
+
+    bool returning;
+    Value returnValue;
+    FunctionCallNode* tailCall; // pending call of a return, run by invoke in the same frame
+    int gcRoots;
+
+    std::vector<Value> suspended;   // environments of the code below running tasks
+    std::unique_ptr<Scheduler> scheduler;
+};
+
+#endif
@@ -0,0 +1,318 @@
+#include "Kernels.h"
+
+#if !defined(LEGBA_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LEGBA_KERNELS_AVX2
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace kernels {
+
+namespace {
+
+constexpr size_t LANES = 8;
+
+// lane l holds the partial sum of the elements at l, l + 8, l + 16, ...
+double combine(double const* lanes) {
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+template <Op op>
+int32_t apply(int32_t a, int32_t b) {
+    auto x = static_cast<uint32_t>(a), y = static_cast<uint32_t>(b);
+    if constexpr (op == Op::ADD) return static_cast<int32_t>(x + y);
+    else if constexpr (op == Op::SUB) return static_cast<int32_t>(x - y);
+    else return static_cast<int32_t>(x * y);
+}
+
+template <Op op>
+double apply(double a, double b) {
+    if constexpr (op == Op::ADD) return a + b;
+    else if constexpr (op == Op::SUB) return a - b;
+    else return a * b;
+}
+
+namespace portable {
+
+int32_t sumInts(int32_t const* a, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += static_cast<uint32_t>(a[i]);
+    }
+    return static_cast<int32_t>(sum);
+}
+
+double sumDoubles(double const* a, size_t n) {
+    double lanes[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            lanes[l] += a[i + l];
+        }
+    }
+    double sum = combine(lanes);
+    for (; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+int32_t dotInts(int32_t const* a, int32_t const* b, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+    }
+    return static_cast<int32_t>(sum);
+}
+
+double dotDoubles(double const* a, double const* b, size_t n) {
+    double lanes[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            lanes[l] += a[i + l] * b[i + l];
+        }
+    }
+    double sum = combine(lanes);
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+bool equalDoubles(double const* a, double const* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void intsToDoubles(double* out, int32_t const* a, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i];
+    }
+}
+
+template <typename T, Op op>
+void arrays(T* out, T const* a, T const* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = apply<op>(a[i], b[i]);
+    }
+}
+
+template <typename T, Op op>
+void scalar(T* out, T const* a, T b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = apply<op>(a[i], b);
+    }
+}
+
+}
+
+#ifdef LEGBA_KERNELS_AVX2
+namespace avx2 {
+
+AVX2 int32_t horizontalSum(__m256i v) {
+    alignas(32) int32_t lanes[LANES];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+    return portable::sumInts(lanes, LANES);
+}
+
+// the two accumulators hold lanes 0-3 and 4-7
+AVX2 double horizontalSum(__m256d low, __m256d high) {
+    alignas(32) double lanes[LANES];
+    _mm256_store_pd(lanes, low);
+    _mm256_store_pd(lanes + 4, high);
+    return combine(lanes);
+}
+
+AVX2 int32_t sumInts(int32_t const* a, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        sum = _mm256_add_epi32(sum, _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i)));
+    }
+    return apply<Op::ADD>(horizontalSum(sum), portable::sumInts(a + i, n - i));
+}
+
+AVX2 double sumDoubles(double const* a, size_t n) {
+    __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        low = _mm256_add_pd(low, _mm256_loadu_pd(a + i));
+        high = _mm256_add_pd(high, _mm256_loadu_pd(a + i + 4));
+    }
+    double sum = horizontalSum(low, high);
+    for (; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+AVX2 int32_t dotInts(int32_t const* a, int32_t const* b, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(x, y));
+    }
+    return apply<Op::ADD>(horizontalSum(sum), portable::dotInts(a + i, b + i, n - i));
+}
+
+// products and sums stay separate instructions, a fused multiply-add rounds differently
+AVX2 double dotDoubles(double const* a, double const* b, size_t n) {
+    __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double sum = horizontalSum(low, high);
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+AVX2 bool equalDoubles(double const* a, double const* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d equal = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_EQ_OQ);
+        if (_mm256_movemask_pd(equal) != 0xF) {
+            return false;
+        }
+    }
+    return portable::equalDoubles(a + i, b + i, n - i);
+}
+
+AVX2 void intsToDoubles(double* out, int32_t const* a, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i))));
+    }
+    portable::intsToDoubles(out + i, a + i, n - i);
+}
+
+template <Op op>
+AVX2 __m256i applyVector(__m256i a, __m256i b) {
+    if constexpr (op == Op::ADD) return _mm256_add_epi32(a, b);
+    else if constexpr (op == Op::SUB) return _mm256_sub_epi32(a, b);
+    else return _mm256_mullo_epi32(a, b);
+}
+
+template <Op op>
+AVX2 __m256d applyVector(__m256d a, __m256d b) {
+    if constexpr (op == Op::ADD) return _mm256_add_pd(a, b);
+    else if constexpr (op == Op::SUB) return _mm256_sub_pd(a, b);
+    else return _mm256_mul_pd(a, b);
+}
+
+template <Op op>
+AVX2 void intArrays(int32_t* out, int32_t const* a, int32_t const* b, size_t n) {
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), applyVector<op>(x, y));
+    }
+    portable::arrays<int32_t, op>(out + i, a + i, b + i, n - i);
+}
+
+template <Op op>
+AVX2 void intScalar(int32_t* out, int32_t const* a, int32_t b, size_t n) {
+    __m256i y = _mm256_set1_epi32(b);
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), applyVector<op>(x, y));
+    }
+    portable::scalar<int32_t, op>(out + i, a + i, b, n - i);
+}
+
+template <Op op>
+AVX2 void doubleArrays(double* out, double const* a, double const* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, applyVector<op>(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    portable::arrays<double, op>(out + i, a + i, b + i, n - i);
+}
+
+template <Op op>
+AVX2 void doubleScalar(double* out, double const* a, double b, size_t n) {
+    __m256d y = _mm256_set1_pd(b);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, applyVector<op>(_mm256_loadu_pd(a + i), y));
+    }
+    portable::scalar<double, op>(out + i, a + i, b, n - i);
+}
+
+}
+#endif
+
+// the kernels of one instruction set, arithmetic ones indexed by Op
+struct Table {
+    const char* name;
+    int32_t (*sumInts)(int32_t const*, size_t);
+    double (*sumDoubles)(double const*, size_t);
+    int32_t (*dotInts)(int32_t const*, int32_t const*, size_t);
+    double (*dotDoubles)(double const*, double const*, size_t);
+    bool (*equalDoubles)(double const*, double const*, size_t);
+    void (*intsToDoubles)(double*, int32_t const*, size_t);
+    void (*intArrays[3])(int32_t*, int32_t const*, int32_t const*, size_t);
+    void (*intScalar[3])(int32_t*, int32_t const*, int32_t, size_t);
+    void (*doubleArrays[3])(double*, double const*, double const*, size_t);
+    void (*doubleScalar[3])(double*, double const*, double, size_t);
+};
+
+Table select() {
+#ifdef LEGBA_KERNELS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        using namespace avx2;
+        return {
+            "avx2", sumInts, sumDoubles, dotInts, dotDoubles, equalDoubles, intsToDoubles,
+            { intArrays<Op::ADD>, intArrays<Op::SUB>, intArrays<Op::MUL> },
+            { intScalar<Op::ADD>, intScalar<Op::SUB>, intScalar<Op::MUL> },
+            { doubleArrays<Op::ADD>, doubleArrays<Op::SUB>, doubleArrays<Op::MUL> },
+            { doubleScalar<Op::ADD>, doubleScalar<Op::SUB>, doubleScalar<Op::MUL> },
+        };
+    }
+#endif
+    using namespace portable;
+    return {
+        "portable", sumInts, sumDoubles, dotInts, dotDoubles, equalDoubles, intsToDoubles,
+        { arrays<int32_t, Op::ADD>, arrays<int32_t, Op::SUB>, arrays<int32_t, Op::MUL> },
+        { scalar<int32_t, Op::ADD>, scalar<int32_t, Op::SUB>, scalar<int32_t, Op::MUL> },
+        { arrays<double, Op::ADD>, arrays<double, Op::SUB>, arrays<double, Op::MUL> },
+        { scalar<double, Op::ADD>, scalar<double, Op::SUB>, scalar<double, Op::MUL> },
+    };
+}
+
+Table const& table() {
+    static const Table selected = select();
+    return selected;
+}
+
+int index(Op op) { return static_cast<int>(op); }
+
+}
+
+int32_t sumInts(int32_t const* a, size_t n) { return table().sumInts(a, n); }
+double sumDoubles(double const* a, size_t n) { return table().sumDoubles(a, n); }
+int32_t dotInts(int32_t const* a, int32_t const* b, size_t n) { return table().dotInts(a, b, n); }
+double dotDoubles(double const* a, double const* b, size_t n) { return table().dotDoubles(a, b, n); }
+bool equalDoubles(double const* a, double const* b, size_t n) { return table().equalDoubles(a, b, n); }
+void intsToDoubles(double* out, int32_t const* a, size_t n) { table().intsToDoubles(out, a, n); }
+
+void arithmetic(Op op, int32_t* out, int32_t const* a, int32_t const* b, size_t n) { table().intArrays[index(op)](out, a, b, n); }
+void arithmetic(Op op, int32_t* out, int32_t const* a, int32_t b, size_t n) { table().intScalar[index(op)](out, a, b, n); }
+void arithmetic(Op op, double* out, double const* a, double const* b, size_t n) { table().doubleArrays[index(op)](out, a, b, n); }
+void arithmetic(Op op, double* out, double const* a, double b, size_t n) { table().doubleScalar[index(op)](out, a, b, n); }
+
+const char* instructionSet() { return table().name; }
+
+}
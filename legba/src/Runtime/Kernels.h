@@ -0,0 +1,38 @@
+#ifndef LEGBA_RUNTIME_KERNELS_H
+#define LEGBA_RUNTIME_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Loops over the unboxed elements of int and double arrays, the work of the bulk
+// builtins. Each exists in a portable version and one using AVX2, picked on first
+// use by what the CPU supports; building with LEGBA_NO_SIMD keeps the portable
+// ones. Both give the same results: ints wrap around either way, and doubles are
+// summed in eight interleaved partial sums that are combined in a fixed order, which
+// the C runtime of --emit-c follows as well.
+namespace kernels {
+
+enum class Op : uint8_t {
+    ADD, SUB, MUL
+};
+
+int32_t sumInts(int32_t const* a, size_t n);
+double sumDoubles(double const* a, size_t n);
+int32_t dotInts(int32_t const* a, int32_t const* b, size_t n);
+double dotDoubles(double const* a, double const* b, size_t n);
+// == on every pair of elements, NaN is unequal to itself
+bool equalDoubles(double const* a, double const* b, size_t n);
+void intsToDoubles(double* out, int32_t const* a, size_t n);
+
+// out[i] = a[i] op b[i], or a[i] op b for a scalar b; out may be a
+void arithmetic(Op op, int32_t* out, int32_t const* a, int32_t const* b, size_t n);
+void arithmetic(Op op, int32_t* out, int32_t const* a, int32_t b, size_t n);
+void arithmetic(Op op, double* out, double const* a, double const* b, size_t n);
+void arithmetic(Op op, double* out, double const* a, double b, size_t n);
+
+// "avx2" or "portable"
+const char* instructionSet();
+
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "Map.h"
+
+#include <bit>
+#include <cmath>
+
+#include "Error.h"
+#include "Runtime/Heap.h"
+
+#if !defined(LEGBA_NO_SIMD) && defined(__SSE2__)
+#define LEGBA_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace maps {
+
+namespace {
+
+constexpr uint32_t MIN_CAPACITY = TableObject::GROUP;
+constexpr uint32_t MAX_CAPACITY = 1u << 27;
+
+static_assert(sizeof(TableObject) + MAX_CAPACITY * TableObject::SLOT_SIZE <= UINT32_MAX);
+
+// bit i set if slot i of the group has control byte c
+inline uint32_t match(uint8_t const* group, uint8_t c) {
+#ifdef LEGBA_MAP_SSE2
+    auto controls = _mm_loadu_si128(reinterpret_cast<__m128i const*>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(static_cast<char>(c)))));
+#else
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < TableObject::GROUP; i++) {
+        bits |= static_cast<uint32_t>(group[i] == c) << i;
+    }
+    return bits;
+#endif
+}
+
+// EMPTY and DELETED are the control bytes with the high bit set
+inline uint32_t matchFree(uint8_t const* group) {
+#ifdef LEGBA_MAP_SSE2
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(group))));
+#else
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < TableObject::GROUP; i++) {
+        bits |= static_cast<uint32_t>(group[i] >> 7) << i;
+    }
+    return bits;
+#endif
+}
+
+// The key as stored: integral doubles become ints so that 1 and 1.0 are one key.
+inline Value normalize(Value key) {
+    if (key.isInt()) {
+        return key;
+    }
+    if (key.isDouble()) {
+        double d = key.asDouble();
+        if (d >= INT32_MIN && d <= INT32_MAX && std::trunc(d) == d) {
+            return Value::fromInt(static_cast<int32_t>(d));
+        }
+        return key;
+    }
+    if (key.isChar() || key.isBool() || isObjectType(key, ObjectType::STRING)) {
+        return key;
+    }
+    throw RuntimeError("Map keys must be numbers, strings, chars or bools, got " + key.typeName() + '.');
+}
+
+// murmur3's finalizer, the control byte takes the low bits and the group the others
+inline uint64_t hash(Value key) {
+    uint64_t h = isObjectType(key, ObjectType::STRING) ? asString(key)->hashCode() : key.bits;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+bool equalStrings(StringObject* a, StringObject* b) {
+    // interned strings are unique by their contents
+    return !(a->interned && b->interned) && a->hashCode() == b->hashCode() && a->view() == b->view();
+}
+
+inline bool equal(Value stored, Value key) {
+    if (stored == key) {
+        return true;
+    }
+    return isObjectType(key, ObjectType::STRING) && isObjectType(stored, ObjectType::STRING) && equalStrings(asString(stored), asString(key));
+}
+
+// Groups are probed in triangular steps, which visit each group once.
+inline uint32_t firstGroup(TableObject* table, uint64_t h) {
+    return static_cast<uint32_t>(h >> 7) & (table->capacity / TableObject::GROUP - 1);
+}
+
+inline uint32_t nextGroup(TableObject* table, uint32_t group, uint32_t step) {
+    return (group + step) & (table->capacity / TableObject::GROUP - 1);
+}
+
+// slot of the key, -1 if absent
+inline int64_t findSlot(TableObject* table, Value key, uint64_t h) {
+    auto h2 = static_cast<uint8_t>(h & 0x7F);
+    uint32_t group = firstGroup(table, h);
+    for (uint32_t step = 1; ; step++) {
+        auto controls = table->controls(group);
+        for (uint32_t bits = match(controls, h2); bits != 0; bits &= bits - 1) {
+            uint32_t slot = group * TableObject::GROUP + std::countr_zero(bits);
+            if (equal(table->entry(slot)[0], key)) {
+                return slot;
+            }
+        }
+        if (match(controls, TableObject::EMPTY) != 0) {
+            return -1;
+        }
+        group = nextGroup(table, group, step);
+    }
+}
+
+// first empty or deleted slot on the probe sequence, there always is one
+inline uint32_t freeSlot(TableObject* table, uint64_t h) {
+    uint32_t group = firstGroup(table, h);
+    for (uint32_t step = 1; ; step++) {
+        if (uint32_t bits = matchFree(table->controls(group))) {
+            return group * TableObject::GROUP + std::countr_zero(bits);
+        }
+        group = nextGroup(table, group, step);
+    }
+}
+
+void store(TableObject* table, uint32_t slot, uint64_t h, Value key, Value value) {
+    table->control(slot) = static_cast<uint8_t>(h & 0x7F);
+    table->entry(slot)[0] = key;
+    table->entry(slot)[1] = value;
+    writeBarrier(table, key);
+    writeBarrier(table, value);
+}
+
+uint32_t capacityFor(size_t count) {
+    uint32_t capacity = MIN_CAPACITY;
+    while (count > capacity / 8 * 7) {
+        if (capacity == MAX_CAPACITY) {
+            throw RuntimeError("Maps hold at most " + std::to_string(MAX_COUNT) + " entries.");
+        }
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Moves the entries into a new table with room for count of them.
+void rehash(Root& map, size_t count) {
+    auto capacity = capacityFor(count);
+    auto table = Heap::get().create<TableObject>(TableObject::sizeFor(capacity), capacity);
+
+    auto object = asMap(map.value);
+    forEach(object, [&](Value key, Value value) {
+        auto h = hash(key);
+        store(table, freeSlot(table, h), h, key, value);
+    });
+    object->table = Value::fromObject(table);
+    object->tombstones = 0;
+    writeBarrier(object, object->table);
+}
+
+}
+
+static_assert(MAX_COUNT == MAX_CAPACITY / 8 * 7);
+
+Value newMap(size_t expected) {
+    Root map(Value::fromObject(Heap::get().create<MapObject>(sizeof(MapObject))));
+    if (expected > 0) {
+        rehash(map, expected);
+    }
+    return map.value;
+}
+
+Value newMap(Value const* entries, size_t count) {
+    Root map(newMap(count));
+    for (size_t i = 0; i < count; i++) {
+        set(map.value, entries[2 * i], entries[2 * i + 1]);
+    }
+    return map.value;
+}
+
+Value* find(MapObject* map, Value key) {
+    key = normalize(key);
+    if (map->count == 0) {
+        return nullptr;
+    }
+    auto table = asTable(map->table);
+    auto slot = findSlot(table, key, hash(key));
+    return slot >= 0 ? &table->entry(static_cast<uint32_t>(slot))[1] : nullptr;
+}
+
+Value get(Value map, Value key) {
+    auto value = find(asMap(map), key);
+    return value != nullptr ? *value : Value::nil();
+}
+
+void set(Value map, Value key, Value value) {
+    key = normalize(key);
+    if (auto stored = find(asMap(map), key)) {
+        *stored = value;
+        writeBarrier(asTable(asMap(map)->table), value);
+        return;
+    }
+
+    if (isObjectType(key, ObjectType::STRING) && !asString(key)->interned) {
+        key = Value::fromObject(Heap::get().intern(asString(key)->view(), false));
+    }
+    auto object = asMap(map);
+    if (object->table.isNil() || object->count + object->tombstones + 1 > asTable(object->table)->capacity / 8 * 7) {
+        Root rootedMap(map), rootedKey(key), rootedValue(value);
+        rehash(rootedMap, static_cast<size_t>(object->count) + 1);
+        object = asMap(rootedMap.value);
+        key = rootedKey.value;
+        value = rootedValue.value;
+    }
+
+    auto table = asTable(object->table);
+    auto h = hash(key);
+    auto slot = freeSlot(table, h);
+    if (table->control(slot) == TableObject::DELETED) {
+        object->tombstones--;
+    }
+    store(table, slot, h, key, value);
+    object->count++;
+}
+
+bool remove(Value map, Value key) {
+    key = normalize(key);
+    auto object = asMap(map);
+    if (object->count == 0) {
+        return false;
+    }
+    auto table = asTable(object->table);
+    auto found = findSlot(table, key, hash(key));
+    if (found < 0) {
+        return false;
+    }
+
+    // A group that still has an empty slot was never full, no probe went past it
+    // and the slot can be empty again. Groups that were full keep a tombstone.
+    auto slot = static_cast<uint32_t>(found);
+    if (match(table->controls(slot / TableObject::GROUP), TableObject::EMPTY) != 0) {
+        table->control(slot) = TableObject::EMPTY;
+    } else {
+        table->control(slot) = TableObject::DELETED;
+        object->tombstones++;
+    }
+    table->entry(slot)[0] = table->entry(slot)[1] = Value::nil();
+    object->count--;
+    return true;
+}
+
+const char* instructionSet() {
+#ifdef LEGBA_MAP_SSE2
+    return "sse2";
+#else
+    return "portable";
+#endif
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef LEGBA_RUNTIME_MAP_H
+#define LEGBA_RUNTIME_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Runtime/Object.h"
+#include "Runtime/Value.h"
+
+// Maps are Swiss tables: open addressing over a TableObject whose slots are probed
+// in groups of 16. The 7 low bits of a key's hash are kept in the slot's control
+// byte, a lookup compares them for a whole group at once (with SSE2 unless built
+// with LEGBA_NO_SIMD) and only looks at the keys that match. Groups are visited in
+// triangular steps until one has an empty slot. Removed keys leave DELETED slots
+// behind. The table is rebuilt once full and deleted slots reach 7/8 of it.
+//
+// Keys are numbers, strings, chars and bools, compared like ==: a double with an int
+// value is the same key as that int. Strings hash by their cached hash code, stored
+// keys are interned so looking one up with a constant is a pointer comparison.
+// Entries are iterated in slot order, which the C runtime of --emit-c reproduces.
+namespace maps {
+
+// the largest table's size must fit in Object::size
+constexpr uint32_t MAX_COUNT = (1u << 27) / 8 * 7;
+
+Value newMap(size_t expected = 0);
+// Map literal of count keys and values alternating in entries, which must be roots.
+// Later entries replace earlier ones with the same key.
+Value newMap(Value const* entries, size_t count);
+// the value stored for key, nullptr if there is none; throws for unhashable keys
+Value* find(MapObject* map, Value key);
+// nil if absent
+Value get(Value map, Value key);
+// may collect, map, key and value are kept alive
+void set(Value map, Value key, Value value);
+// true if the key was there
+bool remove(Value map, Value key);
+
+// f(key, value) for every entry in slot order, f must not change the map
+template <typename F>
+void forEach(MapObject* map, F&& f) {
+    if (map->table.isNil()) {
+        return;
+    }
+    auto table = asTable(map->table);
+    for (uint32_t slot = 0; slot < table->capacity; slot++) {
+        if (table->control(slot) < TableObject::EMPTY) {
+            f(table->entry(slot)[0], table->entry(slot)[1]);
+        }
+    }
+}
+
+// "sse2" or "portable", how groups are probed
+const char* instructionSet();
+
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include "Message.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include "Error.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Map.h"
+#include "Runtime/Operations.h"
+#include "Runtime/Scheduler.h"
+
+namespace {
+
+Value reference(size_t record) {
+    return Value::fromBits((static_cast<uint64_t>(Value::TAG_OBJECT) << Value::TAG_SHIFT) | record);
+}
+
+size_t recordOf(Value reference) {
+    return static_cast<size_t>(reference.bits & Value::PAYLOAD_MASK);
+}
+
+}
+
+// Records are filled in breadth first, so deep structures don't recurse.
+Message::Message(Value const* values, size_t count) : count(count) {
+    std::unordered_map<Object*, size_t> indices;
+    std::vector<Object*> objects;
+    auto encode = [&](Value value) {
+        if (!value.isObject()) {
+            return value;
+        }
+        auto [it, added] = indices.emplace(value.asObject(), objects.size());
+        if (added) {
+            objects.push_back(value.asObject());
+        }
+        return reference(it->second);
+    };
+
+    this->values.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        this->values.push_back(encode(values[i]));
+    }
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        auto object = objects[i];
+        Record record { object->type, ElementType::VALUE, 0, this->values.size() };
+        switch (object->type) {
+            case ObjectType::STRING: {
+                auto string = static_cast<StringObject*>(object);
+                if (string->generation == Generation::PERMANENT) {
+                    record.shared = string;
+                    break;
+                }
+                auto chars = string->view();
+                record.length = static_cast<uint32_t>(chars.size());
+                record.offset = bytes.size();
+                bytes.insert(bytes.end(), chars.begin(), chars.end());
+                break;
+            }
+            case ObjectType::INSTANCE: {
+                auto instance = static_cast<InstanceObject*>(object);
+                record.shared = instance->klass;
+                record.length = static_cast<uint32_t>(instance->fieldCount());
+                for (size_t field = 0; field < instance->fieldCount(); field++) {
+                    this->values.push_back(encode(instance->fields()[field]));
+                }
+                break;
+            }
+            case ObjectType::ARRAY: {
+                auto array = static_cast<ArrayObject*>(object);
+                record.elementType = array->elementType;
+                record.length = array->length;
+                if (array->elementType == ElementType::VALUE) {
+                    for (uint32_t element = 0; element < array->length; element++) {
+                        this->values.push_back(encode(array->values()[element]));
+                    }
+                } else {
+                    auto elements = reinterpret_cast<char const*>(array + 1);
+                    record.offset = bytes.size();
+                    bytes.insert(bytes.end(), elements, elements + array->length * ArrayObject::elementSize(array->elementType));
+                }
+                break;
+            }
+            case ObjectType::MAP: {
+                auto map = static_cast<MapObject*>(object);
+                record.length = map->count;
+                maps::forEach(map, [&](Value key, Value value) {
+                    this->values.push_back(encode(key));
+                    this->values.push_back(encode(value));
+                });
+                break;
+            }
+            case ObjectType::TASK: {
+                auto task = static_cast<TaskObject*>(object)->task;
+                task->retain();
+                record.shared = task;
+                break;
+            }
+            case ObjectType::COROUTINE:
+                // the tasks retained so far are released again
+                clear();
+                throw RuntimeError("Coroutines stay on the thread that started them, they can't be passed to tasks.");
+            case ObjectType::TABLE:
+                break; // only maps refer to tables
+        }
+        records.push_back(record);
+    }
+}
+
+Message::Message(Message&& other) noexcept
+    : count(std::exchange(other.count, 0)), values(std::move(other.values)), records(std::move(other.records)), bytes(std::move(other.bytes)) {
+    other.records.clear();
+}
+
+Message& Message::operator=(Message&& other) noexcept {
+    if (this != &other) {
+        clear();
+        count = std::exchange(other.count, 0);
+        values = std::move(other.values);
+        records = std::move(other.records);
+        bytes = std::move(other.bytes);
+        other.records.clear();
+    }
+    return *this;
+}
+
+Message::~Message() {
+    clear();
+}
+
+void Message::clear() {
+    for (auto const& record : records) {
+        if (record.type == ObjectType::TASK) {
+            Task::release(static_cast<Task*>(record.shared));
+        }
+    }
+    records.clear();
+    values.clear();
+    bytes.clear();
+    count = 0;
+}
+
+// Every object is created before any is filled in, creating them may collect.
+// Filling them in never does: maps have room for their entries from the start and
+// interning their keys doesn't collect either.
+void Message::unpack(Value* out, ClassResolver const& classes) const {
+    // the objects created, visited until they are all filled in
+    RootArray created(records.size());
+    auto decode = [&created](Value value) { return value.isObject() ? created.values[recordOf(value)] : value; };
+    std::unordered_map<void*, ClassObject*> resolved;
+    for (size_t i = 0; i < records.size(); i++) {
+        auto const& record = records[i];
+        Value object;
+        switch (record.type) {
+            case ObjectType::STRING:
+                object = record.shared != nullptr ? Value::fromObject(static_cast<StringObject*>(record.shared))
+                    : newString(std::string_view(bytes.data() + record.offset, record.length));
+                break;
+            case ObjectType::INSTANCE: {
+                auto& klass = resolved[record.shared];
+                if (klass == nullptr) {
+                    auto const& name = static_cast<ClassObject*>(record.shared)->name;
+                    klass = classes(name);
+                    if (klass == nullptr || klass->fieldNames.size() != record.length) {
+                        throw RuntimeError("Can't pass an instance of '" + name + "' between tasks, the class is unknown.");
+                    }
+                }
+                object = newInstance(klass);
+                break;
+            }
+            case ObjectType::ARRAY:
+                object = newArray(record.elementType, record.length);
+                if (record.elementType != ElementType::VALUE) {
+                    std::memcpy(asArray(object) + 1, bytes.data() + record.offset, record.length * ArrayObject::elementSize(record.elementType));
+                }
+                break;
+            case ObjectType::MAP:
+                object = maps::newMap(record.length);
+                break;
+            case ObjectType::TASK:
+                object = Value::fromObject(Heap::get().createOld<TaskObject>(sizeof(TaskObject), static_cast<Task*>(record.shared)));
+                break;
+            case ObjectType::COROUTINE:
+            case ObjectType::TABLE:
+                break;
+        }
+        created.values[i] = object;
+    }
+
+    for (size_t i = 0; i < records.size(); i++) {
+        auto const& record = records[i];
+        auto object = created.values[i];
+        auto first = values.data() + record.offset;
+        if (record.type == ObjectType::INSTANCE) {
+            auto instance = asInstance(object);
+            for (uint32_t field = 0; field < record.length; field++) {
+                instance->fields()[field] = decode(first[field]);
+                writeBarrier(instance, instance->fields()[field]);
+            }
+        } else if (record.type == ObjectType::ARRAY && record.elementType == ElementType::VALUE) {
+            auto array = asArray(object);
+            for (uint32_t element = 0; element < record.length; element++) {
+                array->values()[element] = decode(first[element]);
+                writeBarrier(array, array->values()[element]);
+            }
+        } else if (record.type == ObjectType::MAP) {
+            for (uint32_t entry = 0; entry < record.length; entry++) {
+                maps::set(object, decode(first[2 * entry]), decode(first[2 * entry + 1]));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = decode(values[i]);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef LEGBA_RUNTIME_MESSAGE_H
+#define LEGBA_RUNTIME_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Runtime/Object.h"
+#include "Runtime/Value.h"
+
+// Values copied out of the heap of one thread, to be recreated in the heap of another,
+// see Scheduler. Everything reachable from them comes along: an object reachable
+// twice is copied once and cycles stay cycles. Constant strings are shared by all
+// heaps and not copied, ropes arrive flattened and instances get the class of the
+// same name in the receiving engine.
+class Message {
+public:
+    // the receiving engine's class with this name, nullptr if it has none
+    using ClassResolver = std::function<ClassObject*(std::string const& name)>;
+
+    Message() = default;
+    // Never allocates, the values may be anywhere.
+    Message(Value const* values, size_t count);
+    Message(Message&& other) noexcept;
+    Message& operator=(Message&& other) noexcept;
+    Message(Message const&) = delete;
+    Message& operator=(Message const&) = delete;
+    ~Message();
+
+    size_t size() const { return count; }
+
+    // Recreates the values in the current heap, into size() values at out which the
+    // collector has to find. May collect.
+    void unpack(Value* out, ClassResolver const& classes) const;
+
+private:
+    struct Record {
+        ObjectType type;
+        ElementType elementType;    // of arrays
+        uint32_t length;            // characters, elements, fields or entries
+        size_t offset;              // of the characters and unboxed elements in bytes, of anything else in values
+        void* shared = nullptr;     // constant string, class of an instance or task
+    };
+
+    void clear();
+
+    size_t count = 0;
+    // The values first, then the fields, elements and entries of the records. Objects
+    // are references to their record: the payload is the record's index.
+    std::vector<Value> values;
+    std::vector<Record> records;
+    std::vector<char> bytes;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef LEGBA_RUNTIME_OBJECT_H
+#define LEGBA_RUNTIME_OBJECT_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Runtime/Value.h"
+
+class ClassNode;
+struct FunctionProto;
+struct Task;
+
+enum class ObjectType : uint8_t {
+    STRING, INSTANCE, ARRAY, MAP, TABLE, TASK, COROUTINE
+};
+
+// Where an object lives, see Heap. Permanent objects are never collected nor moved,
+// a forwarded one has been copied out of the nursery and points to its new place.
+enum class Generation : uint8_t {
+    NURSERY, OLD, PERMANENT, FORWARDED
+};
+
+struct Object {
+    explicit Object(ObjectType type) : type(type) {}
+
+    ObjectType type;
+    Generation generation = Generation::PERMANENT;
+    bool marked = false;        // reached by the running major collection
+    bool remembered = true;     // stores into it need no write barrier: young or already remembered
+    uint32_t size = 0;          // of the whole allocation in bytes
+};
+
+struct StringObject;
+
+// Copies the characters of a rope into one flat string, see RopeObject.
+std::string_view flatten(StringObject* rope);
+
+// Flat strings store their characters directly after the object, a short string is
+// a single small allocation and moves by copying its bytes. Long concatenations are
+// RopeObjects instead, which are strings as well and flattened on first use.
+struct StringObject : public Object {
+    static size_t sizeFor(size_t length) { return sizeof(StringObject) + length; }
+
+    explicit StringObject(std::string_view value) : Object(ObjectType::STRING), length(static_cast<uint32_t>(value.size())) {
+        std::memcpy(chars(), value.data(), value.size());
+    }
+    // leaves the characters to the caller, or a rope's parts
+    StringObject(uint32_t length, bool rope) : Object(ObjectType::STRING), length(length), rope(rope) {}
+
+    char* chars() { return reinterpret_cast<char*>(this + 1); }
+    std::string_view view() { return rope ? flatten(this) : std::string_view(chars(), length); }
+    uint32_t hashCode();
+
+    uint32_t length;
+    uint32_t hash = 0;          // 0 until hashCode computed it
+    bool rope = false;
+    bool interned = false;      // the only interned string with its contents, see Heap::intern
+};
+
+// Concatenation of two strings that is only copied together when its characters are
+// needed. Flattening keeps the result in left and drops right, so the parts can be
+// collected.
+struct RopeObject : public StringObject {
+    explicit RopeObject(uint32_t length) : StringObject(length, true) {}
+
+    Value left;
+    Value right;        // nil once flattened
+};
+
+// FNV-1a, never 0
+inline uint32_t hashString(std::string_view value) {
+    uint32_t h = 2166136261u;
+    for (char c : value) {
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return h != 0 ? h : 1;
+}
+
+inline uint32_t StringObject::hashCode() {
+    if (hash == 0) {
+        hash = hashString(view());
+    }
+    return hash;
+}
+
+// Runtime description of a class, shared by all of its instances.
+struct ClassObject {
+    explicit ClassObject(ClassNode* node) : node(node), constructor(nullptr) {}
+
+    ClassNode* node;
+    std::string name;
+    FunctionProto* constructor;
+
+    // Methods by their index, assigned at compile time. Calls through 'this' use the
+    // index directly, other call sites look the name up once and cache the target.
+    std::vector<FunctionProto*> vtable;
+    std::unordered_map<std::string, int> methodIndices;
+
+    FunctionProto* findMethod(const std::string& method) const {
+        auto it = methodIndices.find(method);
+        return it != methodIndices.end() ? vtable[it->second] : nullptr;
+    }
+
+    // every instance stores its attributes in this order
+    std::vector<std::string> fieldNames;
+    std::unordered_map<std::string, int> fieldIndices;
+
+    // static attributes live once per class
+    std::vector<std::string> staticNames;
+    std::unordered_map<std::string, int> staticIndices;
+    std::vector<Value> statics;
+};
+
+// Instances are flat: the attribute values directly follow the object in the same
+// allocation, in the order of the class' fieldNames.
+struct InstanceObject : public Object {
+    static size_t sizeFor(ClassObject* klass) { return sizeof(InstanceObject) + klass->fieldNames.size() * sizeof(Value); }
+
+    explicit InstanceObject(ClassObject* klass) : Object(ObjectType::INSTANCE), klass(klass) {
+        std::uninitialized_fill_n(fields(), fieldCount(), Value::nil());
+    }
+
+    ClassObject* klass;
+
+    Value* fields() { return reinterpret_cast<Value*>(this + 1); }
+    size_t fieldCount() const { return klass->fieldNames.size(); }
+};
+
+// Int and double arrays store their elements unboxed, the collector never looks at
+// them. Arrays of anything else hold Values.
+enum class ElementType : uint8_t {
+    INT, DOUBLE, VALUE
+};
+
+// Arrays are flat like instances: the elements follow the object in the same
+// allocation. Their length is fixed at creation.
+struct ArrayObject : public Object {
+    static size_t elementSize(ElementType type) { return type == ElementType::INT ? sizeof(int32_t) : sizeof(Value); }
+    static size_t sizeFor(ElementType type, size_t length) { return sizeof(ArrayObject) + length * elementSize(type); }
+
+    // zeros, or nil for VALUE arrays
+    ArrayObject(ElementType elementType, uint32_t length) : Object(ObjectType::ARRAY), elementType(elementType), length(length) {
+        if (elementType == ElementType::VALUE) {
+            std::uninitialized_fill_n(values(), length, Value::nil());
+        } else {
+            std::memset(static_cast<void*>(this + 1), 0, length * elementSize(elementType));
+        }
+    }
+
+    ElementType elementType;
+    uint32_t length;
+
+    int32_t* ints() { return reinterpret_cast<int32_t*>(this + 1); }
+    double* doubles() { return reinterpret_cast<double*>(this + 1); }
+    Value* values() { return reinterpret_cast<Value*>(this + 1); }
+};
+
+// Slots of a MapObject's hash table, see Runtime/Map.h. The control bytes of all
+// slots come first, then the key and value of every slot: the control bytes are
+// what a lookup scans and stay in cache much longer packed together. The capacity is
+// a power of two and a multiple of the group size, the slots of a group are probed
+// together.
+struct alignas(Value) TableObject : public Object {
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr uint8_t DELETED = 0xFE;   // full slots hold the low 7 bits of the key's hash
+    static constexpr uint32_t GROUP = 16;
+    static constexpr size_t SLOT_SIZE = 1 + 2 * sizeof(Value);
+
+    static size_t sizeFor(uint32_t capacity) { return sizeof(TableObject) + capacity * SLOT_SIZE; }
+
+    explicit TableObject(uint32_t capacity) : Object(ObjectType::TABLE), capacity(capacity) {
+        std::memset(controls(0), EMPTY, capacity);
+    }
+
+    uint32_t capacity;
+
+    uint8_t* controls(uint32_t group) { return reinterpret_cast<uint8_t*>(this + 1) + group * GROUP; }
+    uint8_t& control(uint32_t slot) { return controls(0)[slot]; }
+    // key of the slot, its value after it; only full slots are initialized
+    Value* entry(uint32_t slot) { return reinterpret_cast<Value*>(controls(0) + capacity) + 2 * slot; }
+};
+
+// Hash map from numbers, strings, chars and bools to any values. The table is a heap
+// object of its own and replaced when the map grows, nil while the map is empty.
+struct MapObject : public Object {
+    MapObject() : Object(ObjectType::MAP) {}
+
+    uint32_t count = 0;
+    uint32_t tombstones = 0;    // DELETED slots, they count towards the load
+    Value table;
+};
+
+// Handle of a task started with spawn, see Runtime/Scheduler.h. Every heap holding a
+// handle keeps the task alive. Handles are only created in the old generation, which
+// destroys them when they are swept.
+struct TaskObject : public Object {
+    explicit TaskObject(Task* task);
+    ~TaskObject();
+
+    Task* task;
+};
+
+// Handle of a coroutine started with async, see Runtime/Coroutines.h. It holds the
+// result once the coroutine returned, until then the engine's state of it. The engine
+// keeps the handle alive while the coroutine runs.
+struct CoroutineObject : public Object {
+    CoroutineObject() : Object(ObjectType::COROUTINE) {}
+
+    Value result;
+    void* state = nullptr;      // the engine's, nullptr once done
+    bool done = false;
+};
+
+static_assert(sizeof(Object) == 8);
+static_assert(sizeof(TableObject) % alignof(Value) == 0);
+static_assert(sizeof(ArrayObject) % alignof(double) == 0);
+static_assert(sizeof(InstanceObject) % alignof(Value) == 0);
+
+inline bool isObjectType(Value value, ObjectType type) {
+    return value.isObject() && value.asObject()->type == type;
+}
+
+inline StringObject* asString(Value value) {
+    return static_cast<StringObject*>(value.asObject());
+}
+
+inline InstanceObject* asInstance(Value value) {
+    return static_cast<InstanceObject*>(value.asObject());
+}
+
+inline ArrayObject* asArray(Value value) {
+    return static_cast<ArrayObject*>(value.asObject());
+}
+
+inline MapObject* asMap(Value value) {
+    return static_cast<MapObject*>(value.asObject());
+}
+
+inline TableObject* asTable(Value value) {
+    return static_cast<TableObject*>(value.asObject());
+}
+
+inline TaskObject* asTask(Value value) {
+    return static_cast<TaskObject*>(value.asObject());
+}
+
+inline CoroutineObject* asCoroutine(Value value) {
+    return static_cast<CoroutineObject*>(value.asObject());
+}
+
+#endif
+
@@ -0,0 +1,341 @@
+#include "Operations.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Error.h"
+#include "ASTNode/ASTNode.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Map.h"
+#include "Runtime/Object.h"
+
+static bool isIntegral(Value v) {
+    return v.isInt() || v.isChar();
+}
+
+static int32_t toInt(Value v) {
+    return v.isInt() ? v.asInt() : static_cast<int32_t>(v.asChar());
+}
+
+static std::string operandError(TokenType op, Value a, Value b) {
+    return "Unsupported operand types for " + tokenTypeToString(op) + ": " + a.typeName() + " and " + b.typeName() + '.';
+}
+
+// Shorter concatenations are copied right away, a rope node isn't worth it for them.
+static constexpr size_t ROPE_MIN_LENGTH = 64;
+
+static Value concatenate(Value a, Value b) {
+    bool aString = isObjectType(a, ObjectType::STRING), bString = isObjectType(b, ObjectType::STRING);
+    if (aString && bString && asString(a)->length == 0) {
+        return b;
+    }
+    if (aString && bString && asString(b)->length == 0) {
+        return a;
+    }
+
+    // other operands get converted, they are short
+    std::string x = aString ? std::string() : a.toString();
+    std::string y = bString ? std::string() : b.toString();
+    size_t length = (aString ? asString(a)->length : x.size()) + (bString ? asString(b)->length : y.size());
+    if (length < ROPE_MIN_LENGTH) {
+        return newString((aString ? a.toString() : x) + (bString ? b.toString() : y));
+    }
+    if (length > std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("String too long.");
+    }
+
+    Root left(aString ? a : Value::nil()), right(bString ? b : Value::nil());
+    if (!aString) {
+        left.value = newString(x);
+    }
+    if (!bString) {
+        right.value = newString(y);
+    }
+    auto rope = Heap::get().create<RopeObject>(sizeof(RopeObject), static_cast<uint32_t>(length));
+    rope->left = left.value;
+    rope->right = right.value;
+    writeBarrier(rope, rope->left);
+    return Value::fromObject(rope);
+}
+
+// Parts are copied from the back, so ropes built by appending, which lean left, need
+// no more than a few pending parts.
+std::string_view flatten(StringObject* string) {
+    auto rope = static_cast<RopeObject*>(string);
+    if (rope->right.isNil()) {
+        return asString(rope->left)->view();
+    }
+
+    // allocating can't collect here, callers hold raw pointers
+    auto flat = Heap::get().createOld<StringObject>(StringObject::sizeFor(rope->length), rope->length, false);
+    char* out = flat->chars() + rope->length;
+    std::vector<StringObject*> pending { rope };
+    while (!pending.empty()) {
+        auto part = pending.back();
+        pending.pop_back();
+        if (part->rope && !static_cast<RopeObject*>(part)->right.isNil()) {
+            pending.push_back(asString(static_cast<RopeObject*>(part)->left));
+            pending.push_back(asString(static_cast<RopeObject*>(part)->right));
+            continue;
+        }
+        auto chars = part->view();
+        out -= chars.size();
+        std::memcpy(out, chars.data(), chars.size());
+    }
+
+    rope->left = Value::fromObject(flat);
+    rope->right = Value::nil();
+    writeBarrier(rope, rope->left);
+    return flat->view();
+}
+
+Value arithmetic(TokenType op, Value a, Value b) {
+    if (op == TokenType::PLUS && (isObjectType(a, ObjectType::STRING) || isObjectType(b, ObjectType::STRING))) {
+        return concatenate(a, b);
+    }
+
+    if (isIntegral(a) && isIntegral(b)) {
+        auto x = static_cast<uint32_t>(toInt(a));
+        auto y = static_cast<uint32_t>(toInt(b));
+        switch (op) {
+            case TokenType::PLUS: return Value::fromInt(static_cast<int32_t>(x + y));
+            case TokenType::MINUS: return Value::fromInt(static_cast<int32_t>(x - y));
+            case TokenType::STAR: return Value::fromInt(static_cast<int32_t>(x * y));
+            case TokenType::SLASH:
+            case TokenType::MODULO: {
+                int32_t l = toInt(a);
+                int32_t r = toInt(b);
+                if (r == 0) {
+                    throw RuntimeError("Division by zero.");
+                }
+                if (r == -1) { // INT_MIN / -1 overflows
+                    return Value::fromInt(op == TokenType::SLASH ? static_cast<int32_t>(0u - x) : 0);
+                }
+                return Value::fromInt(op == TokenType::SLASH ? l / r : l % r);
+            }
+            default: break;
+        }
+        throw RuntimeError(operandError(op, a, b));
+    }
+
+    if ((a.isNumber() || a.isChar()) && (b.isNumber() || b.isChar())) {
+        double x = a.isChar() ? a.asChar() : a.toNumber();
+        double y = b.isChar() ? b.asChar() : b.toNumber();
+        switch (op) {
+            case TokenType::PLUS: return Value::fromDouble(x + y);
+            case TokenType::MINUS: return Value::fromDouble(x - y);
+            case TokenType::STAR: return Value::fromDouble(x * y);
+            case TokenType::SLASH: return Value::fromDouble(x / y);
+            case TokenType::MODULO: return Value::fromDouble(std::fmod(x, y));
+            default: break;
+        }
+    }
+
+    throw RuntimeError(operandError(op, a, b));
+}
+
+Value comparison(TokenType op, Value a, Value b) {
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: return Value::fromBool(valuesEqual(a, b));
+        case TokenType::BANG_EQUAL: return Value::fromBool(!valuesEqual(a, b));
+        default: break;
+    }
+
+    if (isIntegral(a) && isIntegral(b)) {
+        int32_t x = toInt(a);
+        int32_t y = toInt(b);
+        switch (op) {
+            case TokenType::LESS: return Value::fromBool(x < y);
+            case TokenType::LESS_EQUAL: return Value::fromBool(x <= y);
+            case TokenType::GREATER: return Value::fromBool(x > y);
+            case TokenType::GREATER_EQUAL: return Value::fromBool(x >= y);
+            default: break;
+        }
+    } else if (a.isNumber() && b.isNumber()) {
+        double x = a.toNumber();
+        double y = b.toNumber();
+        switch (op) {
+            case TokenType::LESS: return Value::fromBool(x < y);
+            case TokenType::LESS_EQUAL: return Value::fromBool(x <= y);
+            case TokenType::GREATER: return Value::fromBool(x > y);
+            case TokenType::GREATER_EQUAL: return Value::fromBool(x >= y);
+            default: break;
+        }
+    } else if (isObjectType(a, ObjectType::STRING) && isObjectType(b, ObjectType::STRING)) {
+        int c = asString(a)->view().compare(asString(b)->view());
+        switch (op) {
+            case TokenType::LESS: return Value::fromBool(c < 0);
+            case TokenType::LESS_EQUAL: return Value::fromBool(c <= 0);
+            case TokenType::GREATER: return Value::fromBool(c > 0);
+            case TokenType::GREATER_EQUAL: return Value::fromBool(c >= 0);
+            default: break;
+        }
+    }
+
+    throw RuntimeError(operandError(op, a, b));
+}
+
+Value negate(Value a) {
+    if (a.isInt()) {
+        return Value::fromInt(static_cast<int32_t>(0u - static_cast<uint32_t>(a.asInt())));
+    }
+    if (a.isDouble()) {
+        return Value::fromDouble(-a.asDouble());
+    }
+    throw RuntimeError("Unsupported operand type for MINUS: " + a.typeName() + '.');
+}
+
+Value newString(std::string_view value) {
+    return Value::fromObject(Heap::get().create<StringObject>(StringObject::sizeFor(value.size()), value));
+}
+
+Value newConstantString(std::string_view value) {
+    return Value::fromObject(Heap::get().intern(value, true));
+}
+
+ClassObject* newClass(ClassNode* node) {
+    auto klass = new ClassObject(node);
+    klass->name = node->getName();
+    klass->fieldNames.resize(node->getFieldCount());
+    klass->staticNames.resize(node->getStaticCount());
+    klass->statics.resize(node->getStaticCount());
+    for (auto const& [name, attribute] : node->getAttributes()) {
+        if (attribute->isStatic()) {
+            klass->staticIndices.emplace(name, attribute->getSlot());
+            klass->staticNames[attribute->getSlot()] = name;
+        } else {
+            klass->fieldIndices.emplace(name, attribute->getSlot());
+            klass->fieldNames[attribute->getSlot()] = name;
+        }
+    }
+    return klass;
+}
+
+Value newInstance(ClassObject* klass) {
+    return Value::fromObject(Heap::get().create<InstanceObject>(InstanceObject::sizeFor(klass), klass));
+}
+
+int attributeIndex(Value object, const std::string& name) {
+    if (!isObjectType(object, ObjectType::INSTANCE)) {
+        throw RuntimeError("Only instances have attributes, got " + object.typeName() + '.');
+    }
+
+    auto klass = asInstance(object)->klass;
+    auto it = klass->fieldIndices.find(name);
+    if (it != klass->fieldIndices.end()) {
+        return it->second;
+    }
+    if (klass->staticIndices.contains(name)) {
+        return -1;
+    }
+    throw RuntimeError("Class '" + klass->name + "' has no attribute '" + name + "'.");
+}
+
+Value& attribute(Value object, const std::string& name) {
+    int index = attributeIndex(object, name);
+    auto instance = asInstance(object);
+    return index >= 0 ? instance->fields()[index] : instance->klass->statics[instance->klass->staticIndices.at(name)];
+}
+
+Value getAttribute(Value object, const std::string& name) {
+    return attribute(object, name);
+}
+
+void setAttribute(Value object, const std::string& name, Value value) {
+    attribute(object, name) = value;
+    writeBarrier(asInstance(object), value);
+}
+
+Value newArray(ElementType type, int64_t length) {
+    if (length < 0 || static_cast<uint64_t>(length) > MAX_ARRAY_LENGTH) {
+        throw RuntimeError("Array length out of range: " + std::to_string(length) + '.');
+    }
+    auto count = static_cast<uint32_t>(length);
+    return Value::fromObject(Heap::get().create<ArrayObject>(ArrayObject::sizeFor(type, count), type, count));
+}
+
+Value newArray(Value const* values, size_t count, std::optional<ElementType> type) {
+    if (!type) {
+        bool ints = count > 0, numbers = count > 0;
+        for (size_t i = 0; i < count; i++) {
+            ints = ints && values[i].isInt();
+            numbers = numbers && values[i].isNumber();
+        }
+        type = ints ? ElementType::INT : numbers ? ElementType::DOUBLE : ElementType::VALUE;
+    }
+
+    // the values are read after allocating, which may have moved the objects among them
+    auto array = asArray(newArray(*type, static_cast<int64_t>(count)));
+    for (size_t i = 0; i < count; i++) {
+        setArrayElement(array, static_cast<uint32_t>(i), values[i]);
+    }
+    return Value::fromObject(array);
+}
+
+std::optional<ElementType> declaredElementType(ValueTypeEnum type) {
+    switch (type) {
+        case ValueTypeEnum::VT_NONE: return std::nullopt;
+        case ValueTypeEnum::VT_INTEGER: return ElementType::INT;
+        case ValueTypeEnum::VT_DOUBLE: return ElementType::DOUBLE;
+        default: return ElementType::VALUE;
+    }
+}
+
+static uint32_t checkedIndex(Value array, Value index) {
+    if (!isObjectType(array, ObjectType::ARRAY)) {
+        throw RuntimeError("Only arrays and maps can be indexed, got " + array.typeName() + '.');
+    }
+    if (!index.isInt()) {
+        throw RuntimeError("Array index must be an int, got " + index.typeName() + '.');
+    }
+    auto length = asArray(array)->length;
+    if (index.asInt() < 0 || static_cast<uint32_t>(index.asInt()) >= length) {
+        throw RuntimeError("Array index " + std::to_string(index.asInt()) + " out of range for length " + std::to_string(length) + '.');
+    }
+    return static_cast<uint32_t>(index.asInt());
+}
+
+Value getIndex(Value target, Value index) {
+    if (isObjectType(target, ObjectType::MAP)) {
+        return maps::get(target, index);
+    }
+    return arrayElement(asArray(target), checkedIndex(target, index));
+}
+
+void setIndex(Value target, Value index, Value value) {
+    if (isObjectType(target, ObjectType::MAP)) {
+        maps::set(target, index, value);
+        return;
+    }
+    setArrayElement(asArray(target), checkedIndex(target, index), value);
+}
+
+Value arrayElement(ArrayObject* array, uint32_t index) {
+    switch (array->elementType) {
+        case ElementType::INT: return Value::fromInt(array->ints()[index]);
+        case ElementType::DOUBLE: return Value::fromDouble(array->doubles()[index]);
+        default: return array->values()[index];
+    }
+}
+
+void setArrayElement(ArrayObject* array, uint32_t index, Value value) {
+    switch (array->elementType) {
+        case ElementType::INT:
+            if (!value.isInt()) {
+                throw RuntimeError("Can't store a " + value.typeName() + " in an int[].");
+            }
+            array->ints()[index] = value.asInt();
+            break;
+        case ElementType::DOUBLE:
+            if (!value.isNumber()) {
+                throw RuntimeError("Can't store a " + value.typeName() + " in a double[].");
+            }
+            array->doubles()[index] = value.toNumber();
+            break;
+        default:
+            array->values()[index] = value;
+            writeBarrier(array, value);
+            break;
+    }
+}
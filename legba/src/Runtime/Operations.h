@@ -0,0 +1,57 @@
+#ifndef LEGBA_RUNTIME_OPERATIONS_H
+#define LEGBA_RUNTIME_OPERATIONS_H
+
+#include <optional>
+#include <string_view>
+
+#include "Token.h"
+#include "ValueType.h"
+#include "Runtime/Object.h"
+#include "Runtime/Value.h"
+
+// Generic (slow path) semantics of the operators, shared by all execution engines.
+Value arithmetic(TokenType op, Value a, Value b);
+Value comparison(TokenType op, Value a, Value b);
+Value negate(Value a);
+
+// Strings, instances, arrays and maps are allocated on the collected Heap. Constant
+// strings are interned and live as long as the program, they are neither collected
+// nor moved.
+Value newString(std::string_view value);
+Value newConstantString(std::string_view value);
+
+class ClassNode;
+struct ClassObject;
+
+ClassObject* newClass(ClassNode* node);
+Value newInstance(ClassObject* klass);
+// Index of the attribute in the instance's field layout, -1 for a static attribute of
+// its class. Throws for non-instances and unknown attributes.
+int attributeIndex(Value object, const std::string& name);
+// Field or per-class storage of the attribute, same errors as attributeIndex. Stores
+// into a field need a writeBarrier.
+Value& attribute(Value object, const std::string& name);
+Value getAttribute(Value object, const std::string& name);
+void setAttribute(Value object, const std::string& name, Value value);
+
+// Arrays. Int arrays only hold ints and double arrays numbers, which they convert;
+// storing anything else into them throws.
+constexpr size_t MAX_ARRAY_LENGTH = (UINT32_MAX - sizeof(ArrayObject)) / sizeof(Value);
+
+// length zeros, or nils for VALUE arrays; throws for lengths out of range
+Value newArray(ElementType type, int64_t length);
+// Array literal of count values. Its element type is the declared one if there is
+// one, otherwise the narrowest holding them all: INT for ints, DOUBLE for numbers.
+Value newArray(Value const* values, size_t count, std::optional<ElementType> type);
+// int and double declare typed arrays, anything else arrays of values; nothing if
+// VT_NONE, the type wasn't declared
+std::optional<ElementType> declaredElementType(ValueTypeEnum type);
+// Indexing an array or a map, a missing key of a map reads as nil. Storing into a
+// map may collect.
+Value getIndex(Value target, Value index);
+void setIndex(Value target, Value index, Value value);
+// element at a checked index, boxed
+Value arrayElement(ArrayObject* array, uint32_t index);
+void setArrayElement(ArrayObject* array, uint32_t index, Value value);
+
+#endif
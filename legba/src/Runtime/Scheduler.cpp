@@ -0,0 +1,293 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+
+#include "Error.h"
+
+TaskObject::TaskObject(Task* task) : Object(ObjectType::TASK), task(task) {
+    task->retain();
+}
+
+TaskObject::~TaskObject() {
+    Task::release(task);
+}
+
+Scheduler::Deque::Deque() : top(0), bottom(0) {
+    arrays.push_back(std::make_unique<Array>(64));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+}
+
+void Scheduler::Deque::push(Task* task) {
+    auto b = bottom.load(std::memory_order_relaxed);
+    auto t = top.load(std::memory_order_acquire);
+    auto a = array.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+        a = grow(a, b, t);
+    }
+    a->put(b, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+// The owner takes the last task back. If it is the only one, a thief may be taking it
+// at the same time and whoever moves top first gets it.
+Task* Scheduler::Deque::pop() {
+    auto b = bottom.load(std::memory_order_relaxed) - 1;
+    auto a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    auto task = a->get(b);
+    if (t == b) {
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+Task* Scheduler::Deque::steal() {
+    for (;;) {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        auto task = array.load(std::memory_order_acquire)->get(t);
+        if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return task;
+        }
+        // another thief or the owner was faster, there may be more
+    }
+}
+
+size_t Scheduler::Deque::size() const {
+    auto b = bottom.load(std::memory_order_relaxed);
+    auto t = top.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+}
+
+Scheduler::Deque::Array* Scheduler::Deque::grow(Array* old, int64_t b, int64_t t) {
+    auto bigger = std::make_unique<Array>(old->capacity * 2);
+    for (auto i = t; i < b; i++) {
+        bigger->put(i, old->get(i));
+    }
+    auto a = bigger.get();
+    arrays.push_back(std::move(bigger));
+    array.store(a, std::memory_order_release);
+    return a;
+}
+
+unsigned Scheduler::threads() {
+    return threadCount != 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+Scheduler::Scheduler(TaskEngine& engine, EngineFactory factory) : factory(std::move(factory)), settings(Heap::get()) {
+    unsigned count = threads();
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    for (unsigned i = 0; i < count; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->random = seed * (i + 1);
+        workers.push_back(std::move(worker));
+    }
+
+    workers[0]->engine = &engine;
+    running = this;
+    self = workers[0].get();
+    for (size_t i = 1; i < workers.size(); i++) {
+        auto worker = workers[i].get();
+        worker->thread = std::thread([this, worker] { work(*worker); });
+    }
+}
+
+Scheduler::~Scheduler() {
+    auto& worker = *workers[0];
+    while (pending.load() > 0) {
+        auto seen = epoch.load();
+        if (auto task = find(worker)) {
+            run(worker, task);
+        } else if (pending.load() > 0) {
+            idle(worker, seen);
+        }
+    }
+
+    stopping.store(true);
+    wake();
+    for (size_t i = 1; i < workers.size(); i++) {
+        workers[i]->thread.join();
+    }
+    running = nullptr;
+    self = nullptr;
+}
+
+// A worker thread runs tasks in a heap and engine of its own until the scheduler stops.
+void Scheduler::work(Worker& worker) {
+    Heap heap;
+    heap.configureLike(settings);
+    Heap::setCurrent(&heap);
+    running = this;
+    self = &worker;
+
+    auto engine = factory();
+    worker.engine = engine.get();
+    while (!stopping.load()) {
+        auto seen = epoch.load();
+        if (auto task = find(worker)) {
+            run(worker, task);
+        } else {
+            idle(worker, seen);
+        }
+    }
+
+    // the engine's roots are in the heap
+    engine.reset();
+    Heap::setCurrent(nullptr);
+}
+
+void Scheduler::run(Worker& worker, Task* task) {
+    task->state.store(Task::RUNNING, std::memory_order_relaxed);
+    worker.executed.fetch_add(1, std::memory_order_relaxed);
+    worker.depth++;
+    try {
+        RootArray values(task->input.size());
+        task->input.unpack(values.values.data(), [&worker](std::string const& name) { return worker.engine->findClass(name); });
+        // the handle may live on long after, and the copies of the environment are large
+        task->input = Message();
+        auto result = worker.engine->runTask(task->function, values.values.data(), task->argumentCount, values.values.data() + task->argumentCount);
+        task->result = Message(&result, 1);
+    } catch (std::exception& e) {
+        task->failed = true;
+        task->error = e.what();
+    }
+    worker.depth--;
+
+    task->state.store(Task::DONE, std::memory_order_release);
+    pending.fetch_sub(1);
+    Task::release(task);
+    wake();
+}
+
+Task* Scheduler::find(Worker& worker) {
+    if (auto task = worker.deque.pop()) {
+        return task;
+    }
+    return steal(worker);
+}
+
+// Tries every other thread once, starting at a random one.
+Task* Scheduler::steal(Worker& worker) {
+    auto count = workers.size();
+    if (count == 1) {
+        return nullptr;
+    }
+    auto& x = worker.random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    for (size_t i = 0, first = x % count; i < count; i++) {
+        auto& victim = *workers[(first + i) % count];
+        if (&victim == &worker) {
+            continue;
+        }
+        if (auto task = victim.deque.steal()) {
+            worker.stolen.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+// Yields a while first: tasks are often pushed again right away.
+void Scheduler::idle(Worker& worker, uint64_t seen) {
+    auto start = std::chrono::steady_clock::now();
+    auto changed = [this, seen] { return epoch.load() != seen || stopping.load(); };
+    bool woken = false;
+    for (int i = 0; i < SPINS && !woken; i++) {
+        std::this_thread::yield();
+        woken = changed();
+    }
+    if (!woken) {
+        std::unique_lock lock(mutex);
+        sleepers.fetch_add(1);
+        sleeping.wait(lock, changed);
+        sleepers.fetch_sub(1);
+    }
+    auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    worker.idleNanoseconds.fetch_add(static_cast<uint64_t>(waited), std::memory_order_relaxed);
+}
+
+// A sleeper registers before it checks the epoch, the waker changes the epoch before
+// it checks for sleepers: one of them sees the other.
+void Scheduler::wake() {
+    epoch.fetch_add(1);
+    if (sleepers.load() > 0) {
+        std::lock_guard lock(mutex);
+        sleeping.notify_all();
+    }
+}
+
+Value Scheduler::spawn(uintptr_t function, Value const* args, size_t count) {
+    auto& worker = *self;
+    std::vector<Value> values(args, args + count);
+    worker.engine->saveEnvironment(values);
+    // neither copying the values nor creating the handle collects
+    auto task = new Task(function, count, Message(values.data(), values.size()));
+    auto handle = Heap::get().createOld<TaskObject>(sizeof(TaskObject), task);
+
+    pending.fetch_add(1);
+    worker.deque.push(task);
+    worker.spawned.fetch_add(1, std::memory_order_relaxed);
+    auto queued = worker.deque.size();
+    if (queued > worker.deepestQueue.load(std::memory_order_relaxed)) {
+        worker.deepestQueue.store(queued, std::memory_order_relaxed);
+    }
+    wake();
+    return Value::fromObject(handle);
+}
+
+Value Scheduler::join(Task* task) {
+    auto& worker = *self;
+    while (task->state.load(std::memory_order_acquire) != Task::DONE) {
+        auto seen = epoch.load();
+        if (task->state.load(std::memory_order_acquire) == Task::DONE) {
+            break;
+        }
+        auto other = worker.depth < MAX_DEPTH ? find(worker) : worker.deque.pop();
+        if (other != nullptr) {
+            run(worker, other);
+        } else {
+            idle(worker, seen);
+        }
+    }
+
+    if (task->failed) {
+        throw RuntimeError(task->error);
+    }
+    // nothing allocates once the result is unpacked
+    Value result;
+    task->result.unpack(&result, [&worker](std::string const& name) { return worker.engine->findClass(name); });
+    return result;
+}
+
+void Scheduler::printStats(std::ostream& os) const {
+    uint64_t spawned = 0, stolen = 0, idleNanoseconds = 0;
+    size_t deepest = 0;
+    std::string executed;
+    for (auto const& worker : workers) {
+        spawned += worker->spawned.load();
+        stolen += worker->stolen.load();
+        idleNanoseconds += worker->idleNanoseconds.load();
+        deepest = std::max(deepest, worker->deepestQueue.load());
+        executed += (executed.empty() ? "" : "/") + std::to_string(worker->executed.load());
+    }
+    os << "-- Tasks: " << spawned << " spawned on " << workers.size() << " threads, " << stolen << " stolen, executed "
+       << executed << ", idle " << std::format("{:.3f}ms", idleNanoseconds / 1e6) << ", deepest queue " << deepest << std::endl;
+}
@@ -0,0 +1,175 @@
+#ifndef LEGBA_RUNTIME_SCHEDULER_H
+#define LEGBA_RUNTIME_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Runtime/Heap.h"
+#include "Runtime/Message.h"
+#include "Runtime/Value.h"
+
+// A call started by spawn. It runs on whichever thread of the scheduler gets to it
+// first, with copies of its arguments and of the globals and static attributes the
+// spawning code had, so nothing it changes is seen outside. Joining it returns a copy
+// of its result.
+struct Task {
+    enum State : uint8_t { QUEUED, RUNNING, DONE };
+
+    Task(uintptr_t function, size_t argumentCount, Message input)
+        : function(function), argumentCount(argumentCount), input(std::move(input)) {}
+
+    void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+    static void release(Task* task) {
+        if (task->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete task;
+        }
+    }
+
+    uintptr_t function;     // as the spawning engine knows it, see TaskEngine
+    size_t argumentCount;
+    Message input;          // the arguments, then the environment
+    Message result;         // set once DONE, unless the task failed
+    bool failed = false;
+    std::string error;
+    std::atomic<uint8_t> state = QUEUED;
+    std::atomic<uint32_t> references = 1;
+};
+
+// An engine that runs tasks on the thread it was created on, in that thread's heap.
+// All engines of a scheduler run the same program.
+class TaskEngine {
+public:
+    virtual ~TaskEngine() = default;
+
+    // Appends what a task spawned now starts out with: the globals, then the static
+    // attributes of every class.
+    virtual void saveEnvironment(std::vector<Value>& values) = 0;
+    // Calls function with count arguments in an environment saveEnvironment made and
+    // restores the engine's own afterwards. It may be running code that joins a task
+    // already, the call goes on top of it. args and environment must be roots.
+    virtual Value runTask(uintptr_t function, Value* args, size_t count, Value const* environment) = 0;
+    // the class with this name, for instances passed between engines
+    virtual ClassObject* findClass(std::string const& name) = 0;
+};
+
+// Work stealing thread pool running the tasks of one program run. Every thread has a
+// deque of tasks: it pushes the ones it spawns and pops them again from the same
+// end, while idle threads steal from the other end of someone else's. The thread
+// that started the scheduler is one of them, it runs tasks whenever it waits in a
+// join, as does every thread waiting for a task.
+class Scheduler {
+public:
+    // creates the engine of a worker thread, called on that thread
+    using EngineFactory = std::function<std::unique_ptr<TaskEngine>()>;
+
+    // threads running tasks including the calling one, 0 for one per hardware thread
+    static void setThreadCount(unsigned count) { threadCount = count; }
+    // the number of threads a scheduler started now runs tasks on
+    static unsigned threads();
+
+    // Starts the worker threads, the calling thread takes part through engine.
+    Scheduler(TaskEngine& engine, EngineFactory factory);
+    Scheduler(Scheduler const&) = delete;
+    Scheduler& operator=(Scheduler const&) = delete;
+    // runs the remaining tasks and stops the workers
+    ~Scheduler();
+
+    // the scheduler the calling thread runs tasks for, nullptr if none
+    static Scheduler* current() { return running; }
+
+    // Queues a call of function with copies of count arguments and of the calling
+    // engine's environment, returns its handle.
+    Value spawn(uintptr_t function, Value const* args, size_t count);
+    // Waits for the task, running others meanwhile, and returns a copy of its result
+    // or throws its error.
+    Value join(Task* task);
+
+    // spawned and stolen tasks, time threads spent waiting and the deepest deque
+    void printStats(std::ostream& os) const;
+
+private:
+    // Chase-Lev deque: the owner pushes and pops at the bottom, thieves take from the
+    // top. Arrays it outgrew stay around, a thief may still be reading one.
+    class Deque {
+    public:
+        Deque();
+
+        void push(Task* task);
+        Task* pop();
+        Task* steal();
+        size_t size() const;
+
+    private:
+        struct Array {
+            explicit Array(int64_t capacity) : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {}
+
+            // whoever gets a task from a slot sees everything written to it before it was put there
+            Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_acquire); }
+            void put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, std::memory_order_release); }
+
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Task*>[]> slots;
+        };
+
+        Array* grow(Array* array, int64_t bottom, int64_t top);
+
+        alignas(64) std::atomic<int64_t> top;
+        alignas(64) std::atomic<int64_t> bottom;
+        std::atomic<Array*> array;
+        std::vector<std::unique_ptr<Array>> arrays;
+    };
+
+    struct Worker {
+        Deque deque;
+        TaskEngine* engine = nullptr;
+        std::thread thread;
+        uint64_t random;        // state of the victim choice
+        int depth = 0;          // tasks running on top of each other on this thread
+
+        std::atomic<uint64_t> spawned = 0;
+        std::atomic<uint64_t> executed = 0;
+        std::atomic<uint64_t> stolen = 0;
+        std::atomic<uint64_t> idleNanoseconds = 0;
+        std::atomic<size_t> deepestQueue = 0;
+    };
+
+    // Joins deeper than this only run tasks from their own deque, which the thread
+    // spawned itself, instead of stealing unrelated ones on an already deep stack.
+    static constexpr int MAX_DEPTH = 64;
+    static constexpr int SPINS = 64;
+
+    void work(Worker& worker);
+    void run(Worker& worker, Task* task);
+    // a task from the own deque or stolen from another, nullptr if there is none
+    Task* find(Worker& worker);
+    Task* steal(Worker& worker);
+    // Sleeps until tasks were pushed or finished since epoch was seen.
+    void idle(Worker& worker, uint64_t seen);
+    void wake();
+
+    static inline unsigned threadCount = 0;
+    static inline thread_local Scheduler* running = nullptr;
+    static inline thread_local Worker* self = nullptr;
+
+    EngineFactory factory;
+    Heap& settings;             // the worker heaps are configured like it
+    std::vector<std::unique_ptr<Worker>> workers;   // the starting thread's first
+
+    std::atomic<uint64_t> pending = 0;      // spawned and not done
+    std::atomic<uint64_t> epoch = 0;        // counts pushes and completions
+    std::atomic<int> sleepers = 0;
+    std::atomic<bool> stopping = false;
+    std::mutex mutex;
+    std::condition_variable sleeping;
+};
+
+#endif
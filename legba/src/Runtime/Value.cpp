@@ -0,0 +1,140 @@
+#include "Value.h"
+
+#include <sstream>
+
+#include "Runtime/Map.h"
+#include "Runtime/Object.h"
+
+bool Value::isTruthy() const {
+    switch (tag()) {
+        case TAG_BOOL: return asBool();
+        case TAG_NIL: return false;
+        case TAG_INT: return asInt() != 0;
+        case TAG_CHAR: return asChar() != '\0';
+        case TAG_OBJECT: return true;
+        default: return asDouble() != 0.0;
+    }
+}
+
+// Arrays of values and maps may contain themselves, nesting is cut off.
+static void appendValue(std::string& out, Value value, int depth) {
+    if (isObjectType(value, ObjectType::ARRAY)) {
+        auto array = asArray(value);
+        if (depth == 8) {
+            out += "[...]";
+            return;
+        }
+        out += '[';
+        for (uint32_t i = 0; i < array->length; i++) {
+            if (i > 0) {
+                out += ", ";
+            }
+            Value element = array->elementType == ElementType::INT ? Value::fromInt(array->ints()[i])
+                : array->elementType == ElementType::DOUBLE ? Value::fromDouble(array->doubles()[i])
+                : array->values()[i];
+            appendValue(out, element, depth + 1);
+        }
+        out += ']';
+    } else if (isObjectType(value, ObjectType::MAP)) {
+        if (depth == 8) {
+            out += "{...}";
+            return;
+        }
+        out += '{';
+        bool first = true;
+        maps::forEach(asMap(value), [&](Value key, Value element) {
+            out += first ? "" : ", ";
+            first = false;
+            appendValue(out, key, depth + 1);
+            out += ": ";
+            appendValue(out, element, depth + 1);
+        });
+        out += '}';
+    } else {
+        out += value.toString();
+    }
+}
+
+std::string Value::toString() const {
+    switch (tag()) {
+        case TAG_INT: return std::to_string(asInt());
+        case TAG_BOOL: return asBool() ? "true" : "false";
+        case TAG_CHAR: return std::string(1, asChar());
+        case TAG_NIL: return "nil";
+        case TAG_OBJECT: {
+            auto obj = asObject();
+            switch (obj->type) {
+                case ObjectType::STRING: return std::string(static_cast<StringObject*>(obj)->view());
+                case ObjectType::INSTANCE: return "<" + static_cast<InstanceObject*>(obj)->klass->name + " instance>";
+                case ObjectType::ARRAY:
+                case ObjectType::MAP: {
+                    std::string result;
+                    appendValue(result, *this, 0);
+                    return result;
+                }
+                // the slots of a map, scripts only see the map
+                case ObjectType::TABLE: return "<table>";
+                case ObjectType::TASK: return "<task>";
+                case ObjectType::COROUTINE: return "<coroutine>";
+            }
+            return "<object>";
+        }
+        default: {
+            std::stringstream os;
+            os << asDouble();
+            return os.str();
+        }
+    }
+}
+
+std::string Value::typeName() const {
+    switch (tag()) {
+        case TAG_INT: return "int";
+        case TAG_BOOL: return "bool";
+        case TAG_CHAR: return "char";
+        case TAG_NIL: return "void";
+        case TAG_OBJECT:
+            switch (asObject()->type) {
+                case ObjectType::STRING: return "string";
+                case ObjectType::INSTANCE: return static_cast<InstanceObject*>(asObject())->klass->name;
+                case ObjectType::ARRAY:
+                    switch (static_cast<ArrayObject*>(asObject())->elementType) {
+                        case ElementType::INT: return "int[]";
+                        case ElementType::DOUBLE: return "double[]";
+                        default: return "array";
+                    }
+                case ObjectType::MAP: return "map";
+                case ObjectType::TABLE: return "table";
+                case ObjectType::TASK: return "task";
+                case ObjectType::COROUTINE: return "coroutine";
+            }
+            return "object";
+        default: return "double";
+    }
+}
+
+bool valuesEqual(Value a, Value b) {
+    if (a.isNumber() && b.isNumber()) {
+        if (a.isInt() && b.isInt()) {
+            return a.asInt() == b.asInt();
+        }
+        return a.toNumber() == b.toNumber();
+    }
+
+    if (isObjectType(a, ObjectType::STRING) && isObjectType(b, ObjectType::STRING)) {
+        auto x = asString(a), y = asString(b);
+        if (x == y) {
+            return true;
+        }
+        if (x->length != y->length || (x->interned && y->interned)) {
+            return false;
+        }
+        // a string compared with constants gets its hash cached, mismatches are cheap then
+        if (x->interned != y->interned && x->hashCode() != y->hashCode()) {
+            return false;
+        }
+        return x->view() == y->view();
+    }
+
+    return a == b;
+}
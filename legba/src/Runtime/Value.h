@@ -0,0 +1,77 @@
+#ifndef LEGBA_RUNTIME_VALUE_H
+#define LEGBA_RUNTIME_VALUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+struct Object;
+
+// NaN-boxed value: doubles are stored as they are, every other type lives in the
+// payload of a negative quiet NaN with its tag in the upper 16 bits.
+class Value {
+public:
+    static constexpr uint64_t TAG_SHIFT = 48;
+    static constexpr uint64_t PAYLOAD_MASK = (1ULL << TAG_SHIFT) - 1;
+
+    enum Tag : uint64_t {
+        TAG_INT = 0xFFF9,
+        TAG_BOOL = 0xFFFA,
+        TAG_CHAR = 0xFFFB,
+        TAG_NIL = 0xFFFC,
+        TAG_OBJECT = 0xFFFD
+    };
+
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ULL;
+
+    constexpr Value() : bits(static_cast<uint64_t>(TAG_NIL) << TAG_SHIFT) {}
+
+    static constexpr Value fromBits(uint64_t bits) { Value v; v.bits = bits; return v; }
+
+    static Value fromDouble(double d) {
+        uint64_t b;
+        std::memcpy(&b, &d, sizeof(double));
+        if (d != d) {
+            b = CANONICAL_NAN;
+        }
+        return fromBits(b);
+    }
+    static constexpr Value fromInt(int32_t i) { return fromBits((static_cast<uint64_t>(TAG_INT) << TAG_SHIFT) | static_cast<uint32_t>(i)); }
+    static constexpr Value fromBool(bool b) { return fromBits((static_cast<uint64_t>(TAG_BOOL) << TAG_SHIFT) | (b ? 1 : 0)); }
+    static constexpr Value fromChar(char c) { return fromBits((static_cast<uint64_t>(TAG_CHAR) << TAG_SHIFT) | static_cast<uint8_t>(c)); }
+    static constexpr Value nil() { return Value(); }
+    static Value fromObject(Object* obj) { return fromBits((static_cast<uint64_t>(TAG_OBJECT) << TAG_SHIFT) | reinterpret_cast<uint64_t>(obj)); }
+
+    constexpr uint64_t tag() const { return bits >> TAG_SHIFT; }
+
+    constexpr bool isDouble() const { return tag() < TAG_INT; }
+    constexpr bool isInt() const { return tag() == TAG_INT; }
+    constexpr bool isBool() const { return tag() == TAG_BOOL; }
+    constexpr bool isChar() const { return tag() == TAG_CHAR; }
+    constexpr bool isNil() const { return tag() == TAG_NIL; }
+    constexpr bool isObject() const { return tag() == TAG_OBJECT; }
+    constexpr bool isNumber() const { return isDouble() || isInt(); }
+
+    double asDouble() const { double d; std::memcpy(&d, &bits, sizeof(double)); return d; }
+    constexpr int32_t asInt() const { return static_cast<int32_t>(static_cast<uint32_t>(bits)); }
+    constexpr bool asBool() const { return (bits & 1) != 0; }
+    constexpr char asChar() const { return static_cast<char>(bits & 0xFF); }
+    Object* asObject() const { return reinterpret_cast<Object*>(bits & PAYLOAD_MASK); }
+
+    double toNumber() const { return isInt() ? static_cast<double>(asInt()) : asDouble(); }
+
+    bool isTruthy() const;
+    std::string toString() const;
+    std::string typeName() const;
+
+    constexpr bool operator==(Value const& other) const { return bits == other.bits; }
+    constexpr bool operator!=(Value const& other) const { return bits != other.bits; }
+
+    uint64_t bits;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed");
+
+bool valuesEqual(Value a, Value b);
+
+#endif
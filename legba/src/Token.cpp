@@ -48,6 +48,8 @@ std::string tokenTypeToString(TokenType type) {
         case TokenType::FUNCTION: return "FUNCTION";
         case TokenType::FOR: return "FOR";
         case TokenType::WHILE: return "WHILE";
+        case TokenType::PARALLEL: return "PARALLEL";
+        case TokenType::IMPORT: return "IMPORT";
         case TokenType::TRUE: return "TRUE";
         case TokenType::FALSE: return "FALSE";
         case TokenType::SUPER: return "SUPER";
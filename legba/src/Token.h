@@ -21,7 +21,7 @@ enum class TokenType {
 
     CLASS, PUBLIC, PROTECTED, STATIC, CONST, VIRTUAL,
     
-    IF, ELSE, FUNCTION, FOR, WHILE,
+    IF, ELSE, FUNCTION, FOR, WHILE, PARALLEL, IMPORT,
     TRUE, FALSE, SUPER, THIS, RETURN, VAR,
 
     END_OF_FILE, ERROR
@@ -0,0 +1,620 @@
+#include "Bytecode.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Error.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Operations.h"
+
+namespace {
+
+constexpr char MAGIC[4] = { 'L', 'E', 'G', 'C' };
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr uint32_t NONE = UINT32_MAX;
+constexpr uint32_t FLAG_METHOD = 1;
+// GETGLOBAL and SETGLOBAL address globals with 16 bits
+constexpr uint32_t MAX_GLOBALS = UINT16_MAX + 1;
+
+struct Section {
+    uint32_t offset;
+    uint32_t count;
+};
+
+struct Header {
+    char magic[4];
+    uint16_t version;
+    uint16_t opcodeCount;
+    uint32_t byteOrder;
+    uint32_t fileSize;
+    uint32_t mainFunction;
+    uint32_t globalCount;
+    Section functions;  // FunctionEntry
+    Section classes;    // ClassEntry
+    Section strings;    // StringEntry
+};
+
+struct FunctionEntry {
+    uint32_t name;
+    uint32_t paramCount;
+    uint32_t flags;
+    uint32_t frameSize;
+    Section code;         // Instruction
+    Section constants;    // Value, nil where a string constant gets patched in
+    Section relocations;  // Relocation
+    Section names;        // string indices
+    Section lines;        // LineEntry
+};
+
+struct Relocation {
+    uint32_t constant;
+    uint32_t string;
+};
+
+struct ClassEntry {
+    uint32_t name;
+    uint32_t constructor; // function index or NONE
+    Section methods;      // MethodEntry in vtable order
+    Section fields;       // string indices in layout order
+    Section statics;      // string indices in per-class storage order
+};
+
+struct MethodEntry {
+    uint32_t name;
+    uint32_t function;
+};
+
+struct StringEntry {
+    uint32_t offset;
+    uint32_t length;
+};
+
+static_assert(std::is_trivially_copyable_v<Value> && std::is_trivially_copyable_v<LineEntry>);
+
+class Writer {
+public:
+    std::vector<char> bytes;
+
+    template<typename T>
+    Section append(T const* data, size_t count) {
+        while (bytes.size() % alignof(T) != 0) {
+            bytes.push_back(0);
+        }
+        auto offset = static_cast<uint32_t>(bytes.size());
+        bytes.resize(bytes.size() + count * sizeof(T));
+        if (count > 0) {
+            std::memcpy(bytes.data() + offset, data, count * sizeof(T));
+        }
+        return { offset, static_cast<uint32_t>(count) };
+    }
+
+    template<typename T>
+    Section append(std::vector<T> const& data) { return append(data.data(), data.size()); }
+
+    uint32_t intern(const std::string& value) {
+        auto it = stringIndices.find(value);
+        if (it != stringIndices.end()) {
+            return it->second;
+        }
+        auto index = static_cast<uint32_t>(strings.size());
+        strings.push_back(value);
+        stringIndices.emplace(value, index);
+        return index;
+    }
+
+    std::vector<std::string> strings;
+
+private:
+    std::unordered_map<std::string, uint32_t> stringIndices;
+};
+
+// Bounds checked access to the mapped file.
+class Reader {
+public:
+    Reader(const char* data, size_t size) : data(data), size(size) {}
+
+    template<typename T>
+    T* section(Section section) const {
+        if (section.offset % alignof(T) != 0 || static_cast<uint64_t>(section.offset) + static_cast<uint64_t>(section.count) * sizeof(T) > size) {
+            throw BytecodeError("Section out of bounds.");
+        }
+        return reinterpret_cast<T*>(const_cast<char*>(data) + section.offset);
+    }
+
+private:
+    const char* data;
+    size_t size;
+};
+
+bool hasExtra(OpCode op) {
+    switch (op) {
+        case OpCode::CALL:
+        case OpCode::TAILCALL:
+        case OpCode::CALLNATIVE:
+        case OpCode::SPAWN:
+        case OpCode::ASYNC:
+        case OpCode::INVOKE:
+        case OpCode::INVOKEVT:
+        case OpCode::INVOKEDIRECT:
+        case OpCode::NEW:
+        case OpCode::GETATTR:
+        case OpCode::SETATTR:
+        case OpCode::GETSTATIC:
+        case OpCode::SETSTATIC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Structural checks, so the VM never indexes past a table of a corrupt file.
+// owner is the class of a method, nullptr for functions.
+void verify(FunctionProto const& proto, Program const& program, ClassObject const* owner) {
+    auto fail = [&](size_t at, const std::string& what) {
+        throw BytecodeError("Invalid instruction " + std::to_string(at) + " in '" + proto.name + "': " + what + '.');
+    };
+
+    auto size = proto.code.size();
+    if (size == 0 || (getOp(proto.code[size - 1]) != OpCode::RETURN && getOp(proto.code[size - 1]) != OpCode::RETURNNIL)) {
+        fail(size, "missing return");
+    }
+
+    for (size_t at = 0; at < size; at++) {
+        Instruction i = proto.code[at];
+        OpCode op = getOp(i);
+        if (op >= OpCode::EXTRA) {
+            fail(at, "unknown or specialized opcode");
+        }
+        if (getA(i) >= proto.frameSize) {
+            fail(at, "register out of frame");
+        }
+        auto inFrame = [&](uint32_t r) { return r < static_cast<uint32_t>(proto.frameSize); };
+
+        switch (op) {
+            case OpCode::MOVE:
+            case OpCode::NOT:
+            case OpCode::NEG:
+            case OpCode::GETATTR:
+            case OpCode::SETATTR:
+                if (!inFrame(getB(i))) fail(at, "register out of frame");
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV:
+            case OpCode::MOD:
+            case OpCode::EQ:
+            case OpCode::NE:
+            case OpCode::LT:
+            case OpCode::LE:
+            case OpCode::GT:
+            case OpCode::GE:
+                if (!inFrame(getB(i)) || !inFrame(getC(i))) fail(at, "register out of frame");
+                break;
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+                if (getA(i) + getB(i) > proto.frameSize) fail(at, "arguments out of frame");
+                break;
+            case OpCode::INVOKE:
+            case OpCode::INVOKEVT:
+            case OpCode::INVOKEDIRECT:
+            case OpCode::NEW:
+                if (!inFrame(getA(i) + getB(i))) fail(at, "arguments out of frame");
+                break;
+            case OpCode::LOADK:
+                if (getBx(i) >= proto.constants.size()) fail(at, "constant out of range");
+                break;
+            case OpCode::GETGLOBAL:
+            case OpCode::SETGLOBAL:
+                if (getBx(i) >= program.globalCount) fail(at, "global out of range");
+                break;
+            case OpCode::GETFIELD:
+            case OpCode::SETFIELD:
+                if (owner == nullptr || (op == OpCode::GETFIELD ? getB(i) : getA(i)) != 0) fail(at, "field access on something else than 'this'");
+                if (op == OpCode::SETFIELD && !inFrame(getB(i))) fail(at, "register out of frame");
+                if (getC(i) >= owner->fieldNames.size()) fail(at, "field out of range");
+                break;
+            case OpCode::NEWARRAY:
+                if (getA(i) + getB(i) >= proto.frameSize) fail(at, "elements out of frame");
+                if (getC(i) > static_cast<uint8_t>(ElementType::VALUE) + 1) fail(at, "unknown element type");
+                break;
+            case OpCode::NEWMAP:
+                if (getA(i) + 2 * getB(i) >= proto.frameSize) fail(at, "entries out of frame");
+                break;
+            case OpCode::GETINDEX:
+            case OpCode::SETINDEX:
+                if (getB(i) >= proto.frameSize || getC(i) >= proto.frameSize) fail(at, "register out of frame");
+                break;
+            case OpCode::JMP:
+            case OpCode::JMPIF:
+            case OpCode::JMPIFNOT: {
+                auto target = static_cast<int64_t>(at) + 1 + getSBx(i);
+                if (target < 0 || target >= static_cast<int64_t>(size)) fail(at, "jump out of code");
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (!hasExtra(op)) {
+            continue;
+        }
+        if (at + 1 >= size || getOp(proto.code[at + 1]) != OpCode::EXTRA) {
+            fail(at, "missing operand");
+        }
+        uint32_t extra = getExtra(proto.code[++at]);
+        // methods are only entered with an instance of their class in R[0]
+        auto isFunction = [&](uint32_t index) { return index < program.functions.size() && !program.functions[index]->isMethod; };
+        switch (op) {
+            case OpCode::CALL:
+                if (!isFunction(extra)) fail(at, "function out of range");
+                break;
+            case OpCode::TAILCALL:
+                if (!isFunction(extra)) fail(at, "function out of range");
+                if (owner != nullptr && owner->constructor == &proto) fail(at, "tail call in a constructor");
+                break;
+            case OpCode::CALLNATIVE:
+                if (extra >= BUILTIN_COUNT) fail(at, "builtin out of range");
+                if (getB(i) != BUILTINS[extra].arity) fail(at, "wrong argument count");
+                if (getA(i) + getB(i) > proto.frameSize) fail(at, "arguments out of frame");
+                break;
+            case OpCode::SPAWN:
+            case OpCode::ASYNC:
+                if (!isFunction(extra)) fail(at, "function out of range");
+                if (getA(i) + getB(i) > proto.frameSize) fail(at, "arguments out of frame");
+                break;
+            case OpCode::INVOKEVT:
+                if (owner == nullptr) fail(at, "vtable call outside a method");
+                if (extra >= owner->vtable.size()) fail(at, "method out of range");
+                if (getB(i) != owner->vtable[extra]->paramCount) fail(at, "wrong argument count");
+                break;
+            case OpCode::INVOKEDIRECT:
+                if (extra >= program.functions.size() || !program.functions[extra]->isMethod) fail(at, "method out of range");
+                if (getB(i) != program.functions[extra]->paramCount) fail(at, "wrong argument count");
+                break;
+            case OpCode::NEW:
+                if (extra >= program.classes.size()) fail(at, "class out of range");
+                break;
+            case OpCode::GETSTATIC:
+            case OpCode::SETSTATIC:
+                if (extra >= program.classes.size() || getBx(i) >= program.classes[extra]->statics.size()) fail(at, "static attribute out of range");
+                break;
+            default:
+                if (extra >= proto.names.size()) fail(at, "name out of range");
+                break;
+        }
+    }
+}
+
+}
+
+void writeBytecode(Program const& program, std::ostream& os) {
+    Writer writer;
+    Header header{};
+    writer.bytes.resize(sizeof(Header));
+
+    std::unordered_map<FunctionProto*, uint32_t> functionIndices;
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        functionIndices.emplace(program.functions[f], static_cast<uint32_t>(f));
+    }
+
+    // Sections are grouped by kind rather than by function: the string patches at load
+    // then copy only the few pages holding constants, and code stays shared until the
+    // VM quickens it.
+    auto functions = std::vector<FunctionEntry>(program.functions.size());
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        auto proto = program.functions[f];
+        functions[f].name = writer.intern(proto->name);
+        functions[f].paramCount = static_cast<uint32_t>(proto->paramCount);
+        functions[f].flags = proto->isMethod ? FLAG_METHOD : 0;
+        functions[f].frameSize = static_cast<uint32_t>(proto->frameSize);
+        functions[f].code = writer.append(proto->code.data(), proto->code.size());
+    }
+
+    auto relocations = std::vector<std::vector<Relocation>>(program.functions.size());
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        auto proto = program.functions[f];
+        auto constants = std::vector<Value>(proto->constants.begin(), proto->constants.end());
+        for (size_t c = 0; c < constants.size(); c++) {
+            if (!constants[c].isObject()) {
+                continue;
+            }
+            if (!isObjectType(constants[c], ObjectType::STRING)) {
+                throw BytecodeError("Only string constants can be written.");
+            }
+            relocations[f].push_back({ static_cast<uint32_t>(c), writer.intern(std::string(asString(constants[c])->view())) });
+            constants[c] = Value::nil();
+        }
+        functions[f].constants = writer.append(constants);
+    }
+
+    for (size_t f = 0; f < program.functions.size(); f++) {
+        auto proto = program.functions[f];
+        functions[f].relocations = writer.append(relocations[f]);
+
+        auto names = std::vector<uint32_t>();
+        for (auto const& name : proto->names) {
+            names.push_back(writer.intern(name));
+        }
+        functions[f].names = writer.append(names);
+        functions[f].lines = writer.append(proto->lines.data(), proto->lines.size());
+    }
+
+    auto classes = std::vector<ClassEntry>();
+    for (auto klass : program.classes) {
+        ClassEntry entry{};
+        entry.name = writer.intern(klass->name);
+        entry.constructor = klass->constructor != nullptr ? functionIndices.at(klass->constructor) : NONE;
+
+        auto methods = std::vector<MethodEntry>();
+        methods.resize(klass->vtable.size());
+        for (auto const& [name, index] : klass->methodIndices) {
+            methods[index] = { writer.intern(name), functionIndices.at(klass->vtable[index]) };
+        }
+        entry.methods = writer.append(methods);
+
+        auto fields = std::vector<uint32_t>();
+        for (auto const& name : klass->fieldNames) {
+            fields.push_back(writer.intern(name));
+        }
+        entry.fields = writer.append(fields);
+
+        auto statics = std::vector<uint32_t>();
+        for (auto const& name : klass->staticNames) {
+            statics.push_back(writer.intern(name));
+        }
+        entry.statics = writer.append(statics);
+        classes.push_back(entry);
+    }
+
+    // every string is interned by now
+    auto strings = std::vector<StringEntry>();
+    for (auto const& value : writer.strings) {
+        auto chars = writer.append(value.data(), value.size());
+        strings.push_back({ chars.offset, chars.count });
+    }
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = BYTECODE_VERSION;
+    header.opcodeCount = static_cast<uint16_t>(OPCODE_COUNT);
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.mainFunction = static_cast<uint32_t>(program.mainFunction);
+    header.globalCount = static_cast<uint32_t>(program.globalCount);
+    header.functions = writer.append(functions);
+    header.classes = writer.append(classes);
+    header.strings = writer.append(strings);
+    header.fileSize = static_cast<uint32_t>(writer.bytes.size());
+    std::memcpy(writer.bytes.data(), &header, sizeof(Header));
+
+    os.write(writer.bytes.data(), static_cast<std::streamsize>(writer.bytes.size()));
+    if (!os.good()) {
+        throw BytecodeError("Failed to write the bytecode.");
+    }
+}
+
+static void* mapFile(const std::string& path, size_t& size) {
+#if defined(_WIN32)
+    // no mapping with copy on write here, read the file into one block instead
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+    size = static_cast<size_t>(file.tellg());
+    void* data = std::malloc(std::max<size_t>(size, 1));
+    file.seekg(0);
+    if (data != nullptr && !file.read(static_cast<char*>(data), static_cast<std::streamsize>(size))) {
+        std::free(data);
+        return nullptr;
+    }
+    return data;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    size = static_cast<size_t>(info.st_size);
+    // private and writable: quickening and string patches copy only the pages they touch
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return data == MAP_FAILED ? nullptr : data;
+#endif
+}
+
+// a private copy of bytes that unmapBytecode releases like a mapped file
+static void* mapBytes(std::string_view bytes) {
+    if (bytes.empty()) {
+        return nullptr;
+    }
+#if defined(_WIN32)
+    void* data = std::malloc(bytes.size());
+    if (data == nullptr) {
+        return nullptr;
+    }
+#else
+    void* data = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+#endif
+    std::memcpy(data, bytes.data(), bytes.size());
+    return data;
+}
+
+void unmapBytecode(void* mapping, size_t size) {
+#if defined(_WIN32)
+    std::free(mapping);
+#else
+    munmap(mapping, size);
+#endif
+}
+
+bool isBytecodeFile(const std::string& path) {
+    return path.ends_with(BYTECODE_EXTENSION);
+}
+
+static void load(void* data, size_t size, Program& program);
+
+void loadBytecode(const std::string& path, Program& program) {
+    size_t size = 0;
+    void* data = mapFile(path, size);
+    if (data == nullptr) {
+        throw BytecodeError("Failed to open '" + path + "'.");
+    }
+    load(data, size, program);
+}
+
+void loadBytecode(std::string_view bytes, Program& program) {
+    void* data = mapBytes(bytes);
+    if (data == nullptr) {
+        throw BytecodeError("Not a Legba bytecode file.");
+    }
+    load(data, bytes.size(), program);
+}
+
+static void load(void* data, size_t size, Program& program) {
+    // the program owns the mapping from here on, also when loading fails below
+    program.mapping = data;
+    program.mappingSize = size;
+
+    Reader reader(static_cast<const char*>(data), size);
+    if (size < sizeof(Header) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        throw BytecodeError("Not a Legba bytecode file.");
+    }
+    auto header = reader.section<Header>({ 0, 1 });
+    if (header->byteOrder != BYTE_ORDER_MARK || header->version != BYTECODE_VERSION || header->opcodeCount != OPCODE_COUNT) {
+        throw BytecodeError("Bytecode was compiled by an incompatible version of Legba, recompile it.");
+    }
+    if (header->fileSize != size) {
+        throw BytecodeError("Bytecode file is truncated.");
+    }
+
+    auto stringEntries = reader.section<StringEntry>(header->strings);
+    auto string = [&](uint32_t index) {
+        if (index >= header->strings.count) {
+            throw BytecodeError("String index out of range.");
+        }
+        return std::string(reader.section<char>({ stringEntries[index].offset, stringEntries[index].length }), stringEntries[index].length);
+    };
+    // one object per interned string, shared by every constant referring to it
+    auto stringObjects = std::vector<Value>(header->strings.count, Value::nil());
+
+    auto functionEntries = reader.section<FunctionEntry>(header->functions);
+    program.functions.reserve(header->functions.count);
+    for (uint32_t f = 0; f < header->functions.count; f++) {
+        auto const& entry = functionEntries[f];
+        auto proto = new FunctionProto();
+        program.functions.push_back(proto);
+
+        proto->name = string(entry.name);
+        proto->paramCount = static_cast<int>(entry.paramCount);
+        proto->isMethod = (entry.flags & FLAG_METHOD) != 0;
+        proto->frameSize = static_cast<int>(entry.frameSize);
+        if (entry.frameSize == 0 || entry.frameSize > MAX_REGISTERS || entry.paramCount > entry.frameSize - (proto->isMethod ? 1 : 0)) {
+            throw BytecodeError("Invalid frame size of '" + proto->name + "'.");
+        }
+
+        proto->code = { reader.section<Instruction>(entry.code), entry.code.count };
+        proto->constants = { reader.section<Value>(entry.constants), entry.constants.count };
+        proto->lines = { reader.section<const LineEntry>(entry.lines), entry.lines.count };
+        // objects only get in through the relocations below, other bits with their tag
+        // would be taken for pointers
+        for (auto constant : proto->constants) {
+            if (constant.tag() >= Value::TAG_OBJECT) {
+                throw BytecodeError("Invalid constant in '" + proto->name + "'.");
+            }
+        }
+
+        auto relocations = reader.section<Relocation>(entry.relocations);
+        for (uint32_t r = 0; r < entry.relocations.count; r++) {
+            auto [constant, index] = relocations[r];
+            if (constant >= proto->constants.size()) {
+                throw BytecodeError("Constant index out of range.");
+            }
+            if (index >= header->strings.count) {
+                throw BytecodeError("String index out of range.");
+            }
+            if (stringObjects[index].isNil()) {
+                stringObjects[index] = newConstantString(string(index));
+            }
+            proto->constants[constant] = stringObjects[index];
+        }
+
+        auto names = reader.section<uint32_t>(entry.names);
+        for (uint32_t n = 0; n < entry.names.count; n++) {
+            proto->names.push_back(string(names[n]));
+        }
+    }
+    if (header->mainFunction >= program.functions.size()) {
+        throw BytecodeError("Main function out of range.");
+    }
+    if (header->globalCount > MAX_GLOBALS) {
+        throw BytecodeError("Global count out of range.");
+    }
+    program.mainFunction = static_cast<int>(header->mainFunction);
+    program.globalCount = static_cast<int>(header->globalCount);
+
+    auto classEntries = reader.section<ClassEntry>(header->classes);
+    program.classes.reserve(header->classes.count);
+    for (uint32_t c = 0; c < header->classes.count; c++) {
+        auto const& entry = classEntries[c];
+        auto klass = new ClassObject(nullptr);
+        program.classes.push_back(klass);
+        klass->name = string(entry.name);
+
+        auto function = [&](uint32_t index) {
+            if (index >= program.functions.size()) {
+                throw BytecodeError("Function index out of range.");
+            }
+            return program.functions[index];
+        };
+        auto methods = reader.section<MethodEntry>(entry.methods);
+        for (uint32_t m = 0; m < entry.methods.count; m++) {
+            klass->methodIndices.emplace(string(methods[m].name), static_cast<int>(m));
+            klass->vtable.push_back(function(methods[m].function));
+        }
+        klass->constructor = entry.constructor != NONE ? function(entry.constructor) : nullptr;
+
+        auto fields = reader.section<uint32_t>(entry.fields);
+        for (uint32_t i = 0; i < entry.fields.count; i++) {
+            auto name = string(fields[i]);
+            klass->fieldIndices.emplace(name, static_cast<int>(klass->fieldNames.size()));
+            klass->fieldNames.push_back(name);
+        }
+
+        auto statics = reader.section<uint32_t>(entry.statics);
+        for (uint32_t i = 0; i < entry.statics.count; i++) {
+            auto name = string(statics[i]);
+            klass->staticIndices.emplace(name, static_cast<int>(klass->staticNames.size()));
+            klass->staticNames.push_back(name);
+        }
+        klass->statics.resize(klass->staticNames.size());
+    }
+
+    auto owners = std::unordered_map<FunctionProto const*, ClassObject const*>();
+    for (auto klass : program.classes) {
+        for (auto method : klass->vtable) {
+            owners.emplace(method, klass);
+        }
+    }
+    for (auto proto : program.functions) {
+        auto owner = owners.find(proto);
+        verify(*proto, program, owner != owners.end() ? owner->second : nullptr);
+    }
+}
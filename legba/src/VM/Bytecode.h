@@ -0,0 +1,36 @@
+#ifndef LEGBA_VM_BYTECODE_H
+#define LEGBA_VM_BYTECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "VM/Program.h"
+
+// Precompiled programs (.legc). A file holds a header, one table each of functions,
+// classes and interned strings, and the sections the tables point into: code,
+// constants, line tables, name and method lists and the string characters. All
+// references are file offsets or table indices, so the file is position independent
+// and gets executed straight from a private mapping. Loading only allocates the
+// protos, class objects and name strings and patches string constants in place.
+//
+// The layout follows the host (checked through a byte order mark) and the opcode
+// numbering, files are rejected when either changed.
+constexpr const char* BYTECODE_EXTENSION = ".legc";
+constexpr uint16_t BYTECODE_VERSION = 10;
+
+// Writes a freshly compiled program, before any VM quickened it. Throws BytecodeError
+// when the stream fails.
+void writeBytecode(Program const& program, std::ostream& os);
+
+// Maps path and fills program, throws BytecodeError on malformed files.
+void loadBytecode(const std::string& path, Program& program);
+// Same for a file's contents received some other way, copied into a mapping of their own.
+void loadBytecode(std::string_view bytes, Program& program);
+void unmapBytecode(void* mapping, size_t size);
+
+bool isBytecodeFile(const std::string& path);
+
+#endif
@@ -0,0 +1,709 @@
+#include "Compiler.h"
+
+#include <algorithm>
+
+#include "Error.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Operations.h"
+
+void Compiler::compile(ScopeNode* rootScope, int globalCount, Program& program) {
+    this->program = &program;
+    program.globalCount = globalCount;
+
+    declare(rootScope);
+
+    auto main = new FunctionProto();
+    main->name = "<script>";
+    program.mainFunction = static_cast<int>(program.functions.size());
+    program.functions.emplace_back(main);
+    function(main, rootScope, 0);
+
+    for (auto [func, index] : functionIndices) {
+        function(program.functions[index], func->getBody(), func->getFrameSize());
+    }
+    for (auto [method, index] : methodIndices) {
+        function(program.functions[index], method->getBody(), method->getFrameSize(), method->getClass());
+    }
+}
+
+// Declarations
+
+void Compiler::declare(ScopeNode* rootScope) {
+    // every callee gets its index up front, calls may precede the declaration
+    for (auto stmt : rootScope->getStatements()) {
+        if (stmt->getType() == NodeType::FUNCTION) {
+            auto func = static_cast<FunctionNode*>(stmt);
+            auto proto = new FunctionProto();
+            proto->name = func->getName();
+            proto->paramCount = static_cast<int>(func->getParams().size());
+            functionIndices.emplace(func, static_cast<int>(program->functions.size()));
+            program->functions.emplace_back(proto);
+        } else if (stmt->getType() == NodeType::CLASS) {
+            auto klass = static_cast<ClassNode*>(stmt);
+            auto classObject = newClass(klass);
+
+            // vtable indices follow the method names, independent of hash map order
+            auto methods = std::vector<std::pair<std::string, MethodNode*>>();
+            for (auto const& entry : klass->getMethods()) {
+                methods.push_back(entry);
+            }
+            std::sort(methods.begin(), methods.end());
+
+            for (auto const& [name, method] : methods) {
+                auto proto = new FunctionProto();
+                proto->name = klass->getName() + '.' + name;
+                proto->paramCount = static_cast<int>(method->getParams().size());
+                proto->isMethod = true;
+                methodIndices.emplace(method, static_cast<int>(program->functions.size()));
+                program->functions.emplace_back(proto);
+
+                classObject->methodIndices.emplace(name, static_cast<int>(classObject->vtable.size()));
+                classObject->vtable.push_back(proto);
+                if (method == klass->getConstructor()) {
+                    classObject->constructor = proto;
+                }
+            }
+
+            classIndices.emplace(klass, static_cast<int>(program->classes.size()));
+            program->classes.emplace_back(classObject);
+        }
+    }
+}
+
+int Compiler::functionIndex(FunctionNode* func) {
+    auto it = functionIndices.find(func);
+    if (it != functionIndices.end()) {
+        return it->second;
+    }
+    return importedFunction(func, func->getName(), static_cast<int>(func->getParams().size()), false);
+}
+
+int Compiler::methodIndex(MethodNode* method) {
+    auto it = methodIndices.find(method);
+    if (it != methodIndices.end()) {
+        return it->second;
+    }
+    return importedFunction(method, method->getClass()->getName() + '.' + method->getName(),
+                            static_cast<int>(method->getParams().size()), true);
+}
+
+int Compiler::classIndex(ClassNode* klass) {
+    if (auto it = classIndices.find(klass); it != classIndices.end()) {
+        return it->second;
+    }
+    if (auto it = importIndices.find(klass); it != importIndices.end()) {
+        return it->second;
+    }
+    if (!moduleOf) {
+        throw CompileError("Class '" + klass->getName() + "' is declared in another module.");
+    }
+
+    auto stub = new ClassObject(nullptr);
+    stub->name = klass->getName();
+    int index = static_cast<int>(program->classes.size());
+    program->classes.emplace_back(stub);
+    program->importedClasses.push_back({index, moduleOf(klass), klass->getName()});
+    importIndices.emplace(klass, index);
+    return index;
+}
+
+// the stub returns nil, it only keeps the program valid until it is linked
+int Compiler::importedFunction(Node* declaration, const std::string& name, int paramCount, bool isMethod) {
+    if (auto it = importIndices.find(declaration); it != importIndices.end()) {
+        return it->second;
+    }
+    if (!moduleOf) {
+        throw CompileError("'" + name + "' is declared in another module.");
+    }
+
+    auto stub = new FunctionProto();
+    stub->name = name;
+    stub->paramCount = paramCount;
+    stub->isMethod = isMethod;
+    stub->frameSize = std::max(paramCount + (isMethod ? 1 : 0), 1);
+    stub->codeStorage.push_back(encodeABC(OpCode::RETURNNIL, 0, 0, 0));
+    stub->viewStorage();
+    int index = static_cast<int>(program->functions.size());
+    program->functions.emplace_back(stub);
+    program->importedFunctions.push_back({index, moduleOf(declaration), name});
+    importIndices.emplace(declaration, index);
+    return index;
+}
+
+void Compiler::function(FunctionProto* proto, Node* body, int localCount, ClassNode* klass) {
+    current = proto;
+    currentClass = klass;
+    this->localCount = localCount;
+    freeRegister = localCount;
+    proto->frameSize = std::max(localCount, 1); // R[0] receives the return value
+    numberConstants.clear();
+    stringConstants.clear();
+    names.clear();
+
+    line = 0;
+    statement(body);
+    emit(encodeABC(OpCode::RETURNNIL, 0, 0, 0));
+    proto->viewStorage();
+}
+
+// Statements
+
+void Compiler::statement(Node* node) {
+    int saved = freeRegister;
+    int savedLine = line;
+    if (node->getLine() != 0) {
+        line = node->getLine();
+    }
+
+    switch (node->getType()) {
+        case NodeType::SCOPE: scope(static_cast<ScopeNode*>(node)); break;
+        case NodeType::IF: ifStatement(static_cast<IfNode*>(node)); break;
+        case NodeType::WHILE: whileStatement(static_cast<WhileNode*>(node)); break;
+        case NodeType::FOR: forStatement(static_cast<ForNode*>(node)); break;
+        case NodeType::VARIABLE_DECL: variableDeclaration(static_cast<VariableDeclarationNode*>(node)); break;
+        case NodeType::FUNCTION:
+        case NodeType::CLASS:
+            break; // compiled separately
+        case NodeType::UNARY:
+            if (static_cast<UnaryNode*>(node)->getOp()->getOp() == TokenType::RETURN) {
+                returnStatement(static_cast<UnaryNode*>(node));
+                break;
+            }
+            discard(node);
+            break;
+        default:
+            discard(node);
+            break;
+    }
+
+    freeRegister = saved;
+    line = savedLine;
+}
+
+void Compiler::scope(ScopeNode* node) {
+    for (auto stmt : node->getStatements()) {
+        statement(stmt);
+    }
+}
+
+void Compiler::ifStatement(IfNode* node) {
+    int saved = freeRegister;
+    uint8_t condition = expression(node->getCondition());
+    freeRegister = saved;
+    size_t elseJump = emitJump(OpCode::JMPIFNOT, condition);
+
+    statement(node->getThenBranch());
+
+    if (node->getElseBranch() == nullptr) {
+        patchJump(elseJump);
+        return;
+    }
+
+    size_t endJump = emitJump(OpCode::JMP, 0);
+    patchJump(elseJump);
+    statement(node->getElseBranch());
+    patchJump(endJump);
+}
+
+void Compiler::whileStatement(WhileNode* node) {
+    size_t start = current->codeStorage.size();
+
+    int saved = freeRegister;
+    uint8_t condition = expression(node->getCondition());
+    freeRegister = saved;
+    size_t exitJump = emitJump(OpCode::JMPIFNOT, condition);
+
+    statement(node->getBody());
+    emitLoop(start);
+
+    patchJump(exitJump);
+}
+
+void Compiler::forStatement(ForNode* node) {
+    if (node->getInitializer() != nullptr) {
+        statement(node->getInitializer());
+    }
+
+    size_t start = current->codeStorage.size();
+
+    size_t exitJump = SIZE_MAX;
+    if (node->getCondition() != nullptr) {
+        int saved = freeRegister;
+        uint8_t condition = expression(node->getCondition());
+        freeRegister = saved;
+        exitJump = emitJump(OpCode::JMPIFNOT, condition);
+    }
+
+    statement(node->getBody());
+    if (node->getIncrement() != nullptr) {
+        statement(node->getIncrement());
+    }
+    emitLoop(start);
+
+    if (exitJump != SIZE_MAX) {
+        patchJump(exitJump);
+    }
+}
+
+void Compiler::returnStatement(UnaryNode* node) {
+    if (node->getNode() == nullptr) {
+        emit(encodeABC(OpCode::RETURNNIL, 0, 0, 0));
+        return;
+    }
+
+    if (node->getNode()->getType() == NodeType::CALL && tailCall(static_cast<FunctionCallNode*>(node->getNode()))) {
+        return;
+    }
+    emit(encodeABC(OpCode::RETURN, expression(node->getNode()), 0, 0));
+}
+
+// A function called in tail position takes over the frame instead of stacking a new
+// one; calling the function itself again becomes a jump back to its start. Constructor
+// frames stay, their caller expects the instance rather than a result.
+bool Compiler::tailCall(FunctionCallNode* node) {
+    if (node->getFunction() == nullptr) {
+        return false;
+    }
+    if (currentClass != nullptr && program->classes[classIndices.at(currentClass)]->constructor == current) {
+        return false;
+    }
+
+    int index = functionIndex(node->getFunction());
+    uint8_t base = allocateRegister();
+    uint8_t argc = arguments(node->getArgs(), base);
+    if (program->functions[index] != current || argc != current->paramCount) {
+        emit(encodeABC(OpCode::TAILCALL, base, argc, 0));
+        emitExtra(index);
+        return true;
+    }
+
+    // parameters are the first registers, the remaining locals get declared again
+    auto args = node->getArgs();
+    for (uint8_t i = 0; i < argc; i++) {
+        bool unchanged = args[i]->getType() == NodeType::VARIABLE && static_cast<VariableNode*>(args[i])->getVar()->getSlot() == i
+            && !static_cast<VariableNode*>(args[i])->getVar()->isGlobal();
+        if (!unchanged) {
+            emit(encodeABC(OpCode::MOVE, i, base + i, 0));
+        }
+    }
+    emitLoop(0);
+    return true;
+}
+
+void Compiler::variableDeclaration(VariableDeclarationNode* node) {
+    if (!node->isGlobal()) {
+        auto slot = static_cast<uint8_t>(node->getSlot());
+        if (node->getInitializer() != nullptr) {
+            expressionTo(node->getInitializer(), slot);
+        } else {
+            emit(encodeABC(OpCode::LOADNIL, slot, 0, 0));
+        }
+        return;
+    }
+
+    uint8_t value;
+    if (node->getInitializer() != nullptr) {
+        value = expression(node->getInitializer());
+    } else {
+        value = allocateRegister();
+        emit(encodeABC(OpCode::LOADNIL, value, 0, 0));
+    }
+    emit(encodeABx(OpCode::SETGLOBAL, value, static_cast<uint16_t>(node->getSlot())));
+}
+
+void Compiler::discard(Node* node) {
+    if (node->getType() == NodeType::BINARY && static_cast<BinaryNode*>(node)->getOp()->getOp() == TokenType::EQUAL) {
+        assignment(static_cast<BinaryNode*>(node), -1);
+        return;
+    }
+
+    expression(node);
+}
+
+// Expressions
+
+uint8_t Compiler::expression(Node* node) {
+    if (node->getType() == NodeType::VARIABLE) {
+        auto var = static_cast<VariableNode*>(node)->getVar();
+        if (!var->isGlobal()) {
+            return static_cast<uint8_t>(var->getSlot());
+        }
+    }
+
+    uint8_t reg = allocateRegister();
+    expressionTo(node, reg);
+    return reg;
+}
+
+void Compiler::expressionTo(Node* node, uint8_t reg) {
+    int saved = freeRegister;
+
+    switch (node->getType()) {
+        case NodeType::INTEGER: {
+            int value = static_cast<IntegerNode*>(node)->getValue();
+            if (value >= SBX_MIN && value <= SBX_MAX) {
+                emit(encodeAsBx(OpCode::LOADI, reg, static_cast<int16_t>(value)));
+            } else {
+                emit(encodeABx(OpCode::LOADK, reg, constant(Value::fromInt(value))));
+            }
+            break;
+        }
+        case NodeType::DOUBLE:
+            emit(encodeABx(OpCode::LOADK, reg, constant(Value::fromDouble(static_cast<DoubleNode*>(node)->getValue()))));
+            break;
+        case NodeType::CHAR:
+            emit(encodeABx(OpCode::LOADK, reg, constant(Value::fromChar(static_cast<CharNode*>(node)->getValue()))));
+            break;
+        case NodeType::BOOL:
+            emit(encodeABC(OpCode::LOADBOOL, reg, static_cast<BoolNode*>(node)->getValue() ? 1 : 0, 0));
+            break;
+        case NodeType::STRING: {
+            auto const& value = static_cast<StringNode*>(node)->getValue();
+            auto it = stringConstants.find(value);
+            uint16_t index;
+            if (it != stringConstants.end()) {
+                index = it->second;
+            } else {
+                index = constant(newConstantString(value));
+                stringConstants.emplace(value, index);
+            }
+            emit(encodeABx(OpCode::LOADK, reg, index));
+            break;
+        }
+        case NodeType::VARIABLE: {
+            auto var = static_cast<VariableNode*>(node)->getVar();
+            if (var->isGlobal()) {
+                emit(encodeABx(OpCode::GETGLOBAL, reg, static_cast<uint16_t>(var->getSlot())));
+            } else if (var->getSlot() != reg) {
+                emit(encodeABC(OpCode::MOVE, reg, static_cast<uint8_t>(var->getSlot()), 0));
+            }
+            break;
+        }
+        case NodeType::IDENTIFIER:
+            throw CompileError("Undefined variable '" + static_cast<IdentifierNode*>(node)->getName() + "'.");
+        case NodeType::UNARY: unary(static_cast<UnaryNode*>(node), reg); break;
+        case NodeType::BINARY: binary(static_cast<BinaryNode*>(node), reg); break;
+        case NodeType::CALL: call(static_cast<FunctionCallNode*>(node), reg); break;
+        case NodeType::SPAWN: spawn(static_cast<SpawnNode*>(node), reg); break;
+        case NodeType::METHOD_CALL: methodCall(static_cast<MethodCallNode*>(node), reg); break;
+        case NodeType::ARRAY: array(static_cast<ArrayNode*>(node), reg); break;
+        case NodeType::MAP: map(static_cast<MapNode*>(node), reg); break;
+        default:
+            throw CompileError("Cannot compile " + node->toString() + " as an expression.");
+    }
+
+    freeRegister = saved;
+}
+
+void Compiler::unary(UnaryNode* node, uint8_t reg) {
+    OpCode op;
+    switch (node->getOp()->getOp()) {
+        case TokenType::BANG: op = OpCode::NOT; break;
+        case TokenType::MINUS: op = OpCode::NEG; break;
+        default: throw CompileError("A return is only allowed as a statement.");
+    }
+
+    emit(encodeABC(op, reg, expression(node->getNode()), 0));
+}
+
+void Compiler::binary(BinaryNode* node, uint8_t reg) {
+    OpCode op;
+    switch (node->getOp()->getOp()) {
+        case TokenType::EQUAL: assignment(node, reg); return;
+        case TokenType::AND:
+        case TokenType::OR: logical(node, reg); return;
+        case TokenType::DOT: {
+            auto attribute = ownAttribute(node);
+            if (attribute != nullptr && attribute->isStatic()) {
+                emit(encodeABx(OpCode::GETSTATIC, reg, static_cast<uint16_t>(attribute->getSlot())));
+                emitExtra(classIndices.at(currentClass));
+                return;
+            }
+            uint8_t object = expression(node->getLeft());
+            if (attribute != nullptr) {
+                emit(encodeABC(OpCode::GETFIELD, reg, object, static_cast<uint8_t>(attribute->getSlot())));
+                return;
+            }
+            emit(encodeABC(OpCode::GETATTR, reg, object, 0));
+            emitExtra(name(static_cast<IdentifierNode*>(node->getRight())->getName()));
+            return;
+        }
+        case TokenType::LEFT_BRACKET: op = OpCode::GETINDEX; break;
+        case TokenType::PLUS: op = OpCode::ADD; break;
+        case TokenType::MINUS: op = OpCode::SUB; break;
+        case TokenType::STAR: op = OpCode::MUL; break;
+        case TokenType::SLASH: op = OpCode::DIV; break;
+        case TokenType::MODULO: op = OpCode::MOD; break;
+        case TokenType::EQUAL_EQUAL: op = OpCode::EQ; break;
+        case TokenType::BANG_EQUAL: op = OpCode::NE; break;
+        case TokenType::LESS: op = OpCode::LT; break;
+        case TokenType::LESS_EQUAL: op = OpCode::LE; break;
+        case TokenType::GREATER: op = OpCode::GT; break;
+        case TokenType::GREATER_EQUAL: op = OpCode::GE; break;
+        default:
+            throw CompileError("Unsupported binary operator " + tokenTypeToString(node->getOp()->getOp()) + '.');
+    }
+
+    uint8_t left = expression(node->getLeft());
+    uint8_t right = expression(node->getRight());
+    emit(encodeABC(op, reg, left, right));
+}
+
+void Compiler::logical(BinaryNode* node, uint8_t reg) {
+    // the left operand is written before the right one is read, never short-circuit into a variable
+    uint8_t target = isLocal(reg) ? allocateRegister() : reg;
+
+    expressionTo(node->getLeft(), target);
+    size_t jump = emitJump(node->getOp()->getOp() == TokenType::AND ? OpCode::JMPIFNOT : OpCode::JMPIF, target);
+    expressionTo(node->getRight(), target);
+    patchJump(jump);
+
+    if (target != reg) {
+        emit(encodeABC(OpCode::MOVE, reg, target, 0));
+    }
+}
+
+void Compiler::assignment(BinaryNode* node, int reg) {
+    auto target = node->getLeft();
+
+    if (target->getType() == NodeType::VARIABLE) {
+        auto var = static_cast<VariableNode*>(target)->getVar();
+        if (!var->isGlobal()) {
+            auto slot = static_cast<uint8_t>(var->getSlot());
+            expressionTo(node->getRight(), slot);
+            if (reg >= 0 && reg != slot) {
+                emit(encodeABC(OpCode::MOVE, static_cast<uint8_t>(reg), slot, 0));
+            }
+            return;
+        }
+
+        uint8_t value = reg >= 0 ? static_cast<uint8_t>(reg) : allocateRegister();
+        expressionTo(node->getRight(), value);
+        emit(encodeABx(OpCode::SETGLOBAL, value, static_cast<uint16_t>(var->getSlot())));
+        return;
+    }
+
+    auto attribute = static_cast<BinaryNode*>(target);
+    auto own = attribute->getOp()->getOp() == TokenType::DOT ? ownAttribute(attribute) : nullptr;
+    uint8_t value;
+    if (attribute->getOp()->getOp() == TokenType::LEFT_BRACKET) {
+        uint8_t array = expression(attribute->getLeft());
+        uint8_t index = expression(attribute->getRight());
+        value = expression(node->getRight());
+        emit(encodeABC(OpCode::SETINDEX, array, index, value));
+    } else if (own != nullptr && own->isStatic()) {
+        value = expression(node->getRight());
+        emit(encodeABx(OpCode::SETSTATIC, value, static_cast<uint16_t>(own->getSlot())));
+        emitExtra(classIndices.at(currentClass));
+    } else if (own != nullptr) {
+        uint8_t object = expression(attribute->getLeft());
+        value = expression(node->getRight());
+        emit(encodeABC(OpCode::SETFIELD, object, value, static_cast<uint8_t>(own->getSlot())));
+    } else {
+        uint8_t object = expression(attribute->getLeft());
+        value = expression(node->getRight());
+        emit(encodeABC(OpCode::SETATTR, object, value, 0));
+        emitExtra(name(static_cast<IdentifierNode*>(attribute->getRight())->getName()));
+    }
+    if (reg >= 0 && reg != value) {
+        emit(encodeABC(OpCode::MOVE, static_cast<uint8_t>(reg), value, 0));
+    }
+}
+
+void Compiler::call(FunctionCallNode* node, uint8_t reg) {
+    uint8_t base = allocateRegister();
+
+    if (node->getFunction() != nullptr) {
+        uint8_t argc = arguments(node->getArgs(), base);
+        emit(encodeABC(OpCode::CALL, base, argc, 0));
+        emitExtra(functionIndex(node->getFunction()));
+    } else if (node->getBuiltin() != nullptr) {
+        uint8_t argc = arguments(node->getArgs(), base);
+        emit(encodeABC(OpCode::CALLNATIVE, base, argc, 0));
+        emitExtra(builtinIndex(node->getBuiltin()));
+    } else if (node->getInstantiatedClass() != nullptr) {
+        uint8_t argc = arguments(node->getArgs(), base + 1);
+        emit(encodeABC(OpCode::NEW, base, argc, 0));
+        emitExtra(classIndex(node->getInstantiatedClass()));
+    } else {
+        throw CompileError("Undefined function '" + node->getCallee() + "'.");
+    }
+
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base, 0));
+    }
+}
+
+// the arguments are laid out like those of a call, the task handle replaces the first
+void Compiler::spawn(SpawnNode* node, uint8_t reg) {
+    auto call = node->getCall();
+    if (call->getFunction() == nullptr) {
+        throw CompileError(std::string("'") + node->keyword() + "' only runs functions, '" + call->getCallee() + "' is not one.");
+    }
+
+    uint8_t base = allocateRegister();
+    uint8_t argc = arguments(call->getArgs(), base);
+    emit(encodeABC(node->isCoroutine() ? OpCode::ASYNC : OpCode::SPAWN, base, argc, 0));
+    emitExtra(functionIndex(call->getFunction()));
+
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base, 0));
+    }
+}
+
+// the elements go above the array's register like the arguments of NEW
+void Compiler::array(ArrayNode* node, uint8_t reg) {
+    uint8_t base = allocateRegister();
+    uint8_t count = arguments(node->getElements(), base + 1);
+    auto type = declaredElementType(node->getElementType());
+    emit(encodeABC(OpCode::NEWARRAY, base, count, type ? static_cast<uint8_t>(*type) + 1 : 0));
+
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base, 0));
+    }
+}
+
+// keys and values alternate above the map's register
+void Compiler::map(MapNode* node, uint8_t reg) {
+    uint8_t base = allocateRegister();
+    uint8_t count = arguments(node->getEntries(), base + 1);
+    emit(encodeABC(OpCode::NEWMAP, base, count / 2, 0));
+
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base, 0));
+    }
+}
+
+void Compiler::methodCall(MethodCallNode* node, uint8_t reg) {
+    uint8_t base = allocateRegister();
+    expressionTo(node->getReceiver(), base);
+    uint8_t argc = arguments(node->getArgs(), base + 1);
+
+    // a call through 'this' with the right arity can't fail to resolve
+    auto method = isThis(node->getReceiver()) ? currentClass->getMethod(node->getCallee()) : nullptr;
+    if (node->getFunction() != nullptr) {
+        emit(encodeABC(OpCode::INVOKEDIRECT, base, argc, 0));
+        emitExtra(methodIndex(node->getFunction()));
+    } else if (method != nullptr && method->getParams().size() == argc) {
+        emit(encodeABC(OpCode::INVOKEVT, base, argc, 0));
+        emitExtra(program->classes[classIndices.at(currentClass)]->methodIndices.at(node->getCallee()));
+    } else {
+        emit(encodeABC(OpCode::INVOKE, base, argc, 0));
+        emitExtra(name(node->getCallee()));
+    }
+
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base, 0));
+    }
+}
+
+uint8_t Compiler::arguments(std::vector<Node*> const& args, uint8_t base) {
+    // arguments occupy consecutive registers and become the callee's first slots
+    freeRegister = base;
+    for (auto arg : args) {
+        uint8_t reg = allocateRegister();
+        expressionTo(arg, reg);
+    }
+    return static_cast<uint8_t>(args.size());
+}
+
+// Whether node is the receiver of the compiled method. Its class is known up front,
+// as 'this' can't be reassigned and classes have no subclasses.
+bool Compiler::isThis(Node* node) const {
+    if (currentClass == nullptr || node->getType() != NodeType::VARIABLE) {
+        return false;
+    }
+    auto var = static_cast<VariableNode*>(node)->getVar();
+    return var->getName() == "this" && !var->isGlobal() && var->getSlot() == 0;
+}
+
+// Attribute of the compiled method's own class accessed through 'this'
+VariableDeclarationNode* Compiler::ownAttribute(BinaryNode* dot) const {
+    if (!isThis(dot->getLeft())) {
+        return nullptr;
+    }
+
+    auto attribute = currentClass->getAttribute(static_cast<IdentifierNode*>(dot->getRight())->getName());
+    if (attribute == nullptr || (!attribute->isStatic() && attribute->getSlot() > UINT8_MAX)) {
+        return nullptr; // left to GETATTR, which also reports unknown attributes
+    }
+    return attribute;
+}
+
+// Emission
+
+size_t Compiler::emit(Instruction instruction) {
+    auto& lines = current->lineStorage;
+    if (line != 0 && (lines.empty() || lines.back().line != static_cast<uint32_t>(line))) {
+        lines.push_back({ static_cast<uint32_t>(current->codeStorage.size()), static_cast<uint32_t>(line) });
+    }
+    current->codeStorage.emplace_back(instruction);
+    return current->codeStorage.size() - 1;
+}
+
+void Compiler::emitExtra(uint32_t operand) {
+    emit(encodeExtra(operand));
+}
+
+size_t Compiler::emitJump(OpCode op, uint8_t reg) {
+    return emit(encodeAsBx(op, reg, 0));
+}
+
+void Compiler::patchJump(size_t at) {
+    auto offset = static_cast<int64_t>(current->codeStorage.size()) - static_cast<int64_t>(at) - 1;
+    if (offset > SBX_MAX) {
+        throw CompileError("Too much code to jump over in '" + current->name + "'.");
+    }
+    auto instruction = current->codeStorage[at];
+    current->codeStorage[at] = encodeAsBx(getOp(instruction), getA(instruction), static_cast<int16_t>(offset));
+}
+
+void Compiler::emitLoop(size_t start) {
+    auto offset = static_cast<int64_t>(start) - static_cast<int64_t>(current->codeStorage.size()) - 1;
+    if (offset < SBX_MIN) {
+        throw CompileError("Loop body too large in '" + current->name + "'.");
+    }
+    emit(encodeAsBx(OpCode::JMP, 0, static_cast<int16_t>(offset)));
+}
+
+uint16_t Compiler::constant(Value value) {
+    if (!value.isObject()) {
+        auto it = numberConstants.find(value.bits);
+        if (it != numberConstants.end()) {
+            return it->second;
+        }
+    }
+
+    if (current->constantStorage.size() > UINT16_MAX) {
+        throw CompileError("Too many constants in '" + current->name + "'.");
+    }
+
+    auto index = static_cast<uint16_t>(current->constantStorage.size());
+    current->constantStorage.emplace_back(value);
+    if (!value.isObject()) {
+        numberConstants.emplace(value.bits, index);
+    }
+    return index;
+}
+
+uint32_t Compiler::name(const std::string& name) {
+    auto it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+
+    auto index = static_cast<uint32_t>(current->names.size());
+    current->names.emplace_back(name);
+    names.emplace(name, index);
+    return index;
+}
+
+uint8_t Compiler::allocateRegister() {
+    if (freeRegister >= MAX_REGISTERS) {
+        throw CompileError("Expression too complex in '" + current->name + "', out of registers.");
+    }
+
+    int reg = freeRegister++;
+    current->frameSize = std::max(current->frameSize, freeRegister);
+    return static_cast<uint8_t>(reg);
+}
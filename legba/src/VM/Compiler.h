@@ -0,0 +1,92 @@
+#ifndef LEGBA_VM_COMPILER_H
+#define LEGBA_VM_COMPILER_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "ASTNode/ASTNode.h"
+#include "VM/Program.h"
+
+// Compiles the parsed AST into register based bytecode. Parser assigned variable
+// slots become the first registers of a frame, temporaries are allocated above them.
+class Compiler {
+public:
+    Compiler() = default;
+
+    void compile(ScopeNode* rootScope, int globalCount, Program& program);
+
+    // Compiling a module, see Build/ModuleBuilder.h: calls and instantiations of what
+    // the modules it imports declare become stubs listed in Program::importedFunctions
+    // and importedClasses. moduleOf gives the path of the module declaring a
+    // FunctionNode, MethodNode or ClassNode.
+    void setImports(std::function<std::string(Node*)> moduleOf) { this->moduleOf = std::move(moduleOf); }
+
+private:
+    // Declarations
+    void declare(ScopeNode* rootScope);
+    void function(FunctionProto* proto, Node* body, int localCount, ClassNode* klass = nullptr);
+
+    // Statements
+    void statement(Node* node);
+    void scope(ScopeNode* node);
+    void ifStatement(IfNode* node);
+    void whileStatement(WhileNode* node);
+    void forStatement(ForNode* node);
+    void returnStatement(UnaryNode* node);
+    bool tailCall(FunctionCallNode* node);
+    void variableDeclaration(VariableDeclarationNode* node);
+    void discard(Node* node);
+
+    // Expressions
+    uint8_t expression(Node* node);
+    void expressionTo(Node* node, uint8_t reg);
+    void unary(UnaryNode* node, uint8_t reg);
+    void binary(BinaryNode* node, uint8_t reg);
+    void logical(BinaryNode* node, uint8_t reg);
+    void assignment(BinaryNode* node, int reg);
+    void call(FunctionCallNode* node, uint8_t reg);
+    void spawn(SpawnNode* node, uint8_t reg);
+    void methodCall(MethodCallNode* node, uint8_t reg);
+    void array(ArrayNode* node, uint8_t reg);
+    void map(MapNode* node, uint8_t reg);
+    uint8_t arguments(std::vector<Node*> const& args, uint8_t base);
+    bool isThis(Node* node) const;
+    VariableDeclarationNode* ownAttribute(BinaryNode* dot) const;
+
+    // Indices of callees and classes, imported ones get a stub
+    int functionIndex(FunctionNode* func);
+    int methodIndex(MethodNode* method);
+    int classIndex(ClassNode* klass);
+    int importedFunction(Node* declaration, const std::string& name, int paramCount, bool isMethod);
+
+    // Emission
+    size_t emit(Instruction instruction);
+    void emitExtra(uint32_t operand);
+    size_t emitJump(OpCode op, uint8_t reg);
+    void patchJump(size_t at);
+    void emitLoop(size_t start);
+    uint16_t constant(Value value);
+    uint32_t name(const std::string& name);
+    uint8_t allocateRegister();
+    bool isLocal(uint8_t reg) const { return reg < localCount; }
+
+private:
+    Program* program = nullptr;
+    FunctionProto* current = nullptr;
+    ClassNode* currentClass = nullptr; // of the method being compiled
+    int localCount = 0;
+    int freeRegister = 0;
+    int line = 0; // source line of the statement being compiled
+
+    std::unordered_map<FunctionNode*, int> functionIndices;
+    std::unordered_map<MethodNode*, int> methodIndices;
+    std::unordered_map<ClassNode*, int> classIndices;
+    std::unordered_map<Node*, int> importIndices;
+    std::function<std::string(Node*)> moduleOf;
+    std::unordered_map<uint64_t, uint16_t> numberConstants;
+    std::unordered_map<std::string, uint16_t> stringConstants;
+    std::unordered_map<std::string, uint32_t> names;
+};
+
+#endif
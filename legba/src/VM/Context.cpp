@@ -0,0 +1,56 @@
+#include "Context.h"
+
+namespace {
+
+// Makes heap the calling thread's for as long as it lives.
+class UseHeap {
+public:
+    explicit UseHeap(Heap& heap) : previous(&Heap::get()) { Heap::setCurrent(&heap); }
+    UseHeap(UseHeap const&) = delete;
+    UseHeap& operator=(UseHeap const&) = delete;
+    ~UseHeap() { Heap::setCurrent(previous == &Heap::mainHeap() ? nullptr : previous); }
+
+private:
+    Heap* previous;
+};
+
+}
+
+Context::Context(Program const& program) {
+    heap.configureLike(Heap::get());
+    // the VM registers its roots with the current heap
+    UseHeap use(heap);
+    vm = std::make_unique<VM>(program);
+}
+
+Context::~Context() {
+    UseHeap use(heap);
+    vm.reset();
+}
+
+// The scheduler belongs to the thread that started it, so it doesn't outlive the
+// run. Finishing the tasks left may collect, the result has to be a root meanwhile.
+template <typename Body>
+Value Context::enter(Body const& body) {
+    UseHeap use(heap);
+    try {
+        Root result(body());
+        vm->stopTasks();
+        return result.value;
+    } catch (...) {
+        vm->stopTasks();
+        throw;
+    }
+}
+
+Value Context::run() {
+    return enter([this] { return vm->run(); });
+}
+
+Value Context::call(uint32_t function, Value const* args, size_t count) {
+    return enter([&] { return vm->call(function, args, count); });
+}
+
+Value Context::with(std::function<Value()> const& body) {
+    return enter(body);
+}
@@ -0,0 +1,47 @@
+#ifndef LEGBA_VM_CONTEXT_H
+#define LEGBA_VM_CONTEXT_H
+
+#include <functional>
+
+#include "Runtime/Heap.h"
+#include "VM/Program.h"
+#include "VM/VM.h"
+
+// Everything one run of a compiled program changes: the globals and static
+// attributes, the stack, the heap and the code quickened from the types it saw.
+// The program itself is only read, by creating contexts, so it can be compiled or
+// loaded once and run by any number of contexts on as many threads without locks.
+// It has to outlive them, and no VM may run it directly meanwhile.
+//
+// A context runs on one thread at a time, which may differ between runs. The heap
+// of the thread creating the first context decides the heap settings of all.
+class Context {
+public:
+    explicit Context(Program const& program);
+    Context(Context const&) = delete;
+    Context& operator=(Context const&) = delete;
+    ~Context();
+
+    // Runs the top level code on the calling thread. Tasks it spawned are finished
+    // when it returns.
+    Value run();
+    // Calls a function of the program like run, see VM::findFunction.
+    Value call(uint32_t function, Value const* args, size_t count);
+    // Runs body like run runs the program, for hosts that create values in the heap
+    // and make many calls on the VM at once.
+    Value with(std::function<Value()> const& body);
+
+    // The engine, to turn the JIT off or get its stats. Its settings only take
+    // effect on the thread running it.
+    VM& getVM() { return *vm; }
+    Heap& getHeap() { return heap; }
+
+private:
+    template <typename Body>
+    Value enter(Body const& body);
+
+    Heap heap;
+    std::unique_ptr<VM> vm;
+};
+
+#endif
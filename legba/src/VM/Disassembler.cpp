@@ -0,0 +1,190 @@
+#include "Disassembler.h"
+
+#include <format>
+
+#include "Runtime/Builtins.h"
+
+const char* opCodeToString(OpCode op) {
+    switch (op) {
+#define LEGBA_OPCODE_NAME(name) case OpCode::name: return #name;
+        LEGBA_OPCODES(LEGBA_OPCODE_NAME)
+#undef LEGBA_OPCODE_NAME
+        case OpCode::COUNT: break;
+    }
+    return "UNKNOWN";
+}
+
+// class a method belongs to, for naming the fields it accesses
+static ClassObject* methodClass(Program const& program, FunctionProto const& proto) {
+    for (auto klass : program.classes) {
+        for (auto method : klass->vtable) {
+            if (method == &proto) {
+                return klass;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static std::string constantToString(Value value) {
+    if (value.isObject()) {
+        return '"' + value.toString() + '"';
+    }
+    return value.toString();
+}
+
+void disassemble(Program const& program, std::ostream& os) {
+    for (auto proto : program.functions) {
+        disassembleFunction(program, *proto, os);
+    }
+}
+
+void disassembleFunction(Program const& program, FunctionProto const& proto, std::ostream& os) {
+    os << std::format("== {} (params: {}, registers: {}, constants: {}) ==\n",
+        proto.name, proto.paramCount, proto.frameSize, proto.constants.size());
+
+    size_t offset = 0;
+    while (offset < proto.code.size()) {
+        offset = disassembleInstruction(program, proto, offset, os);
+    }
+    os << '\n';
+}
+
+size_t disassembleInstruction(Program const& program, FunctionProto const& proto, size_t offset, std::ostream& os) {
+    Instruction i = proto.code[offset];
+    OpCode op = getOp(i);
+    uint32_t extra = offset + 1 < proto.code.size() ? getExtra(proto.code[offset + 1]) : 0;
+
+    // source line, or '|' while it stays the same
+    int line = proto.lineAt(offset);
+    if (offset > 0 && line == proto.lineAt(offset - 1)) {
+        os << std::format("{:04}    | {:<10} ", offset, opCodeToString(op));
+    } else {
+        os << std::format("{:04} {:4} {:<10} ", offset, line, opCodeToString(op));
+    }
+
+    switch (op) {
+        case OpCode::LOADK:
+            os << std::format("R{} K{} ; {}", getA(i), getBx(i), constantToString(proto.constants[getBx(i)]));
+            break;
+        case OpCode::LOADNIL:
+        case OpCode::RETURN:
+            os << std::format("R{}", getA(i));
+            break;
+        case OpCode::LOADBOOL:
+            os << std::format("R{} {}", getA(i), getB(i) != 0 ? "true" : "false");
+            break;
+        case OpCode::MOVE:
+        case OpCode::NOT:
+        case OpCode::NEG:
+            os << std::format("R{} R{}", getA(i), getB(i));
+            break;
+        case OpCode::GETGLOBAL:
+        case OpCode::SETGLOBAL:
+            os << std::format("R{} G{}", getA(i), getBx(i));
+            break;
+        case OpCode::JMP:
+            os << std::format("-> {}", static_cast<int64_t>(offset) + 1 + getSBx(i));
+            break;
+        case OpCode::JMPIF:
+        case OpCode::JMPIFNOT:
+            os << std::format("R{} -> {}", getA(i), static_cast<int64_t>(offset) + 1 + getSBx(i));
+            break;
+        case OpCode::CALL:
+        case OpCode::TAILCALL:
+        case OpCode::SPAWN:
+        case OpCode::ASYNC:
+            os << std::format("R{} {} ; {}", getA(i), getB(i), program.functions[extra]->name);
+            os << '\n';
+            return offset + 2;
+        case OpCode::CALLNATIVE:
+            os << std::format("R{} {} ; {}", getA(i), getB(i), extra < BUILTIN_COUNT ? BUILTINS[extra].name : "?");
+            os << '\n';
+            return offset + 2;
+        case OpCode::INVOKE:
+            os << std::format("R{} {} ; .{}", getA(i), getB(i), proto.names[extra]);
+            os << '\n';
+            return offset + 2;
+        case OpCode::INVOKEDIRECT:
+            os << std::format("R{} {} ; {}", getA(i), getB(i), program.functions[extra]->name);
+            os << '\n';
+            return offset + 2;
+        case OpCode::INVOKEVT: {
+            auto klass = methodClass(program, proto);
+            bool named = klass != nullptr && extra < klass->vtable.size();
+            os << std::format("R{} {} ; {} <vtable {}>", getA(i), getB(i), named ? klass->vtable[extra]->name : "?", extra);
+            os << '\n';
+            return offset + 2;
+        }
+        case OpCode::INVOKE_MONO:
+        case OpCode::INVOKE_POLY: {
+            auto const& cache = proto.invokeCaches[extra];
+            std::string classes;
+            for (int e = 0; e < cache.count; e++) {
+                classes += (e == 0 ? "" : ",") + cache.klass[e]->name;
+            }
+            os << std::format("R{} {} ; .{} <{}>", getA(i), getB(i), proto.names[cache.name], classes);
+            os << '\n';
+            return offset + 2;
+        }
+        case OpCode::NEW:
+            os << std::format("R{} {} ; {}", getA(i), getB(i), program.classes[extra]->name);
+            os << '\n';
+            return offset + 2;
+        case OpCode::GETATTR:
+            os << std::format("R{} R{} ; .{}", getA(i), getB(i), proto.names[extra]);
+            os << '\n';
+            return offset + 2;
+        case OpCode::SETATTR:
+            os << std::format("R{} R{} ; .{}", getA(i), getB(i), proto.names[extra]);
+            os << '\n';
+            return offset + 2;
+        case OpCode::GETATTR_MONO:
+        case OpCode::SETATTR_MONO: {
+            auto const& cache = proto.attributeCaches[extra];
+            os << std::format("R{} R{} ; .{} <{}:{}>", getA(i), getB(i), proto.names[cache.name], cache.klass->name, cache.index);
+            os << '\n';
+            return offset + 2;
+        }
+        case OpCode::GETFIELD:
+        case OpCode::SETFIELD: {
+            auto klass = methodClass(program, proto);
+            bool named = klass != nullptr && getC(i) < klass->fieldNames.size();
+            os << std::format("R{} R{} {} ; .{}", getA(i), getB(i), getC(i), named ? klass->fieldNames[getC(i)] : "?");
+            break;
+        }
+        case OpCode::GETSTATIC:
+        case OpCode::SETSTATIC: {
+            auto klass = program.classes[extra];
+            os << std::format("R{} {} ; {}.{}", getA(i), getBx(i), klass->name, klass->staticNames[getBx(i)]);
+            os << '\n';
+            return offset + 2;
+        }
+        case OpCode::NEWARRAY: {
+            static const char* const types[] = { "", "int[]", "double[]", "array" };
+            os << std::format("R{} {}", getA(i), getB(i));
+            if (getC(i) != 0) {
+                os << " ; " << (getC(i) < std::size(types) ? types[getC(i)] : "?");
+            }
+            break;
+        }
+        case OpCode::NEWMAP:
+            os << std::format("R{} {}", getA(i), getB(i));
+            break;
+        case OpCode::LOADI:
+        case OpCode::ADDI_II:
+        case OpCode::SUBI_II:
+            os << std::format("R{} {}", getA(i), getSBx(i));
+            break;
+        case OpCode::RETURNNIL:
+        case OpCode::EXTRA:
+        case OpCode::COUNT:
+            break;
+        default:
+            os << std::format("R{} R{} R{}", getA(i), getB(i), getC(i));
+            break;
+    }
+
+    os << '\n';
+    return offset + 1;
+}
@@ -0,0 +1,12 @@
+#ifndef LEGBA_VM_DISASSEMBLER_H
+#define LEGBA_VM_DISASSEMBLER_H
+
+#include <ostream>
+
+#include "VM/Program.h"
+
+void disassemble(Program const& program, std::ostream& os);
+void disassembleFunction(Program const& program, FunctionProto const& proto, std::ostream& os);
+size_t disassembleInstruction(Program const& program, FunctionProto const& proto, size_t offset, std::ostream& os);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef LEGBA_VM_INSTRUCTION_H
+#define LEGBA_VM_INSTRUCTION_H
+
+#include <cstdint>
+
+// Instructions are 32 bit words in one of three formats:
+//   iABC:  op:8 A:8 B:8 C:8
+//   iABx:  op:8 A:8 Bx:16
+//   iAsBx: op:8 A:8 sBx:16 (signed)
+// Registers are frame relative. Calls, spawns, attribute accesses by name, static
+// attribute accesses and instantiations are followed by an EXTRA word holding a 32 bit
+// function, builtin, name or class index.
+#define LEGBA_OPCODES(X) \
+    X(LOADK)      /* iABx  R[A] = K[Bx] */ \
+    X(LOADI)      /* iAsBx R[A] = sBx */ \
+    X(LOADNIL)    /* iABC  R[A] = nil */ \
+    X(LOADBOOL)   /* iABC  R[A] = B != 0 */ \
+    X(MOVE)       /* iABC  R[A] = R[B] */ \
+    X(GETGLOBAL)  /* iABx  R[A] = G[Bx] */ \
+    X(SETGLOBAL)  /* iABx  G[Bx] = R[A] */ \
+    X(ADD)        /* iABC  R[A] = R[B] + R[C] */ \
+    X(SUB)        /* iABC  R[A] = R[B] - R[C] */ \
+    X(MUL)        /* iABC  R[A] = R[B] * R[C] */ \
+    X(DIV)        /* iABC  R[A] = R[B] / R[C] */ \
+    X(MOD)        /* iABC  R[A] = R[B] % R[C] */ \
+    X(EQ)         /* iABC  R[A] = R[B] == R[C] */ \
+    X(NE)         /* iABC  R[A] = R[B] != R[C] */ \
+    X(LT)         /* iABC  R[A] = R[B] < R[C] */ \
+    X(LE)         /* iABC  R[A] = R[B] <= R[C] */ \
+    X(GT)         /* iABC  R[A] = R[B] > R[C] */ \
+    X(GE)         /* iABC  R[A] = R[B] >= R[C] */ \
+    X(NOT)        /* iABC  R[A] = !R[B] */ \
+    X(NEG)        /* iABC  R[A] = -R[B] */ \
+    X(JMP)        /* iAsBx pc += sBx */ \
+    X(JMPIF)      /* iAsBx if R[A] then pc += sBx */ \
+    X(JMPIFNOT)   /* iAsBx if not R[A] then pc += sBx */ \
+    X(CALL)       /* iABC  R[A] = F[EXTRA](R[A] .. R[A+B-1]) */ \
+    X(TAILCALL)   /* iABC  return F[EXTRA](R[A] .. R[A+B-1]), the callee reuses the frame */ \
+    X(CALLNATIVE) /* iABC  R[A] = BUILTINS[EXTRA](R[A] .. R[A+B-1]) */ \
+    X(SPAWN)      /* iABC  R[A] = task running F[EXTRA](R[A] .. R[A+B-1]) */ \
+    X(ASYNC)      /* iABC  R[A] = coroutine running F[EXTRA](R[A] .. R[A+B-1]) */ \
+    X(INVOKE)     /* iABC  R[A] = R[A].N[EXTRA](R[A+1] .. R[A+B]) */ \
+    X(INVOKEVT)   /* iABC  R[A] = R[A].vtable[EXTRA](R[A+1] .. R[A+B]), R[A] is the method's receiver */ \
+    X(INVOKEDIRECT) /* iABC  R[A] = F[EXTRA](R[A] .. R[A+B]), method devirtualized at compile time */ \
+    X(NEW)        /* iABC  R[A] = new C[EXTRA](R[A+1] .. R[A+B]) */ \
+    X(GETATTR)    /* iABC  R[A] = R[B].N[EXTRA] */ \
+    X(SETATTR)    /* iABC  R[A].N[EXTRA] = R[B] */ \
+    X(GETFIELD)   /* iABC  R[A] = R[B].fields[C], R[B] is the method's receiver */ \
+    X(SETFIELD)   /* iABC  R[A].fields[C] = R[B], R[A] is the method's receiver */ \
+    X(GETSTATIC)  /* iABx  R[A] = C[EXTRA].statics[Bx] */ \
+    X(SETSTATIC)  /* iABx  C[EXTRA].statics[Bx] = R[A] */ \
+    X(NEWARRAY)   /* iABC  R[A] = [R[A+1] .. R[A+B]], C = 1 + declared ElementType or 0 */ \
+    X(GETINDEX)   /* iABC  R[A] = R[B][R[C]] */ \
+    X(SETINDEX)   /* iABC  R[A][R[B]] = R[C] */ \
+    X(NEWMAP)     /* iABC  R[A] = {R[A+1]: R[A+2], ..}, B entries */ \
+    X(RETURN)     /* iABC  return R[A] */ \
+    X(RETURNNIL)  /* iABC  return nil */ \
+    X(EXTRA)      /* operand of the previous instruction */ \
+    LEGBA_QUICK_OPCODES(X)
+
+// Specialized forms the VM rewrites generic instructions into once it has seen the
+// operand types of a site. The compiler never emits them; a failed type guard turns
+// the instruction back into its generic form. The _JMP forms fuse a comparison with
+// the JMPIFNOT following it, ADDI/SUBI fuse a LOADI with the ADD/SUB consuming it.
+#define LEGBA_QUICK_OPCODES(X) \
+    X(ADD_II) X(ADD_DD) X(SUB_II) X(SUB_DD) X(MUL_II) X(MUL_DD) X(DIV_DD) \
+    X(EQ_II) X(NE_II) X(LT_II) X(LE_II) X(GT_II) X(GE_II) \
+    X(LT_DD) X(LE_DD) X(GT_DD) X(GE_DD) \
+    X(EQ_II_JMP) X(NE_II_JMP) X(LT_II_JMP) X(LE_II_JMP) X(GT_II_JMP) X(GE_II_JMP) \
+    X(LT_DD_JMP) X(LE_DD_JMP) X(GT_DD_JMP) X(GE_DD_JMP) \
+    X(ADDI_II)    /* iAsBx R[A] = sBx; next ADD executed as R[B'] + sBx */ \
+    X(SUBI_II)    /* iAsBx R[A] = sBx; next SUB executed as R[B'] - sBx */ \
+    X(GETATTR_MONO) /* GETATTR with EXTRA indexing the proto's attribute caches */ \
+    X(SETATTR_MONO) /* SETATTR with EXTRA indexing the proto's attribute caches */ \
+    X(INVOKE_MONO)  /* INVOKE with EXTRA indexing the proto's invoke caches, one class */ \
+    X(INVOKE_POLY)  /* INVOKE_MONO that saw up to InvokeCache::SIZE receiver classes */ \
+    X(GETINDEX_I) X(GETINDEX_D) /* GETINDEX of an int[] or double[] */ \
+    X(SETINDEX_I) X(SETINDEX_D) /* SETINDEX into an int[] or double[] */
+
+enum class OpCode : uint8_t {
+#define LEGBA_OPCODE_ENUM(name) name,
+    LEGBA_OPCODES(LEGBA_OPCODE_ENUM)
+#undef LEGBA_OPCODE_ENUM
+    COUNT
+};
+
+constexpr int OPCODE_COUNT = static_cast<int>(OpCode::COUNT);
+
+using Instruction = uint32_t;
+
+constexpr int MAX_REGISTERS = 256;
+constexpr int SBX_MAX = INT16_MAX;
+constexpr int SBX_MIN = INT16_MIN;
+
+constexpr Instruction encodeABC(OpCode op, uint8_t a, uint8_t b, uint8_t c) {
+    return static_cast<uint32_t>(op) | (static_cast<uint32_t>(a) << 8) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 24);
+}
+
+constexpr Instruction encodeABx(OpCode op, uint8_t a, uint16_t bx) {
+    return static_cast<uint32_t>(op) | (static_cast<uint32_t>(a) << 8) | (static_cast<uint32_t>(bx) << 16);
+}
+
+constexpr Instruction encodeAsBx(OpCode op, uint8_t a, int16_t sbx) {
+    return encodeABx(op, a, static_cast<uint16_t>(sbx));
+}
+
+constexpr Instruction encodeExtra(uint32_t operand) {
+    return static_cast<uint32_t>(OpCode::EXTRA) | (operand << 8);
+}
+
+constexpr Instruction withOp(Instruction i, OpCode op) {
+    return (i & ~0xFFu) | static_cast<uint32_t>(op);
+}
+
+constexpr OpCode getOp(Instruction i) { return static_cast<OpCode>(i & 0xFF); }
+constexpr uint8_t getA(Instruction i) { return static_cast<uint8_t>(i >> 8); }
+constexpr uint8_t getB(Instruction i) { return static_cast<uint8_t>(i >> 16); }
+constexpr uint8_t getC(Instruction i) { return static_cast<uint8_t>(i >> 24); }
+constexpr uint16_t getBx(Instruction i) { return static_cast<uint16_t>(i >> 16); }
+constexpr int16_t getSBx(Instruction i) { return static_cast<int16_t>(i >> 16); }
+constexpr uint32_t getExtra(Instruction i) { return i >> 8; }
+
+const char* opCodeToString(OpCode op);
+
+#endif
@@ -0,0 +1,64 @@
+#include "Program.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "VM/Bytecode.h"
+
+void FunctionProto::viewStorage() {
+    code = codeStorage;
+    constants = constantStorage;
+    lines = lineStorage;
+}
+
+int FunctionProto::lineAt(size_t offset) const {
+    auto it = std::upper_bound(lines.begin(), lines.end(), offset, [](size_t offset, LineEntry const& entry) {
+        return offset < entry.offset;
+    });
+    return it == lines.begin() ? 0 : static_cast<int>((it - 1)->line);
+}
+
+Program::~Program() {
+    for (auto func : functions) {
+        delete func;
+    }
+    for (auto klass : classes) {
+        delete klass;
+    }
+    if (mapping != nullptr) {
+        unmapBytecode(mapping, mappingSize);
+    }
+}
+
+std::unique_ptr<Program> Program::clone() const {
+    auto copy = std::make_unique<Program>();
+    copy->mainFunction = mainFunction;
+    copy->globalCount = globalCount;
+
+    std::unordered_map<FunctionProto*, FunctionProto*> protos;
+    for (auto func : functions) {
+        auto proto = new FunctionProto();
+        proto->name = func->name;
+        proto->paramCount = func->paramCount;
+        proto->isMethod = func->isMethod;
+        proto->frameSize = func->frameSize;
+        proto->names = func->names;
+        proto->codeStorage.assign(func->code.begin(), func->code.end());
+        proto->code = proto->codeStorage;
+        proto->constants = func->constants;
+        proto->lines = func->lines;
+        protos.emplace(func, proto);
+        copy->functions.push_back(proto);
+    }
+
+    for (auto klass : classes) {
+        auto object = new ClassObject(*klass);
+        object->constructor = klass->constructor != nullptr ? protos.at(klass->constructor) : nullptr;
+        for (auto& method : object->vtable) {
+            method = protos.at(method);
+        }
+        std::fill(object->statics.begin(), object->statics.end(), Value::nil());
+        copy->classes.push_back(object);
+    }
+    return copy;
+}
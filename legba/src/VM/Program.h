@@ -0,0 +1,123 @@
+#ifndef LEGBA_VM_PROGRAM_H
+#define LEGBA_VM_PROGRAM_H
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "VM/Instruction.h"
+#include "Runtime/Value.h"
+#include "Runtime/Object.h"
+
+// Operand types observed at an instruction, accumulated in FunctionProto::feedback.
+// A site is quickened while exactly one of INT or DOUBLE has been seen, any other
+// combination keeps it generic for good.
+enum Feedback : uint8_t {
+    FEEDBACK_INT = 1,
+    FEEDBACK_DOUBLE = 2,
+    FEEDBACK_OTHER = 4
+};
+
+// Monomorphic inline cache of a quickened attribute access.
+struct AttributeCache {
+    ClassObject* klass;
+    int index;        // field index in klass' layout
+    uint32_t name;    // name operand of the generic instruction, restored on deopt
+};
+
+// Inline cache of a quickened method call site: the receiver classes seen so far and
+// the methods they resolved to. INVOKE_MONO only checks the first entry.
+struct InvokeCache {
+    static constexpr int SIZE = 4;
+
+    ClassObject* klass[SIZE];
+    FunctionProto* target[SIZE];
+    int count;
+    uint32_t name;    // name operand of the generic instruction, restored once megamorphic
+};
+
+// First instruction of a run of instructions compiled from the same source line.
+struct LineEntry {
+    uint32_t offset;
+    uint32_t line;
+};
+
+// Entry of JIT compiled code: runs the function from the instruction at offset and
+// returns the offset the interpreter continues at, see JIT/JIT.h.
+using JitFunction = uint32_t (*)(Value* base, Value* globals, uint32_t offset);
+
+struct FunctionProto {
+    std::string name;
+    int paramCount = 0;        // declared parameters, 'this' not included
+    bool isMethod = false;     // methods receive 'this' in R[0]
+    int frameSize = 0;         // registers used by the frame: locals first, temporaries after
+
+    // Code, constants and line table view either the storage vectors below, filled
+    // by the compiler, or a private mapping of a .legc file, see Bytecode.h. Both
+    // are writable, quickening rewrites code in place.
+    std::span<Instruction> code;
+    std::span<Value> constants;
+    std::span<const LineEntry> lines;
+    std::vector<std::string> names;
+
+    std::vector<Instruction> codeStorage;
+    std::vector<Value> constantStorage;
+    std::vector<LineEntry> lineStorage;
+
+    void viewStorage();
+    int lineAt(size_t offset) const; // 0 if unknown
+
+    // Filled in while running: operand types seen per instruction and the caches
+    // of quickened attribute and method call sites.
+    std::vector<uint8_t> feedback;
+    std::vector<AttributeCache> attributeCaches;
+    std::vector<InvokeCache> invokeCaches;
+
+    // Baseline JIT state
+    JitFunction jitCode = nullptr;
+    uint32_t hotness = 0;           // calls and loop iterations run by the interpreter
+    uint32_t jitGuardFailures = 0;  // since the current code was installed
+    int jitCompiles = 0;
+    bool jitDisabled = false;
+};
+
+// Result of compiling a script: every function and method as a FunctionProto and
+// one ClassObject per class. The top level code is compiled into its own proto.
+// VMs specialize the program they run, those made for a Context run copies instead.
+struct Program {
+    Program() = default;
+    Program(Program const&) = delete;
+    Program& operator=(Program const&) = delete;
+    ~Program();
+
+    // Copy of the code as it is now with fresh feedback and caches, and classes with
+    // nil statics, for another VM to specialize on its own. Constants and line tables
+    // are shared, this program has to outlive the copy.
+    std::unique_ptr<Program> clone() const;
+
+    std::vector<FunctionProto*> functions;
+    std::vector<ClassObject*> classes;
+    int mainFunction = 0;
+    int globalCount = 0;
+
+    // A function or class of another module, see Build/ModuleBuilder.h. Compiling a
+    // module puts a stub at index in its place, linking it replaces the stub.
+    // Methods are named "Class.method" like their protos.
+    struct Import {
+        int index;
+        std::string module;
+        std::string name;
+    };
+    std::vector<Import> importedFunctions;
+    std::vector<Import> importedClasses;
+
+    // modules linked into this program, their code and constants stay with them
+    std::vector<std::unique_ptr<Program>> modules;
+
+    // loaded .legc file the functions point into, unmapped with the program
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+};
+
+#endif
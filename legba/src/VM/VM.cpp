@@ -0,0 +1,1229 @@
+#include "VM.h"
+
+#include <algorithm>
+#include <format>
+#include <optional>
+
+#include "Error.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Builtins.h"
+#include "Runtime/Kernels.h"
+#include "Runtime/Map.h"
+#include "Runtime/Operations.h"
+
+// Threaded dispatch through a label table where the compiler supports it, define
+// LEGBA_NO_COMPUTED_GOTO to force the portable switch loop.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(LEGBA_NO_COMPUTED_GOTO)
+#define LEGBA_COMPUTED_GOTO
+#endif
+
+VM::VM(Program* program, bool owned)
+    : ownedProgram(owned ? program : nullptr), program(*program),
+      stack(static_cast<Value*>(::operator new(STACK_SIZE * sizeof(Value)))), globals(program->globalCount), frames(), opCounts() {
+    frames.reserve(256);
+    for (auto proto : program->functions) {
+        proto->feedback.resize(proto->code.size(), 0);
+    }
+    jitEnabled = JIT::isSupported();
+    gcRoots = Heap::get().addRoots([this](Heap& heap) { visitRoots(heap); });
+}
+
+// The code is copied for the workers before this VM quickens any of it.
+VM::VM(Program& program) : VM(&program, false) {
+    for (auto proto : program.functions) {
+        if (std::any_of(proto->code.begin(), proto->code.end(), [](Instruction i) { return getOp(i) == OpCode::SPAWN; })) {
+            ownedTaskProgram = program.clone();
+            taskProgram = ownedTaskProgram.get();
+            break;
+        }
+    }
+}
+
+VM::VM(std::unique_ptr<Program> program) : VM(program.release(), true) {}
+
+VM::VM(Program const& shared) : VM(shared.clone().release(), true) {
+    taskProgram = &shared;
+}
+
+VM::~VM() {
+    // the workers may still run tasks of this VM's
+    scheduler.reset();
+    Heap::get().removeRoots(gcRoots);
+    // the compiled code dies with the JIT
+    for (auto proto : program.functions) {
+        proto->jitCode = nullptr;
+    }
+}
+
+// Every register of an active frame holds a valid value, calls clear the ones their
+// arguments don't fill, so the frames are exact maps of the stack.
+void VM::visitRoots(Heap& heap) {
+    for (auto const& frame : frames) {
+        heap.visit(frame.base, frame.base + frame.proto->frameSize);
+    }
+    heap.visit(globals.data(), globals.data() + globals.size());
+    for (auto klass : program.classes) {
+        heap.visit(klass->statics.data(), klass->statics.data() + klass->statics.size());
+    }
+    heap.visit(suspended.data(), suspended.data() + suspended.size());
+    for (auto const& set : coroutineSets) {
+        for (auto const& coroutine : set->all) {
+            heap.visit(coroutine->handle);
+            heap.visit(coroutine->registers.data(), coroutine->registers.data() + coroutine->registers.size());
+        }
+        heap.visit(set->mainResult);
+    }
+}
+
+static bool isArrayOf(Value value, ElementType type) {
+    return isObjectType(value, ObjectType::ARRAY) && asArray(value)->elementType == type;
+}
+
+// Indexing an int[] or a double[] with an int is what the quick forms handle.
+static uint8_t indexFeedback(Value array, Value index) {
+    if (!index.isInt()) return FEEDBACK_OTHER;
+    if (isArrayOf(array, ElementType::INT)) return FEEDBACK_INT;
+    if (isArrayOf(array, ElementType::DOUBLE)) return FEEDBACK_DOUBLE;
+    return FEEDBACK_OTHER;
+}
+
+// Counts a call or loop iteration of proto and compiles it once it is hot.
+bool VM::jitReady(FunctionProto* proto) {
+    if (proto->jitCode != nullptr) {
+        return true;
+    }
+    if (!jitEnabled || proto->jitDisabled || ++proto->hotness < JIT_THRESHOLD) {
+        return false;
+    }
+
+    proto->hotness = 0;
+    proto->jitGuardFailures = 0;
+    proto->jitCompiles++;
+    if (!jit.compile(program, *proto)) {
+        proto->jitDisabled = true;
+        return false;
+    }
+    jitCompiled++;
+    return true;
+}
+
+// Code whose type assumptions keep failing is thrown away. The interpreter has
+// deoptimized the sites in question by then, so the next compile sees them generic.
+void VM::jitGuardFailed(FunctionProto* proto) {
+    jitGuardExits++;
+    if (++proto->jitGuardFailures < JIT_MAX_GUARD_FAILURES) {
+        return;
+    }
+
+    proto->jitCode = nullptr;
+    if (proto->jitCompiles >= JIT_MAX_COMPILES) {
+        proto->jitDisabled = true;
+    }
+}
+
+void VM::printStats(std::ostream& os) const {
+    uint64_t total = 0;
+    std::vector<std::pair<uint64_t, int>> counts;
+    for (int op = 0; op < OPCODE_COUNT; op++) {
+        total += opCounts[op];
+        if (opCounts[op] != 0) {
+            counts.emplace_back(opCounts[op], op);
+        }
+    }
+    std::sort(counts.rbegin(), counts.rend());
+
+    os << "-- Executed " << total << " instructions, quickened " << quickened
+       << " sites, " << deoptimized << " deoptimizations, " << tailCalls << " tail calls" << std::endl;
+    if (jitEnabled) {
+        os << "-- JIT compiled " << jitCompiled << " functions, left compiled code " << jitExits
+           << " times (" << jitGuardExits << " failed type guards)" << std::endl;
+    }
+    os << "-- Array kernels: " << kernels::instructionSet() << ", map probing: " << maps::instructionSet() << std::endl;
+    uint64_t cached = methodMonoHits + methodPolyHits;
+    uint64_t invokes = cached + methodCacheMisses + methodLookups;
+    if (methodDirectCalls + methodVtableCalls + invokes != 0) {
+        os << "-- Method dispatch: " << methodDirectCalls << " direct, " << methodVtableCalls << " through vtables, "
+           << std::format("{:.2f}", invokes == 0 ? 0.0 : 100.0 * cached / invokes) << "% inline cache hits ("
+           << methodMonoHits << " monomorphic, " << methodPolyHits << " polymorphic), "
+           << methodLookups << " lookups by name" << std::endl;
+    }
+    for (auto const& [count, op] : counts) {
+        os << std::format("   {:<14} {:>12} {:>6.2f}%\n", opCodeToString(static_cast<OpCode>(op)), count, 100.0 * count / total);
+    }
+    if (coroutinesStarted != 0) {
+        os << "-- Coroutines: " << coroutinesStarted << " started, " << coroutineSwitches << " switches, at most "
+           << coroutinesPeak << " at once, taking " << coroutineBytesPeak << " bytes ("
+           << coroutineBytesPeak / std::max<size_t>(coroutinesPeak, 1) << " each)" << std::endl;
+    }
+    if (scheduler != nullptr) {
+        scheduler->printStats(os);
+    }
+}
+
+Value VM::run() {
+    frames.clear();
+    return execute(program.functions[program.mainFunction], stack.get());
+}
+
+Value VM::call(uint32_t function, Value const* args, size_t count) {
+    auto proto = program.functions[function];
+    Value* base = frames.empty() ? stack.get() : frames.back().base + frames.back().proto->frameSize;
+    if (base + proto->frameSize > stack.get() + STACK_SIZE) {
+        throw RuntimeError("Stack overflow.");
+    }
+    std::copy_n(args, count, base);
+    return execute(proto, base);
+}
+
+void VM::stopTasks() {
+    scheduler.reset();
+}
+
+void VM::saveEnvironment(std::vector<Value>& values) {
+    values.insert(values.end(), globals.begin(), globals.end());
+    for (auto klass : program.classes) {
+        values.insert(values.end(), klass->statics.begin(), klass->statics.end());
+    }
+}
+
+void VM::loadEnvironment(Value const* values) {
+    std::copy_n(values, globals.size(), globals.begin());
+    values += globals.size();
+    for (auto klass : program.classes) {
+        std::copy_n(values, klass->statics.size(), klass->statics.begin());
+        values += klass->statics.size();
+    }
+}
+
+// The task's frame goes above the frames of whatever joins it. The code below gets
+// its globals and statics back however the task ends.
+Value VM::runTask(uintptr_t function, Value* args, size_t count, Value const* environment) {
+    size_t saved = suspended.size();
+    saveEnvironment(suspended);
+    loadEnvironment(environment);
+
+    auto proto = program.functions[function];
+    Value* base = frames.empty() ? stack.get() : frames.back().base + frames.back().proto->frameSize;
+    Value result;
+    try {
+        if (base + proto->frameSize > stack.get() + STACK_SIZE) {
+            throw RuntimeError("Stack overflow.");
+        }
+        std::copy_n(args, count, base);
+        result = execute(proto, base);
+    } catch (...) {
+        loadEnvironment(suspended.data() + saved);
+        suspended.resize(saved);
+        throw;
+    }
+    loadEnvironment(suspended.data() + saved);
+    suspended.resize(saved);
+    return result;
+}
+
+ClassObject* VM::findClass(std::string const& name) {
+    for (auto klass : program.classes) {
+        if (klass->name == name) {
+            return klass;
+        }
+    }
+    return nullptr;
+}
+
+int VM::findFunction(std::string_view name) const {
+    for (size_t i = 0; i < program.functions.size(); i++) {
+        auto proto = program.functions[i];
+        if (!proto->isMethod && static_cast<int>(i) != program.mainFunction && proto->name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// The first spawn of the main VM starts the scheduler, with a VM on a copy of the
+// code for each worker.
+Value VM::spawn(uint32_t function, Value const* args, size_t count) {
+    auto current = Scheduler::current();
+    if (current == nullptr) {
+        scheduler = std::make_unique<Scheduler>(*this, [this]() -> std::unique_ptr<TaskEngine> {
+            auto vm = std::make_unique<VM>(taskProgram->clone());
+            vm->setJitEnabled(jitEnabled);
+            return vm;
+        });
+        current = scheduler.get();
+    }
+    return current->spawn(function, args, count);
+}
+
+// The new coroutine waits in line, the one calling async goes on.
+Value VM::startCoroutine(uint32_t function, Value const* args, size_t count) {
+    currentCoroutine();
+    auto proto = program.functions[function];
+    auto handle = Heap::get().create<CoroutineObject>(sizeof(CoroutineObject));
+
+    auto coroutine = std::make_unique<Coroutine>();
+    coroutine->handle = Value::fromObject(handle);
+    coroutine->registers.assign(args, args + count);
+    coroutine->registers.resize(proto->frameSize, Value::nil());
+    coroutine->frames.push_back({ proto, 0, 0, false });
+    coroutine->index = coroutines->all.size();
+    handle->state = coroutine.get();
+    coroutines->runnable.push_back(coroutine.get());
+    savedBytes += coroutine->registers.capacity() * sizeof(Value) + coroutine->frames.capacity() * sizeof(SavedFrame);
+    coroutines->all.push_back(std::move(coroutine));
+
+    coroutinesStarted++;
+    coroutinesPeak = std::max(coroutinesPeak, coroutines->all.size());
+    return Value::fromObject(handle);
+}
+
+VM::CoroutineSet& VM::coroutineSet() {
+    if (coroutines == nullptr) {
+        auto set = std::make_unique<CoroutineSet>();
+        set->depth = executeDepth;
+        set->base = executeBase;
+        coroutines = set.get();
+        coroutineSets.push_back(std::move(set));
+    }
+    return *coroutines;
+}
+
+VM::Coroutine* VM::currentCoroutine() {
+    auto& set = coroutineSet();
+    if (set.running == nullptr) {
+        auto main = std::make_unique<Coroutine>();
+        main->index = set.all.size();
+        set.running = main.get();
+        set.all.push_back(std::move(main));
+    }
+    return set.running;
+}
+
+void VM::await(CoroutineObject* handle) {
+    auto coroutine = static_cast<Coroutine*>(handle->state);
+    if (coroutine == nullptr) {
+        throw RuntimeError("The coroutine was stopped by an error.");
+    }
+    auto self = currentCoroutine();
+    auto const& all = coroutines->all;
+    if (coroutine->index >= all.size() || all[coroutine->index].get() != coroutine) {
+        throw RuntimeError("Only coroutines started by the same task can await each other.");
+    }
+    if (coroutine == self) {
+        throw RuntimeError("A coroutine can't await itself.");
+    }
+    coroutine->waiters.push_back(self);
+    switching = true;
+}
+
+bool VM::finishCoroutine(Value result) {
+    auto finished = coroutines->running;
+    coroutines->running = nullptr;
+    if (finished->handle.isNil()) {
+        coroutines->mainResult = result;
+    } else {
+        auto handle = asCoroutine(finished->handle);
+        handle->result = result;
+        writeBarrier(handle, result);
+        handle->done = true;
+        handle->state = nullptr;
+    }
+    coroutines->runnable.insert(coroutines->runnable.end(), finished->waiters.begin(), finished->waiters.end());
+
+    // swap-remove, the order doesn't matter
+    auto& all = coroutines->all;
+    size_t index = finished->index;
+    all[index] = std::move(all.back());
+    all[index]->index = index;
+    all.pop_back();
+
+    if (all.empty()) {
+        return false;
+    }
+    restoreCoroutine(nextCoroutine());
+    return true;
+}
+
+void VM::switchCoroutine() {
+    switching = false;
+    auto parked = coroutines->running;
+    saveCoroutine(parked);
+    parked->parked = true;
+    coroutines->running = nullptr;
+    restoreCoroutine(nextCoroutine());
+}
+
+// The loop is asked every switch so that sleepers and I/O wake even while others
+// keep yielding, it only blocks once nobody can run.
+VM::Coroutine* VM::nextCoroutine() {
+    coroutineSwitches++;
+    auto& runnable = coroutines->runnable;
+    auto& events = coroutines->events;
+    woken.clear();
+    events.poll(woken, runnable.empty());
+    while (true) {
+        for (auto waiter : woken) {
+            runnable.push_back(static_cast<Coroutine*>(waiter));
+        }
+        if (!runnable.empty()) {
+            break;
+        }
+        if (events.empty()) {
+            throw RuntimeError("Every coroutine waits for another one.");
+        }
+        woken.clear();
+        events.poll(woken, true);
+    }
+    auto next = runnable.front();
+    runnable.pop_front();
+    return next;
+}
+
+void VM::saveCoroutine(Coroutine* coroutine) {
+    auto const& top = frames.back();
+    coroutine->registers.assign(coroutines->base, top.base + top.proto->frameSize);
+    coroutine->frames.reserve(frames.size() - coroutines->depth);
+    for (size_t f = coroutines->depth; f < frames.size(); f++) {
+        auto const& frame = frames[f];
+        coroutine->frames.push_back({ frame.proto, static_cast<uint32_t>(frame.pc - frame.proto->code.data()),
+            static_cast<uint32_t>(frame.base - coroutines->base), frame.constructor });
+    }
+    frames.resize(coroutines->depth);
+
+    savedBytes += coroutine->registers.capacity() * sizeof(Value) + coroutine->frames.capacity() * sizeof(SavedFrame);
+    size_t bytes = savedBytes + coroutines->all.size() * (sizeof(Coroutine) + sizeof(CoroutineObject));
+    coroutineBytesPeak = std::max(coroutineBytesPeak, bytes);
+}
+
+void VM::restoreCoroutine(Coroutine* coroutine) {
+    std::copy(coroutine->registers.begin(), coroutine->registers.end(), coroutines->base);
+    for (auto const& frame : coroutine->frames) {
+        frames.push_back({ frame.proto, frame.proto->code.data() + frame.pc, coroutines->base + frame.base, frame.constructor });
+    }
+    savedBytes -= coroutine->registers.capacity() * sizeof(Value) + coroutine->frames.capacity() * sizeof(SavedFrame);
+    coroutine->registers = {};
+    coroutine->frames = {};
+
+    retrying = coroutine->parked;
+    coroutine->parked = false;
+    coroutines->running = coroutine;
+}
+
+// after an error, whatever was parked won't run anymore
+void VM::dropCoroutines() {
+    for (auto const& coroutine : coroutines->all) {
+        if (!coroutine->handle.isNil()) {
+            asCoroutine(coroutine->handle)->state = nullptr;
+        }
+        savedBytes -= coroutine->registers.capacity() * sizeof(Value) + coroutine->frames.capacity() * sizeof(SavedFrame);
+    }
+    coroutines->all.clear();
+    coroutines->runnable.clear();
+    coroutines->events.clear();
+    coroutines->running = nullptr;
+    switching = false;
+    retrying = false;
+}
+
+Value VM::execute(FunctionProto* entry, Value* base) {
+    FunctionProto* proto = entry;
+    Instruction* pc = proto->code.data();
+    Instruction* code = pc;
+    const Value* k = proto->constants.data();
+    uint8_t* feedback = proto->feedback.data();
+    Value* const stackEnd = stack.get() + STACK_SIZE;
+    FunctionProto* const* functions = program.functions.data();
+    Value* const globalValues = globals.data();
+
+    for (int i = proto->paramCount; i < proto->frameSize; i++) {
+        base[i] = Value::nil();
+    }
+    size_t entryDepth = frames.size();
+    frames.push_back({ proto, pc, base, false });
+
+    // coroutines started from here on are this execute's, see CoroutineSet
+    struct Nesting {
+        VM& vm;
+        Coroutines* engine;
+        CoroutineSet* coroutines;
+        size_t depth;
+        Value* base;
+
+        Nesting(VM& vm, size_t depth, Value* base)
+            : vm(vm), engine(running), coroutines(vm.coroutines), depth(vm.executeDepth), base(vm.executeBase) {
+            running = &vm;
+            vm.coroutines = nullptr;
+            vm.executeDepth = depth;
+            vm.executeBase = base;
+        }
+        ~Nesting() {
+            if (vm.coroutines != nullptr) {
+                vm.coroutineSets.pop_back();
+            }
+            running = engine;
+            vm.coroutines = coroutines;
+            vm.executeDepth = depth;
+            vm.executeBase = base;
+        }
+    } nesting(*this, entryDepth, base);
+
+    Instruction i;
+
+#define A getA(i)
+#define B getB(i)
+#define C getC(i)
+#define R(x) base[x]
+#define EXTRA_OPERAND() getExtra(*pc++)
+#define SITE() (pc - 1 - code)
+#define OBSERVE(x, y) (BOTH_INT(x, y) ? FEEDBACK_INT : BOTH_DOUBLE(x, y) ? FEEDBACK_DOUBLE : FEEDBACK_OTHER)
+#define QUICKEN(op) do { pc[-1] = withOp(i, op); quickened++; } while (0)
+// rewrites the current instruction back to its generic form and executes that
+// (a plain block, a do-while would swallow the continue of the switch dispatch)
+#define DEOPT(op) { pc--; *pc = withOp(*pc, OpCode::op); deoptimized++; DISPATCH(); }
+// runs compiled code of the current function, the interpreter continues where it left
+#define JIT_ENTER(offset) { \
+            uint32_t resume = proto->jitCode(base, globalValues, static_cast<uint32_t>(offset)); \
+            jitExits++; \
+            if (resume & JIT_GUARD_FAILED) jitGuardFailed(proto); \
+            pc = code + (resume & ~JIT_GUARD_FAILED); \
+            DISPATCH(); \
+        }
+// enters callee with the receiver in R[A] and B arguments after it
+#define INVOKE_METHOD(callee) { \
+            FunctionProto* target = (callee); \
+            Value* newBase = base + A; \
+            if (newBase + target->frameSize > stackEnd) { \
+                throw RuntimeError("Stack overflow."); \
+            } \
+            for (int r = B + 1; r < target->frameSize; r++) { \
+                newBase[r] = Value::nil(); \
+            } \
+            frames.back().pc = pc; \
+            frames.push_back({ target, target->code.data(), newBase, false }); \
+            base = newBase; \
+            ENTER(target); \
+            if (jitReady(target)) JIT_ENTER(0); \
+            DISPATCH(); \
+        }
+// continues the coroutine that just got restored
+#define RESUME() { \
+            auto const& frame = frames.back(); \
+            proto = frame.proto; \
+            pc = frame.pc; \
+            base = frame.base; \
+            code = proto->code.data(); \
+            k = proto->constants.data(); \
+            feedback = proto->feedback.data(); \
+            DISPATCH(); \
+        }
+// the bottom frame of a coroutine returned
+#define FINISH_COROUTINE(result) { \
+            if (finishCoroutine(result)) RESUME(); \
+            return coroutines->mainResult; \
+        }
+#define ENTER(callee) do { proto = callee; code = pc = callee->code.data(); k = callee->constants.data(); feedback = callee->feedback.data(); } while (0)
+#define BOTH_INT(x, y) ((x).isInt() && (y).isInt())
+#define BOTH_DOUBLE(x, y) ((x).isDouble() && (y).isDouble())
+#define WRAP(x) static_cast<int32_t>(x)
+#define U(x) static_cast<uint32_t>(x)
+
+#ifdef LEGBA_COMPUTED_GOTO
+    static void* const dispatchTable[] = {
+#define LEGBA_OPCODE_LABEL(name) &&op_##name,
+        LEGBA_OPCODES(LEGBA_OPCODE_LABEL)
+#undef LEGBA_OPCODE_LABEL
+    };
+    // counting is done by a detour through count_opcode, so it costs nothing when off
+    static void* const countingTable[] = {
+#define LEGBA_OPCODE_COUNT_LABEL(name) &&count_opcode,
+        LEGBA_OPCODES(LEGBA_OPCODE_COUNT_LABEL)
+#undef LEGBA_OPCODE_COUNT_LABEL
+    };
+    void* const* table = countOpcodes ? countingTable : dispatchTable;
+#define DISPATCH() do { i = *pc++; goto *table[static_cast<uint8_t>(getOp(i))]; } while (0)
+#define CASE(name) op_##name:
+#else
+#define DISPATCH() continue
+#define CASE(name) case OpCode::name:
+#endif
+
+    try {
+#ifdef LEGBA_COMPUTED_GOTO
+        DISPATCH();
+
+    count_opcode:
+        opCounts[static_cast<uint8_t>(getOp(i))]++;
+        goto *dispatchTable[static_cast<uint8_t>(getOp(i))];
+#else
+        for (;;) {
+            i = *pc++;
+            if (countOpcodes) {
+                opCounts[static_cast<uint8_t>(getOp(i))]++;
+            }
+            switch (getOp(i)) {
+#endif
+
+        CASE(LOADK) {
+            R(A) = k[getBx(i)];
+            DISPATCH();
+        }
+        CASE(LOADI) {
+            R(A) = Value::fromInt(getSBx(i));
+            // fuse with an already quickened ADD/SUB taking the constant as right operand
+            Instruction next = *pc;
+            if (feedback[SITE()] == 0 && getC(next) == A && getB(next) != A) {
+                if (getOp(next) == OpCode::ADD_II) QUICKEN(OpCode::ADDI_II);
+                else if (getOp(next) == OpCode::SUB_II) QUICKEN(OpCode::SUBI_II);
+            }
+            DISPATCH();
+        }
+        CASE(LOADNIL) {
+            R(A) = Value::nil();
+            DISPATCH();
+        }
+        CASE(LOADBOOL) {
+            R(A) = Value::fromBool(B != 0);
+            DISPATCH();
+        }
+        CASE(MOVE) {
+            R(A) = R(B);
+            DISPATCH();
+        }
+        CASE(GETGLOBAL) {
+            R(A) = globals[getBx(i)];
+            DISPATCH();
+        }
+        CASE(SETGLOBAL) {
+            globals[getBx(i)] = R(A);
+            DISPATCH();
+        }
+
+        CASE(ADD) {
+            Value x = R(B), y = R(C);
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y);
+            if (seen == FEEDBACK_INT) QUICKEN(OpCode::ADD_II);
+            else if (seen == FEEDBACK_DOUBLE) QUICKEN(OpCode::ADD_DD);
+
+            if (BOTH_INT(x, y)) R(A) = Value::fromInt(WRAP(U(x.asInt()) + U(y.asInt())));
+            else if (BOTH_DOUBLE(x, y)) R(A) = Value::fromDouble(x.asDouble() + y.asDouble());
+            else R(A) = arithmetic(TokenType::PLUS, x, y);
+            DISPATCH();
+        }
+        CASE(SUB) {
+            Value x = R(B), y = R(C);
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y);
+            if (seen == FEEDBACK_INT) QUICKEN(OpCode::SUB_II);
+            else if (seen == FEEDBACK_DOUBLE) QUICKEN(OpCode::SUB_DD);
+
+            if (BOTH_INT(x, y)) R(A) = Value::fromInt(WRAP(U(x.asInt()) - U(y.asInt())));
+            else if (BOTH_DOUBLE(x, y)) R(A) = Value::fromDouble(x.asDouble() - y.asDouble());
+            else R(A) = arithmetic(TokenType::MINUS, x, y);
+            DISPATCH();
+        }
+        CASE(MUL) {
+            Value x = R(B), y = R(C);
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y);
+            if (seen == FEEDBACK_INT) QUICKEN(OpCode::MUL_II);
+            else if (seen == FEEDBACK_DOUBLE) QUICKEN(OpCode::MUL_DD);
+
+            if (BOTH_INT(x, y)) R(A) = Value::fromInt(WRAP(U(x.asInt()) * U(y.asInt())));
+            else if (BOTH_DOUBLE(x, y)) R(A) = Value::fromDouble(x.asDouble() * y.asDouble());
+            else R(A) = arithmetic(TokenType::STAR, x, y);
+            DISPATCH();
+        }
+        CASE(DIV) {
+            Value x = R(B), y = R(C);
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y);
+            if (seen == FEEDBACK_DOUBLE) QUICKEN(OpCode::DIV_DD);
+
+            if (BOTH_DOUBLE(x, y)) R(A) = Value::fromDouble(x.asDouble() / y.asDouble());
+            else R(A) = arithmetic(TokenType::SLASH, x, y);
+            DISPATCH();
+        }
+        CASE(MOD) {
+            R(A) = arithmetic(TokenType::MODULO, R(B), R(C));
+            DISPATCH();
+        }
+
+        CASE(ADD_II) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_INT(x, y)) DEOPT(ADD);
+            R(A) = Value::fromInt(WRAP(U(x.asInt()) + U(y.asInt())));
+            DISPATCH();
+        }
+        CASE(ADD_DD) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_DOUBLE(x, y)) DEOPT(ADD);
+            R(A) = Value::fromDouble(x.asDouble() + y.asDouble());
+            DISPATCH();
+        }
+        CASE(SUB_II) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_INT(x, y)) DEOPT(SUB);
+            R(A) = Value::fromInt(WRAP(U(x.asInt()) - U(y.asInt())));
+            DISPATCH();
+        }
+        CASE(SUB_DD) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_DOUBLE(x, y)) DEOPT(SUB);
+            R(A) = Value::fromDouble(x.asDouble() - y.asDouble());
+            DISPATCH();
+        }
+        CASE(MUL_II) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_INT(x, y)) DEOPT(MUL);
+            R(A) = Value::fromInt(WRAP(U(x.asInt()) * U(y.asInt())));
+            DISPATCH();
+        }
+        CASE(MUL_DD) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_DOUBLE(x, y)) DEOPT(MUL);
+            R(A) = Value::fromDouble(x.asDouble() * y.asDouble());
+            DISPATCH();
+        }
+        CASE(DIV_DD) {
+            Value x = R(B), y = R(C);
+            if (!BOTH_DOUBLE(x, y)) DEOPT(DIV);
+            R(A) = Value::fromDouble(x.asDouble() / y.asDouble());
+            DISPATCH();
+        }
+        CASE(ADDI_II) {
+            Instruction next = *pc;
+            Value x = R(getB(next));
+            if (!x.isInt()) {
+                feedback[SITE()] = FEEDBACK_OTHER;
+                DEOPT(LOADI);
+            }
+            R(A) = Value::fromInt(getSBx(i));
+            R(getA(next)) = Value::fromInt(WRAP(U(x.asInt()) + U(getSBx(i))));
+            pc++;
+            DISPATCH();
+        }
+        CASE(SUBI_II) {
+            Instruction next = *pc;
+            Value x = R(getB(next));
+            if (!x.isInt()) {
+                feedback[SITE()] = FEEDBACK_OTHER;
+                DEOPT(LOADI);
+            }
+            R(A) = Value::fromInt(getSBx(i));
+            R(getA(next)) = Value::fromInt(WRAP(U(x.asInt()) - U(getSBx(i))));
+            pc++;
+            DISPATCH();
+        }
+
+// Generic comparison plus its quick forms. A site followed by a JMPIFNOT on its
+// result is quickened into the fused form, which still writes R[A] so a jump
+// landing directly on the JMPIFNOT sees the same register state.
+#define COMPARISON(NAME, OPERATOR, TOKEN) \
+        CASE(NAME) { \
+            Value x = R(B), y = R(C); \
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y); \
+            bool fuse = getOp(*pc) == OpCode::JMPIFNOT && getA(*pc) == A; \
+            if (seen == FEEDBACK_INT) QUICKEN(fuse ? OpCode::NAME##_II_JMP : OpCode::NAME##_II); \
+            else if (seen == FEEDBACK_DOUBLE) QUICKEN(fuse ? OpCode::NAME##_DD_JMP : OpCode::NAME##_DD); \
+            R(A) = BOTH_INT(x, y) ? Value::fromBool(x.asInt() OPERATOR y.asInt()) : comparison(TOKEN, x, y); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_II) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_INT(x, y)) DEOPT(NAME); \
+            R(A) = Value::fromBool(x.asInt() OPERATOR y.asInt()); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_DD) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_DOUBLE(x, y)) DEOPT(NAME); \
+            R(A) = Value::fromBool(x.asDouble() OPERATOR y.asDouble()); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_II_JMP) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_INT(x, y)) DEOPT(NAME); \
+            bool result = x.asInt() OPERATOR y.asInt(); \
+            R(A) = Value::fromBool(result); \
+            Instruction jump = *pc++; \
+            if (!result) pc += getSBx(jump); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_DD_JMP) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_DOUBLE(x, y)) DEOPT(NAME); \
+            bool result = x.asDouble() OPERATOR y.asDouble(); \
+            R(A) = Value::fromBool(result); \
+            Instruction jump = *pc++; \
+            if (!result) pc += getSBx(jump); \
+            DISPATCH(); \
+        }
+
+        COMPARISON(LT, <, TokenType::LESS)
+        COMPARISON(LE, <=, TokenType::LESS_EQUAL)
+        COMPARISON(GT, >, TokenType::GREATER)
+        COMPARISON(GE, >=, TokenType::GREATER_EQUAL)
+#undef COMPARISON
+
+// Equality has no double forms: valuesEqual mixes ints and doubles and NaN != NaN.
+#define EQUALITY(NAME, OPERATOR) \
+        CASE(NAME) { \
+            Value x = R(B), y = R(C); \
+            uint8_t seen = feedback[SITE()] |= OBSERVE(x, y); \
+            bool fuse = getOp(*pc) == OpCode::JMPIFNOT && getA(*pc) == A; \
+            if (seen == FEEDBACK_INT) QUICKEN(fuse ? OpCode::NAME##_II_JMP : OpCode::NAME##_II); \
+            R(A) = Value::fromBool(BOTH_INT(x, y) ? (x OPERATOR y) : (valuesEqual(x, y) OPERATOR true)); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_II) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_INT(x, y)) DEOPT(NAME); \
+            R(A) = Value::fromBool(x OPERATOR y); \
+            DISPATCH(); \
+        } \
+        CASE(NAME##_II_JMP) { \
+            Value x = R(B), y = R(C); \
+            if (!BOTH_INT(x, y)) DEOPT(NAME); \
+            bool result = x OPERATOR y; \
+            R(A) = Value::fromBool(result); \
+            Instruction jump = *pc++; \
+            if (!result) pc += getSBx(jump); \
+            DISPATCH(); \
+        }
+
+        EQUALITY(EQ, ==)
+        EQUALITY(NE, !=)
+#undef EQUALITY
+
+        CASE(NOT) {
+            R(A) = Value::fromBool(!R(B).isTruthy());
+            DISPATCH();
+        }
+        CASE(NEG) {
+            R(A) = negate(R(B));
+            DISPATCH();
+        }
+
+        CASE(JMP) {
+            pc += getSBx(i);
+            // loops are the other way into the JIT besides calls
+            if (getSBx(i) < 0 && jitReady(proto)) JIT_ENTER(pc - code);
+            DISPATCH();
+        }
+        CASE(JMPIF) {
+            if (R(A).isTruthy()) pc += getSBx(i);
+            DISPATCH();
+        }
+        CASE(JMPIFNOT) {
+            if (!R(A).isTruthy()) pc += getSBx(i);
+            DISPATCH();
+        }
+
+        CASE(CALL) {
+            FunctionProto* callee = functions[EXTRA_OPERAND()];
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+
+            Value* newBase = base + A;
+            if (newBase + callee->frameSize > stackEnd) {
+                throw RuntimeError("Stack overflow.");
+            }
+            for (int r = B; r < callee->frameSize; r++) {
+                newBase[r] = Value::nil();
+            }
+
+            frames.back().pc = pc;
+            frames.push_back({ callee, callee->code.data(), newBase, false });
+            base = newBase;
+            ENTER(callee);
+            if (jitReady(callee)) JIT_ENTER(0);
+            DISPATCH();
+        }
+        CASE(TAILCALL) {
+            FunctionProto* callee = functions[EXTRA_OPERAND()];
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+            if (base + callee->frameSize > stackEnd) {
+                throw RuntimeError("Stack overflow.");
+            }
+
+            // the arguments move down to the bottom of the frame, which the callee takes over
+            for (int r = 0; r < B; r++) {
+                base[r] = base[A + r];
+            }
+            for (int r = B; r < callee->frameSize; r++) {
+                base[r] = Value::nil();
+            }
+
+            tailCalls++;
+            frames.back().proto = callee;
+            ENTER(callee);
+            if (jitReady(callee)) JIT_ENTER(0);
+            DISPATCH();
+        }
+        CASE(CALLNATIVE) {
+            Value result = callBuiltin(BUILTINS[EXTRA_OPERAND()], &R(A));
+            if (switching) {
+                // the builtin parked the coroutine, it is called again once resumed
+                pc -= 2;
+                frames.back().pc = pc;
+                switchCoroutine();
+                RESUME();
+            }
+            retrying = false;
+            R(A) = result;
+            DISPATCH();
+        }
+        CASE(SPAWN) {
+            uint32_t function = EXTRA_OPERAND();
+            FunctionProto* callee = functions[function];
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+            R(A) = spawn(function, &R(A), B);
+            DISPATCH();
+        }
+        CASE(ASYNC) {
+            uint32_t function = EXTRA_OPERAND();
+            FunctionProto* callee = functions[function];
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+            R(A) = startCoroutine(function, &R(A), B);
+            DISPATCH();
+        }
+        CASE(INVOKE) {
+            uint32_t name = EXTRA_OPERAND();
+            Value receiver = R(A);
+            if (!isObjectType(receiver, ObjectType::INSTANCE)) {
+                throw RuntimeError("Only instances have methods, got " + receiver.typeName() + '.');
+            }
+
+            auto klass = asInstance(receiver)->klass;
+            FunctionProto* callee = klass->findMethod(proto->names[name]);
+            if (callee == nullptr) {
+                throw RuntimeError("Class '" + klass->name + "' has no method '" + proto->names[name] + "'.");
+            }
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+
+            methodLookups++;
+            if (feedback[pc - 2 - code] == 0) {
+                pc[-1] = encodeExtra(static_cast<uint32_t>(proto->invokeCaches.size()));
+                pc[-2] = withOp(i, OpCode::INVOKE_MONO);
+                proto->invokeCaches.push_back({ { klass }, { callee }, 1, name });
+                quickened++;
+            }
+            INVOKE_METHOD(callee);
+        }
+        CASE(INVOKEVT) {
+            methodVtableCalls++;
+            // the compiler only emits it on 'this', a damaged file may not
+            uint32_t index = EXTRA_OPERAND();
+            if (!isObjectType(R(A), ObjectType::INSTANCE) || index >= asInstance(R(A))->klass->vtable.size()) {
+                throw RuntimeError("Invalid receiver of a method call.");
+            }
+            INVOKE_METHOD(asInstance(R(A))->klass->vtable[index]);
+        }
+        CASE(INVOKEDIRECT) {
+            methodDirectCalls++;
+            INVOKE_METHOD(functions[EXTRA_OPERAND()]);
+        }
+        CASE(INVOKE_MONO) {
+            auto const& cache = proto->invokeCaches[EXTRA_OPERAND()];
+            Value receiver = R(A);
+            if (isObjectType(receiver, ObjectType::INSTANCE) && asInstance(receiver)->klass == cache.klass[0]) {
+                methodMonoHits++;
+                INVOKE_METHOD(cache.target[0]);
+            }
+            // another class: retry as polymorphic site, which extends the cache
+            pc -= 2;
+            *pc = withOp(*pc, OpCode::INVOKE_POLY);
+            DISPATCH();
+        }
+        CASE(INVOKE_POLY) {
+            auto& cache = proto->invokeCaches[EXTRA_OPERAND()];
+            Value receiver = R(A);
+            if (isObjectType(receiver, ObjectType::INSTANCE)) {
+                auto klass = asInstance(receiver)->klass;
+                for (int e = 0; e < cache.count; e++) {
+                    if (cache.klass[e] == klass) {
+                        methodPolyHits++;
+                        INVOKE_METHOD(cache.target[e]);
+                    }
+                }
+
+                methodCacheMisses++;
+                FunctionProto* callee = klass->findMethod(proto->names[cache.name]);
+                if (callee != nullptr && B == callee->paramCount && cache.count < InvokeCache::SIZE) {
+                    cache.klass[cache.count] = klass;
+                    cache.target[cache.count] = callee;
+                    cache.count++;
+                    INVOKE_METHOD(callee);
+                }
+            }
+            // megamorphic, or an error the generic form reports: look up by name for good
+            feedback[pc - 2 - code] = FEEDBACK_OTHER;
+            pc[-1] = encodeExtra(cache.name);
+            pc--;
+            DEOPT(INVOKE);
+        }
+        CASE(NEW) {
+            ClassObject* klass = program.classes[EXTRA_OPERAND()];
+            R(A) = newInstance(klass);
+
+            FunctionProto* callee = klass->constructor;
+            if (callee == nullptr) {
+                if (B != 0) {
+                    throw RuntimeError("Class '" + klass->name + "' has no constructor taking arguments.");
+                }
+                DISPATCH();
+            }
+            if (B != callee->paramCount) {
+                throw RuntimeError("'" + callee->name + "' expects " + std::to_string(callee->paramCount) + " arguments but got " + std::to_string(B) + '.');
+            }
+
+            Value* newBase = base + A;
+            if (newBase + callee->frameSize > stackEnd) {
+                throw RuntimeError("Stack overflow.");
+            }
+            for (int r = B + 1; r < callee->frameSize; r++) {
+                newBase[r] = Value::nil();
+            }
+
+            frames.back().pc = pc;
+            frames.push_back({ callee, callee->code.data(), newBase, true });
+            base = newBase;
+            ENTER(callee);
+            if (jitReady(callee)) JIT_ENTER(0);
+            DISPATCH();
+        }
+        CASE(GETATTR) {
+            uint32_t name = EXTRA_OPERAND();
+            Value object = R(B);
+            int index = attributeIndex(object, proto->names[name]);
+            if (index < 0) {
+                R(A) = attribute(object, proto->names[name]);
+                DISPATCH();
+            }
+            R(A) = asInstance(object)->fields()[index];
+            if (feedback[pc - 2 - code] == 0) {
+                pc[-1] = encodeExtra(static_cast<uint32_t>(proto->attributeCaches.size()));
+                pc[-2] = withOp(i, OpCode::GETATTR_MONO);
+                proto->attributeCaches.push_back({ asInstance(object)->klass, index, name });
+                quickened++;
+            }
+            DISPATCH();
+        }
+        CASE(SETATTR) {
+            uint32_t name = EXTRA_OPERAND();
+            Value object = R(A);
+            int index = attributeIndex(object, proto->names[name]);
+            if (index < 0) {
+                attribute(object, proto->names[name]) = R(B);
+                DISPATCH();
+            }
+            asInstance(object)->fields()[index] = R(B);
+            writeBarrier(asInstance(object), R(B));
+            if (feedback[pc - 2 - code] == 0) {
+                pc[-1] = encodeExtra(static_cast<uint32_t>(proto->attributeCaches.size()));
+                pc[-2] = withOp(i, OpCode::SETATTR_MONO);
+                proto->attributeCaches.push_back({ asInstance(object)->klass, index, name });
+                quickened++;
+            }
+            DISPATCH();
+        }
+        CASE(GETATTR_MONO) {
+            auto const& cache = proto->attributeCaches[EXTRA_OPERAND()];
+            Value object = R(B);
+            if (!isObjectType(object, ObjectType::INSTANCE) || asInstance(object)->klass != cache.klass) {
+                feedback[pc - 2 - code] = FEEDBACK_OTHER;
+                pc[-1] = encodeExtra(cache.name);
+                pc--;
+                DEOPT(GETATTR);
+            }
+            R(A) = asInstance(object)->fields()[cache.index];
+            DISPATCH();
+        }
+        CASE(SETATTR_MONO) {
+            auto const& cache = proto->attributeCaches[EXTRA_OPERAND()];
+            Value object = R(A);
+            if (!isObjectType(object, ObjectType::INSTANCE) || asInstance(object)->klass != cache.klass) {
+                feedback[pc - 2 - code] = FEEDBACK_OTHER;
+                pc[-1] = encodeExtra(cache.name);
+                pc--;
+                DEOPT(SETATTR);
+            }
+            asInstance(object)->fields()[cache.index] = R(B);
+            writeBarrier(asInstance(object), R(B));
+            DISPATCH();
+        }
+        CASE(GETFIELD) {
+            R(A) = asInstance(R(B))->fields()[C];
+            DISPATCH();
+        }
+        CASE(SETFIELD) {
+            asInstance(R(A))->fields()[C] = R(B);
+            writeBarrier(asInstance(R(A)), R(B));
+            DISPATCH();
+        }
+        CASE(GETSTATIC) {
+            R(A) = program.classes[EXTRA_OPERAND()]->statics[getBx(i)];
+            DISPATCH();
+        }
+        CASE(SETSTATIC) {
+            program.classes[EXTRA_OPERAND()]->statics[getBx(i)] = R(A);
+            DISPATCH();
+        }
+        CASE(NEWARRAY) {
+            auto type = C != 0 ? std::optional(static_cast<ElementType>(C - 1)) : std::nullopt;
+            R(A) = newArray(&R(A + 1), B, type);
+            DISPATCH();
+        }
+        CASE(NEWMAP) {
+            R(A) = maps::newMap(&R(A + 1), B);
+            DISPATCH();
+        }
+        CASE(GETINDEX) {
+            Value array = R(B), index = R(C);
+            R(A) = getIndex(array, index);
+            uint8_t seen = feedback[SITE()] |= indexFeedback(array, index);
+            if (seen == FEEDBACK_INT) QUICKEN(OpCode::GETINDEX_I);
+            else if (seen == FEEDBACK_DOUBLE) QUICKEN(OpCode::GETINDEX_D);
+            DISPATCH();
+        }
+        CASE(SETINDEX) {
+            Value array = R(A), index = R(B), value = R(C);
+            // before storing, which may collect and move a map
+            uint8_t seen = feedback[SITE()] |= indexFeedback(array, index);
+            setIndex(array, index, value);
+            if (seen == FEEDBACK_INT && value.isInt()) QUICKEN(OpCode::SETINDEX_I);
+            else if (seen == FEEDBACK_DOUBLE && value.isNumber()) QUICKEN(OpCode::SETINDEX_D);
+            DISPATCH();
+        }
+        CASE(GETINDEX_I) {
+            Value array = R(B), index = R(C);
+            if (!isArrayOf(array, ElementType::INT) || !index.isInt()) DEOPT(GETINDEX);
+            ArrayObject* elements = asArray(array);
+            if (U(index.asInt()) >= elements->length) {
+                getIndex(array, index); // throws the range error
+            }
+            R(A) = Value::fromInt(elements->ints()[index.asInt()]);
+            DISPATCH();
+        }
+        CASE(GETINDEX_D) {
+            Value array = R(B), index = R(C);
+            if (!isArrayOf(array, ElementType::DOUBLE) || !index.isInt()) DEOPT(GETINDEX);
+            ArrayObject* elements = asArray(array);
+            if (U(index.asInt()) >= elements->length) {
+                getIndex(array, index); // throws the range error
+            }
+            R(A) = Value::fromDouble(elements->doubles()[index.asInt()]);
+            DISPATCH();
+        }
+        CASE(SETINDEX_I) {
+            Value array = R(A), index = R(B), value = R(C);
+            if (!isArrayOf(array, ElementType::INT) || !index.isInt() || !value.isInt()) DEOPT(SETINDEX);
+            ArrayObject* elements = asArray(array);
+            if (U(index.asInt()) >= elements->length) {
+                setIndex(array, index, value); // throws the range error
+            }
+            elements->ints()[index.asInt()] = value.asInt();
+            DISPATCH();
+        }
+        CASE(SETINDEX_D) {
+            Value array = R(A), index = R(B), value = R(C);
+            if (!isArrayOf(array, ElementType::DOUBLE) || !index.isInt() || !value.isNumber()) DEOPT(SETINDEX);
+            ArrayObject* elements = asArray(array);
+            if (U(index.asInt()) >= elements->length) {
+                setIndex(array, index, value); // throws the range error
+            }
+            elements->doubles()[index.asInt()] = value.toNumber();
+            DISPATCH();
+        }
+
+        CASE(RETURN) {
+            Value result = R(A);
+            bool constructor = frames.back().constructor;
+            frames.pop_back();
+            if (frames.size() == entryDepth) {
+                if (coroutines != nullptr && coroutines->running != nullptr) FINISH_COROUTINE(result);
+                return result;
+            }
+
+            // the callee's R[0] is the caller's R[A] of the call instruction
+            if (!constructor) {
+                *base = result;
+            }
+            auto& frame = frames.back();
+            proto = frame.proto;
+            pc = frame.pc;
+            base = frame.base;
+            code = proto->code.data();
+            k = proto->constants.data();
+            feedback = proto->feedback.data();
+            if (proto->jitCode != nullptr) JIT_ENTER(pc - code);
+            DISPATCH();
+        }
+        CASE(RETURNNIL) {
+            bool constructor = frames.back().constructor;
+            frames.pop_back();
+            if (frames.size() == entryDepth) {
+                if (coroutines != nullptr && coroutines->running != nullptr) FINISH_COROUTINE(Value::nil());
+                return Value::nil();
+            }
+
+            if (!constructor) {
+                *base = Value::nil();
+            }
+            auto& frame = frames.back();
+            proto = frame.proto;
+            pc = frame.pc;
+            base = frame.base;
+            code = proto->code.data();
+            k = proto->constants.data();
+            feedback = proto->feedback.data();
+            if (proto->jitCode != nullptr) JIT_ENTER(pc - code);
+            DISPATCH();
+        }
+        CASE(EXTRA) {
+            throw RuntimeError("Malformed bytecode.");
+        }
+
+#ifndef LEGBA_COMPUTED_GOTO
+                case OpCode::COUNT:
+                    throw RuntimeError("Malformed bytecode.");
+            }
+        }
+#endif
+    } catch (RuntimeError const& e) {
+        frames.resize(entryDepth);
+        if (coroutines != nullptr) {
+            dropCoroutines();
+        }
+        int line = pc > code ? proto->lineAt(static_cast<size_t>(pc - code - 1)) : 0;
+        auto where = line > 0 ? "line " + std::to_string(line) + " in " : std::string("in ");
+        throw RuntimeError(std::string(e.what()) + " [" + where + proto->name + "]");
+    }
+
+#undef A
+#undef B
+#undef C
+#undef R
+#undef EXTRA_OPERAND
+#undef SITE
+#undef OBSERVE
+#undef QUICKEN
+#undef DEOPT
+#undef ENTER
+#undef RESUME
+#undef FINISH_COROUTINE
+#undef INVOKE_METHOD
+#undef JIT_ENTER
+#undef BOTH_INT
+#undef BOTH_DOUBLE
+#undef WRAP
+#undef U
+#undef DISPATCH
+#undef CASE
+}
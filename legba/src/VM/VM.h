@@ -0,0 +1,194 @@
+#ifndef LEGBA_VM_VM_H
+#define LEGBA_VM_VM_H
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "JIT/JIT.h"
+#include "Runtime/Coroutines.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Scheduler.h"
+#include "VM/Program.h"
+
+// Register based bytecode interpreter. Frames are windows into one contiguous value
+// stack: a callee's frame starts at the register holding its first argument, so
+// arguments are passed without copying and the result lands in the caller's R[A].
+// Instructions are specialized in place from the operand types they see, see the
+// quick opcodes in Instruction.h.
+//
+// Tasks run on VMs of their own, one per worker thread. Each gets a copy of the code
+// as it was compiled, since every VM quickens its code in place.
+//
+// Coroutines take turns on the stack of the execute that started them: the one that
+// stops running has its frames and registers copied off the stack, the next one's
+// copied back, see switchCoroutine. Parked they only take what their frames use. An
+// execute returns once all of its coroutines did, those of a task a join runs are
+// done before the join returns.
+class VM : public TaskEngine, public Coroutines {
+public:
+    explicit VM(Program& program);
+    // runs a program it owns, the VMs of worker threads do
+    explicit VM(std::unique_ptr<Program> program);
+    // Runs a copy of a program that is only ever read, as are the copies of its
+    // workers, so any number of VMs can be made from it at once, see Context.
+    explicit VM(Program const& shared);
+    VM(VM const&) = delete;
+    VM& operator=(VM const&) = delete;
+    ~VM() override;
+
+    Value run();
+    // Calls a function of the program with its parameter count of arguments, on top
+    // of whatever runs already. The result is not a root.
+    Value call(uint32_t function, Value const* args, size_t count);
+    // Waits for the tasks still running and stops the worker threads, the next
+    // spawn starts them again on whichever thread it runs.
+    void stopTasks();
+
+    void saveEnvironment(std::vector<Value>& values) override;
+    Value runTask(uintptr_t function, Value* args, size_t count, Value const* environment) override;
+    ClassObject* findClass(std::string const& name) override;
+
+    EventLoop& loop() override { return coroutineSet().events; }
+    void* self() override { return currentCoroutine(); }
+    bool resumed() const override { return retrying; }
+    void park() override { switching = true; }
+    void await(CoroutineObject* handle) override;
+
+    // index of the function, not method, with this name, -1 if there is none
+    int findFunction(std::string_view name) const;
+
+    // Count executed instructions per opcode, see printStats.
+    void setCountOpcodes(bool enabled) { countOpcodes = enabled; }
+    void printStats(std::ostream& os) const;
+
+    // The JIT is on by default where it is supported.
+    void setJitEnabled(bool enabled) { jitEnabled = enabled && JIT::isSupported(); }
+    void setJitDump(std::ostream* os) { jit.setDump(os); }
+
+private:
+    VM(Program* program, bool owned);
+
+    struct CallFrame {
+        FunctionProto* proto;
+        Instruction* pc;
+        Value* base;
+        bool constructor;
+    };
+
+    // a call frame of a coroutine that doesn't run, relative to its code and registers
+    struct SavedFrame {
+        FunctionProto* proto;
+        uint32_t pc;
+        uint32_t base;
+        bool constructor;
+    };
+
+    struct Coroutine {
+        Value handle;       // nil for the code that started the first coroutine
+        std::vector<SavedFrame> frames;
+        std::vector<Value> registers;
+        std::vector<Coroutine*> waiters;    // awaiting its result
+        size_t index;       // in CoroutineSet::all
+        bool parked = false;    // in a builtin, which it calls again when resumed
+    };
+
+    // the coroutines of one execute, which all start at its bottom frame
+    struct CoroutineSet {
+        size_t depth;
+        Value* base;
+        std::vector<std::unique_ptr<Coroutine>> all;
+        std::deque<Coroutine*> runnable;
+        Coroutine* running = nullptr;
+        Value mainResult;   // of the code that started the first one, once it returned
+        EventLoop events;
+    };
+
+    // runs entry with its arguments already in base[0 .. paramCount)
+    Value execute(FunctionProto* entry, Value* base);
+    Value spawn(uint32_t function, Value const* args, size_t count);
+    Value startCoroutine(uint32_t function, Value const* args, size_t count);
+    // those of the running execute, made by the first one it starts or parks
+    CoroutineSet& coroutineSet();
+    // the running coroutine, made up for the code that runs if none was started yet
+    Coroutine* currentCoroutine();
+    // Records the result of the running coroutine, whose frames are gone, and resumes
+    // the next one. False once every coroutine returned.
+    bool finishCoroutine(Value result);
+    // parks the running coroutine and resumes the next one, possibly itself
+    void switchCoroutine();
+    Coroutine* nextCoroutine();
+    void saveCoroutine(Coroutine* coroutine);
+    void restoreCoroutine(Coroutine* coroutine);
+    void dropCoroutines();
+    // replaces the globals and statics with values saveEnvironment made
+    void loadEnvironment(Value const* values);
+    void visitRoots(Heap& heap);
+    bool jitReady(FunctionProto* proto);
+    void jitGuardFailed(FunctionProto* proto);
+
+private:
+    static constexpr size_t STACK_SIZE = 1 << 20;
+    static constexpr uint32_t JIT_THRESHOLD = 1000;
+    static constexpr uint32_t JIT_MAX_GUARD_FAILURES = 100;
+    static constexpr int JIT_MAX_COMPILES = 3;
+
+    // Registers are cleared by the calls entering them, see execute, so the stack is
+    // left uninitialized and its pages are only touched as deep as calls go.
+    struct StackMemory {
+        void operator()(Value* values) const { ::operator delete(values); }
+    };
+
+    std::unique_ptr<Program> ownedProgram;
+    Program& program;
+    std::unique_ptr<Value[], StackMemory> stack;
+    std::vector<Value> globals;
+    std::vector<CallFrame> frames;
+    std::vector<Value> suspended;   // globals and statics of the code below running tasks
+    int gcRoots;
+
+    // pristine code for the workers, if it spawns tasks at all: the shared program
+    // or a copy made before this VM quickened any of it
+    Program const* taskProgram = nullptr;
+    std::unique_ptr<Program> ownedTaskProgram;
+    std::unique_ptr<Scheduler> scheduler;   // started by the first spawn
+
+    // one set of coroutines per execute running, nested ones for tasks joins run
+    std::vector<std::unique_ptr<CoroutineSet>> coroutineSets;
+    CoroutineSet* coroutines = nullptr;     // of the innermost execute, if it has any
+    size_t executeDepth = 0;                // its bottom frame
+    Value* executeBase = nullptr;
+    std::vector<void*> woken;
+    bool switching = false;     // a builtin parked the running coroutine
+    bool retrying = false;      // the builtin called is the one it parked in
+    size_t savedBytes = 0;      // frames and registers of parked coroutines
+    uint64_t coroutinesStarted = 0;
+    uint64_t coroutineSwitches = 0;
+    size_t coroutinesPeak = 0;
+    size_t coroutineBytesPeak = 0;
+
+    bool countOpcodes = false;
+    std::array<uint64_t, OPCODE_COUNT> opCounts;
+    uint64_t quickened = 0;
+    uint64_t deoptimized = 0;
+    uint64_t tailCalls = 0;
+
+    // method dispatch, see printStats
+    uint64_t methodDirectCalls = 0;
+    uint64_t methodVtableCalls = 0;
+    uint64_t methodMonoHits = 0;
+    uint64_t methodPolyHits = 0;
+    uint64_t methodCacheMisses = 0;
+    uint64_t methodLookups = 0;
+
+    JIT jit;
+    bool jitEnabled = false;
+    uint64_t jitCompiled = 0;
+    uint64_t jitExits = 0;
+    uint64_t jitGuardExits = 0;
+};
+
+#endif
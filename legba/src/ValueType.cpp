@@ -5,6 +5,9 @@ void ValueType::setType(ValueTypeEnum type) {
 }
 
 std::string ValueType::toString() const {
+    if (type == ValueTypeEnum::VT_ARRAY) {
+        return name + "[]";
+    }
 
     return valueTypeEnumToString(type);
 }
@@ -28,6 +31,15 @@ ValueType ValueType::fromString(const std::string& s) {
     if (s == "string") {
         return ValueType(ValueTypeEnum::VT_STRING);
     }
+    if (s == "map") {
+        return ValueType(ValueTypeEnum::VT_MAP);
+    }
+    if (s == "task") {
+        return ValueType(ValueTypeEnum::VT_TASK);
+    }
+    if (s == "coroutine") {
+        return ValueType(ValueTypeEnum::VT_COROUTINE);
+    }
 
     return ValueType(ValueTypeEnum::VT_ERROR);
 }
@@ -42,6 +54,10 @@ std::string valueTypeEnumToString(ValueTypeEnum type) {
         case ValueTypeEnum::VT_INTEGER: return "INT";
         case ValueTypeEnum::VT_VOID: return "VOID";
         case ValueTypeEnum::VT_OBJ: return "OBJ";
+        case ValueTypeEnum::VT_ARRAY: return "ARRAY";
+        case ValueTypeEnum::VT_MAP: return "MAP";
+        case ValueTypeEnum::VT_TASK: return "TASK";
+        case ValueTypeEnum::VT_COROUTINE: return "COROUTINE";
         case ValueTypeEnum::VT_ERROR: return "ERROR";
     }
     return "ERROR2";
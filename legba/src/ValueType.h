@@ -4,7 +4,7 @@
 #include <sstream>
 
 enum class ValueTypeEnum {
-	VT_NONE, VT_ERROR, VT_VOID, VT_INTEGER, VT_DOUBLE, VT_STRING, VT_CHAR, VT_BOOL, VT_OBJ
+	VT_NONE, VT_ERROR, VT_VOID, VT_INTEGER, VT_DOUBLE, VT_STRING, VT_CHAR, VT_BOOL, VT_OBJ, VT_ARRAY, VT_MAP, VT_TASK, VT_COROUTINE
 };
 
 
@@ -12,6 +12,7 @@ class ValueType {
 public:
 	ValueType() : type(ValueTypeEnum::VT_NONE), name() {}
 
+	// arrays are named after their element type
 	ValueType(ValueTypeEnum type, std::string name = "")
 		: type(type), name(name) { }
 
@@ -3,10 +3,76 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <filesystem>
 #include <stack>
+#include <sstream>
+#include <format>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "Lexer.h"
 #include "Parser.h"
+#include "Error.h"
+#include "Build/BatchCompiler.h"
+#include "Build/CompileServer.h"
+#include "Build/ModuleBuilder.h"
+#include "Optimizer/DeadCodeEliminator.h"
+#include "Optimizer/Inliner.h"
+#include "Codegen/CEmitter.h"
+#include "Codegen/CRuntime.h"
+#include "Embed/LineStream.h"
+#include "Embed/Script.h"
+#include "Runtime/Heap.h"
+#include "Runtime/Interpreter.h"
+#include "Runtime/Map.h"
+#include "Runtime/Scheduler.h"
+#include "VM/Bytecode.h"
+#include "VM/Compiler.h"
+#include "VM/Context.h"
+#include "VM/Disassembler.h"
+#include "VM/VM.h"
+
+struct Options {
+    bool treeWalker = false;    // run the AST interpreter instead of the bytecode VM
+    bool disassemble = false;
+    bool printAst = false;
+    bool bench = false;         // run both engines and compare
+    bool stats = false;         // print executed opcodes after a VM run
+    bool jit = true;
+    bool dumpJit = false;
+    bool inlining = true;
+    bool verbose = false;       // report optimization decisions
+    std::string emitC;          // translate to C into this file instead of running
+    bool check = false;         // only report errors of the scripts
+    bool compile = false;       // write precompiled bytecode instead of running
+    std::string output;         // bytecode file of --compile, defaults to the script with .legc
+    bool gcStats = false;       // print collections and pauses after running
+    bool gcStress = false;      // collect at every allocation
+    size_t nurserySize = Heap::DEFAULT_NURSERY_SIZE;
+    size_t oldLimit = Heap::DEFAULT_OLD_LIMIT;
+    size_t contexts = 0;        // run the compiled program in this many contexts at once
+    bool each = false;          // stream lines through the script's function each
+    std::string input;          // of --each, stdin if empty
+    unsigned jobs = 0;          // threads of --each and batches, 0 for their default
+    bool serve = false;         // run the compile server
+    bool remote = false;        // have the compile server compile the script
+    std::string request;        // for the compile server instead of a script: stats or stop
+    std::string socket = CompileServer::defaultSocket();
+    size_t cacheSize = CompileServer::DEFAULT_CAPACITY;
+};
 
 std::string durationAsString(std::chrono::time_point<std::chrono::high_resolution_clock> start, std::chrono::time_point<std::chrono::high_resolution_clock> end) {
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
@@ -38,12 +104,64 @@ std::string durationAsString(std::chrono::time_point<std::chrono::high_resolutio
     return result;
 }
 
+// positive decimal number, 0 if arg isn't one
+size_t sizeArgument(const std::string& arg) {
+    if (arg.empty() || arg.size() > 9 || !std::all_of(arg.begin(), arg.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return 0;
+    }
+    return std::stoul(arg);
+}
+
 void printUsage() {
     std::cout << "Usage:\n"
               << "Run a script:\n"
-              << "\tlegba script\n"
+              << "\tlegba [options] script\n"
+              << "Options:\n"
+              << "\t--ast              run the script with the tree walking interpreter\n"
+              << "\t--disassemble, -d  print the compiled bytecode before running\n"
+              << "\t--print-ast        print the parsed scopes before running\n"
+              << "\t--bench            run with both engines and compare their timings\n"
+              << "\t--stats            print executed instructions per opcode and spawned tasks after running\n"
+              << "\t--no-jit           don't compile hot functions to machine code\n"
+              << "\t--dump-jit         print the machine code generated for each bytecode instruction\n"
+              << "\t--no-inline        don't inline small functions and methods\n"
+              << "\t--verbose, -v      report which calls got inlined or devirtualized\n"
+              << "\t--emit-c file.c    translate the script to C instead of running it\n"
+              << "\t--compile          write precompiled bytecode instead of running the script\n"
+              << "\t-o file.legc       output of --compile, defaults to the script name with " << BYTECODE_EXTENSION << "\n"
+              << "\t--gc-stats         print garbage collections and their pauses after running\n"
+              << "\t--gc-stress        collect garbage at every allocation\n"
+              << "\t--nursery KB       size of the young generation, defaults to " << Heap::DEFAULT_NURSERY_SIZE / 1024 << "\n"
+              << "\t--heap MB          old generation size that triggers the first full collection, defaults to "
+              << Heap::DEFAULT_OLD_LIMIT / (1024 * 1024) << "\n"
+              << "\t--threads N        threads running spawned tasks, defaults to one per hardware thread\n"
+              << "\t--contexts N       compile once and run the script in N contexts on N threads at the same time\n"
+              << "Scripts ending in " << BYTECODE_EXTENSION << " are loaded as precompiled bytecode.\n"
+              << "Scripts importing modules are built with them, -j N builds N modules at a time. Compiled modules\n"
+              << "\tare cached in .legba-cache next to the script. They only run on the bytecode VM, --ast, --print-ast\n"
+              << "\tand --emit-c reject them.\n"
+              << "Check or compile many scripts at once, directories stand for the .leg files below them:\n"
+              << "\tlegba --check [-j N] [--no-inline] script|directory...\n"
+              << "\tlegba --compile [-j N] [--no-inline] script|directory...\n"
+              << "\t-j N works on N scripts at a time, defaults to one per hardware thread.\n"
+              << "Stream lines through the function each(line) of a script, writing its results that aren't nil:\n"
+              << "\tlegba --each [options] script [--input file] [-j N] < input > output\n"
+              << "\t-j N runs chunks of lines on N threads with a context each, output keeps the input's order.\n"
+              << "\tDefaults to one thread.\n"
+              << "\tReports and print go to stderr, stdout only gets the results.\n"
+              << "Keep compiled scripts in memory for clients, until stopped:\n"
+              << "\tlegba --serve [--socket path] [--cache MB]\n"
+              << "\tlegba --remote [options] script     compile or take the cached bytecode from the daemon, then go on\n"
+              << "\t                                    like with a .legc file, also with --check or --compile\n"
+              << "\tlegba --server-stats | --server-stop [--socket path]\n"
+              << "\tThe socket defaults to " << CompileServer::defaultSocket() << ", the cache to "
+              << CompileServer::DEFAULT_CAPACITY / (1024 * 1024) << " MB.\n"
               << "Start REPL:\n"
-              << "\tlegba {--repl|-r}" << std::endl;
+              << "\tlegba {--repl|-r}\n"
+              << "Compare the runtime's maps with std::unordered_map:\n"
+              << "\tlegba --bench-maps\n"
+              << "Time calls of script functions from C++ through the embedding API:\n"
+              << "\tlegba --bench-calls" << std::endl;
 }
 
 void printVersion() {
@@ -56,13 +174,528 @@ void runRepl() {
     std::cout << "Exiting REPL" << std::endl;
 }
 
-void runScript(const std::string& filename) {
+// Nanoseconds per entry to insert, look up and iterate int keys, in a map of the
+// runtime and in a std::unordered_map of the same values with its default hash.
+// Lookups go through the keys in a shuffled order.
+void benchMaps() {
+    std::cout << "-- Comparing maps with std::unordered_map, map probing: " << maps::instructionSet() << '\n'
+              << std::format("{:>10}  {:<8}{:>12}{:>22}", "entries", "", "legba map", "std::unordered_map") << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    auto nanoseconds = [](Clock::time_point start, Clock::time_point end) { return std::chrono::duration<double, std::nano>(end - start).count(); };
+    for (size_t n : { 10'000, 1'000'000, 10'000'000 }) {
+        std::vector<Value> keys(n);
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = Value::fromInt(static_cast<int32_t>(static_cast<uint32_t>(i) * 2654435761u));
+        }
+        auto lookups = keys;
+        std::shuffle(lookups.begin(), lookups.end(), std::mt19937_64(n));
+        double times[3][2];
+        std::fill(&times[0][0], &times[0][0] + 6, HUGE_VAL);
+        int64_t sums[2][2];
+        // the best of three rounds, the first one also pays for faulting the memory in
+        for (int round = 0; round < 3; round++) {
+            sums[0][0] = sums[0][1] = sums[1][0] = sums[1][1] = 0;
+
+            {
+                Root map(maps::newMap());
+                auto start = Clock::now();
+                for (size_t i = 0; i < n; i++) {
+                    maps::set(map.value, keys[i], Value::fromInt(static_cast<int32_t>(i)));
+                }
+                auto inserted = Clock::now();
+                for (auto key : lookups) {
+                    sums[0][0] += maps::find(asMap(map.value), key)->asInt();
+                }
+                auto found = Clock::now();
+                maps::forEach(asMap(map.value), [&](Value, Value value) { sums[0][1] += value.asInt(); });
+                auto iterated = Clock::now();
+                times[0][0] = std::min(times[0][0], nanoseconds(start, inserted));
+                times[1][0] = std::min(times[1][0], nanoseconds(inserted, found));
+                times[2][0] = std::min(times[2][0], nanoseconds(found, iterated));
+            }
+            Heap::get().collect(true);
+
+            {
+                std::unordered_map<uint64_t, Value> map;
+                auto start = Clock::now();
+                for (size_t i = 0; i < n; i++) {
+                    map[keys[i].bits] = Value::fromInt(static_cast<int32_t>(i));
+                }
+                auto inserted = Clock::now();
+                for (auto key : lookups) {
+                    sums[1][0] += map.find(key.bits)->second.asInt();
+                }
+                auto found = Clock::now();
+                for (auto const& [key, value] : map) {
+                    sums[1][1] += value.asInt();
+                }
+                auto iterated = Clock::now();
+                times[0][1] = std::min(times[0][1], nanoseconds(start, inserted));
+                times[1][1] = std::min(times[1][1], nanoseconds(inserted, found));
+                times[2][1] = std::min(times[2][1], nanoseconds(found, iterated));
+            }
+        }
+
+        if (sums[0][0] != sums[1][0] || sums[0][1] != sums[1][1]) {
+            std::cout << "-- Maps disagree for " << n << " entries" << std::endl;
+        }
+        const char* operations[] = { "insert", "lookup", "iterate" };
+        for (int op = 0; op < 3; op++) {
+            std::cout << std::format("{:>10}  {:<8}{:>10.1f}ns{:>20.1f}ns", n, operations[op], times[op][0] / n, times[op][1] / n) << std::endl;
+        }
+    }
+}
+
+// Nanoseconds per call of trivial script functions from C++ through Script, with
+// and without the JIT. The best of three rounds of a million calls each.
+void benchCalls() {
+    std::cout << "-- Timing calls from C++ into scripts\n"
+              << std::format("{:<18}{:>12}{:>12}", "function", "bytecode", "with JIT") << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    constexpr int CALLS = 1'000'000;
+    auto script = Script::fromSource(
+        "fn add(a, b) { return a + b; }\n"
+        "fn scale(x) { return x * 0.5; }\n"
+        "fn answer() { return 42; }\n");
+    script->run();
+    auto add = script->function("add");
+    auto scale = script->function("scale");
+    auto answer = script->function("answer");
+
+    auto time = [&](bool jit, auto const& call) {
+        script->getVM().setJitEnabled(jit);
+        double best = HUGE_VAL;
+        for (int round = 0; round < 3; round++) {
+            auto start = Clock::now();
+            for (int i = 0; i < CALLS; i++) {
+                call(i);
+            }
+            best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CALLS);
+        }
+        return best;
+    };
+
+    int64_t sum = 0;
+    double total = 0;
+    auto report = [&](const char* name, auto const& call) {
+        // the JIT compiles the functions in the first round, the bytecode timings come first
+        double interpreted = time(false, call);
+        double compiled = JIT::isSupported() ? time(true, call) : interpreted;
+        std::cout << std::format("{:<18}{:>10.1f}ns{:>10.1f}ns", name, interpreted, compiled) << std::endl;
+    };
+    report("add(i, 1)", [&](int i) { sum += script->call(add, i, 1).asInt(); });
+    report("scale(i * 1.0)", [&](int i) { total += script->call(scale, i * 1.0).asDouble(); });
+    report("answer()", [&](int) { sum += script->call(answer).asInt(); });
+    if (sum == 0 || total == 0) {
+        std::cout << "-- Calls returned nothing" << std::endl;
+    }
+}
+
+// false if the script can't be translated or the files not written
+bool emitC(ScopeNode* rootScope, const std::string& filename, const std::string& output) {
+    std::ostringstream code;
+    try {
+        CEmitter(rootScope).emit(filename, code);
+    } catch (CompileError const& e) {
+        std::cout << "-- Compile error: " << e.what() << " ... Exiting" << std::endl;
+        return false;
+    }
+
+    // the runtime header goes next to the generated file
+    auto header = std::filesystem::path(output).replace_filename(C_RUNTIME_HEADER_NAME).string();
+    std::ofstream file(output, std::ios::out | std::ios::trunc);
+    std::ofstream runtime(header, std::ios::out | std::ios::trunc);
+    if (!file.is_open() || !runtime.is_open()) {
+        std::cout << "Failed to write '" << (file.is_open() ? header : output) << "'" << std::endl;
+        return false;
+    }
+    file << code.str();
+    runtime << cRuntimeHeader();
+
+    std::cout << "-- Wrote C to '" << output << "' and '" << header << "'" << std::endl;
+    return true;
+}
+
+// False if the file couldn't be written.
+bool writeProgram(Program const& program, const std::string& filename, const std::string& output) {
+    auto path = output.empty() ? std::filesystem::path(filename).replace_extension(BYTECODE_EXTENSION).string() : output;
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "Failed to write '" << path << "'" << std::endl;
+        return false;
+    }
+    try {
+        writeBytecode(program, file);
+    } catch (BytecodeError const& e) {
+        std::cout << "-- Compile error: " << e.what() << " ... Exiting" << std::endl;
+        return false;
+    }
+    // the write may only fail when the buffer gets flushed
+    file.close();
+    if (file.fail()) {
+        std::cout << "Failed to write '" << path << "'" << std::endl;
+        return false;
+    }
+    std::cout << "-- Wrote bytecode to '" << path << "'" << std::endl;
+    return true;
+}
+
+// Runs the program in as many contexts as options say, each on a thread of its own.
+// Output of the runs is interleaved. False if any of them stopped on a runtime error.
+bool runContexts(Program const& program, Options const& options) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::unique_ptr<Context>> contexts;
+    for (size_t i = 0; i < options.contexts; i++) {
+        contexts.push_back(std::make_unique<Context>(program));
+        contexts.back()->getVM().setJitEnabled(options.jit);
+    }
+    auto created = std::chrono::high_resolution_clock::now();
+    std::cout << "-- Created " << contexts.size() << " contexts in " << durationAsString(start, created) << std::endl;
+
+    std::vector<std::string> outcomes(contexts.size());
+    std::vector<char> failed(contexts.size(), false);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < contexts.size(); i++) {
+        threads.emplace_back([&contexts, &outcomes, &failed, i] {
+            try {
+                auto result = contexts[i]->run();
+                if (!result.isNil()) {
+                    outcomes[i] = "returned " + result.toString();
+                }
+            } catch (RuntimeError const& e) {
+                outcomes[i] = std::string("runtime error: ") + e.what();
+                failed[i] = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        if (!outcomes[i].empty()) {
+            std::cout << "-- Context " << i + 1 << ' ' << outcomes[i] << std::endl;
+        }
+    }
+    std::cout << "-- Finished running in " << durationAsString(created, end) << std::endl;
+    return std::find(failed.begin(), failed.end(), true) == failed.end();
+}
+
+// Checks or compiles all scripts of paths on a pool of threads, see BatchCompiler.
+// Errors are printed by file in the order given, false if there were any.
+bool runBatch(std::vector<std::string> const& paths, Options const& options) {
+    auto scripts = BatchCompiler::collect(paths);
+    if (scripts.empty()) {
+        std::cout << "-- No scripts found ... Exiting" << std::endl;
+        return false;
+    }
+
+    auto batch = BatchCompiler(options.check ? BatchCompiler::Mode::CHECK : BatchCompiler::Mode::COMPILE, options.jobs);
+    batch.setInlining(options.inlining);
+    auto start = std::chrono::high_resolution_clock::now();
+    batch.run(scripts);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    size_t lines = 0;
+    for (auto const& file : batch.getFiles()) {
+        lines += file.lines;
+        std::istringstream diagnostics(file.diagnostics);
+        for (std::string line; std::getline(diagnostics, line);) {
+            std::cout << file.path << ": " << line << '\n';
+        }
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << (options.check ? "-- Checked " : "-- Compiled ") << scripts.size() << " scripts with " << lines
+              << " lines on " << batch.getJobs() << " threads in " << durationAsString(start, end)
+              << std::format(" ({:.0f} scripts/s)", scripts.size() / seconds) << std::endl;
+    if (batch.getFailed() > 0) {
+        std::cout << "-- " << batch.getFailed() << " of them failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Streams the input through the function each of the program, see LineStream.
+// std::cout is stderr here, stdout only gets the results. False if the stream
+// didn't get through the input.
+bool runEach(Program const& program, Options const& options) {
+    int input = 0;
+    if (!options.input.empty()) {
+        input = open(options.input.c_str(), O_RDONLY);
+        if (input < 0) {
+            std::cout << "Failed to open file '" << options.input << "'" << std::endl;
+            return false;
+        }
+    }
+
+    bool ok = false;
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+        LineStream stream(program, "each", options.jobs);
+        stream.setJitEnabled(options.jit);
+        try {
+            stream.run(input, 1);
+            ok = true;
+        } catch (RuntimeError const& e) {
+            std::cout << "-- Runtime error: " << e.what() << std::endl;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "-- Processed " << stream.getLines() << " lines, "
+                  << std::format("{:.1f} MB in {} ({:.0f} MB/s)", stream.getBytes() / 1e6, durationAsString(start, end), stream.getBytes() / 1e6 / seconds)
+                  << std::endl;
+    } catch (RuntimeError const& e) {
+        std::cout << "-- " << e.what() << " ... Exiting" << std::endl;
+    }
+    if (input != 0) {
+        close(input);
+    }
+    return ok;
+}
+
+// Builds the program with build, from source or a .legc file, and runs it. The tree
+// walker needs rootScope and is unavailable without it. False if it couldn't be
+// built or a run stopped on a runtime error.
+bool runProgram(std::function<bool(Program&)> const& build, ScopeNode* rootScope, int globalCount, Options const& options,
+                std::chrono::time_point<std::chrono::high_resolution_clock> timeStart) {
+    bool precompiled = rootScope == nullptr;
+    Program program;
+    if ((!options.treeWalker || options.bench || options.contexts > 0 || options.each) && !build(program)) {
+        return false;
+    }
+
+    auto timeEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << (precompiled ? "-- Loading took " : "-- Compilation took ") << durationAsString(timeStart, timeEnd) << std::endl;
+
+    if (options.disassemble) {
+        disassemble(program, std::cout);
+    }
+
+    auto& heap = Heap::get();
+    heap.configure(options.nurserySize, options.oldLimit);
+    heap.setStress(options.gcStress);
+
+    if (options.contexts > 0) {
+        return runContexts(program, options);
+    }
+    if (options.each) {
+        return runEach(program, options);
+    }
+
+    enum class Engine { TREE_WALKER, INTERPRETER, JIT };
+    auto engineName = [](Engine engine) {
+        switch (engine) {
+            case Engine::TREE_WALKER: return " (tree walker)";
+            case Engine::INTERPRETER: return " (bytecode)";
+            default: return " (bytecode + JIT)";
+        }
+    };
+
+    // every VM run gets freshly compiled bytecode, VMs specialize the code they run
+    bool programUsed = false;
+    bool ok = true;
+    auto runWith = [&](Engine engine) {
+        std::cout << "-- Running script" << engineName(engine) << std::endl;
+
+        Program fresh;
+        Program* bytecode = &program;
+        if (engine != Engine::TREE_WALKER) {
+            if (programUsed) {
+                build(fresh);
+                bytecode = &fresh;
+            }
+            programUsed = true;
+        }
+        auto vm = VM(*bytecode);
+        vm.setCountOpcodes(options.stats);
+        vm.setJitEnabled(engine == Engine::JIT);
+        vm.setJitDump(options.dumpJit ? &std::cout : nullptr);
+
+        // kept until the stats are printed, like the VM
+        std::unique_ptr<Interpreter> interpreter;
+
+        heap.resetStats();
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            Value result;
+            if (engine == Engine::TREE_WALKER) {
+                interpreter = std::make_unique<Interpreter>(rootScope, globalCount);
+                result = interpreter->run();
+            } else {
+                result = vm.run();
+            }
+            if (!result.isNil()) {
+                std::cout << "-- Script returned " << result.toString() << std::endl;
+            }
+        } catch (RuntimeError const& e) {
+            std::cout << "-- Runtime error: " << e.what() << std::endl;
+            ok = false;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (options.stats) {
+            if (interpreter != nullptr) {
+                interpreter->printStats(std::cout);
+            } else {
+                vm.printStats(std::cout);
+            }
+        }
+        if (options.gcStats) {
+            heap.printStats(std::cout);
+        }
+
+        std::cout << "-- Finished running in " << durationAsString(start, end) << std::endl;
+        return std::chrono::duration<double>(end - start).count();
+    };
+
+    Engine engine = options.treeWalker ? Engine::TREE_WALKER : options.jit ? Engine::JIT : Engine::INTERPRETER;
+    if (options.bench && precompiled) {
+        double interpreted = runWith(Engine::INTERPRETER);
+        if (options.jit && JIT::isSupported()) {
+            double compiled = runWith(Engine::JIT);
+            std::cout << "-- JIT speedup: " << std::format("{:.2f}x over the bytecode interpreter", interpreted / compiled) << std::endl;
+        }
+    } else if (options.bench) {
+        double walker = runWith(Engine::TREE_WALKER);
+        double interpreted = runWith(Engine::INTERPRETER);
+        std::cout << "-- Bytecode VM speedup: " << std::format("{:.2f}x", walker / interpreted) << std::endl;
+        if (options.jit && JIT::isSupported()) {
+            double compiled = runWith(Engine::JIT);
+            std::cout << "-- JIT speedup: " << std::format("{:.2f}x over the tree walker, {:.2f}x over the bytecode interpreter",
+                walker / compiled, interpreted / compiled) << std::endl;
+        }
+    } else {
+        runWith(engine);
+    }
+    return ok;
+}
+
+// Runs the compile server, see CompileServer.
+void runServer(Options const& options) {
+    try {
+        CompileServer server(options.socket, options.cacheSize);
+        std::cout << "-- Listening on '" << options.socket << "'" << std::endl;
+        server.serve();
+        std::cout << "-- Stopped" << std::endl;
+    } catch (RuntimeError const& e) {
+        std::cout << "-- " << e.what() << " ... Exiting" << std::endl;
+    }
+}
+
+// Has the compile server compile the script, or hand over the bytecode it has cached,
+// and goes on like with a .legc file. False if that failed.
+bool runRemote(const std::string& filename, Options const& options) {
+    if (options.treeWalker || options.printAst || !options.emitC.empty() || isBytecodeFile(filename)) {
+        std::cout << "-- Scripts from the daemon only run on the bytecode VM ... Exiting" << std::endl;
+        return false;
+    }
+    auto timeStart = std::chrono::high_resolution_clock::now();
+    std::string bytecode;
+    try {
+        auto path = std::filesystem::absolute(filename).string();
+        if (!CompileClient(options.socket).build(path, options.inlining, options.each, bytecode)) {
+            std::cout << bytecode << "-- Failed to compile script ... Exiting" << std::endl;
+            return false;
+        }
+    } catch (RuntimeError const& e) {
+        std::cout << "-- " << e.what() << " ... Exiting" << std::endl;
+        return false;
+    }
+
+    if (options.check) {
+        std::cout << "-- No errors in '" << filename << "'" << std::endl;
+        return true;
+    }
+    if (options.compile) {
+        auto path = options.output.empty() ? std::filesystem::path(filename).replace_extension(BYTECODE_EXTENSION).string() : options.output;
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open() || !file.write(bytecode.data(), static_cast<std::streamsize>(bytecode.size()))) {
+            std::cout << "Failed to write '" << path << "'" << std::endl;
+            return false;
+        }
+        std::cout << "-- Wrote bytecode to '" << path << "'" << std::endl;
+        return true;
+    }
+    auto load = [&](Program& program) {
+        try {
+            loadBytecode(std::string_view(bytecode), program);
+            return true;
+        } catch (BytecodeError const& e) {
+            std::cout << "-- Failed to load the daemon's bytecode: " << e.what() << " ... Exiting" << std::endl;
+            return false;
+        }
+    };
+    return runProgram(load, nullptr, 0, options, timeStart);
+}
+
+// Builds a script importing modules together with them, see ModuleBuilder, and goes
+// on like with a .legc file. False if that failed.
+bool runModules(const std::string& filename, Options const& options,
+                std::chrono::time_point<std::chrono::high_resolution_clock> timeStart) {
+    // the modules are linked as bytecode, there is no tree of the whole program
+    if (options.treeWalker || options.printAst || !options.emitC.empty()) {
+        auto option = options.treeWalker ? "--ast" : options.printAst ? "--print-ast" : "--emit-c";
+        std::cout << "-- " << option << " doesn't support 'import', scripts importing modules only run on the bytecode VM ... Exiting" << std::endl;
+        return false;
+    }
+    auto builder = ModuleBuilder(options.jobs);
+    builder.setInlining(options.inlining);
+    // each is only called from outside
+    builder.setKeepFunctions(options.each);
+    builder.setCacheDirectory(ModuleBuilder::defaultCacheDirectory(filename));
+    auto build = [&](Program& program) {
+        if (!builder.build(filename, program)) {
+            std::cout << "-- Failed to build the modules ... Exiting" << std::endl;
+            return false;
+        }
+        std::cout << "-- Built " << builder.getModules() << " modules: " << builder.getParsed() << " parsed, "
+                  << builder.getCompiled() << " compiled, " << builder.getReused() << " reused from the cache" << std::endl;
+        return true;
+    };
+
+    if (options.compile) {
+        Program program;
+        if (!build(program)) {
+            return false;
+        }
+        std::cout << "-- Compilation took " << durationAsString(timeStart, std::chrono::high_resolution_clock::now()) << std::endl;
+        return writeProgram(program, filename, options.output);
+    }
+    return runProgram(build, nullptr, 0, options, timeStart);
+}
+
+// Runs, compiles or translates one script. False if that failed, see runProgram.
+bool runScript(const std::string& filename, Options const& options) {
+    if (options.remote) {
+        return runRemote(filename, options);
+    }
+    if (isBytecodeFile(filename)) {
+        if (options.treeWalker || options.printAst || options.compile || !options.emitC.empty()) {
+            std::cout << "-- Precompiled scripts only run on the bytecode VM ... Exiting" << std::endl;
+            return false;
+        }
+        auto load = [&](Program& program) {
+            try {
+                loadBytecode(filename, program);
+                return true;
+            } catch (BytecodeError const& e) {
+                std::cout << "-- Failed to load '" << filename << "': " << e.what() << " ... Exiting" << std::endl;
+                return false;
+            }
+        };
+        return runProgram(load, nullptr, 0, options, std::chrono::high_resolution_clock::now());
+    }
+
     std::ifstream file;
     file.open(filename, std::ios::in);
     if (!file.is_open()) {
         file.close();
         std::cout << "Failed to open file '" << filename << "'" << std::endl;
-        return;
+        return false;
     }
 
     std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
@@ -76,24 +709,60 @@ void runScript(const std::string& filename) {
     /*for (auto const& token : tokens) {
         std::cout << token << std::endl;
     }*/
+    if (ModuleBuilder::importsModules(tokens)) {
+        return runModules(filename, options, timeStart);
+    }
 
     auto parser = Parser();
     if (!parser.parse(tokens)) {
         std::cout << "-- Failed to parse script ... Exiting" << std::endl;
-        return;
+        return false;
     }
 
-    auto timeEnd = std::chrono::high_resolution_clock::now();
+    auto eliminator = DeadCodeEliminator(parser.getRootScope(), parser.getUnresolvedFunctionCalls());
+    // each is only called from outside
+    eliminator.setKeepFunctions(options.each);
+    eliminator.run();
 
-    std::cout << "-- Compilation took " << durationAsString(timeStart, timeEnd) << std::endl;
+    std::cout << "-- Removed " << eliminator.getRemovedStatements() << " unreachable statements, "
+              << eliminator.getRemovedFunctions() << " unused functions and "
+              << eliminator.getRemovedMethods() << " unused methods" << std::endl;
 
-    parser.printEnv();
+    if (!options.emitC.empty()) {
+        return emitC(parser.getRootScope(), filename, options.emitC);
+    }
 
-    std::cout << "-- Running script" << std::endl;
+    // the C translation above leaves inlining to the C compiler
+    if (options.inlining) {
+        auto inliner = Inliner(parser.getRootScope(), options.verbose ? &std::cout : nullptr);
+        inliner.run();
+        std::cout << "-- Inlined " << inliner.getInlinedCalls() << " calls, devirtualized "
+                  << inliner.getDevirtualizedCalls() << " method calls" << std::endl;
+    }
 
-    std::cout << "-- Finished running" << std::endl;
+    auto compile = [&](Program& program) {
+        try {
+            Compiler().compile(parser.getRootScope(), parser.getGlobalCount(), program);
+            return true;
+        } catch (CompileError const& e) {
+            std::cout << "-- Compile error: " << e.what() << " ... Exiting" << std::endl;
+            return false;
+        }
+    };
 
+    if (options.compile) {
+        Program program;
+        if (!compile(program)) {
+            return false;
+        }
+        std::cout << "-- Compilation took " << durationAsString(timeStart, std::chrono::high_resolution_clock::now()) << std::endl;
+        return writeProgram(program, filename, options.output);
+    }
 
+    if (options.printAst) {
+        parser.printEnv();
+    }
+    return runProgram(compile, parser.getRootScope(), parser.getGlobalCount(), options, timeStart);
 }
 
 int main(int argc, char** argv) {
@@ -102,16 +771,122 @@ int main(int argc, char** argv) {
         args.emplace_back(argv[i]);
     }
 
+    // --each writes the results to stdout, everything else goes to stderr
+    if (std::find(args.begin(), args.end(), "--each") != args.end()) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     printVersion();
 
     if (args.empty() || args[0] == "--help" || args[0] == "-h" || args[0] == "?") {
         printUsage();
     } else if (args[0] == "--repl" || args[0] == "-r") {
         runRepl();
-    } else if (args.size() == 1) {
-        runScript(args[0]);
+    } else if (args[0] == "--bench-maps") {
+        benchMaps();
+    } else if (args[0] == "--bench-calls") {
+        benchCalls();
     } else {
-        printUsage();
+        Options options;
+        std::vector<std::string> scripts;
+        for (size_t i = 0; i < args.size(); i++) {
+            auto const& arg = args[i];
+            if (arg == "--ast") {
+                options.treeWalker = true;
+            } else if (arg == "--disassemble" || arg == "-d") {
+                options.disassemble = true;
+            } else if (arg == "--print-ast") {
+                options.printAst = true;
+            } else if (arg == "--bench") {
+                options.bench = true;
+            } else if (arg == "--stats") {
+                options.stats = true;
+            } else if (arg == "--no-jit") {
+                options.jit = false;
+            } else if (arg == "--dump-jit") {
+                options.dumpJit = true;
+            } else if (arg == "--no-inline") {
+                options.inlining = false;
+            } else if (arg == "--verbose" || arg == "-v") {
+                options.verbose = true;
+            } else if (arg == "--emit-c" && i + 1 < args.size()) {
+                options.emitC = args[++i];
+            } else if (arg == "--check") {
+                options.check = true;
+            } else if (arg == "--compile") {
+                options.compile = true;
+            } else if (arg == "-o" && i + 1 < args.size()) {
+                options.output = args[++i];
+            } else if (arg == "--gc-stats") {
+                options.gcStats = true;
+            } else if (arg == "--gc-stress") {
+                options.gcStress = true;
+            } else if ((arg == "--nursery" || arg == "--heap") && i + 1 < args.size() && sizeArgument(args[i + 1]) > 0) {
+                size_t size = sizeArgument(args[++i]);
+                if (arg == "--nursery") {
+                    options.nurserySize = size * 1024;
+                } else {
+                    options.oldLimit = size * 1024 * 1024;
+                }
+            } else if (arg == "--threads" && i + 1 < args.size() && sizeArgument(args[i + 1]) > 0) {
+                Scheduler::setThreadCount(static_cast<unsigned>(sizeArgument(args[++i])));
+            } else if (arg == "--contexts" && i + 1 < args.size() && sizeArgument(args[i + 1]) > 0) {
+                options.contexts = sizeArgument(args[++i]);
+            } else if (arg == "--each") {
+                options.each = true;
+            } else if (arg == "--input" && i + 1 < args.size()) {
+                options.input = args[++i];
+            } else if (arg == "-j" && i + 1 < args.size() && sizeArgument(args[i + 1]) > 0) {
+                options.jobs = static_cast<unsigned>(sizeArgument(args[++i]));
+            } else if (arg == "--serve") {
+                options.serve = true;
+            } else if (arg == "--remote") {
+                options.remote = true;
+            } else if (arg == "--server-stats" || arg == "--server-stop") {
+                options.request = arg == "--server-stats" ? "stats" : "stop";
+            } else if (arg == "--socket" && i + 1 < args.size()) {
+                options.socket = args[++i];
+            } else if (arg == "--cache" && i + 1 < args.size() && sizeArgument(args[i + 1]) > 0) {
+                options.cacheSize = sizeArgument(args[++i]) * 1024 * 1024;
+            } else if (!arg.starts_with("-")) {
+                scripts.push_back(arg);
+            } else {
+                printUsage();
+                return 0;
+            }
+        }
+
+        if (options.serve || !options.request.empty()) {
+            if (!scripts.empty()) {
+                printUsage();
+            } else if (options.serve) {
+                runServer(options);
+            } else {
+                try {
+                    auto client = CompileClient(options.socket);
+                    if (options.request == "stats") {
+                        std::cout << client.stats();
+                    } else {
+                        client.stop();
+                        std::cout << "-- Stopped the daemon" << std::endl;
+                    }
+                } catch (RuntimeError const& e) {
+                    std::cout << "-- " << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            return 0;
+        }
+
+        // one script runs, several or directories only get checked or compiled
+        bool batch = !options.remote && (options.check || (options.compile && !scripts.empty() && (scripts.size() > 1 || std::filesystem::is_directory(scripts[0]))));
+        if (scripts.empty() || (scripts.size() > 1 && !batch) || (batch && !options.output.empty())) {
+            printUsage();
+        } else if (batch) {
+            return runBatch(scripts, options) ? 0 : 1;
+        } else {
+            return runScript(scripts[0], options) ? 0 : 1;
+        }
     }
 
 